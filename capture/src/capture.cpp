@@ -11,16 +11,24 @@
 #include <mutex>
 #include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
 #include <sys/stat.h>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
 
 #include "../../public/common/TracyProtocol.hpp"
+#include "../../public/common/TracySocket.hpp"
 #include "../../public/common/TracyStackFrames.hpp"
+#include "../../server/TracyConnectionPool.hpp"
 #include "../../server/TracyFileWrite.hpp"
 #include "../../server/TracyMemory.hpp"
 #include "../../server/TracyPrint.hpp"
+#include "../../server/TracyTaskDispatch.hpp"
 #include "../../server/TracyWorker.hpp"
 
 #ifdef _WIN32
@@ -43,6 +51,16 @@ void SigInt( int )
     s_disconnect.store(true, std::memory_order_relaxed);
 }
 
+#ifndef _WIN32
+// Requests a snapshot of the flight recorder window, written by SigUsr1.
+static std::atomic<bool> s_snapshot { false };
+
+void SigUsr1( int )
+{
+    s_snapshot.store( true, std::memory_order_relaxed );
+}
+#endif
+
 static bool s_isStdoutATerminal = false;
 
 void InitIsStdoutATerminal() {
@@ -90,10 +108,283 @@ void AnsiPrintf( const char* ansiEscape, const char* format, ... ) {
 
 [[noreturn]] void Usage()
 {
-    printf( "Usage: capture -o output.tracy [-a address] [-p port] [-f] [-s seconds]\n" );
+    printf( "Usage: capture -o output.tracy [-a address] [-p port] [-f] [-s seconds] [-j jobs] [-S seconds | -W seconds [-P text]] [-b megabytes] [-z lz4|zstd|none]\n" );
+    printf( "       capture -d -o directory [-p port] [-f] [-j jobs] [-b megabytes] [-z lz4|zstd|none] [-n name] [-c clients] [-m megabytes]\n" );
     exit( 1 );
 }
 
+// Segments of a streamed capture are numbered before the file extension.
+static std::string SegmentName( const char* output, int segment )
+{
+    std::string name( output );
+    char idx[16];
+    snprintf( idx, sizeof( idx ), ".%04i", segment );
+    const auto ext = name.rfind( ".tracy" );
+    if( ext != std::string::npos && ext == name.size() - 6 )
+    {
+        name.insert( ext, idx );
+    }
+    else
+    {
+        name += idx;
+    }
+    return name;
+}
+
+static bool WriteSegment( tracy::Worker& worker, const std::string& fn, int jobs )
+{
+    auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( fn.c_str(), tracy::FileWrite::Compression::Fast, 1, jobs ) );
+    if( !f ) return false;
+    std::lock_guard<tracy::DataLock> lock( worker.GetDataLock() );
+    worker.Write( *f, false );
+    f->Finish();
+    worker.ReleaseSegmentData();
+    return true;
+}
+
+static bool SaveTrace( tracy::Worker& worker, const std::string& fn, int jobs )
+{
+    auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( fn.c_str(), tracy::FileWrite::Compression::Fast, 1, jobs ) );
+    if( !f ) return false;
+    worker.Write( *f, false );
+    f->Finish();
+    return true;
+}
+
+// Trace of a client found in daemon mode is saved to the output directory,
+// with a file name made of the program name, its process id and the time of
+// connection.
+static std::string DaemonOutputName( const char* dir, const char* program, uint64_t pid, uint16_t port, bool overwrite )
+{
+    std::string name;
+    for( auto ptr = program; *ptr; ptr++ )
+    {
+        const auto c = *ptr;
+        if( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '.' )
+        {
+            name += c;
+        }
+        else
+        {
+            name += '_';
+        }
+    }
+    if( name.empty() ) name = "client";
+
+    char tmp[64];
+    const auto t = time( nullptr );
+    auto tm = localtime( &t );
+    char date[32];
+    strftime( date, sizeof( date ), "%Y%m%d-%H%M%S", tm );
+    snprintf( tmp, sizeof( tmp ), "-%" PRIu64 "-%s", pid != 0 ? pid : uint64_t( port ), date );
+
+    const auto base = std::string( dir ) + "/" + name + tmp;
+    auto fn = base + ".tracy";
+    if( overwrite ) return fn;
+    struct stat st;
+    for( int i=2; stat( fn.c_str(), &st ) == 0; i++ )
+    {
+        snprintf( tmp, sizeof( tmp ), ".%i.tracy", i );
+        fn = base + tmp;
+    }
+    return fn;
+}
+
+struct DaemonClient
+{
+    std::unique_ptr<tracy::Worker> worker;
+    std::string name;
+    std::string output;
+    uint64_t clientId;
+    std::chrono::high_resolution_clock::time_point connectTime;
+    bool draining;
+};
+
+// Listens for client announcements and captures every matching client to its
+// own file. All connections are serviced by a single pool of threads, which
+// share the ingestion thread pool. The memory used by all traces is kept
+// within the given budget by finishing the oldest capture when the limit is
+// reached.
+static int RunDaemon( const char* output, uint16_t port, bool overwrite, int jobs, size_t netBufferSize, uint8_t wireCodec, const char* filter, int maxClients, size_t memoryBudget )
+{
+    struct stat st;
+    if( stat( output, &st ) != 0 || !S_ISDIR( st.st_mode ) )
+    {
+        printf( "Output directory %s does not exist!\n", output );
+        return 5;
+    }
+
+    tracy::UdpListen listen;
+    if( !listen.Listen( port ) )
+    {
+        printf( "Cannot listen for client announcements on port %i!\n", port );
+        return 6;
+    }
+
+    std::unique_ptr<tracy::TaskDispatch> dispatch;
+    if( jobs > 1 ) dispatch = std::make_unique<tracy::TaskDispatch>( jobs - 1, "Tracy Ingest" );
+    tracy::ConnectionPool pool( jobs, "Tracy Connection" );
+
+#ifdef _WIN32
+    signal( SIGINT, SigInt );
+#else
+    struct sigaction sigint, oldsigint;
+    memset( &sigint, 0, sizeof( sigint ) );
+    sigint.sa_handler = SigInt;
+    sigaction( SIGINT, &sigint, &oldsigint );
+#endif
+
+    printf( "Waiting for clients announced on port %i...\n", port );
+    fflush( stdout );
+
+    // Process ids of the clients that were already captured, or that refused
+    // the connection. Such clients are not connected to again.
+    std::unordered_map<uint64_t, uint64_t> done;
+    std::vector<std::unique_ptr<DaemonClient>> clients;
+    bool shutdown = false;
+
+    const auto MemoryUsed = [&clients, netBufferSize] {
+        return tracy::memUsage.load( std::memory_order_relaxed ) + clients.size() * netBufferSize;
+    };
+
+    for(;;)
+    {
+        if( !shutdown && s_disconnect.load( std::memory_order_relaxed ) )
+        {
+            printf( "Disconnecting %zu client(s)...\n", clients.size() );
+            fflush( stdout );
+            shutdown = true;
+            for( auto& client : clients )
+            {
+                if( client->worker->HasData() ) client->worker->Disconnect();
+            }
+        }
+
+        tracy::IpAddress addr;
+        size_t len;
+        while( auto msg = listen.Read( len, addr, 0 ) )
+        {
+            if( shutdown ) continue;
+            if( len > sizeof( tracy::BroadcastMessage ) || len < offsetof( tracy::BroadcastMessage, programName ) ) continue;
+            tracy::BroadcastMessage bm = {};
+            memcpy( &bm, msg, len );
+            if( bm.broadcastVersion != tracy::BroadcastVersion || bm.protocolVersion != tracy::ProtocolVersion ) continue;
+            if( bm.activeTime < 0 ) continue;
+            bm.programName[tracy::WelcomeMessageProgramNameSize-1] = '\0';
+            if( filter && !strstr( bm.programName, filter ) ) continue;
+
+            const auto clientId = uint64_t( addr.GetNumber() ) | ( uint64_t( bm.listenPort ) << 32 );
+            auto it = done.find( clientId );
+            if( it != done.end() && it->second == bm.pid ) continue;
+            bool active = false;
+            for( auto& client : clients )
+            {
+                if( client->clientId == clientId )
+                {
+                    active = true;
+                    break;
+                }
+            }
+            if( active ) continue;
+            if( int( clients.size() ) >= maxClients ) continue;
+            if( memoryBudget != 0 && MemoryUsed() + netBufferSize > memoryBudget ) continue;
+
+            auto client = std::make_unique<DaemonClient>();
+            client->worker = std::make_unique<tracy::Worker>( addr.GetText(), bm.listenPort, netBufferSize, dispatch.get(), wireCodec, true );
+            pool.Add( client->worker.get() );
+            client->name = std::string( bm.programName ) + " @ " + addr.GetText() + ":" + std::to_string( bm.listenPort );
+            client->output = DaemonOutputName( output, bm.programName, bm.pid, bm.listenPort, overwrite );
+            client->clientId = clientId;
+            client->connectTime = std::chrono::high_resolution_clock::now();
+            client->draining = false;
+            done[clientId] = bm.pid;
+            printf( "Connecting to %s\n", client->name.c_str() );
+            fflush( stdout );
+            clients.emplace_back( std::move( client ) );
+        }
+
+        const auto now = std::chrono::high_resolution_clock::now();
+        auto it = clients.begin();
+        while( it != clients.end() )
+        {
+            auto& client = **it;
+            auto& worker = *client.worker;
+            if( !worker.HasData() )
+            {
+                const auto handshake = worker.GetHandshakeStatus();
+                const bool timeout = std::chrono::duration_cast<std::chrono::seconds>( now - client.connectTime ).count() >= 10;
+                if( handshake == tracy::HandshakePending && !timeout && !shutdown )
+                {
+                    ++it;
+                    continue;
+                }
+                AnsiPrintf( ANSI_RED, "Cannot capture %s: %s\n", client.name.c_str(),
+                    handshake == tracy::HandshakeProtocolMismatch ? "incompatible protocol" :
+                    handshake == tracy::HandshakeNotAvailable ? "client not available" :
+                    handshake == tracy::HandshakeDropped ? "connection dropped" : "connection timed out" );
+                fflush( stdout );
+                if( handshake != tracy::HandshakeNotAvailable && handshake != tracy::HandshakeProtocolMismatch ) done.erase( client.clientId );
+                worker.Shutdown();
+                pool.Remove( &worker );
+                it = clients.erase( it );
+                continue;
+            }
+            if( worker.IsConnected() )
+            {
+                ++it;
+                continue;
+            }
+
+            const auto& failure = worker.GetFailureType();
+            if( failure != tracy::Worker::Failure::None )
+            {
+                AnsiPrintf( ANSI_RED, "Instrumentation failure in %s: %s\n", client.name.c_str(), tracy::Worker::GetFailureString( failure ) );
+            }
+            printf( "Saving %s (%s zones, %s) to %s...", client.name.c_str(), tracy::RealToString( worker.GetZoneCount() ),
+                tracy::TimeToString( worker.GetLastTime() - worker.GetFirstTime() ), client.output.c_str() );
+            fflush( stdout );
+            if( SaveTrace( worker, client.output, jobs ) )
+            {
+                AnsiPrintf( ANSI_GREEN ANSI_BOLD, " done!\n" );
+            }
+            else
+            {
+                AnsiPrintf( ANSI_RED ANSI_BOLD, " failed!\n" );
+            }
+            fflush( stdout );
+            pool.Remove( &worker );
+            it = clients.erase( it );
+        }
+
+        if( shutdown && clients.empty() ) break;
+
+        // Over the memory budget, the oldest capture is finished, so that its
+        // memory is released once it's saved. Only one capture is drained at
+        // a time.
+        if( memoryBudget != 0 && !shutdown && MemoryUsed() > memoryBudget )
+        {
+            bool draining = false;
+            DaemonClient* oldest = nullptr;
+            for( auto& client : clients )
+            {
+                if( client->draining ) draining = true;
+                if( client->worker->HasData() && ( !oldest || client->connectTime < oldest->connectTime ) ) oldest = client.get();
+            }
+            if( !draining && oldest )
+            {
+                AnsiPrintf( ANSI_YELLOW, "Memory budget exceeded (%s), finishing capture of %s\n", tracy::MemSizeToString( MemoryUsed() ), oldest->name.c_str() );
+                fflush( stdout );
+                oldest->draining = true;
+                oldest->worker->Disconnect();
+            }
+        }
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+    }
+
+    return 0;
+}
+
 int main( int argc, char** argv )
 {
 #ifdef _WIN32
@@ -111,9 +402,19 @@ int main( int argc, char** argv )
     const char* output = nullptr;
     int port = 8086;
     int seconds = -1;
+    int jobs = 1;
+    int segmentTime = -1;
+    size_t netBufferSize = tracy::Worker::DefaultNetBufferSize;
+    uint8_t wireCodec = tracy::WireCodecAny;
+    int windowTime = -1;
+    const char* trigger = nullptr;
+    bool daemon = false;
+    const char* filter = nullptr;
+    int maxClients = 64;
+    size_t memoryBudget = 0;
 
     int c;
-    while( ( c = getopt( argc, argv, "a:o:p:fs:" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "a:o:p:fs:j:S:W:P:b:z:dn:c:m:" ) ) != -1 )
     {
         switch( c )
         {
@@ -132,6 +433,52 @@ int main( int argc, char** argv )
         case 's':
             seconds = atoi (optarg);
             break;
+        case 'j':
+            jobs = atoi( optarg );
+            if( jobs < 1 )
+            {
+                printf( "Number of jobs must be at least 1\n" );
+                exit( 1 );
+            }
+            break;
+        case 'S':
+            segmentTime = std::max( 1, atoi( optarg ) );
+            break;
+        case 'W':
+            windowTime = std::max( 1, atoi( optarg ) );
+            break;
+        case 'P':
+            trigger = optarg;
+            break;
+        case 'b':
+        {
+            const auto mb = strtol( optarg, nullptr, 10 );
+            if( mb < 1 || mb > tracy::Worker::MaxNetBufferSize / ( 1024 * 1024 ) )
+            {
+                printf( "Buffer size must be between 1 and %i megabytes\n", tracy::Worker::MaxNetBufferSize / ( 1024 * 1024 ) );
+                exit( 1 );
+            }
+            netBufferSize = size_t( mb ) * 1024 * 1024;
+            break;
+        }
+        case 'z':
+            if( strcmp( optarg, "lz4" ) == 0 ) wireCodec = tracy::WireCodecLz4;
+            else if( strcmp( optarg, "zstd" ) == 0 ) wireCodec = tracy::WireCodecZstd;
+            else if( strcmp( optarg, "none" ) == 0 ) wireCodec = tracy::WireCodecNone;
+            else Usage();
+            break;
+        case 'd':
+            daemon = true;
+            break;
+        case 'n':
+            filter = optarg;
+            break;
+        case 'c':
+            maxClients = std::max( 1, atoi( optarg ) );
+            break;
+        case 'm':
+            memoryBudget = size_t( std::max( 1, atoi( optarg ) ) ) * 1024 * 1024;
+            break;
         default:
             Usage();
             break;
@@ -139,26 +486,37 @@ int main( int argc, char** argv )
     }
 
     if( !address || !output ) Usage();
+    if( windowTime != -1 && segmentTime != -1 ) Usage();
+    if( trigger && windowTime == -1 ) Usage();
+    if( daemon ) return RunDaemon( output, port, overwrite, jobs, netBufferSize, wireCodec, filter, maxClients, memoryBudget );
+
+    int segment = 0;
+    const auto firstOutput = segmentTime != -1 ? SegmentName( output, segment ) : std::string( output );
 
     struct stat st;
-    if( stat( output, &st ) == 0 && !overwrite )
+    if( stat( firstOutput.c_str(), &st ) == 0 && !overwrite )
     {
-        printf( "Output file %s already exists! Use -f to force overwrite.\n", output );
+        printf( "Output file %s already exists! Use -f to force overwrite.\n", firstOutput.c_str() );
         return 4;
     }
 
-    FILE* test = fopen( output, "wb" );
+    FILE* test = fopen( firstOutput.c_str(), "wb" );
     if( !test )
     {
-        printf( "Cannot open output file %s for writing!\n", output );
+        printf( "Cannot open output file %s for writing!\n", firstOutput.c_str() );
         return 5;
     }
     fclose( test );
-    unlink( output );
+    unlink( firstOutput.c_str() );
 
     printf( "Connecting to %s:%i...", address, port );
     fflush( stdout );
-    tracy::Worker worker( address, port );
+    tracy::Worker worker( address, port, netBufferSize, nullptr, wireCodec );
+    if( segmentTime != -1 || windowTime != -1 )
+    {
+        std::lock_guard<tracy::DataLock> lock( worker.GetDataLock() );
+        worker.EnableStreaming();
+    }
     while( !worker.HasData() )
     {
         const auto handshake = worker.GetHandshakeStatus();
@@ -188,12 +546,23 @@ int main( int argc, char** argv )
     memset( &sigint, 0, sizeof( sigint ) );
     sigint.sa_handler = SigInt;
     sigaction( SIGINT, &sigint, &oldsigint );
+    if( windowTime != -1 )
+    {
+        struct sigaction sigusr1;
+        memset( &sigusr1, 0, sizeof( sigusr1 ) );
+        sigusr1.sa_handler = SigUsr1;
+        sigaction( SIGUSR1, &sigusr1, nullptr );
+    }
 #endif
 
     const auto firstTime = worker.GetFirstTime();
+    const auto window = int64_t( windowTime ) * 1000 * 1000 * 1000;
+    int64_t triggerTime = 0;
+    int snapshot = 0;
     auto& lock = worker.GetMbpsDataLock();
 
     const auto t0 = std::chrono::high_resolution_clock::now();
+    auto tSegment = t0;
     while( worker.IsConnected() )
     {
         // Relaxed order is sufficient here because `s_disconnect` is only ever
@@ -234,7 +603,7 @@ int main( int argc, char** argv )
             AnsiPrintf( ANSI_YELLOW, "Tx: ");
             AnsiPrintf( ANSI_GREEN, "%s",  tracy::MemSizeToString( netTotal ) );
             printf( " | ");
-            AnsiPrintf( ANSI_RED ANSI_BOLD, "%s", tracy::MemSizeToString( tracy::memUsage ) );
+            AnsiPrintf( ANSI_RED ANSI_BOLD, "%s", tracy::MemSizeToString( tracy::memUsage.load( std::memory_order_relaxed ) ) );
             printf( " | ");
             AnsiPrintf( ANSI_RED, "%s", tracy::TimeToString( worker.GetLastTime() - firstTime ) );
             fflush( stdout );
@@ -251,6 +620,74 @@ int main( int argc, char** argv )
                 s_disconnect.store(true, std::memory_order_relaxed );
             }
         }
+        if( segmentTime != -1 )
+        {
+            const auto now = std::chrono::high_resolution_clock::now();
+            if( std::chrono::duration_cast<std::chrono::seconds>( now - tSegment ).count() >= segmentTime )
+            {
+                const auto fn = SegmentName( output, segment );
+                if( WriteSegment( worker, fn, jobs ) )
+                {
+                    printf( "\nSaved segment %s\n", fn.c_str() );
+                    segment++;
+                }
+                else
+                {
+                    AnsiPrintf( ANSI_RED ANSI_BOLD, "\nCannot write segment %s!\n", fn.c_str() );
+                }
+                tSegment = now;
+            }
+        }
+        if( windowTime != -1 )
+        {
+#ifndef _WIN32
+            bool save = s_snapshot.exchange( false, std::memory_order_relaxed );
+#else
+            bool save = false;
+#endif
+            std::lock_guard<tracy::DataLock> dataLock( worker.GetDataLock() );
+            auto& msgs = worker.GetMessages();
+            if( trigger && !msgs.empty() )
+            {
+                // Messages with text not yet retrieved from the client are checked again later.
+                auto checked = msgs.back()->time;
+                for( size_t i=msgs.size(); i>0 && msgs[i-1]->time > triggerTime; i-- )
+                {
+                    auto& msg = *msgs[i-1];
+                    if( !worker.IsStringAvailable( msg.ref ) )
+                    {
+                        checked = msg.time - 1;
+                    }
+                    else if( strstr( worker.GetString( msg.ref ), trigger ) )
+                    {
+                        save = true;
+                        break;
+                    }
+                }
+                triggerTime = save ? msgs.back()->time : checked;
+            }
+            // The snapshot is written before any further release, so that it keeps
+            // everything still retained at the time of the trigger.
+            if( save )
+            {
+                const auto fn = SegmentName( output, snapshot );
+                if( SaveTrace( worker, fn, jobs ) )
+                {
+                    printf( "\nSaved snapshot %s\n", fn.c_str() );
+                    snapshot++;
+                }
+                else
+                {
+                    AnsiPrintf( ANSI_RED ANSI_BOLD, "\nCannot write snapshot %s!\n", fn.c_str() );
+                }
+            }
+            const auto now = std::chrono::high_resolution_clock::now();
+            if( std::chrono::duration_cast<std::chrono::seconds>( now - tSegment ).count() >= 1 )
+            {
+                worker.ReleaseDataBefore( worker.GetLastTime() - window );
+                tSegment = now;
+            }
+        }
     }
     const auto t1 = std::chrono::high_resolution_clock::now();
 
@@ -335,7 +772,9 @@ int main( int argc, char** argv )
         worker.GetFrameCount( *worker.GetFramesBase() ), tracy::TimeToString( worker.GetLastTime() - firstTime ), tracy::RealToString( worker.GetZoneCount() ),
         tracy::TimeToString( std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() ) );
     fflush( stdout );
-    auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output ) );
+    if( windowTime != -1 ) worker.ReleaseDataBefore( worker.GetLastTime() - window );
+    const auto lastOutput = segmentTime != -1 ? SegmentName( output, segment ) : std::string( output );
+    auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( lastOutput.c_str(), tracy::FileWrite::Compression::Fast, 1, jobs ) );
     if( f )
     {
         worker.Write( *f, false );
@@ -16,6 +16,11 @@ else ifeq (0,$(shell ld -ltbb -o /dev/null 2>/dev/null; echo $$?))
 endif
 endif
 
+# Shared memory functions live in librt on older glibc versions.
+ifeq (0,$(shell ld -lrt -o /dev/null 2>/dev/null; echo $$?))
+	LIBS += -lrt
+endif
+
 OBJDIRBASE := obj/$(BUILD)
 OBJDIR := $(OBJDIRBASE)/o/o/o
 
@@ -217,36 +217,6 @@ const tracy::ZoneEvent* GetSpecialParent(const tracy::Worker& worker, const trac
     return nullptr;
 }
 
-// From TracyView.cpp
-int64_t GetZoneChildTimeFast(
-    const tracy::Worker& worker,
-    const tracy::ZoneEvent& zone
-){
-    int64_t time = 0;
-    if( zone.HasChildren() )
-    {
-        auto& children = worker.GetZoneChildren( zone.Child() );
-        if( children.is_magic() )
-        {
-            auto& vec = *(tracy::Vector<tracy::ZoneEvent>*)&children;
-            for( auto& v : vec )
-            {
-                assert( v.IsEndValid() );
-                time += v.End() - v.Start();
-            }
-        }
-        else
-        {
-            for( auto& v : children )
-            {
-                assert( v->IsEndValid() );
-                time += v->End() - v->Start();
-            }
-        }
-    }
-    return time;
-}
-
 int main(int argc, char** argv)
 {
 #ifdef _WIN32
@@ -383,9 +353,10 @@ int main(int argc, char** argv)
 
         if (args.unwrap)
         {
-            for (const auto& zone_thread_data : zone_data.zones) {
-                const auto zone_event = zone_thread_data.Zone();
-                const auto tId = zone_thread_data.Thread();
+            const auto zsz = zone_data.zones.size();
+            for (size_t i = 0; i < zsz; i++) {
+                const auto zone_event = zone_data.zones[i].Zone();
+                const auto tId = zone_data.thread[i];
 
                 if (worker.HasZoneExtra(*zone_event))
                 {
@@ -400,15 +371,11 @@ int main(int argc, char** argv)
                     }
                 }
 
-                const auto start = zone_event->Start();
-                const auto end = zone_event->End();
+                const auto start = zone_data.start[i];
 
                 values[5] = std::to_string(start);
 
-                auto timespan = end - start;
-                if (args.self_time) {
-                    timespan -= GetZoneChildTimeFast(worker, *zone_event);
-                }
+                const auto timespan = args.self_time ? zone_data.self[i] : zone_data.end[i] - start;
                 values[6] = std::to_string(timespan);
                 values[7] = std::to_string(tId);
 
@@ -183,6 +183,7 @@ static void LoadConfig()
     int v;
     if( ini_sget( ini, "core", "threadedRendering", "%d", &v ) ) s_config.threadedRendering = v;
     if( ini_sget( ini, "timeline", "targetFps", "%d", &v ) && v >= 1 && v < 10000 ) s_config.targetFps = v;
+    if( ini_sget( ini, "timeline", "memoryBudget", "%d", &v ) && v >= 0 ) s_config.timelineMemoryBudget = v;
 
     ini_free( ini );
 }
@@ -198,6 +199,7 @@ static bool SaveConfig()
 
     fprintf( f, "\n[timeline]\n" );
     fprintf( f, "targetFps = %i\n", s_config.targetFps );
+    fprintf( f, "memoryBudget = %i\n", s_config.timelineMemoryBudget );
 
     fclose( f );
     return true;
@@ -632,6 +634,15 @@ static void DrawContents()
                 int tmp = s_config.targetFps;
                 ImGui::SetNextItemWidth( 90 * dpiScale );
                 if( ImGui::InputInt( "##targetfps", &tmp ) ) { s_config.targetFps = std::clamp( tmp, 1, 9999 ); SaveConfig(); }
+
+                ImGui::Spacing();
+                ImGui::TextUnformatted( "Timeline memory budget (MB)" );
+                ImGui::SameLine();
+                tmp = s_config.timelineMemoryBudget;
+                ImGui::SetNextItemWidth( 90 * dpiScale );
+                if( ImGui::InputInt( "##timelinebudget", &tmp ) ) { s_config.timelineMemoryBudget = std::max( tmp, 0 ); SaveConfig(); }
+                ImGui::SameLine();
+                tracy::DrawHelpMarker( "When set, thread zones of opened traces are loaded from disk only when they are displayed, and the least recently used ones are released to stay within the budget. Zero loads everything up front." );
                 ImGui::PopStyleVar();
                 ImGui::TreePop();
             }
@@ -829,6 +840,10 @@ static void DrawContents()
                                 badVer.state = tracy::BadVersionState::LoadFailure;
                                 badVer.msg = e.msg;
                             }
+                            catch( const tracy::FileReadError& )
+                            {
+                                badVer.state = tracy::BadVersionState::ReadError;
+                            }
                         } );
                     }
                 }
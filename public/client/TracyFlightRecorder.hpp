@@ -0,0 +1,149 @@
+#ifndef __TRACYFLIGHTRECORDER_HPP__
+#define __TRACYFLIGHTRECORDER_HPP__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+// Fixed size store for the most recent compressed frames. Frames are grouped in
+// segments. Each segment starts with fresh time references and a thread context
+// switch, so it can be decoded without the data that preceded it. When space runs
+// out, whole segments are discarded, oldest first.
+class FlightRecorder
+{
+public:
+    enum { MaxSegments = 64 };
+
+    struct Segment
+    {
+        uint64_t begin;
+        uint64_t frames;
+        int64_t time;
+        int64_t refTimeSerial;
+        int64_t refTimeCtx;
+        int64_t refTimeGpu;
+    };
+
+    FlightRecorder( size_t size )
+        : m_data( (char*)tracy_malloc( size ) )
+        , m_size( size )
+        , m_write( 0 )
+        , m_first( 0 )
+        , m_count( 0 )
+        , m_open( false )
+    {
+    }
+
+    ~FlightRecorder()
+    {
+        tracy_free( m_data );
+    }
+
+    FlightRecorder( const FlightRecorder& ) = delete;
+    FlightRecorder& operator=( const FlightRecorder& ) = delete;
+
+    size_t Size() const { return m_size; }
+    bool IsRecording() const { return m_open; }
+    uint64_t SegmentSize() const { return m_open ? m_write - Last().begin : 0; }
+    const Segment* First() const { return m_count == 0 ? nullptr : m_segments + m_first; }
+
+    void BeginSegment( const Segment& segment )
+    {
+        if( m_count == MaxSegments ) Drop();
+        auto& s = m_segments[( m_first + m_count ) % MaxSegments];
+        s = segment;
+        s.begin = m_write;
+        m_count++;
+        m_open = true;
+    }
+
+    // Discards all stored segments. Recording resumes with the next BeginSegment().
+    void Reset()
+    {
+        m_write = 0;
+        m_first = 0;
+        m_count = 0;
+        m_open = false;
+    }
+
+    void Append( const char* data, uint32_t size )
+    {
+        if( !m_open ) return;
+        const uint64_t need = sizeof( size ) + size;
+        assert( need <= m_size );
+        const auto left = m_size - m_write % m_size;
+        const auto pad = left < need ? left : 0;
+        const auto end = m_write + pad + need;
+        while( end - m_segments[m_first].begin > m_size )
+        {
+            if( m_count == 1 )
+            {
+                // The current segment alone does not fit. It is useless without its
+                // beginning, so nothing is recorded until the next segment starts.
+                m_count = 0;
+                m_open = false;
+                return;
+            }
+            Drop();
+        }
+        if( pad != 0 )
+        {
+            if( pad >= sizeof( size ) ) memset( m_data + m_size - pad, 0, sizeof( size ) );
+            m_write += pad;
+        }
+        const auto pos = m_write % m_size;
+        memcpy( m_data + pos, &size, sizeof( size ) );
+        memcpy( m_data + pos + sizeof( size ), data, size );
+        m_write += need;
+    }
+
+    // Calls cb( data, size ) for each stored frame, oldest first, until it returns false.
+    template<typename T>
+    bool ForEachFrame( T cb ) const
+    {
+        if( m_count == 0 ) return true;
+        auto pos = m_segments[m_first].begin;
+        while( pos != m_write )
+        {
+            const auto p = pos % m_size;
+            uint32_t size = 0;
+            if( m_size - p >= sizeof( size ) ) memcpy( &size, m_data + p, sizeof( size ) );
+            if( size == 0 )
+            {
+                pos += m_size - p;
+                continue;
+            }
+            if( !cb( m_data + p + sizeof( size ), size ) ) return false;
+            pos += sizeof( size ) + size;
+        }
+        return true;
+    }
+
+private:
+    const Segment& Last() const { return m_segments[( m_first + m_count - 1 ) % MaxSegments]; }
+
+    void Drop()
+    {
+        assert( m_count > 0 );
+        m_first = ( m_first + 1 ) % MaxSegments;
+        m_count--;
+    }
+
+    char* m_data;
+    uint64_t m_size;
+    uint64_t m_write;
+    uint32_t m_first;
+    uint32_t m_count;
+    bool m_open;
+    Segment m_segments[MaxSegments];
+};
+
+}
+
+#endif
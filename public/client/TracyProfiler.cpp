@@ -66,14 +66,20 @@
 
 #include "../common/TracyAlign.hpp"
 #include "../common/TracyAlloc.hpp"
+#include "../common/TracySharedMemory.hpp"
 #include "../common/TracySocket.hpp"
 #include "../common/TracySystem.hpp"
 #include "../common/TracyYield.hpp"
 #include "../common/tracy_lz4.hpp"
+
+#ifdef TRACY_ZSTD_COMPRESSION
+#  include <zstd.h>
+#endif
 #include "tracy_rpmalloc.hpp"
 #include "TracyCallstack.hpp"
 #include "TracyDebug.hpp"
 #include "TracyDxt1.hpp"
+#include "TracyFlightRecorder.hpp"
 #include "TracyScoped.hpp"
 #include "TracyProfiler.hpp"
 #include "TracyThread.hpp"
@@ -274,6 +280,18 @@ static bool EnsureReadable( uintptr_t address )
 
 #endif  // defined __ANDROID__
 
+#ifdef TRACY_PER_THREAD_SERIAL
+struct SerialQueueWrapper
+{
+    ~SerialQueueWrapper()
+    {
+        if( ptr ) ptr->Release();
+        ptr = nullptr;
+    }
+    SerialQueue* ptr;
+};
+#endif
+
 #ifndef TRACY_DELAYED_INIT
 
 struct InitTimeWrapper
@@ -777,8 +795,15 @@ static BroadcastMessage& GetBroadcastMessage( const char* procname, size_t pnsz,
 #if defined _WIN32 && !defined TRACY_UWP && !defined TRACY_NO_CRASH_HANDLER
 static DWORD s_profilerThreadId = 0;
 static DWORD s_symbolThreadId = 0;
+static DWORD s_streamThreadId[MaxWireStreams] = {};
 static char s_crashText[1024];
 
+static bool IsStreamThread( DWORD tid )
+{
+    for( auto& v : s_streamThreadId ) if( v == tid ) return true;
+    return false;
+}
+
 LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 {
     if( !GetProfiler().IsConnected() ) return EXCEPTION_CONTINUE_SEARCH;
@@ -856,7 +881,7 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 
     do
     {
-        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId && te.th32ThreadID != s_symbolThreadId )
+        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId && te.th32ThreadID != s_symbolThreadId && !IsStreamThread( te.th32ThreadID ) )
         {
             HANDLE th = OpenThread( THREAD_SUSPEND_RESUME, FALSE, te.th32ThreadID );
             if( th != INVALID_HANDLE_VALUE )
@@ -874,6 +899,10 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
         TracyLfqCommit;
     }
 
+#ifdef TRACY_FLIGHT_RECORDER
+    Profiler::TriggerFlightRecorder();
+#endif
+
     std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
     GetProfiler().RequestShutdown();
     while( !GetProfiler().HasShutdownFinished() ) { std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) ); };
@@ -902,6 +931,7 @@ static Thread* s_sysTraceThread = nullptr;
 
 static long s_profilerTid = 0;
 static long s_symbolTid = 0;
+static long s_streamTid[MaxWireStreams] = {};
 static char s_crashText[1024];
 static std::atomic<bool> s_alreadyCrashed( false );
 
@@ -1106,7 +1136,10 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
     {
         if( ep->d_name[0] == '.' ) continue;
         int tid = atoi( ep->d_name );
-        if( tid != selfTid && tid != s_profilerTid && tid != s_symbolTid )
+        // Stream threads are needed to send the crash report.
+        bool isStream = false;
+        for( auto& v : s_streamTid ) if( v == tid ) isStream = true;
+        if( tid != selfTid && tid != s_profilerTid && tid != s_symbolTid && !isStream )
         {
             syscall( SYS_tkill, tid, TRACY_CRASH_SIGNAL );
         }
@@ -1120,6 +1153,10 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
     TracyLfqPrepare( QueueType::Crash );
     TracyLfqCommit;
 
+#ifdef TRACY_FLIGHT_RECORDER
+    Profiler::TriggerFlightRecorder();
+#endif
+
     std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
     GetProfiler().RequestShutdown();
     while( !GetProfiler().HasShutdownFinished() ) { std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) ); };
@@ -1128,9 +1165,101 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
 }
 #endif
 
+#if defined TRACY_FLIGHT_RECORDER && defined __linux__
+#  ifndef TRACY_FLIGHT_RECORDER_SIGNAL
+#    define TRACY_FLIGHT_RECORDER_SIGNAL SIGUSR2
+#  endif
+
+static void FlightRecorderTrigger( int /*signal*/ )
+{
+    Profiler::TriggerFlightRecorder();
+}
+#endif
+
 
 enum { QueuePrealloc = 256 * 1024 };
 
+// Open addressing table of source locations with an index on the wire. It is
+// kept at most half full, so that lookups stay short.
+enum { WireSrcLocSlots = 16 * 1024 };
+enum { MaxWireSrcLocs = WireSrcLocSlots / 2 };
+
+// Uses the codec requested by the server if possible, then the one chosen by the user.
+static uint8_t SelectWireCodec( uint8_t requested, uint8_t preferred )
+{
+    auto IsSupported = []( uint8_t codec ) {
+        switch( codec )
+        {
+        case WireCodecLz4:
+        case WireCodecNone:
+            return true;
+#ifdef TRACY_ZSTD_COMPRESSION
+        case WireCodecZstd:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    };
+    if( IsSupported( requested ) ) return requested;
+    if( IsSupported( preferred ) ) return preferred;
+    return WireCodecLz4;
+}
+
+// Sends every m-th frame of a connection split into m streams, on its own thread.
+struct Profiler::WireStream
+{
+    Profiler* profiler;
+    Thread* thread;
+    Socket* sock;                   // m_sock for the first stream
+    void* lz4;                      // LZ4_stream_t*
+    void* zstd;                     // ZSTD_CCtx*
+    char* in;                       // Two frames, used in turn, so that LZ4 finds the previous one in place
+    char* out;
+    int inIdx;
+    std::atomic<uint32_t> pending;  // Size of the frame to send, zero when idle
+    std::atomic<bool> failed;
+};
+
+void Profiler::LaunchStreamWorker( void* ptr )
+{
+    auto stream = (WireStream*)ptr;
+    stream->profiler->StreamWorker( *stream );
+}
+
+#ifdef TRACY_HAS_SHARED_MEMORY
+// Ring passing the data to a server running on the same host, if it accepts it.
+enum { SharedMemorySize = 64 * TargetFrameSize };
+#endif
+
+#ifdef TRACY_FLIGHT_RECORDER
+// Items describing objects that live for the whole program run. Parts of a flight
+// recording are discarded, so these are kept aside and sent first on connection.
+static bool IsDeferredItem( uint8_t idx )
+{
+    switch( (QueueType)idx )
+    {
+    case QueueType::MessageAppInfo:
+    case QueueType::PlotConfig:
+    case QueueType::ParamSetup:
+    case QueueType::CpuTopology:
+    case QueueType::LockAnnounce:
+    case QueueType::LockTerminate:
+    case QueueType::LockName:
+    case QueueType::GpuNewContext:
+    case QueueType::GpuContextName:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// How long a triggered recording is kept for a server to collect, in nanoseconds.
+static constexpr int64_t FlightRecorderHoldTime = 60ll * 1000 * 1000 * 1000;
+// Dequeue calls made per connection poll while recording.
+enum { FlightRecorderBurst = 256 };
+#endif
+
 TRACY_API int64_t GetFrequencyQpc()
 {
 #if defined _WIN32
@@ -1168,9 +1297,15 @@ struct ProfilerThreadData
     ProfilerThreadData( ProfilerData& data ) : token( data ), gpuCtx( { nullptr } ) {}
     ProducerWrapper token;
     GpuCtxWrapper gpuCtx;
+#  ifdef TRACY_PER_THREAD_SERIAL
+    SerialQueueWrapper serialQueue { nullptr };
+#  endif
 #  ifdef TRACY_ON_DEMAND
     LuaZoneState luaZoneState;
 #  endif
+#  ifdef TRACY_DEFERRED_ZONES
+    DeferredZoneStack deferredZones {};
+#  endif
 };
 
 std::atomic<int> RpInitDone { 0 };
@@ -1295,12 +1430,23 @@ TRACY_API int64_t GetInitTime() { return GetProfilerData().initTime; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return GetProfilerData().lockCounter; }
 TRACY_API std::atomic<uint16_t>& GetGpuCtxCounter() { return GetProfilerData().gpuCtxCounter; }
 TRACY_API GpuCtxWrapper& GetGpuCtx() { return GetProfilerThreadData().gpuCtx; }
+#  ifdef TRACY_PER_THREAD_SERIAL
+TRACY_API SerialQueue& GetSerialQueue()
+{
+    auto& wrapper = GetProfilerThreadData().serialQueue;
+    if( !wrapper.ptr ) wrapper.ptr = GetProfiler().AcquireSerialQueue();
+    return *wrapper.ptr;
+}
+#  endif
 TRACY_API uint32_t GetThreadHandle() { return detail::GetThreadHandleImpl(); }
 std::atomic<ThreadNameData*>& GetThreadNameData() { return GetProfilerData().threadNameData; }
 
 #  ifdef TRACY_ON_DEMAND
 TRACY_API LuaZoneState& GetLuaZoneState() { return GetProfilerThreadData().luaZoneState; }
 #  endif
+#  ifdef TRACY_DEFERRED_ZONES
+TRACY_API DeferredZoneStack& GetDeferredZones() { return GetProfilerThreadData().deferredZones; }
+#  endif
 
 #  ifndef TRACY_MANUAL_LIFETIME
 namespace
@@ -1337,6 +1483,9 @@ std::atomic<uint32_t> init_order(104) s_lockCounter( 0 );
 std::atomic<uint16_t> init_order(104) s_gpuCtxCounter( 0 );
 
 thread_local GpuCtxWrapper init_order(104) s_gpuCtx { nullptr };
+#  ifdef TRACY_PER_THREAD_SERIAL
+thread_local SerialQueueWrapper init_order(104) s_serialQueue { nullptr };
+#  endif
 
 struct ThreadNameData;
 static std::atomic<ThreadNameData*> init_order(104) s_threadNameDataInstance( nullptr );
@@ -1345,6 +1494,9 @@ std::atomic<ThreadNameData*>& s_threadNameData = s_threadNameDataInstance;
 #  ifdef TRACY_ON_DEMAND
 thread_local LuaZoneState init_order(104) s_luaZoneState { 0, false };
 #  endif
+#  ifdef TRACY_DEFERRED_ZONES
+thread_local DeferredZoneStack init_order(104) s_deferredZones {};
+#  endif
 
 static Profiler init_order(105) s_profiler;
 
@@ -1355,6 +1507,13 @@ TRACY_API int64_t GetInitTime() { return s_initTime.val; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return s_lockCounter; }
 TRACY_API std::atomic<uint16_t>& GetGpuCtxCounter() { return s_gpuCtxCounter; }
 TRACY_API GpuCtxWrapper& GetGpuCtx() { return s_gpuCtx; }
+#  ifdef TRACY_PER_THREAD_SERIAL
+TRACY_API SerialQueue& GetSerialQueue()
+{
+    if( !s_serialQueue.ptr ) s_serialQueue.ptr = GetProfiler().AcquireSerialQueue();
+    return *s_serialQueue.ptr;
+}
+#  endif
 TRACY_API uint32_t GetThreadHandle() { return s_threadHandle.val; }
 
 std::atomic<ThreadNameData*>& GetThreadNameData() { return s_threadNameData; }
@@ -1362,6 +1521,9 @@ std::atomic<ThreadNameData*>& GetThreadNameData() { return s_threadNameData; }
 #  ifdef TRACY_ON_DEMAND
 TRACY_API LuaZoneState& GetLuaZoneState() { return s_luaZoneState; }
 #  endif
+#  ifdef TRACY_DEFERRED_ZONES
+TRACY_API DeferredZoneStack& GetDeferredZones() { return s_deferredZones; }
+#  endif
 #endif
 
 TRACY_API bool ProfilerAvailable() { return s_instance != nullptr; }
@@ -1375,18 +1537,42 @@ Profiler::Profiler()
     , m_shutdownManual( false )
     , m_shutdownFinished( false )
     , m_sock( nullptr )
+    , m_shm( nullptr )
     , m_broadcast( nullptr )
     , m_noExit( false )
     , m_userPort( 0 )
     , m_zoneId( 1 )
     , m_samplingPeriod( 0 )
     , m_stream( LZ4_createStream() )
+    , m_zstdStream( nullptr )
+    , m_wireCodec( WireCodecLz4 )
+    , m_wireCodecPreference( WireCodecLz4 )
+    , m_wireStreams( nullptr )
+    , m_streamCount( 1 )
+    , m_activeStreams( 1 )
+    , m_streamNext( 0 )
     , m_buffer( (char*)tracy_malloc( TargetFrameSize*3 ) )
     , m_bufferOffset( 0 )
     , m_bufferStart( 0 )
     , m_lz4Buf( (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) ) )
+    , m_wireSrcLocPtr( nullptr )
+    , m_wireSrcLocIdx( nullptr )
+    , m_wireSrcLocCount( 0 )
+    , m_compactZones( false )
+#ifdef TRACY_PER_THREAD_SERIAL
+    , m_serialQueues( nullptr )
+    , m_serialSequence( 0 )
+    , m_serialNext( 0 )
+    , m_serialMemTime( 0 )
+    , m_serialSpillItems( 1024 )
+    , m_serialSpillSeqs( 1024 )
+    , m_serialSpillRead( 0 )
+    , m_serialHeads( 64 )
+    , m_serialDequeue( 64*1024 )
+#else
     , m_serialQueue( 1024*1024 )
     , m_serialDequeue( 1024*1024 )
+#endif
 #ifndef TRACY_NO_FRAME_IMAGE
     , m_fiQueue( 16 )
     , m_fiDequeue( 16 )
@@ -1394,9 +1580,20 @@ Profiler::Profiler()
     , m_symbolQueue( 8*1024 )
     , m_frameCount( 0 )
     , m_isConnected( false )
+#ifdef TRACY_DEFERRED_ZONES
+    , m_zoneThreshold( 0 )
+#endif
 #ifdef TRACY_ON_DEMAND
     , m_connectionId( 0 )
+#endif
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
     , m_deferredQueue( 64*1024 )
+#endif
+#ifdef TRACY_FLIGHT_RECORDER
+    , m_flightRecorder( nullptr )
+    , m_flightRecording( false )
+    , m_flightRecorderTrigger( false )
+    , m_flightRecorderHold( 0 )
 #endif
     , m_paramCallback( nullptr )
     , m_sourceCallback( nullptr )
@@ -1435,6 +1632,20 @@ Profiler::Profiler()
         m_userPort = atoi( userPort );
     }
 
+    const char* compression = GetEnvVar( "TRACY_COMPRESSION" );
+    if( compression )
+    {
+        if( strcmp( compression, "zstd" ) == 0 ) m_wireCodecPreference = WireCodecZstd;
+        else if( strcmp( compression, "none" ) == 0 ) m_wireCodecPreference = WireCodecNone;
+    }
+
+    const char* streams = GetEnvVar( "TRACY_STREAMS" );
+    if( streams )
+    {
+        const auto count = atoi( streams );
+        if( count > 1 ) m_streamCount = uint8_t( std::min<int>( count, MaxWireStreams ) );
+    }
+
 #if !defined(TRACY_DELAYED_INIT) || !defined(TRACY_MANUAL_LIFETIME)
     SpawnWorkerThreads();
 #endif
@@ -1522,11 +1733,33 @@ void Profiler::SpawnWorkerThreads()
     new(s_symbolThread) Thread( LaunchSymbolWorker, this );
 #endif
 
+    if( m_streamCount > 1 )
+    {
+        m_wireStreams = (WireStream*)tracy_malloc( sizeof( WireStream ) * m_streamCount );
+        for( int i=0; i<m_streamCount; i++ )
+        {
+            auto& stream = m_wireStreams[i];
+            new(&stream) WireStream();
+            stream.profiler = this;
+            stream.sock = nullptr;
+            stream.lz4 = LZ4_createStream();
+            stream.zstd = nullptr;
+            stream.in = (char*)tracy_malloc( TargetFrameSize * 2 );
+            stream.out = (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) );
+            stream.inIdx = 0;
+            stream.pending.store( 0, std::memory_order_relaxed );
+            stream.failed.store( false, std::memory_order_relaxed );
+            stream.thread = (Thread*)tracy_malloc( sizeof( Thread ) );
+            new(stream.thread) Thread( LaunchStreamWorker, &stream );
+        }
+    }
+
 #if defined _WIN32 && !defined TRACY_UWP && !defined TRACY_NO_CRASH_HANDLER
     s_profilerThreadId = GetThreadId( s_thread->Handle() );
 #  ifdef TRACY_HAS_CALLSTACK
     s_symbolThreadId = GetThreadId( s_symbolThread->Handle() );
 #  endif
+    for( int i=0; i<m_streamCount && m_wireStreams; i++ ) s_streamThreadId[i] = GetThreadId( m_wireStreams[i].thread->Handle() );
 #endif
 
 #ifdef TRACY_HAS_CALLSTACK
@@ -1564,19 +1797,52 @@ Profiler::~Profiler()
     s_thread->~Thread();
     tracy_free( s_thread );
 
+    // Stream threads exit after the profiler thread has sent the last frame.
+    if( m_wireStreams )
+    {
+        for( int i=0; i<m_streamCount; i++ )
+        {
+            auto& stream = m_wireStreams[i];
+            stream.thread->~Thread();
+            tracy_free( stream.thread );
+            if( i != 0 && stream.sock )
+            {
+                stream.sock->~Socket();
+                tracy_free( stream.sock );
+            }
+            LZ4_freeStream( (LZ4_stream_t*)stream.lz4 );
+#ifdef TRACY_ZSTD_COMPRESSION
+            if( stream.zstd ) ZSTD_freeCCtx( (ZSTD_CCtx*)stream.zstd );
+#endif
+            tracy_free( stream.out );
+            tracy_free( stream.in );
+            stream.~WireStream();
+        }
+        tracy_free( m_wireStreams );
+    }
+
 #ifdef TRACY_HAS_CALLSTACK
     EndCallstack();
 #endif
 
     tracy_free( m_lz4Buf );
     tracy_free( m_buffer );
+    if( m_wireSrcLocPtr )
+    {
+        tracy_free( m_wireSrcLocPtr );
+        tracy_free( m_wireSrcLocIdx );
+    }
     LZ4_freeStream( (LZ4_stream_t*)m_stream );
+#ifdef TRACY_ZSTD_COMPRESSION
+    if( m_zstdStream ) ZSTD_freeCCtx( (ZSTD_CCtx*)m_zstdStream );
+#endif
 
     if( m_sock )
     {
         m_sock->~Socket();
         tracy_free( m_sock );
     }
+    DestroySharedMemory();
 
     if( m_broadcast )
     {
@@ -1584,6 +1850,14 @@ Profiler::~Profiler()
         tracy_free( m_broadcast );
     }
 
+#ifdef TRACY_FLIGHT_RECORDER
+    if( m_flightRecorder )
+    {
+        m_flightRecorder->~FlightRecorder();
+        tracy_free( m_flightRecorder );
+    }
+#endif
+
     assert( s_instance );
     s_instance = nullptr;
 }
@@ -1646,6 +1920,10 @@ void Profiler::Worker()
 #ifdef TRACY_ON_DEMAND
     flags |= WelcomeFlag::OnDemand;
 #endif
+#ifdef TRACY_FLIGHT_RECORDER
+    // A flight recording starts in the middle of the program run, just like an on-demand connection.
+    flags |= WelcomeFlag::OnDemand | WelcomeFlag::FlightRecorder;
+#endif
 #ifdef __APPLE__
     flags |= WelcomeFlag::IsApple;
 #endif
@@ -1762,20 +2040,41 @@ void Profiler::Worker()
     }
 #endif
 
+#ifdef TRACY_FLIGHT_RECORDER
+#  ifdef TRACY_FLIGHT_RECORDER_SIZE
+    const size_t flightRecorderSize = std::max<size_t>( size_t( TRACY_FLIGHT_RECORDER_SIZE ) * 1024 * 1024, LZ4Size * 4 );
+#  else
+    const size_t flightRecorderSize = 16 * 1024 * 1024;
+#  endif
+    m_flightRecorder = (FlightRecorder*)tracy_malloc( sizeof( FlightRecorder ) );
+    new(m_flightRecorder) FlightRecorder( flightRecorderSize );
+    m_flightRecording = true;
+    BeginFlightSegment();
+    InstallCrashHandler();
+#  ifdef __linux__
+    signal( TRACY_FLIGHT_RECORDER_SIGNAL, FlightRecorderTrigger );
+#  endif
+#endif
+
     int broadcastLen = 0;
     auto& broadcastMsg = GetBroadcastMessage( procname, pnsz, broadcastLen, dataPort );
     uint64_t lastBroadcast = 0;
 
     // Connections loop.
     // Each iteration of the loop handles whole connection. Multiple iterations will only
-    // happen in the on-demand mode or when handshake fails.
+    // happen in the on-demand and flight recorder modes, or when handshake fails.
     for(;;)
     {
         // Wait for incoming connection
         for(;;)
         {
 #ifndef TRACY_NO_EXIT
+#  ifdef TRACY_FLIGHT_RECORDER
+            // A held recording stays available to servers, even when the program exits or crashes.
+            if( !m_noExit && ShouldExit() && m_flightRecorderHold == 0 )
+#  else
             if( !m_noExit && ShouldExit() )
+#  endif
             {
                 if( m_broadcast )
                 {
@@ -1793,6 +2092,9 @@ void Profiler::Worker()
 #  ifdef TRACY_HAS_SYSPOWER
             m_sysPower.Tick();
 #  endif
+#endif
+#ifdef TRACY_FLIGHT_RECORDER
+            if( m_flightRecorder ) RecordFlight( token );
 #endif
 
             if( m_broadcast )
@@ -1855,6 +2157,17 @@ void Profiler::Worker()
                 m_sock = nullptr;
                 continue;
             }
+
+            uint8_t wireCodec;
+            res = m_sock->ReadRaw( &wireCodec, sizeof( wireCodec ), 2000 );
+            if( !res )
+            {
+                m_sock->~Socket();
+                tracy_free( m_sock );
+                m_sock = nullptr;
+                continue;
+            }
+            m_wireCodec = SelectWireCodec( wireCodec, m_wireCodecPreference );
         }
 
 #ifdef TRACY_ON_DEMAND
@@ -1863,57 +2176,51 @@ void Profiler::Worker()
         m_connectionId.fetch_add( 1, std::memory_order_release );
 #endif
         m_isConnected.store( true, std::memory_order_release );
+#ifndef TRACY_FLIGHT_RECORDER
         InstallCrashHandler();
+#endif
 
         HandshakeStatus handshake = HandshakeWelcome;
         m_sock->Send( &handshake, sizeof( handshake ) );
 
-        LZ4_resetStream( (LZ4_stream_t*)m_stream );
+        ResetEncoder( m_stream, m_zstdStream );
+        MemWrite( &welcome.wireCodec, m_wireCodec );
+        const auto streamToken = uint32_t( GetTime() ) ^ uint32_t( GetPid() );
+        MemWrite( &welcome.streams, m_streamCount );
+        MemWrite( &welcome.streamToken, streamToken );
+        SharedMemoryOfferMessage shmOffer;
+        const bool shmCreated = CreateSharedMemory( shmOffer );
+        MemWrite( &welcome.flags, uint8_t( shmCreated ? flags | WelcomeFlag::SharedMemory : flags ) );
         m_sock->Send( &welcome, sizeof( welcome ) );
+        if( shmCreated ) OfferSharedMemory( shmOffer );
+        if( !m_shm && m_streamCount > 1 ) AcceptWireStreams( listen, streamToken );
 
+        ResetWireSrcLocs();
+#ifdef TRACY_FLIGHT_RECORDER
+        if( m_flightRecorder ) SendFlightRecording();
+#else
         m_threadCtx = 0;
         m_refTimeSerial = 0;
         m_refTimeCtx = 0;
         m_refTimeGpu = 0;
+#endif
 
 #ifdef TRACY_ON_DEMAND
         OnDemandPayloadMessage onDemand;
         onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
         onDemand.currentTime = currentTime;
+        onDemand.refTimeSerial = 0;
+        onDemand.refTimeCtx = 0;
+        onDemand.refTimeGpu = 0;
 
         m_sock->Send( &onDemand, sizeof( onDemand ) );
 
-        m_deferredLock.lock();
-        for( auto& item : m_deferredQueue )
-        {
-            uint64_t ptr;
-            uint16_t size;
-            const auto idx = MemRead<uint8_t>( &item.hdr.idx );
-            switch( (QueueType)idx )
-            {
-            case QueueType::MessageAppInfo:
-                ptr = MemRead<uint64_t>( &item.messageFat.text );
-                size = MemRead<uint16_t>( &item.messageFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            case QueueType::LockName:
-                ptr = MemRead<uint64_t>( &item.lockNameFat.name );
-                size = MemRead<uint16_t>( &item.lockNameFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            case QueueType::GpuContextName:
-                ptr = MemRead<uint64_t>( &item.gpuContextNameFat.ptr );
-                size = MemRead<uint16_t>( &item.gpuContextNameFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            default:
-                break;
-            }
-            AppendData( &item, QueueDataSize[idx] );
-        }
-        m_deferredLock.unlock();
+        SendDeferredItems();
 #endif
 
+        // Parts of a flight recording may be discarded, so the recorded zones don't use the source location table.
+        m_compactZones = true;
+
         // Main communications loop
         int keepAlive = 0;
         for(;;)
@@ -1966,18 +2273,30 @@ void Profiler::Worker()
         if( ShouldExit() ) break;
 
         m_isConnected.store( false, std::memory_order_release );
+        m_compactZones = false;
+#ifndef TRACY_FLIGHT_RECORDER
         RemoveCrashHandler();
+#endif
 
-#ifdef TRACY_ON_DEMAND
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
         m_bufferOffset = 0;
         m_bufferStart = 0;
 #endif
 
+        CloseWireStreams();
         m_sock->~Socket();
         tracy_free( m_sock );
         m_sock = nullptr;
+        DestroySharedMemory();
 
-#ifndef TRACY_ON_DEMAND
+#ifdef TRACY_FLIGHT_RECORDER
+        // Start recording again, for the next server to connect.
+        m_flightRecorderTrigger.store( false, std::memory_order_relaxed );
+        m_flightRecording = true;
+        BeginFlightSegment();
+#endif
+
+#if !defined TRACY_ON_DEMAND && !defined TRACY_FLIGHT_RECORDER
         // Client is no longer available here. Accept incoming connections, but reject handshake.
         for(;;)
         {
@@ -2314,6 +2633,29 @@ void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
 
 void Profiler::ClearSerial()
 {
+#ifdef TRACY_PER_THREAD_SERIAL
+    // Transactions still in flight will be sent unordered, as their sequence is
+    // already behind the merge position.
+    for( auto queue = m_serialQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        const auto end = queue->WritePos();
+        for( auto pos = queue->ReadPos(); pos != end; pos++ )
+        {
+            FreeAssociatedMemory( *queue->Item( pos ) );
+            if( m_serialNext <= queue->Sequence( pos ) ) m_serialNext = queue->Sequence( pos ) + 1;
+        }
+        queue->Consume( end );
+    }
+    TakeSerialSpill();
+    for( auto pos = m_serialSpillRead; pos != m_serialSpillItems.size(); pos++ )
+    {
+        FreeAssociatedMemory( m_serialSpillItems[pos] );
+        if( m_serialNext <= m_serialSpillSeqs[pos] ) m_serialNext = m_serialSpillSeqs[pos] + 1;
+    }
+    m_serialSpillItems.clear();
+    m_serialSpillSeqs.clear();
+    m_serialSpillRead = 0;
+#else
     bool lockHeld = true;
     while( !m_serialLock.try_lock() )
     {
@@ -2329,11 +2671,56 @@ void Profiler::ClearSerial()
     {
         m_serialLock.unlock();
     }
+#endif
 
     for( auto& v : m_serialDequeue ) FreeAssociatedMemory( v );
     m_serialDequeue.clear();
 }
 
+void Profiler::ResetWireSrcLocs()
+{
+    if( !m_wireSrcLocPtr )
+    {
+        m_wireSrcLocPtr = (uint64_t*)tracy_malloc( sizeof( uint64_t ) * WireSrcLocSlots );
+        m_wireSrcLocIdx = (uint16_t*)tracy_malloc( sizeof( uint16_t ) * WireSrcLocSlots );
+    }
+    memset( m_wireSrcLocPtr, 0, sizeof( uint64_t ) * WireSrcLocSlots );
+    m_wireSrcLocCount = 0;
+}
+
+// Returns the wire index of the source location, or -1 if it doesn't have one yet.
+// In the latter case the source location is added to the table, if there is room.
+tracy_force_inline int32_t Profiler::FindWireSrcLoc( uint64_t srcloc, bool& added )
+{
+    added = false;
+    auto slot = uint32_t( ( srcloc * 0x9E3779B97F4A7C15ull ) >> 50 ) & ( WireSrcLocSlots - 1 );
+    for(;;)
+    {
+        const auto ptr = m_wireSrcLocPtr[slot];
+        if( ptr == srcloc ) return m_wireSrcLocIdx[slot];
+        if( ptr == 0 )
+        {
+            if( m_wireSrcLocCount == MaxWireSrcLocs ) return -1;
+            m_wireSrcLocPtr[slot] = srcloc;
+            m_wireSrcLocIdx[slot] = uint16_t( m_wireSrcLocCount++ );
+            added = true;
+            return -1;
+        }
+        slot = ( slot + 1 ) & ( WireSrcLocSlots - 1 );
+    }
+}
+
+tracy_force_inline bool Profiler::AppendZoneCompact( QueueType type, int64_t dt, int32_t srclocIdx )
+{
+    const auto ret = NeedDataSize( ZoneCompactMaxSize );
+    auto dst = m_buffer + m_bufferOffset;
+    MemWrite( dst++, type );
+    dst = WriteVarInt( dst, ZigZagEncode( dt ) );
+    if( srclocIdx >= 0 ) dst = WriteVarInt( dst, uint64_t( srclocIdx ) );
+    m_bufferOffset = int( dst - m_buffer );
+    return ret;
+}
+
 Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
 {
     bool connectionLost = false;
@@ -2355,6 +2742,18 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                 uint64_t ptr;
                 uint16_t size;
                 auto idx = MemRead<uint8_t>( &item->hdr.idx );
+#ifdef TRACY_FLIGHT_RECORDER
+                if( IsDeferredItem( idx ) )
+                {
+                    // Kept for the later connections, as in the on-demand mode.
+                    DeferItem( *item );
+                    if( m_flightRecording )
+                    {
+                        item++;
+                        continue;
+                    }
+                }
+#endif
                 if( idx < (int)QueueType::Terminate )
                 {
                     switch( (QueueType)idx )
@@ -2384,7 +2783,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         ptr = MemRead<uint64_t>( &item->messageFat.text );
                         size = MemRead<uint16_t>( &item->messageFat.size );
                         SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
+#if !defined TRACY_ON_DEMAND && !defined TRACY_FLIGHT_RECORDER
                         tracy_free_fast( (void*)ptr );
 #endif
                         break;
@@ -2445,6 +2844,25 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         int64_t t = MemRead<int64_t>( &item->zoneBegin.time );
                         int64_t dt = t - refThread;
                         refThread = t;
+                        if( m_compactZones && idx == (int)QueueType::ZoneBegin )
+                        {
+                            bool added;
+                            const auto srclocIdx = FindWireSrcLoc( MemRead<uint64_t>( &item->zoneBegin.srcloc ), added );
+                            if( srclocIdx >= 0 )
+                            {
+                                if( !AppendZoneCompact( QueueType::ZoneBeginCompact, dt, srclocIdx ) )
+                                {
+                                    connectionLost = true;
+                                    m_refTimeThread = refThread;
+                                    m_refTimeCtx = refCtx;
+                                    m_refTimeGpu = refGpu;
+                                    return;
+                                }
+                                ++item;
+                                continue;
+                            }
+                            if( added ) MemWrite( &item->hdr.type, QueueType::ZoneBeginIndexed );
+                        }
                         MemWrite( &item->zoneBegin.time, dt );
                         break;
                     }
@@ -2453,6 +2871,19 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         int64_t t = MemRead<int64_t>( &item->zoneEnd.time );
                         int64_t dt = t - refThread;
                         refThread = t;
+                        if( m_compactZones )
+                        {
+                            if( !AppendZoneCompact( QueueType::ZoneEndCompact, dt, -1 ) )
+                            {
+                                connectionLost = true;
+                                m_refTimeThread = refThread;
+                                m_refTimeCtx = refCtx;
+                                m_refTimeGpu = refGpu;
+                                return;
+                            }
+                            ++item;
+                            continue;
+                        }
                         MemWrite( &item->zoneEnd.time, dt );
                         break;
                     }
@@ -2489,7 +2920,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         ptr = MemRead<uint64_t>( &item->gpuContextNameFat.ptr );
                         size = MemRead<uint16_t>( &item->gpuContextNameFat.size );
                         SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
+#if !defined TRACY_ON_DEMAND && !defined TRACY_FLIGHT_RECORDER
                         tracy_free_fast( (void*)ptr );
 #endif
                         break;
@@ -2695,6 +3126,9 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
 
 Profiler::DequeueStatus Profiler::DequeueSerial()
 {
+#ifdef TRACY_PER_THREAD_SERIAL
+    MergeSerialQueues();
+#else
     {
         bool lockHeld = true;
         while( !m_serialLock.try_lock() )
@@ -2711,6 +3145,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
             m_serialLock.unlock();
         }
     }
+#endif
 
     const auto sz = m_serialDequeue.size();
     if( sz > 0 )
@@ -2727,6 +3162,17 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
         {
             uint64_t ptr;
             auto idx = MemRead<uint8_t>( &item->hdr.idx );
+#ifdef TRACY_FLIGHT_RECORDER
+            if( IsDeferredItem( idx ) )
+            {
+                DeferItem( *item );
+                if( m_flightRecording )
+                {
+                    item++;
+                    continue;
+                }
+            }
+#endif
             if( idx < (int)QueueType::Terminate )
             {
                 switch( (QueueType)idx )
@@ -2768,7 +3214,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ptr = MemRead<uint64_t>( &item->lockNameFat.name );
                     uint16_t size = MemRead<uint16_t>( &item->lockNameFat.size );
                     SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
+#if !defined TRACY_ON_DEMAND && !defined TRACY_FLIGHT_RECORDER
                     tracy_free_fast( (void*)ptr );
 #endif
                     break;
@@ -2837,7 +3283,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ptr = MemRead<uint64_t>( &item->gpuContextNameFat.ptr );
                     uint16_t size = MemRead<uint16_t>( &item->gpuContextNameFat.size );
                     SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
+#if !defined TRACY_ON_DEMAND && !defined TRACY_FLIGHT_RECORDER
                     tracy_free_fast( (void*)ptr );
 #endif
                     break;
@@ -2967,6 +3413,11 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ThreadCtxCheckSerial( zoneValueThread );
                     break;
                 }
+                case QueueType::ZoneDropped:
+                {
+                    ThreadCtxCheckSerial( zoneDroppedThread );
+                    break;
+                }
                 case QueueType::ZoneValidation:
                 {
                     ThreadCtxCheckSerial( zoneValidationThread );
@@ -3011,6 +3462,139 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
     return DequeueStatus::DataDequeued;
 }
 
+#ifdef TRACY_PER_THREAD_SERIAL
+SerialQueue* Profiler::AcquireSerialQueue()
+{
+    for( auto queue = m_serialQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        if( queue->TryAcquire() ) return queue;
+    }
+    auto queue = (SerialQueue*)tracy_malloc( sizeof( SerialQueue ) );
+    new(queue) SerialQueue();
+    auto head = m_serialQueues.load( std::memory_order_relaxed );
+    do
+    {
+        queue->SetNext( head );
+    }
+    while( !m_serialQueues.compare_exchange_weak( head, queue, std::memory_order_release, std::memory_order_relaxed ) );
+    return queue;
+}
+
+void Profiler::TakeSerialSpill()
+{
+    while( !m_serialSpill.lock.try_lock() )
+    {
+        if( m_shutdownManual.load( std::memory_order_relaxed ) ) return;
+    }
+    if( m_serialSpillRead == m_serialSpillItems.size() )
+    {
+        m_serialSpillItems.clear();
+        m_serialSpillSeqs.clear();
+        m_serialSpillRead = 0;
+        m_serialSpill.items.swap( m_serialSpillItems );
+        m_serialSpill.seqs.swap( m_serialSpillSeqs );
+    }
+    else
+    {
+        for( auto& v : m_serialSpill.items ) memcpy( m_serialSpillItems.push_next(), &v, sizeof( QueueItem ) );
+        for( auto& v : m_serialSpill.seqs ) *m_serialSpillSeqs.push_next() = v;
+        m_serialSpill.items.clear();
+        m_serialSpill.seqs.clear();
+    }
+    m_serialSpill.lock.unlock();
+}
+
+void Profiler::MergeSerialQueues()
+{
+    m_serialHeads.clear();
+    for( auto queue = m_serialQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        const auto pos = queue->ReadPos();
+        const auto end = queue->WritePos();
+        if( pos == end ) continue;
+        auto head = m_serialHeads.prepare_next();
+        head->seq = queue->Sequence( pos );
+        head->queue = queue;
+        head->pos = pos;
+        head->end = end;
+        m_serialHeads.commit_next();
+    }
+    TakeSerialSpill();
+    if( m_serialSpillRead != m_serialSpillItems.size() )
+    {
+        auto head = m_serialHeads.prepare_next();
+        head->seq = m_serialSpillSeqs[m_serialSpillRead];
+        head->queue = nullptr;
+        head->pos = m_serialSpillRead;
+        head->end = m_serialSpillItems.size();
+        m_serialHeads.commit_next();
+    }
+
+    // K-way merge of the thread rings, ordered by transaction sequence. A gap in
+    // the sequence means that the next transaction is still being written, and
+    // nothing issued after it may be sent yet.
+    const auto cmp = [] ( const SerialHead& lhs, const SerialHead& rhs ) { return lhs.seq > rhs.seq; };
+    auto heads = m_serialHeads.data();
+    auto end = heads + m_serialHeads.size();
+    std::make_heap( heads, end, cmp );
+    while( heads != end && heads->seq <= m_serialNext )
+    {
+        std::pop_heap( heads, end, cmp );
+        auto& head = *(end-1);
+        const auto seq = head.seq;
+        auto pos = head.pos;
+        do
+        {
+            auto item = m_serialDequeue.prepare_next();
+            memcpy( item, head.queue ? head.queue->Item( pos ) : &m_serialSpillItems[pos], sizeof( QueueItem ) );
+            // Memory events are ordered by sequence, but their timestamps are taken
+            // outside of any lock and may be slightly out of order.
+            switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+            {
+            case QueueType::MemAlloc:
+            case QueueType::MemAllocNamed:
+            case QueueType::MemAllocCallstack:
+            case QueueType::MemAllocCallstackNamed:
+            {
+                const auto t = MemRead<int64_t>( &item->memAlloc.time );
+                if( t < m_serialMemTime ) MemWrite( &item->memAlloc.time, m_serialMemTime );
+                else m_serialMemTime = t;
+                break;
+            }
+            case QueueType::MemFree:
+            case QueueType::MemFreeNamed:
+            case QueueType::MemFreeCallstack:
+            case QueueType::MemFreeCallstackNamed:
+            {
+                const auto t = MemRead<int64_t>( &item->memFree.time );
+                if( t < m_serialMemTime ) MemWrite( &item->memFree.time, m_serialMemTime );
+                else m_serialMemTime = t;
+                break;
+            }
+            default:
+                break;
+            }
+            m_serialDequeue.commit_next();
+            pos++;
+        }
+        while( pos != head.end && ( head.queue ? head.queue->Sequence( pos ) : m_serialSpillSeqs[pos] ) == seq );
+        if( head.queue ) head.queue->Consume( pos );
+        else m_serialSpillRead = pos;
+        if( seq == m_serialNext ) m_serialNext++;
+        if( pos == head.end )
+        {
+            end--;
+        }
+        else
+        {
+            head.pos = pos;
+            head.seq = head.queue ? head.queue->Sequence( pos ) : m_serialSpillSeqs[pos];
+            std::push_heap( heads, end, cmp );
+        }
+    }
+}
+#endif
+
 Profiler::ThreadCtxStatus Profiler::ThreadCtxCheck( uint32_t threadId )
 {
     if( m_threadCtx == threadId ) return ThreadCtxStatus::Same;
@@ -3033,10 +3617,358 @@ bool Profiler::CommitData()
 
 bool Profiler::SendData( const char* data, size_t len )
 {
-    const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
-    memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
-    return m_sock->Send( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) ) != -1;
+#ifdef TRACY_FLIGHT_RECORDER
+    if( m_flightRecording )
+    {
+        // Recorded frames are compressed independently, so that any of them can be dropped.
+        LZ4_resetStream( (LZ4_stream_t*)m_stream );
+        const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf, (int)len, LZ4Size, 1 );
+        m_flightRecorder->Append( m_lz4Buf, lz4sz );
+        return true;
+    }
+#endif
+#ifdef TRACY_HAS_SHARED_MEMORY
+    if( m_shm )
+    {
+        while( !m_shm->Write( data, uint32_t( len ) ) )
+        {
+            if( m_shm->IsServerGone() ) return false;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        return true;
+    }
+#endif
+    if( m_activeStreams > 1 ) return QueueWireFrame( data, len );
+    const auto sz = EncodeFrame( data, len, m_lz4Buf, m_stream, m_zstdStream );
+    return sz != 0 && m_sock->Send( m_lz4Buf, sz ) != -1;
+}
+
+// Returns the size of the encoded frame, including its size prefix, or zero on failure.
+int Profiler::EncodeFrame( const char* data, size_t len, char* out, void* lz4Stream, void* zstdStream )
+{
+#ifndef TRACY_ZSTD_COMPRESSION
+    (void)zstdStream;
+#endif
+    lz4sz_t lz4sz;
+    switch( m_wireCodec )
+    {
+#ifdef TRACY_ZSTD_COMPRESSION
+    case WireCodecZstd:
+    {
+        // Each frame is flushed, so that the server can decode it as soon as it arrives.
+        static_assert( ZSTD_COMPRESSBOUND( TargetFrameSize ) <= LZ4Size, "Zstd frames don't fit in the LZ4 buffer" );
+        ZSTD_inBuffer zin = { data, len, 0 };
+        ZSTD_outBuffer zout = { out + sizeof( lz4sz_t ), LZ4Size, 0 };
+        const auto ret = ZSTD_compressStream2( (ZSTD_CCtx*)zstdStream, &zout, &zin, ZSTD_e_flush );
+        if( ZSTD_isError( ret ) || ret != 0 ) return 0;
+        lz4sz = lz4sz_t( zout.pos );
+        break;
+    }
+#endif
+    case WireCodecNone:
+        lz4sz = lz4sz_t( len );
+        memcpy( out + sizeof( lz4sz_t ), data, len );
+        break;
+    default:
+        lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)lz4Stream, data, out + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
+        break;
+    }
+    memcpy( out, &lz4sz, sizeof( lz4sz ) );
+    return int( lz4sz + sizeof( lz4sz_t ) );
+}
+
+void Profiler::ResetEncoder( void* lz4Stream, void*& zstdStream )
+{
+    LZ4_resetStream( (LZ4_stream_t*)lz4Stream );
+#ifdef TRACY_ZSTD_COMPRESSION
+    if( m_wireCodec == WireCodecZstd )
+    {
+        if( !zstdStream )
+        {
+            zstdStream = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter( (ZSTD_CCtx*)zstdStream, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT );
+        }
+        else
+        {
+            ZSTD_CCtx_reset( (ZSTD_CCtx*)zstdStream, ZSTD_reset_session_only );
+        }
+    }
+#else
+    (void)zstdStream;
+#endif
+}
+
+void Profiler::AcceptWireStreams( ListenSocket& listen, uint32_t token )
+{
+    m_wireStreams[0].sock = m_sock;
+    int connected = 1;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 2 );
+    while( connected < m_streamCount && !ShouldExit() && std::chrono::steady_clock::now() < deadline )
+    {
+        auto sock = listen.Accept();
+        if( !sock ) continue;
+        char shibboleth[StreamShibbolethSize];
+        StreamMessage msg;
+        if( sock->ReadRaw( shibboleth, StreamShibbolethSize, 2000 ) && memcmp( shibboleth, StreamShibboleth, StreamShibbolethSize ) == 0 &&
+            sock->ReadRaw( &msg, sizeof( msg ), 2000 ) && msg.token == token && msg.index > 0 && msg.index < m_streamCount &&
+            !m_wireStreams[msg.index].sock )
+        {
+            m_wireStreams[msg.index].sock = sock;
+            connected++;
+        }
+        else
+        {
+            sock->~Socket();
+            tracy_free( sock );
+        }
+    }
+
+    for( int i=0; i<m_streamCount; i++ )
+    {
+        auto& stream = m_wireStreams[i];
+        ResetEncoder( stream.lz4, stream.zstd );
+        stream.inIdx = 0;
+        stream.failed.store( false, std::memory_order_relaxed );
+    }
+    m_activeStreams = m_streamCount;
+    m_streamNext = 0;
+
+    // The server would wait forever for the missing frames. Lost connection will be noticed in the main loop.
+    if( connected < m_streamCount ) m_sock->Close();
+}
+
+// Hands the frame over to the next stream. Frames are copied, as the caller reuses its buffer.
+bool Profiler::QueueWireFrame( const char* data, size_t len )
+{
+    assert( len != 0 && len <= TargetFrameSize );
+    auto& stream = m_wireStreams[m_streamNext];
+    m_streamNext = ( m_streamNext + 1 ) % m_activeStreams;
+    while( stream.pending.load( std::memory_order_acquire ) != 0 ) std::this_thread::yield();
+    if( stream.failed.load( std::memory_order_relaxed ) || !stream.sock ) return false;
+    stream.inIdx ^= 1;
+    memcpy( stream.in + stream.inIdx * TargetFrameSize, data, len );
+    stream.pending.store( uint32_t( len ), std::memory_order_release );
+    return true;
+}
+
+void Profiler::CloseWireStreams()
+{
+    if( m_activeStreams == 1 ) return;
+    for( int i=0; i<m_activeStreams; i++ )
+    {
+        auto& stream = m_wireStreams[i];
+        while( stream.pending.load( std::memory_order_acquire ) != 0 ) std::this_thread::yield();
+        if( i != 0 && stream.sock )
+        {
+            stream.sock->~Socket();
+            tracy_free( stream.sock );
+        }
+        stream.sock = nullptr;
+    }
+    m_activeStreams = 1;
+}
+
+void Profiler::StreamWorker( WireStream& stream )
+{
+#if defined __linux__ && !defined TRACY_NO_CRASH_HANDLER
+    s_streamTid[&stream - m_wireStreams] = syscall( SYS_gettid );
+#endif
+
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy Stream" );
+
+    int idle = 0;
+    for(;;)
+    {
+        const auto len = stream.pending.load( std::memory_order_acquire );
+        if( len == 0 )
+        {
+            if( m_shutdownFinished.load( std::memory_order_relaxed ) ) return;
+            // Under load the next frame comes soon. Back off gradually when there is none.
+            if( idle < 1000 ) std::this_thread::yield();
+            else std::this_thread::sleep_for( std::chrono::milliseconds( idle < 1100 ? 1 : 10 ) );
+            if( idle < 1100 ) idle++;
+            continue;
+        }
+        idle = 0;
+        const auto sz = EncodeFrame( stream.in + stream.inIdx * TargetFrameSize, len, stream.out, stream.lz4, stream.zstd );
+        if( sz == 0 || stream.sock->Send( stream.out, sz ) == -1 ) stream.failed.store( true, std::memory_order_relaxed );
+        stream.pending.store( 0, std::memory_order_release );
+    }
+}
+
+bool Profiler::CreateSharedMemory( SharedMemoryOfferMessage& offer )
+{
+#ifdef TRACY_HAS_SHARED_MEMORY
+    assert( !m_shm );
+    memset( &offer, 0, sizeof( offer ) );
+    offer.nonce = uint64_t( GetTime() ) ^ ( uint64_t( GetPid() ) << 32 ) ^ uint64_t( (uintptr_t)m_buffer );
+    snprintf( offer.name, SharedMemoryNameSize, "/tracy.%x.%x", uint32_t( GetPid() ), uint32_t( offer.nonce ) );
+    m_shm = (SharedMemoryRing*)tracy_malloc( sizeof( SharedMemoryRing ) );
+    new(m_shm) SharedMemoryRing();
+    if( m_shm->Create( offer.name, offer.nonce, SharedMemorySize ) ) return true;
+    DestroySharedMemory();
+#endif
+    return false;
+}
+
+void Profiler::OfferSharedMemory( const SharedMemoryOfferMessage& offer )
+{
+#ifdef TRACY_HAS_SHARED_MEMORY
+    m_sock->Send( &offer, sizeof( offer ) );
+    SharedMemoryStatus status;
+    if( !m_sock->ReadRaw( &status, sizeof( status ), 2000 ) )
+    {
+        // A late answer would be mistaken for a server query.
+        m_sock->Close();
+        DestroySharedMemory();
+    }
+    else if( status != SharedMemoryAccepted )
+    {
+        // The server runs on another host. Data is sent over the network connection.
+        DestroySharedMemory();
+    }
+    // The server has mapped the object by now, or never will.
+    SharedMemoryRing::Unlink( offer.name );
+#endif
+}
+
+void Profiler::DestroySharedMemory()
+{
+#ifdef TRACY_HAS_SHARED_MEMORY
+    if( !m_shm ) return;
+    m_shm->~SharedMemoryRing();
+    tracy_free( m_shm );
+    m_shm = nullptr;
+#endif
+}
+
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
+void Profiler::SendDeferredItems()
+{
+    m_deferredLock.lock();
+    for( auto& item : m_deferredQueue )
+    {
+        uint64_t ptr;
+        uint16_t size;
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        switch( (QueueType)idx )
+        {
+        case QueueType::MessageAppInfo:
+            ptr = MemRead<uint64_t>( &item.messageFat.text );
+            size = MemRead<uint16_t>( &item.messageFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        case QueueType::LockName:
+            ptr = MemRead<uint64_t>( &item.lockNameFat.name );
+            size = MemRead<uint16_t>( &item.lockNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        case QueueType::GpuContextName:
+            ptr = MemRead<uint64_t>( &item.gpuContextNameFat.ptr );
+            size = MemRead<uint16_t>( &item.gpuContextNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        default:
+            break;
+        }
+        AppendData( &item, QueueDataSize[idx] );
+    }
+    m_deferredLock.unlock();
 }
+#endif
+
+#ifdef TRACY_FLIGHT_RECORDER
+void Profiler::RecordFlight( moodycamel::ConsumerToken& token )
+{
+    const auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    if( m_flightRecorderHold != 0 )
+    {
+        if( t - m_flightRecorderHold < FlightRecorderHoldTime ) return;
+        m_flightRecorderHold = 0;
+    }
+    const auto trigger = m_flightRecorderTrigger.exchange( false, std::memory_order_relaxed );
+
+    const auto segmentSize = m_flightRecorder->Size() / 16;
+    for( int i=0; i<FlightRecorderBurst; i++ )
+    {
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty ) break;
+        if( m_flightRecorder->SegmentSize() >= segmentSize ) BeginFlightSegment();
+    }
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+    if( !m_flightRecorder->IsRecording() || m_flightRecorder->SegmentSize() >= segmentSize ) BeginFlightSegment();
+
+    // Items that are still queued will be sent when a server connects.
+    if( trigger ) m_flightRecorderHold = t;
+}
+
+void Profiler::BeginFlightSegment()
+{
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+
+    FlightRecorder::Segment segment;
+    segment.frames = m_frameCount.load( std::memory_order_relaxed );
+    segment.time = GetTime();
+    segment.refTimeSerial = m_refTimeSerial;
+    segment.refTimeCtx = m_refTimeCtx;
+    segment.refTimeGpu = m_refTimeGpu;
+    m_flightRecorder->BeginSegment( segment );
+
+    // Thread references are restarted by the thread context switch.
+    m_threadCtx = 0;
+    m_refTimeThread = 0;
+}
+
+void Profiler::SendFlightRecording()
+{
+    auto recorder = m_flightRecorder;
+    m_flightRecording = false;
+    m_flightRecorderHold = 0;
+
+    // Everything was committed to the recorder. The server buffer starts at the beginning.
+    m_bufferOffset = 0;
+    m_bufferStart = 0;
+
+    OnDemandPayloadMessage onDemand;
+    auto segment = recorder->First();
+    if( segment )
+    {
+        onDemand.frames = segment->frames;
+        onDemand.currentTime = segment->time;
+        onDemand.refTimeSerial = segment->refTimeSerial;
+        onDemand.refTimeCtx = segment->refTimeCtx;
+        onDemand.refTimeGpu = segment->refTimeGpu;
+    }
+    else
+    {
+        m_threadCtx = 0;
+        m_refTimeThread = 0;
+        onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
+        onDemand.currentTime = GetTime();
+        onDemand.refTimeSerial = m_refTimeSerial;
+        onDemand.refTimeCtx = m_refTimeCtx;
+        onDemand.refTimeGpu = m_refTimeGpu;
+    }
+    m_sock->Send( &onDemand, sizeof( onDemand ) );
+
+    // Lost connection will be noticed in the main loop.
+    SendDeferredItems();
+    if( m_bufferOffset == m_bufferStart || CommitData() )
+    {
+        recorder->ForEachFrame( [this] ( const char* data, uint32_t size ) {
+            const auto sz = LZ4_decompress_safe( data, m_buffer + m_bufferOffset, (int)size, TargetFrameSize );
+            assert( sz > 0 );
+            m_bufferOffset += sz;
+            return CommitData();
+        } );
+    }
+
+    // The ring is reused when recording resumes after this connection.
+    recorder->Reset();
+}
+#endif
 
 void Profiler::SendString( uint64_t str, const char* ptr, size_t len, QueueType type )
 {
@@ -3829,6 +4761,27 @@ void Profiler::SendCallstack( int depth, const char* skipBefore )
 #endif
 }
 
+#ifdef TRACY_DEFERRED_ZONES
+void Profiler::FlushDeferredZones( DeferredZoneStack& stack )
+{
+#  ifdef TRACY_ON_DEMAND
+    const auto connectionId = GetProfiler().ConnectionId();
+#  endif
+    for( uint32_t i=stack.emitted; i<stack.depth; i++ )
+    {
+        auto& zone = stack.zones[i];
+#  ifdef TRACY_ON_DEMAND
+        if( zone.connectionId != connectionId ) continue;
+#  endif
+        TracyQueuePrepare( QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, zone.start );
+        MemWrite( &item->zoneBegin.srcloc, (uint64_t)zone.srcloc );
+        TracyQueueCommit( zoneBeginThread );
+    }
+    stack.emitted = stack.depth;
+}
+#endif
+
 void Profiler::CutCallstack( void* callstack, const char* skipBefore )
 {
 #ifdef TRACY_HAS_CALLSTACK
@@ -4032,6 +4985,9 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin( const struct ___tracy_source_l
     ctx.active = active;
 #endif
     if( !ctx.active ) return ctx;
+#ifdef TRACY_DEFERRED_ZONES
+    tracy::Profiler::FlushDeferredZones();
+#endif
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
 
@@ -4060,6 +5016,9 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_callstack( const struct ___trac
     ctx.active = active;
 #endif
     if( !ctx.active ) return ctx;
+#ifdef TRACY_DEFERRED_ZONES
+    tracy::Profiler::FlushDeferredZones();
+#endif
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
 
@@ -4093,6 +5052,9 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc( uint64_t srcloc, int act
         tracy::tracy_free( (void*)srcloc );
         return ctx;
     }
+#ifdef TRACY_DEFERRED_ZONES
+    tracy::Profiler::FlushDeferredZones();
+#endif
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
 
@@ -4125,6 +5087,9 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc_callstack( uint64_t srclo
         tracy::tracy_free( (void*)srcloc );
         return ctx;
     }
+#ifdef TRACY_DEFERRED_ZONES
+    tracy::Profiler::FlushDeferredZones();
+#endif
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
 
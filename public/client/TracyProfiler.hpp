@@ -13,6 +13,9 @@
 #include "TracySysPower.hpp"
 #include "TracySysTime.hpp"
 #include "TracyFastVector.hpp"
+#ifdef TRACY_PER_THREAD_SERIAL
+#  include "TracySerialQueue.hpp"
+#endif
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyAlign.hpp"
 #include "../common/TracyAlloc.hpp"
@@ -39,6 +42,10 @@
 #  include <chrono>
 #endif
 
+#if defined TRACY_FLIGHT_RECORDER && defined TRACY_ON_DEMAND
+#  error "TRACY_FLIGHT_RECORDER cannot be used together with TRACY_ON_DEMAND."
+#endif
+
 #ifndef TracyConcat
 #  define TracyConcat(x,y) TracyConcatIndirect(x,y)
 #endif
@@ -60,7 +67,10 @@ TRACY_API bool IsProfilerStarted();
 class GpuCtx;
 class Profiler;
 class Socket;
+class ListenSocket;
 class UdpBroadcast;
+class FlightRecorder;
+class SharedMemoryRing;
 
 struct GpuCtxWrapper
 {
@@ -68,6 +78,9 @@ struct GpuCtxWrapper
 };
 
 TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken();
+#ifdef TRACY_PER_THREAD_SERIAL
+TRACY_API SerialQueue& GetSerialQueue();
+#endif
 TRACY_API Profiler& GetProfiler();
 TRACY_API int64_t GetInitTime();
 TRACY_API std::atomic<uint32_t>& GetLockCounter();
@@ -112,26 +125,48 @@ struct LuaZoneState
 };
 #endif
 
+#ifdef TRACY_DEFERRED_ZONES
+struct DeferredZone
+{
+    const SourceLocationData* srcloc;
+    int64_t start;
+#  ifdef TRACY_ON_DEMAND
+    uint64_t connectionId;
+#  endif
+};
+
+// Threshold zones which have begun on this thread, innermost last. Their begin
+// events are held back until it is known that they have to be sent. Zones below
+// the 'emitted' index have already been sent, because a nested zone was.
+struct DeferredZoneStack
+{
+    enum { MaxDepth = 64 };
+    DeferredZone zones[MaxDepth];
+    uint32_t depth;
+    uint32_t emitted;
+};
+
+TRACY_API DeferredZoneStack& GetDeferredZones();
+#endif
+
 
 #define TracyLfqPrepare( _type ) \
     moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
     auto __token = GetToken(); \
-    auto& __tail = __token->get_tail_index(); \
     auto item = __token->enqueue_begin( __magic ); \
     MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommit \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __token->enqueue_finish( __magic + 1 );
 
 #define TracyLfqPrepareC( _type ) \
     tracy::moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
     auto __token = tracy::GetToken(); \
-    auto& __tail = __token->get_tail_index(); \
     auto item = __token->enqueue_begin( __magic ); \
     tracy::MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommitC \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __token->enqueue_finish( __magic + 1 );
 
 
 #ifdef TRACY_FIBERS
@@ -154,6 +189,32 @@ struct LuaZoneState
 #  define TracyQueueCommitC( _name ) TracyLfqCommitC
 #endif
 
+// Items queued by the current thread within the scope of a batch are handed over
+// to the profiler thread in groups, instead of one by one. Pending items are
+// published when the batch fills, and when the outermost batch goes out of scope.
+class QueueBatch
+{
+public:
+    QueueBatch( const QueueBatch& ) = delete;
+    QueueBatch( QueueBatch&& ) = delete;
+    QueueBatch& operator=( const QueueBatch& ) = delete;
+    QueueBatch& operator=( QueueBatch&& ) = delete;
+
+    tracy_force_inline QueueBatch()
+        : m_token( GetToken() )
+    {
+        m_token->batch_begin();
+    }
+
+    tracy_force_inline ~QueueBatch()
+    {
+        m_token->batch_end();
+    }
+
+private:
+    moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* m_token;
+};
+
 
 typedef void(*ParameterCallback)( void* data, uint32_t idx, int32_t val );
 typedef char*(*SourceContentsCallback)( void* data, const char* filename, size_t& size );
@@ -257,26 +318,27 @@ public:
         return m_zoneId.fetch_add( 1, std::memory_order_relaxed );
     }
 
+#ifdef TRACY_PER_THREAD_SERIAL
+    SerialQueue* AcquireSerialQueue();
+#endif
+
     static tracy_force_inline QueueItem* QueueSerial()
     {
-        auto& p = GetProfiler();
-        p.m_serialLock.lock();
-        return p.m_serialQueue.prepare_next();
+        SerialBegin();
+        return SerialPrepare();
     }
 
     static tracy_force_inline QueueItem* QueueSerialCallstack( void* ptr )
     {
-        auto& p = GetProfiler();
-        p.m_serialLock.lock();
-        p.SendCallstackSerial( ptr );
-        return p.m_serialQueue.prepare_next();
+        SerialBegin();
+        SendCallstackSerial( ptr );
+        return SerialPrepare();
     }
 
     static tracy_force_inline void QueueSerialFinish()
     {
-        auto& p = GetProfiler();
-        p.m_serialQueue.commit_next();
-        p.m_serialLock.unlock();
+        SerialCommit();
+        SerialEnd();
     }
 
     static tracy_force_inline void SendFrameMark( const char* name )
@@ -492,9 +554,9 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        SerialBegin();
         SendMemAlloc( QueueType::MemAlloc, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        SerialEnd();
     }
 
     static tracy_force_inline void MemFree( const void* ptr, bool secure )
@@ -505,27 +567,26 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        SerialBegin();
         SendMemFree( QueueType::MemFree, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        SerialEnd();
     }
 
     static tracy_force_inline void MemAllocCallstack( const void* ptr, size_t size, int depth, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         auto callstack = Callstack( depth );
 
-        profiler.m_serialLock.lock();
+        SerialBegin();
         SendCallstackSerial( callstack );
         SendMemAlloc( QueueType::MemAllocCallstack, thread, ptr, size );
-        profiler.m_serialLock.unlock();
+        SerialEnd();
 #else
         static_cast<void>(depth); // unused
         MemAlloc( ptr, size, secure );
@@ -541,18 +602,17 @@ public:
             return;
         }
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         auto callstack = Callstack( depth );
 
-        profiler.m_serialLock.lock();
+        SerialBegin();
         SendCallstackSerial( callstack );
         SendMemFree( QueueType::MemFreeCallstack, thread, ptr );
-        profiler.m_serialLock.unlock();
+        SerialEnd();
 #else
         static_cast<void>(depth); // unused
         MemFree( ptr, secure );
@@ -567,10 +627,10 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        SerialBegin();
         SendMemName( name );
         SendMemAlloc( QueueType::MemAllocNamed, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        SerialEnd();
     }
 
     static tracy_force_inline void MemFreeNamed( const void* ptr, bool secure, const char* name )
@@ -581,29 +641,28 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        SerialBegin();
         SendMemName( name );
         SendMemFree( QueueType::MemFreeNamed, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        SerialEnd();
     }
 
     static tracy_force_inline void MemAllocCallstackNamed( const void* ptr, size_t size, int depth, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         auto callstack = Callstack( depth );
 
-        profiler.m_serialLock.lock();
+        SerialBegin();
         SendCallstackSerial( callstack );
         SendMemName( name );
         SendMemAlloc( QueueType::MemAllocCallstackNamed, thread, ptr, size );
-        profiler.m_serialLock.unlock();
+        SerialEnd();
 #else
         static_cast<void>(depth); // unused
         static_cast<void>(name); // unused
@@ -615,19 +674,18 @@ public:
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         auto callstack = Callstack( depth );
 
-        profiler.m_serialLock.lock();
+        SerialBegin();
         SendCallstackSerial( callstack );
         SendMemName( name );
         SendMemFree( QueueType::MemFreeCallstackNamed, thread, ptr );
-        profiler.m_serialLock.unlock();
+        SerialEnd();
 #else
         static_cast<void>(depth); // unused
         static_cast<void>(name); // unused
@@ -710,12 +768,45 @@ public:
         m_programNameLock.unlock();
     }
 
+#ifdef TRACY_DEFERRED_ZONES
+    // Must be called before any zone begins, so that the pending threshold
+    // zones enclosing it are sent first.
+    static tracy_force_inline void FlushDeferredZones()
+    {
+        auto& stack = GetDeferredZones();
+        if( stack.emitted != stack.depth ) FlushDeferredZones( stack );
+    }
+
+    static void FlushDeferredZones( DeferredZoneStack& stack );
+
+    static tracy_force_inline void SetZoneThreshold( int64_t ns )
+    {
+        auto& profiler = GetProfiler();
+        profiler.m_zoneThreshold.store( int64_t( ns / profiler.m_timerMul ), std::memory_order_relaxed );
+    }
+
+    tracy_force_inline int64_t GetZoneThreshold() const
+    {
+        return m_zoneThreshold.load( std::memory_order_relaxed );
+    }
+#endif
+
 #ifdef TRACY_ON_DEMAND
     tracy_force_inline uint64_t ConnectionId() const
     {
         return m_connectionId.load( std::memory_order_acquire );
     }
+#endif
+
+#ifdef TRACY_FLIGHT_RECORDER
+    // Keeps the flight recording from being overwritten until a server collects it.
+    static tracy_force_inline void TriggerFlightRecorder()
+    {
+        GetProfiler().m_flightRecorderTrigger.store( true, std::memory_order_relaxed );
+    }
+#endif
 
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
     tracy_force_inline void DeferItem( const QueueItem& item )
     {
         m_deferredLock.lock();
@@ -800,6 +891,10 @@ private:
     void CompressWorker();
 #endif
 
+    struct WireStream;
+    static void LaunchStreamWorker( void* ptr );
+    void StreamWorker( WireStream& stream );
+
 #ifdef TRACY_HAS_CALLSTACK
     static void LaunchSymbolWorker( void* ptr ) { ((Profiler*)ptr)->SymbolWorker(); }
     void SymbolWorker();
@@ -814,9 +909,22 @@ private:
     DequeueStatus Dequeue( tracy::moodycamel::ConsumerToken& token );
     DequeueStatus DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop );
     DequeueStatus DequeueSerial();
+#ifdef TRACY_PER_THREAD_SERIAL
+    void TakeSerialSpill();
+    void MergeSerialQueues();
+#endif
     ThreadCtxStatus ThreadCtxCheck( uint32_t threadId );
     bool CommitData();
 
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
+    void SendDeferredItems();
+#endif
+#ifdef TRACY_FLIGHT_RECORDER
+    void RecordFlight( tracy::moodycamel::ConsumerToken& token );
+    void BeginFlightSegment();
+    void SendFlightRecording();
+#endif
+
     tracy_force_inline bool AppendData( const void* data, size_t len )
     {
         const auto ret = NeedDataSize( len );
@@ -842,6 +950,17 @@ private:
     }
 
     bool SendData( const char* data, size_t len );
+    void ResetWireSrcLocs();
+    int32_t FindWireSrcLoc( uint64_t srcloc, bool& added );
+    bool AppendZoneCompact( QueueType type, int64_t dt, int32_t srclocIdx );
+    int EncodeFrame( const char* data, size_t len, char* out, void* lz4Stream, void* zstdStream );
+    void ResetEncoder( void* lz4Stream, void*& zstdStream );
+    void AcceptWireStreams( ListenSocket& listen, uint32_t token );
+    bool QueueWireFrame( const char* data, size_t len );
+    void CloseWireStreams();
+    bool CreateSharedMemory( SharedMemoryOfferMessage& offer );
+    void OfferSharedMemory( const SharedMemoryOfferMessage& offer );
+    void DestroySharedMemory();
     void SendLongString( uint64_t ptr, const char* str, size_t len, QueueType type );
     void SendSourceLocation( uint64_t ptr );
     void SendSourceLocationPayload( uint64_t ptr );
@@ -868,13 +987,52 @@ private:
     void CalibrateDelay();
     void ReportTopology();
 
+    // Serial events are written in transactions, which keep items such as a call
+    // stack and the memory event it belongs to together, in the issuing order.
+    static tracy_force_inline void SerialBegin()
+    {
+#ifdef TRACY_PER_THREAD_SERIAL
+        auto& profiler = GetProfiler();
+        GetSerialQueue().Begin( profiler.m_serialSequence, profiler.m_serialSpill );
+#else
+        GetProfiler().m_serialLock.lock();
+#endif
+    }
+
+    static tracy_force_inline QueueItem* SerialPrepare()
+    {
+#ifdef TRACY_PER_THREAD_SERIAL
+        return GetSerialQueue().prepare_next();
+#else
+        return GetProfiler().m_serialQueue.prepare_next();
+#endif
+    }
+
+    static tracy_force_inline void SerialCommit()
+    {
+#ifdef TRACY_PER_THREAD_SERIAL
+        GetSerialQueue().commit_next();
+#else
+        GetProfiler().m_serialQueue.commit_next();
+#endif
+    }
+
+    static tracy_force_inline void SerialEnd()
+    {
+#ifdef TRACY_PER_THREAD_SERIAL
+        GetSerialQueue().End();
+#else
+        GetProfiler().m_serialLock.unlock();
+#endif
+    }
+
     static tracy_force_inline void SendCallstackSerial( void* ptr )
     {
 #ifdef TRACY_HAS_CALLSTACK
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = SerialPrepare();
         MemWrite( &item->hdr.type, QueueType::CallstackSerial );
         MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
-        GetProfiler().m_serialQueue.commit_next();
+        SerialCommit();
 #else
         static_cast<void>(ptr); // unused
 #endif
@@ -884,7 +1042,7 @@ private:
     {
         assert( type == QueueType::MemAlloc || type == QueueType::MemAllocCallstack || type == QueueType::MemAllocNamed || type == QueueType::MemAllocCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = SerialPrepare();
         MemWrite( &item->hdr.type, type );
         MemWrite( &item->memAlloc.time, GetTime() );
         MemWrite( &item->memAlloc.thread, thread );
@@ -900,28 +1058,28 @@ private:
             memcpy( &item->memAlloc.size, &size, 4 );
             memcpy( ((char*)&item->memAlloc.size)+4, ((char*)&size)+4, 2 );
         }
-        GetProfiler().m_serialQueue.commit_next();
+        SerialCommit();
     }
 
     static tracy_force_inline void SendMemFree( QueueType type, const uint32_t thread, const void* ptr )
     {
         assert( type == QueueType::MemFree || type == QueueType::MemFreeCallstack || type == QueueType::MemFreeNamed || type == QueueType::MemFreeCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = SerialPrepare();
         MemWrite( &item->hdr.type, type );
         MemWrite( &item->memFree.time, GetTime() );
         MemWrite( &item->memFree.thread, thread );
         MemWrite( &item->memFree.ptr, (uint64_t)ptr );
-        GetProfiler().m_serialQueue.commit_next();
+        SerialCommit();
     }
 
     static tracy_force_inline void SendMemName( const char* name )
     {
         assert( name );
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = SerialPrepare();
         MemWrite( &item->hdr.type, QueueType::MemNamePayload );
         MemWrite( &item->memName.name, (uint64_t)name );
-        GetProfiler().m_serialQueue.commit_next();
+        SerialCommit();
     }
 
 #if defined _WIN32 && defined TRACY_TIMER_QPC
@@ -937,6 +1095,7 @@ private:
     std::atomic<bool> m_shutdownManual;
     std::atomic<bool> m_shutdownFinished;
     Socket* m_sock;
+    SharedMemoryRing* m_shm;
     UdpBroadcast* m_broadcast;
     bool m_noExit;
     uint32_t m_userPort;
@@ -950,14 +1109,43 @@ private:
     int64_t m_refTimeGpu;
 
     void* m_stream;     // LZ4_stream_t*
+    void* m_zstdStream; // ZSTD_CCtx*, only with TRACY_ZSTD_COMPRESSION
+    uint8_t m_wireCodec;
+    uint8_t m_wireCodecPreference;
+    WireStream* m_wireStreams;
+    uint8_t m_streamCount;
+    uint8_t m_activeStreams;
+    uint8_t m_streamNext;
     char* m_buffer;
     int m_bufferOffset;
     int m_bufferStart;
 
     char* m_lz4Buf;
 
+    // Source locations sent with ZoneBeginIndexed, used by compact zone events.
+    uint64_t* m_wireSrcLocPtr;
+    uint16_t* m_wireSrcLocIdx;
+    uint32_t m_wireSrcLocCount;
+    bool m_compactZones;
+
+#ifdef TRACY_PER_THREAD_SERIAL
+    std::atomic<SerialQueue*> m_serialQueues;
+    std::atomic<uint64_t> m_serialSequence;
+    uint64_t m_serialNext;
+    int64_t m_serialMemTime;
+    // Spilled transactions not merged yet, read from m_serialSpillRead. A head
+    // without a queue refers to these.
+    SerialSpill m_serialSpill;
+    FastVector<QueueItem> m_serialSpillItems;
+    FastVector<uint64_t> m_serialSpillSeqs;
+    uint64_t m_serialSpillRead;
+    struct SerialHead { uint64_t seq; SerialQueue* queue; uint64_t pos; uint64_t end; };
+    FastVector<SerialHead> m_serialHeads;
+    FastVector<QueueItem> m_serialDequeue;
+#else
     FastVector<QueueItem> m_serialQueue, m_serialDequeue;
     TracyMutex m_serialLock;
+#endif
 
 #ifndef TRACY_NO_FRAME_IMAGE
     FastVector<FrameImageQueueItem> m_fiQueue, m_fiDequeue;
@@ -968,12 +1156,22 @@ private:
 
     std::atomic<uint64_t> m_frameCount;
     std::atomic<bool> m_isConnected;
+#ifdef TRACY_DEFERRED_ZONES
+    std::atomic<int64_t> m_zoneThreshold;
+#endif
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint64_t> m_connectionId;
-
+#endif
+#if defined TRACY_ON_DEMAND || defined TRACY_FLIGHT_RECORDER
     TracyMutex m_deferredLock;
     FastVector<QueueItem> m_deferredQueue;
 #endif
+#ifdef TRACY_FLIGHT_RECORDER
+    FlightRecorder* m_flightRecorder;
+    bool m_flightRecording;
+    std::atomic<bool> m_flightRecorderTrigger;
+    int64_t m_flightRecorderHold;
+#endif
 
 #ifdef TRACY_HAS_SYSTIME
     void ProcessSysTime();
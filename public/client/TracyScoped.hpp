@@ -32,6 +32,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_DEFERRED_ZONES
+        Profiler::FlushDeferredZones();
 #endif
         TracyQueuePrepare( QueueType::ZoneBegin );
         MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
@@ -49,6 +52,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_DEFERRED_ZONES
+        Profiler::FlushDeferredZones();
 #endif
         GetProfiler().SendCallstack( depth );
 
@@ -68,6 +74,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_DEFERRED_ZONES
+        Profiler::FlushDeferredZones();
 #endif
         TracyQueuePrepare( QueueType::ZoneBeginAllocSrcLoc );
         const auto srcloc = Profiler::AllocSourceLocation( line, source, sourceSz, function, functionSz, name, nameSz );
@@ -86,6 +95,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_DEFERRED_ZONES
+        Profiler::FlushDeferredZones();
 #endif
         GetProfiler().SendCallstack( depth );
 
@@ -219,6 +231,167 @@ private:
 #endif
 };
 
+#ifdef TRACY_DEFERRED_ZONES
+// Zone which is only sent if it lasts at least as long as the threshold, given
+// in nanoseconds. A negative threshold selects the global one. A zone which is
+// too short leaves no trace, and its time remains in the parent's self time.
+class ThresholdZone
+{
+public:
+    ThresholdZone( const ThresholdZone& ) = delete;
+    ThresholdZone( ThresholdZone&& ) = delete;
+    ThresholdZone& operator=( const ThresholdZone& ) = delete;
+    ThresholdZone& operator=( ThresholdZone&& ) = delete;
+
+    tracy_force_inline ThresholdZone( const SourceLocationData* srcloc, int64_t threshold, bool is_active = true )
+#ifdef TRACY_ON_DEMAND
+        : m_active( is_active && GetProfiler().IsConnected() )
+#else
+        : m_active( is_active )
+#endif
+        , m_threshold( threshold )
+    {
+        if( !m_active ) return;
+        auto& stack = GetDeferredZones();
+        if( stack.depth == DeferredZoneStack::MaxDepth )
+        {
+            m_active = false;
+            return;
+        }
+        auto& zone = stack.zones[stack.depth++];
+        zone.srcloc = srcloc;
+#ifdef TRACY_ON_DEMAND
+        m_connectionId = GetProfiler().ConnectionId();
+        zone.connectionId = m_connectionId;
+#endif
+        zone.start = Profiler::GetTime();
+    }
+
+    tracy_force_inline ~ThresholdZone()
+    {
+        if( !m_active ) return;
+        const auto end = Profiler::GetTime();
+        auto& stack = GetDeferredZones();
+        const auto idx = --stack.depth;
+#ifdef TRACY_ON_DEMAND
+        if( GetProfiler().ConnectionId() != m_connectionId )
+        {
+            if( stack.emitted > idx ) stack.emitted = idx;
+            return;
+        }
+#endif
+        if( stack.emitted <= idx )
+        {
+            const auto& profiler = GetProfiler();
+            const auto duration = end - stack.zones[idx].start;
+            if( m_threshold >= 0 )
+            {
+                if( duration * profiler.m_timerMul < m_threshold ) return;
+            }
+            else
+            {
+                if( duration < profiler.GetZoneThreshold() ) return;
+            }
+            stack.depth++;
+            Profiler::FlushDeferredZones( stack );
+            stack.depth--;
+        }
+        stack.emitted = idx;
+
+        TracyQueuePrepare( QueueType::ZoneEnd );
+        MemWrite( &item->zoneEnd.time, end );
+        TracyQueueCommit( zoneEndThread );
+    }
+
+private:
+    bool m_active;
+    int64_t m_threshold;
+
+#ifdef TRACY_ON_DEMAND
+    uint64_t m_connectionId = 0;
+#endif
+};
+#endif
+
+// Per call site and per thread state of a sampled zone. Only every Nth instance
+// is sent as a full zone. The number and the total time of the skipped instances
+// are accumulated and reported just before the next kept instance begins.
+struct ZoneSampler
+{
+    uint32_t every;
+    uint32_t counter;
+    uint32_t dropped;
+    int64_t droppedTime;
+#ifdef TRACY_ON_DEMAND
+    uint64_t connectionId;
+#endif
+};
+
+class SampledZone : public ScopedZone
+{
+    enum class SampleResult
+    {
+        Inactive,
+        Dropped,
+        Kept
+    };
+
+public:
+    tracy_force_inline SampledZone( const SourceLocationData* srcloc, ZoneSampler& sampler, bool is_active = true )
+        : SampledZone( srcloc, sampler, Sample( srcloc, sampler, is_active ) )
+    {
+    }
+
+    tracy_force_inline ~SampledZone()
+    {
+        if( !m_sampler ) return;
+        m_sampler->dropped++;
+        m_sampler->droppedTime += Profiler::GetTime() - m_start;
+    }
+
+private:
+    tracy_force_inline SampledZone( const SourceLocationData* srcloc, ZoneSampler& sampler, SampleResult res )
+        : ScopedZone( srcloc, res == SampleResult::Kept )
+        , m_sampler( res == SampleResult::Dropped ? &sampler : nullptr )
+        , m_start( res == SampleResult::Dropped ? Profiler::GetTime() : 0 )
+    {
+    }
+
+    static tracy_force_inline SampleResult Sample( const SourceLocationData* srcloc, ZoneSampler& sampler, bool is_active )
+    {
+        if( !is_active ) return SampleResult::Inactive;
+#ifdef TRACY_ON_DEMAND
+        if( !GetProfiler().IsConnected() ) return SampleResult::Inactive;
+        const auto connectionId = GetProfiler().ConnectionId();
+        if( sampler.connectionId != connectionId )
+        {
+            sampler.connectionId = connectionId;
+            sampler.counter = 0;
+            sampler.dropped = 0;
+            sampler.droppedTime = 0;
+        }
+#endif
+        const auto keep = sampler.counter == 0;
+        if( ++sampler.counter >= sampler.every ) sampler.counter = 0;
+        if( !keep ) return SampleResult::Dropped;
+
+        if( sampler.dropped != 0 )
+        {
+            TracyQueuePrepare( QueueType::ZoneDropped );
+            MemWrite( &item->zoneDropped.srcloc, (uint64_t)srcloc );
+            MemWrite( &item->zoneDropped.count, sampler.dropped );
+            MemWrite( &item->zoneDropped.time, sampler.droppedTime );
+            TracyQueueCommit( zoneDroppedThread );
+            sampler.dropped = 0;
+            sampler.droppedTime = 0;
+        }
+        return SampleResult::Kept;
+    }
+
+    ZoneSampler* m_sampler;
+    int64_t m_start;
+};
+
 }
 
 #endif
@@ -0,0 +1,138 @@
+#ifndef __TRACYSERIALQUEUE_HPP__
+#define __TRACYSERIALQUEUE_HPP__
+
+#include <atomic>
+#include <stdint.h>
+
+#include "TracyFastVector.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "../common/TracyMutex.hpp"
+#include "../common/TracyQueue.hpp"
+
+namespace tracy
+{
+
+// Shared overflow for transactions which don't fit in the ring of their
+// thread. Nothing drains the rings before a server connects, so waiting for
+// free space could block the program indefinitely. Sequence numbers are taken
+// under the lock, which keeps the items in sequence order.
+struct SerialSpill
+{
+    SerialSpill() : items( 1024 ), seqs( 1024 ) {}
+
+    TracyMutex lock;
+    FastVector<QueueItem> items;
+    FastVector<uint64_t> seqs;
+};
+
+// Single producer, single consumer ring of serial queue items, owned by one
+// thread at a time. Items written between Begin() and End() form a transaction,
+// which is stamped with a global sequence number. The profiler thread merges
+// all rings by sequence, restoring the order in which transactions were issued.
+// A transaction which doesn't fit in the ring goes to the spill instead.
+class SerialQueue
+{
+public:
+    enum { Size = 8 * 1024 };
+    enum { Mask = Size - 1 };
+    enum { MaxTransaction = 4 };
+
+    SerialQueue()
+        : m_pos( 0 )
+        , m_seq( 0 )
+        , m_spill( nullptr )
+        , m_read( 0 )
+        , m_write( 0 )
+        , m_next( nullptr )
+        , m_released( false )
+    {
+    }
+
+    SerialQueue( const SerialQueue& ) = delete;
+    SerialQueue( SerialQueue&& ) = delete;
+
+    SerialQueue& operator=( const SerialQueue& ) = delete;
+    SerialQueue& operator=( SerialQueue&& ) = delete;
+
+    tracy_force_inline void Begin( std::atomic<uint64_t>& sequence, SerialSpill& spill )
+    {
+        if( m_pos - m_read.load( std::memory_order_acquire ) > Size - MaxTransaction )
+        {
+            spill.lock.lock();
+            m_spill = &spill;
+        }
+        m_seq = sequence.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    tracy_force_inline QueueItem* prepare_next()
+    {
+        if( m_spill ) return m_spill->items.prepare_next();
+        const auto idx = m_pos & Mask;
+        m_seqs[idx] = m_seq;
+        return m_items + idx;
+    }
+
+    tracy_force_inline void commit_next()
+    {
+        if( m_spill )
+        {
+            m_spill->items.commit_next();
+            *m_spill->seqs.push_next() = m_seq;
+            return;
+        }
+        m_pos++;
+    }
+
+    tracy_force_inline void End()
+    {
+        if( m_spill )
+        {
+            m_spill->lock.unlock();
+            m_spill = nullptr;
+            return;
+        }
+        m_write.store( m_pos, std::memory_order_release );
+    }
+
+    // Consumer side, only to be used by the profiler thread.
+    tracy_force_inline uint64_t ReadPos() const { return m_read.load( std::memory_order_relaxed ); }
+    tracy_force_inline uint64_t WritePos() const { return m_write.load( std::memory_order_acquire ); }
+    tracy_force_inline uint64_t Sequence( uint64_t pos ) const { return m_seqs[pos & Mask]; }
+    tracy_force_inline QueueItem* Item( uint64_t pos ) { return m_items + ( pos & Mask ); }
+    tracy_force_inline void Consume( uint64_t pos ) { m_read.store( pos, std::memory_order_release ); }
+
+    tracy_force_inline SerialQueue* Next() const { return m_next; }
+    tracy_force_inline void SetNext( SerialQueue* next ) { m_next = next; }
+
+    // Rings are never freed. A ring released by an exiting thread is handed
+    // over to a new thread once the profiler thread has drained it.
+    tracy_force_inline void Release() { m_released.store( true, std::memory_order_release ); }
+    tracy_force_inline bool TryAcquire()
+    {
+        if( !m_released.load( std::memory_order_acquire ) ) return false;
+        if( m_read.load( std::memory_order_acquire ) != m_pos ) return false;
+        bool expected = true;
+        return m_released.compare_exchange_strong( expected, false, std::memory_order_acq_rel );
+    }
+
+private:
+    QueueItem m_items[Size];
+    uint64_t m_seqs[Size];
+
+    // Producer and consumer positions are kept on separate cache lines.
+    uint64_t m_pos;
+    uint64_t m_seq;
+    SerialSpill* m_spill;
+    char m_pad0[64];
+    std::atomic<uint64_t> m_read;
+    char m_pad1[64];
+    std::atomic<uint64_t> m_write;
+    char m_pad2[64];
+    SerialQueue* m_next;
+    std::atomic<bool> m_released;
+};
+
+}
+
+#endif
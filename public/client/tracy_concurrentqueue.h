@@ -942,7 +942,12 @@ private:
 			pr_blockIndexSize(EXPLICIT_INITIAL_INDEX_SIZE >> 1),
 			pr_blockIndexFront(0),
 			pr_blockIndexEntries(nullptr),
-			pr_blockIndexRaw(nullptr)
+			pr_blockIndexRaw(nullptr),
+			pr_tailIndex(0),
+			pr_publishIndex(&this->tailIndex),
+			pr_batchTailIndex(0),
+			pr_boundaryMask(static_cast<index_t>(BLOCK_SIZE - 1)),
+			pr_batchDepth(0)
 		{
 			size_t poolBasedIndexSize = details::ceil_to_pow_2(_parent->initialBlockPoolSize) >> 1;
 			if (poolBasedIndexSize > pr_blockIndexSize) {
@@ -1062,18 +1067,46 @@ private:
             pr_blockIndexFront = (pr_blockIndexFront + 1) & (pr_blockIndexSize - 1);
         }
 
+        // The slow path is taken at block boundaries, and while batching also
+        // every MAX_BATCH_SIZE elements, to publish the pending ones. Outside
+        // of a batch enqueue_begin() and enqueue_finish() don't check for it.
         tracy_force_inline T* enqueue_begin(index_t& currentTailIndex)
         {
-            currentTailIndex = this->tailIndex.load(std::memory_order_relaxed);
-            if (details::cqUnlikely((currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0)) {
-                this->enqueue_begin_alloc(currentTailIndex);
+            currentTailIndex = pr_tailIndex;
+            if (details::cqUnlikely((currentTailIndex & pr_boundaryMask) == 0)) {
+                if (pr_batchDepth != 0) {
+                    this->tailIndex.store(currentTailIndex, std::memory_order_release);
+                }
+                if ((currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0) {
+                    this->enqueue_begin_alloc(currentTailIndex);
+                }
             }
             return (*this->tailBlock)[currentTailIndex];
         }
 
-        tracy_force_inline std::atomic<index_t>& get_tail_index()
+        // Inside of a batch the new tail is written to pr_batchTailIndex, which
+        // the consumer never reads.
+        tracy_force_inline void enqueue_finish(index_t nextTailIndex)
+        {
+            pr_tailIndex = nextTailIndex;
+            pr_publishIndex->store(nextTailIndex, std::memory_order_release);
+        }
+
+        tracy_force_inline void batch_begin()
         {
-            return this->tailIndex;
+            if (pr_batchDepth++ == 0) {
+                pr_publishIndex = &pr_batchTailIndex;
+                pr_boundaryMask = static_cast<index_t>(MAX_BATCH_SIZE - 1);
+            }
+        }
+
+        tracy_force_inline void batch_end()
+        {
+            if (--pr_batchDepth == 0) {
+                pr_publishIndex = &this->tailIndex;
+                pr_boundaryMask = static_cast<index_t>(BLOCK_SIZE - 1);
+                this->tailIndex.store(pr_tailIndex, std::memory_order_release);
+            }
         }
 
 		template<class NotifyThread, class ProcessData>
@@ -1203,6 +1236,14 @@ private:
 		size_t pr_blockIndexFront;		// Next slot (not current)
 		BlockIndexEntry* pr_blockIndexEntries;
 		void* pr_blockIndexRaw;
+
+		static const index_t MAX_BATCH_SIZE = 64;
+		static_assert(BLOCK_SIZE % MAX_BATCH_SIZE == 0, "Batches must not straddle blocks");
+		index_t pr_tailIndex;			// Next slot, may be ahead of tailIndex while batching
+		std::atomic<index_t>* pr_publishIndex;	// tailIndex, or pr_batchTailIndex while batching
+		std::atomic<index_t> pr_batchTailIndex;
+		index_t pr_boundaryMask;
+		uint32_t pr_batchDepth;
 	};
 
     ExplicitProducer* get_explicit_producer(producer_token_t const& token)
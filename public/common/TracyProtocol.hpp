@@ -9,7 +9,7 @@ namespace tracy
 
 constexpr unsigned Lz4CompressBound( unsigned isize ) { return isize + ( isize / 255 ) + 16; }
 
-enum : uint32_t { ProtocolVersion = 66 };
+enum : uint32_t { ProtocolVersion = 72 };
 enum : uint16_t { BroadcastVersion = 3 };
 
 using lz4sz_t = uint32_t;
@@ -31,6 +31,27 @@ enum HandshakeStatus : uint8_t
     HandshakeDropped
 };
 
+// Compression of the data frames sent by the client. After the protocol version,
+// the server sends the codec it would like to receive (WireCodecAny if it has no
+// preference). The client announces the codec it uses in the welcome message.
+enum WireCodec : uint8_t
+{
+    WireCodecLz4,
+    WireCodecZstd,
+    WireCodecNone,
+    NumWireCodecs,
+    WireCodecAny = 0xFF
+};
+
+// Frames may be spread over several connections, so that each one has its own
+// compressor. Frame n is sent on connection n % streams. After the shared memory
+// offer (which, if accepted, limits the client to a single stream), the server
+// opens the additional connections, each starting with the stream shibboleth and
+// a StreamMessage.
+enum { MaxWireStreams = 16 };
+enum { StreamShibbolethSize = 8 };
+static const char StreamShibboleth[StreamShibbolethSize] = { 'T', 'r', 'a', 'c', 'y', 'S', 't', 'r' };
+
 enum { WelcomeMessageProgramNameSize = 64 };
 enum { WelcomeMessageHostInfoSize = 1024 };
 
@@ -87,6 +108,8 @@ struct WelcomeFlag
         CodeTransfer    = 1 << 2,
         CombineSamples  = 1 << 3,
         IdentifySamples = 1 << 4,
+        FlightRecorder  = 1 << 5,
+        SharedMemory    = 1 << 6,
     };
 };
 
@@ -103,6 +126,9 @@ struct WelcomeMessage
     int64_t samplingPeriod;
     uint8_t flags;
     uint8_t cpuArch;
+    uint8_t wireCodec;
+    uint8_t streams;
+    uint32_t streamToken;
     char cpuManufacturer[12];
     uint32_t cpuId;
     char programName[WelcomeMessageProgramNameSize];
@@ -116,11 +142,43 @@ struct OnDemandPayloadMessage
 {
     uint64_t frames;
     uint64_t currentTime;
+    int64_t refTimeSerial;
+    int64_t refTimeCtx;
+    int64_t refTimeGpu;
 };
 
 enum { OnDemandPayloadMessageSize = sizeof( OnDemandPayloadMessage ) };
 
 
+// Sent after the welcome message if WelcomeFlag::SharedMemory is set. The server
+// answers with SharedMemoryStatus. If the offer is accepted, all further client
+// data is passed through the shared memory ring, uncompressed.
+enum { SharedMemoryNameSize = 32 };
+
+struct SharedMemoryOfferMessage
+{
+    uint64_t nonce;
+    char name[SharedMemoryNameSize];
+};
+
+enum { SharedMemoryOfferMessageSize = sizeof( SharedMemoryOfferMessage ) };
+
+enum SharedMemoryStatus : uint8_t
+{
+    SharedMemoryRejected,
+    SharedMemoryAccepted
+};
+
+
+struct StreamMessage
+{
+    uint32_t token;
+    uint8_t index;
+};
+
+enum { StreamMessageSize = sizeof( StreamMessage ) };
+
+
 struct BroadcastMessage
 {
     uint16_t broadcastVersion;
@@ -76,6 +76,7 @@ enum class QueueType : uint8_t
     ZoneValidation,
     ZoneColor,
     ZoneValue,
+    ZoneDropped,
     FrameMarkMsg,
     FrameMarkMsgStart,
     FrameMarkMsgEnd,
@@ -105,6 +106,9 @@ enum class QueueType : uint8_t
     AckSourceCodeNotAvailable,
     AckSymbolCodeNotAvailable,
     CpuTopology,
+    ZoneBeginIndexed,
+    ZoneBeginCompact,
+    ZoneEndCompact,
     SingleStringData,
     SecondStringData,
     MemNamePayload,
@@ -188,6 +192,18 @@ struct QueueZoneValueThread : public QueueZoneValue
     uint32_t thread;
 };
 
+struct QueueZoneDropped
+{
+    uint64_t srcloc;    // ptr
+    uint32_t count;
+    int64_t time;
+};
+
+struct QueueZoneDroppedThread : public QueueZoneDropped
+{
+    uint32_t thread;
+};
+
 struct QueueStringTransfer
 {
     uint64_t ptr;
@@ -691,6 +707,8 @@ struct QueueItem
         QueueZoneColorThread zoneColorThread;
         QueueZoneValue zoneValue;
         QueueZoneValueThread zoneValueThread;
+        QueueZoneDropped zoneDropped;
+        QueueZoneDroppedThread zoneDroppedThread;
         QueueStringTransfer stringTransfer;
         QueueFrameMark frameMark;
         QueueFrameVsync frameVsync;
@@ -837,6 +855,7 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueZoneValidation ),
     sizeof( QueueHeader ) + sizeof( QueueZoneColor ),
     sizeof( QueueHeader ) + sizeof( QueueZoneValue ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneDropped ),
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // continuous frames
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // start
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // end
@@ -866,6 +885,9 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueSourceCodeNotAvailable ),
     sizeof( QueueHeader ),                                  // symbol code not available
     sizeof( QueueHeader ) + sizeof( QueueCpuTopology ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // indexed source location
+    sizeof( QueueHeader ),                                  // compact zone begin, variable size
+    sizeof( QueueHeader ),                                  // compact zone end, variable size
     sizeof( QueueHeader ),                                  // single string data
     sizeof( QueueHeader ),                                  // second string data
     sizeof( QueueHeader ) + sizeof( QueueMemNamePayload ),
@@ -885,6 +907,43 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // fiber name
 };
 
+// Compact zone events are produced only when the data is sent. ZoneBeginIndexed
+// is a ZoneBegin which gives its source location the next index in a table that
+// is kept for the whole connection. ZoneBeginCompact is followed by the time
+// delta and the source location index, ZoneEndCompact by the time delta only.
+// Time deltas are zigzag encoded, then both values are stored as varints.
+enum { ZoneCompactMaxSize = sizeof( QueueHeader ) + 10 + 5 };
+
+static inline uint64_t ZigZagEncode( int64_t v ) { return ( uint64_t( v ) << 1 ) ^ uint64_t( v >> 63 ); }
+static inline int64_t ZigZagDecode( uint64_t v ) { return int64_t( v >> 1 ) ^ -int64_t( v & 1 ); }
+
+static inline char* WriteVarInt( char* dst, uint64_t v )
+{
+    while( v >= 0x80 )
+    {
+        *dst++ = char( v | 0x80 );
+        v >>= 7;
+    }
+    *dst++ = char( v );
+    return dst;
+}
+
+static inline const char* ReadVarInt( const char* src, uint64_t& v )
+{
+    uint64_t ret = 0;
+    int shift = 0;
+    uint8_t b;
+    do
+    {
+        b = uint8_t( *src++ );
+        ret |= uint64_t( b & 0x7F ) << shift;
+        shift += 7;
+    }
+    while( b & 0x80 );
+    v = ret;
+    return src;
+}
+
 static_assert( QueueItemSize == 32, "Queue item size not 32 bytes" );
 static_assert( sizeof( QueueDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::NUM_TYPES, "QueueDataSize mismatch" );
 static_assert( sizeof( void* ) <= sizeof( uint64_t ), "Pointer size > 8 bytes" );
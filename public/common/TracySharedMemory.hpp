@@ -0,0 +1,232 @@
+#ifndef __TRACYSHAREDMEMORY_HPP__
+#define __TRACYSHAREDMEMORY_HPP__
+
+#if !defined TRACY_NO_SHARED_MEMORY && ( ( defined __linux__ && !defined __ANDROID__ ) || defined __APPLE__ )
+#  define TRACY_HAS_SHARED_MEMORY
+#endif
+
+#ifdef TRACY_HAS_SHARED_MEMORY
+
+#include <assert.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TracyProtocol.hpp"
+
+namespace tracy
+{
+
+// Single producer, single consumer byte ring placed in a named shared memory
+// object. It carries the same frames as the network connection, without the LZ4
+// compression. Each frame is stored contiguously, prefixed by its size, so the
+// server can process it directly in the mapped memory. A zero size (or a tail too
+// small to hold one) marks a jump to the ring start.
+class SharedMemoryRing
+{
+    enum : uint64_t { Magic = 0x6873796361725473 };
+
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t nonce;
+        uint64_t size;
+        std::atomic<uint32_t> serverPid;
+        std::atomic<uint32_t> detached;
+        alignas( 64 ) std::atomic<uint64_t> write;
+        alignas( 64 ) std::atomic<uint64_t> read;
+    };
+
+public:
+    SharedMemoryRing()
+        : m_header( nullptr )
+        , m_data( nullptr )
+        , m_size( 0 )
+        , m_mapSize( 0 )
+        , m_pos( 0 )
+        , m_corrupt( false )
+    {
+    }
+
+    ~SharedMemoryRing()
+    {
+        if( m_header ) munmap( m_header, m_mapSize );
+    }
+
+    SharedMemoryRing( const SharedMemoryRing& ) = delete;
+    SharedMemoryRing& operator=( const SharedMemoryRing& ) = delete;
+
+    // Client side. The name should be unlinked once the server has answered the offer.
+    bool Create( const char* name, uint64_t nonce, size_t size )
+    {
+        assert( !m_header );
+        assert( size >= TargetFrameSize * 2 );
+        const int fd = shm_open( name, O_CREAT | O_EXCL | O_RDWR, 0600 );
+        if( fd < 0 ) return false;
+        const auto mapSize = sizeof( Header ) + size;
+        if( ftruncate( fd, off_t( mapSize ) ) != 0 )
+        {
+            close( fd );
+            shm_unlink( name );
+            return false;
+        }
+        auto ptr = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if( ptr == MAP_FAILED )
+        {
+            shm_unlink( name );
+            return false;
+        }
+        m_header = new( ptr ) Header();
+        m_header->nonce = nonce;
+        m_header->size = size;
+        m_header->serverPid.store( 0, std::memory_order_relaxed );
+        m_header->detached.store( 0, std::memory_order_relaxed );
+        m_header->write.store( 0, std::memory_order_relaxed );
+        m_header->read.store( 0, std::memory_order_relaxed );
+        m_header->magic = Magic;
+        m_data = (char*)ptr + sizeof( Header );
+        m_size = size;
+        m_mapSize = mapSize;
+        return true;
+    }
+
+    static void Unlink( const char* name )
+    {
+        shm_unlink( name );
+    }
+
+    // Server side. Fails if the object is not there (the client runs on another
+    // host), or if it does not belong to the connected client.
+    bool Open( const char* name, uint64_t nonce )
+    {
+        assert( !m_header );
+        const int fd = shm_open( name, O_RDWR, 0 );
+        if( fd < 0 ) return false;
+        struct stat st;
+        if( fstat( fd, &st ) != 0 || size_t( st.st_size ) < sizeof( Header ) + TargetFrameSize * 2 )
+        {
+            close( fd );
+            return false;
+        }
+        const auto mapSize = size_t( st.st_size );
+        auto ptr = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+        if( ptr == MAP_FAILED ) return false;
+        auto header = (Header*)ptr;
+        if( header->magic != Magic || header->nonce != nonce || header->size > mapSize - sizeof( Header ) || header->size < TargetFrameSize * 2 )
+        {
+            munmap( ptr, mapSize );
+            return false;
+        }
+        header->serverPid.store( uint32_t( getpid() ), std::memory_order_relaxed );
+        m_header = header;
+        m_data = (char*)ptr + sizeof( Header );
+        m_size = header->size;
+        m_mapSize = mapSize;
+        return true;
+    }
+
+    const char* Data() const { return m_data; }
+    uint64_t Size() const { return m_size; }
+
+    // Client side. Returns false if there is not enough free space at the moment.
+    bool Write( const char* data, uint32_t len )
+    {
+        assert( len != 0 );
+        const uint64_t need = sizeof( len ) + len;
+        const auto tail = m_size - m_pos % m_size;
+        const auto pad = tail < need ? tail : 0;
+        if( m_pos + pad + need - m_header->read.load( std::memory_order_acquire ) > m_size ) return false;
+        if( pad != 0 )
+        {
+            if( pad >= sizeof( len ) ) memset( m_data + m_pos % m_size, 0, sizeof( len ) );
+            m_pos += pad;
+        }
+        const auto offset = m_pos % m_size;
+        memcpy( m_data + offset, &len, sizeof( len ) );
+        memcpy( m_data + offset + sizeof( len ), data, len );
+        m_pos += need;
+        m_header->write.store( m_pos, std::memory_order_release );
+        return true;
+    }
+
+    // Client side. The server is gone if it has detached, or if its process no
+    // longer exists (it has crashed while the client was waiting for space).
+    bool IsServerGone() const
+    {
+        if( m_header->detached.load( std::memory_order_acquire ) != 0 ) return true;
+        const auto pid = m_header->serverPid.load( std::memory_order_relaxed );
+        return pid != 0 && kill( pid_t( pid ), 0 ) != 0 && errno == ESRCH;
+    }
+
+    // Server side. Returns the next frame, or nullptr if the client has not
+    // written one yet. The frame stays valid until Release() is called with end,
+    // or with a later position. The ring is shared with another process, so its
+    // contents are not trusted: a frame that doesn't fit the ring or the written
+    // data makes Read() return nullptr from then on, and IsCorrupt() true.
+    const char* Read( uint32_t& len, uint64_t& end )
+    {
+        if( m_corrupt ) return nullptr;
+        const auto write = m_header->write.load( std::memory_order_acquire );
+        if( write - m_pos > m_size )
+        {
+            m_corrupt = true;
+            return nullptr;
+        }
+        while( m_pos != write )
+        {
+            const auto offset = m_pos % m_size;
+            const auto tail = m_size - offset;
+            const auto avail = write - m_pos;
+            uint32_t sz = 0;
+            if( tail >= sizeof( sz ) && avail >= sizeof( sz ) ) memcpy( &sz, m_data + offset, sizeof( sz ) );
+            if( sz == 0 )
+            {
+                if( tail > avail ) break;
+                m_pos += tail;
+                continue;
+            }
+            if( sz > tail - sizeof( sz ) || sz > avail - sizeof( sz ) || sz > TargetFrameSize ) break;
+            len = sz;
+            m_pos += sizeof( sz ) + sz;
+            end = m_pos;
+            return m_data + offset + sizeof( sz );
+        }
+        if( m_pos != write ) m_corrupt = true;
+        return nullptr;
+    }
+
+    bool IsCorrupt() const { return m_corrupt; }
+
+    void Release( uint64_t end )
+    {
+        m_header->read.store( end, std::memory_order_release );
+    }
+
+    void Detach()
+    {
+        m_header->detached.store( 1, std::memory_order_release );
+    }
+
+private:
+    Header* m_header;
+    char* m_data;
+    uint64_t m_size;
+    size_t m_mapSize;
+    uint64_t m_pos;
+    bool m_corrupt;
+};
+
+}
+
+#endif
+
+#endif
@@ -33,6 +33,19 @@
 #define ZoneScopedC(x)
 #define ZoneScopedNC(x,y)
 
+#define ZoneNamedSampled(x,y,z)
+#define ZoneNamedNSampled(x,y,z,w)
+#define ZoneScopedSampled(x)
+#define ZoneScopedNSampled(x,y)
+
+#define ZoneNamedThreshold(x,y,z)
+#define ZoneNamedNThreshold(x,y,z,w)
+#define ZoneScopedThreshold(x)
+#define ZoneScopedNThreshold(x,y)
+#define TracyZoneThreshold(x)
+
+#define TracyQueueBatch
+
 #define ZoneText(x,y)
 #define ZoneTextV(x,y,z)
 #define ZoneTextF(x,...)
@@ -117,6 +130,7 @@
 #define TracyIsConnected false
 #define TracyIsStarted false
 #define TracySetProgramName(x)
+#define TracyFlightRecorderTrigger
 
 #define TracyFiberEnter(x)
 #define TracyFiberLeave
@@ -154,6 +168,25 @@
 #define ZoneScopedC( color ) ZoneNamedC( ___tracy_scoped_zone, color, true )
 #define ZoneScopedNC( name, color ) ZoneNamedNC( ___tracy_scoped_zone, name, color, true )
 
+#define ZoneNamedSampled( varname, every, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { nullptr, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 }; static thread_local tracy::ZoneSampler TracyConcat(__tracy_zone_sampler,TracyLine) { (uint32_t)(every) }; tracy::SampledZone varname( &TracyConcat(__tracy_source_location,TracyLine), TracyConcat(__tracy_zone_sampler,TracyLine), active )
+#define ZoneNamedNSampled( varname, name, every, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { name, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 }; static thread_local tracy::ZoneSampler TracyConcat(__tracy_zone_sampler,TracyLine) { (uint32_t)(every) }; tracy::SampledZone varname( &TracyConcat(__tracy_source_location,TracyLine), TracyConcat(__tracy_zone_sampler,TracyLine), active )
+#define ZoneScopedSampled( every ) ZoneNamedSampled( ___tracy_scoped_zone, every, true )
+#define ZoneScopedNSampled( name, every ) ZoneNamedNSampled( ___tracy_scoped_zone, name, every, true )
+
+#ifdef TRACY_DEFERRED_ZONES
+#  define ZoneNamedThreshold( varname, threshold, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { nullptr, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 }; tracy::ThresholdZone varname( &TracyConcat(__tracy_source_location,TracyLine), threshold, active )
+#  define ZoneNamedNThreshold( varname, name, threshold, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { name, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 }; tracy::ThresholdZone varname( &TracyConcat(__tracy_source_location,TracyLine), threshold, active )
+#  define TracyZoneThreshold( ns ) tracy::Profiler::SetZoneThreshold( ns )
+#else
+#  define ZoneNamedThreshold( varname, threshold, active ) ZoneNamed( varname, active )
+#  define ZoneNamedNThreshold( varname, name, threshold, active ) ZoneNamedN( varname, name, active )
+#  define TracyZoneThreshold( ns )
+#endif
+#define ZoneScopedThreshold( threshold ) ZoneNamedThreshold( ___tracy_scoped_zone, threshold, true )
+#define ZoneScopedNThreshold( name, threshold ) ZoneNamedNThreshold( ___tracy_scoped_zone, name, threshold, true )
+
+#define TracyQueueBatch tracy::QueueBatch TracyConcat(__tracy_queue_batch,TracyLine)
+
 #define ZoneText( txt, size ) ___tracy_scoped_zone.Text( txt, size )
 #define ZoneTextV( varname, txt, size ) varname.Text( txt, size )
 #define ZoneTextF( fmt, ... ) ___tracy_scoped_zone.TextFmt( fmt, ##__VA_ARGS__ )
@@ -286,6 +319,12 @@
 #define TracyIsConnected tracy::GetProfiler().IsConnected()
 #define TracySetProgramName( name ) tracy::GetProfiler().SetProgramName( name );
 
+#ifdef TRACY_FLIGHT_RECORDER
+#  define TracyFlightRecorderTrigger tracy::Profiler::TriggerFlightRecorder()
+#else
+#  define TracyFlightRecorderTrigger
+#endif
+
 #ifdef TRACY_FIBERS
 #  define TracyFiberEnter( fiber ) tracy::Profiler::EnterFiber( fiber )
 #  define TracyFiberLeave tracy::Profiler::LeaveFiber()
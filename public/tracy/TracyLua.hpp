@@ -197,6 +197,10 @@ static inline int LuaZoneBeginS( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+#ifdef TRACY_DEFERRED_ZONES
+    Profiler::FlushDeferredZones();
+#endif
+
 #ifdef TRACY_CALLSTACK
     const uint32_t depth = TRACY_CALLSTACK;
 #else
@@ -226,6 +230,10 @@ static inline int LuaZoneBeginNS( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+#ifdef TRACY_DEFERRED_ZONES
+    Profiler::FlushDeferredZones();
+#endif
+
 #ifdef TRACY_CALLSTACK
     const uint32_t depth = TRACY_CALLSTACK;
 #else
@@ -261,6 +269,10 @@ static inline int LuaZoneBegin( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+#ifdef TRACY_DEFERRED_ZONES
+    Profiler::FlushDeferredZones();
+#endif
+
     lua_Debug dbg;
     lua_getstack( L, 1, &dbg );
     lua_getinfo( L, "Snl", &dbg );
@@ -286,6 +298,10 @@ static inline int LuaZoneBeginN( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+#ifdef TRACY_DEFERRED_ZONES
+    Profiler::FlushDeferredZones();
+#endif
+
     lua_Debug dbg;
     lua_getstack( L, 1, &dbg );
     lua_getinfo( L, "Snl", &dbg );
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <stdio.h>
+
+#include "../public/common/TracySystem.hpp"
+#include "TracyConnectionPool.hpp"
+#include "TracyWorker.hpp"
+
+namespace tracy
+{
+
+ConnectionPool::ConnectionPool( size_t threads, const char* name )
+    : m_next( 0 )
+    , m_exit( false )
+{
+    m_threads.reserve( threads );
+    for( size_t i=0; i<threads; i++ )
+    {
+        m_threads.emplace_back( [this, name, i] {
+            char tmp[128];
+            snprintf( tmp, sizeof( tmp ), "%s #%zu", name, i );
+            SetThreadName( tmp );
+            Thread();
+        } );
+    }
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    m_exit.store( true, std::memory_order_release );
+    m_lock.lock();
+    m_cv.notify_all();
+    m_lock.unlock();
+
+    for( auto& thread : m_threads )
+    {
+        thread.join();
+    }
+}
+
+void ConnectionPool::Add( Worker* worker )
+{
+    std::lock_guard<std::mutex> lock( m_lock );
+    m_entries.emplace_back( Entry { worker, false, false } );
+    m_cv.notify_one();
+}
+
+void ConnectionPool::Remove( Worker* worker )
+{
+    std::unique_lock<std::mutex> lock( m_lock );
+    m_cv.wait( lock, [this, worker] { return !Find( worker )->busy; } );
+    m_entries.erase( Find( worker ) );
+}
+
+std::vector<ConnectionPool::Entry>::iterator ConnectionPool::Find( Worker* worker )
+{
+    auto it = std::find_if( m_entries.begin(), m_entries.end(), [worker] ( const Entry& e ) { return e.worker == worker; } );
+    assert( it != m_entries.end() );
+    return it;
+}
+
+bool ConnectionPool::HasWork() const
+{
+    for( auto& e : m_entries )
+    {
+        if( !e.busy && !e.closed ) return true;
+    }
+    return false;
+}
+
+// Workers are polled round robin. When none of them had anything to do for a
+// whole round, the thread sleeps for a moment, as the sockets are not waited on.
+void ConnectionPool::Thread()
+{
+    size_t idle = 0;
+    std::unique_lock<std::mutex> lock( m_lock );
+    for(;;)
+    {
+        m_cv.wait( lock, [this] { return HasWork() || m_exit.load( std::memory_order_acquire ); } );
+        if( m_exit.load( std::memory_order_acquire ) ) return;
+
+        const auto cnt = m_entries.size();
+        size_t idx = m_next;
+        for(;;)
+        {
+            if( idx >= cnt ) idx = 0;
+            if( !m_entries[idx].busy && !m_entries[idx].closed ) break;
+            idx++;
+        }
+        m_next = idx + 1;
+        auto worker = m_entries[idx].worker;
+        m_entries[idx].busy = true;
+        lock.unlock();
+
+        const auto status = worker->Poll();
+
+        lock.lock();
+        // Entries may have been added or removed in the meantime.
+        auto it = Find( worker );
+        it->busy = false;
+        if( status == Worker::PollStatus::Closed ) it->closed = true;
+        m_cv.notify_all();
+
+        if( status == Worker::PollStatus::Busy )
+        {
+            idle = 0;
+        }
+        else if( ++idle >= m_entries.size() )
+        {
+            idle = 0;
+            lock.unlock();
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            lock.lock();
+        }
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef __TRACYCONNECTIONPOOL_HPP__
+#define __TRACYCONNECTIONPOOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tracy
+{
+
+class Worker;
+
+// Services the connections of any number of pooled workers with a fixed set of
+// threads, instead of the network and worker threads each worker would start.
+// A worker is polled by at most one thread at a time.
+class ConnectionPool
+{
+public:
+    ConnectionPool( size_t threads, const char* name );
+    ~ConnectionPool();
+
+    void Add( Worker* worker );
+    // Waits until the worker is no longer polled. Shutdown() the worker first,
+    // if its connection may still be open.
+    void Remove( Worker* worker );
+
+private:
+    struct Entry
+    {
+        Worker* worker;
+        bool busy;
+        bool closed;
+    };
+
+    void Thread();
+    std::vector<Entry>::iterator Find( Worker* worker );
+    bool HasWork() const;
+
+    std::vector<Entry> m_entries;
+    size_t m_next;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::atomic<bool> m_exit;
+
+    std::vector<std::thread> m_threads;
+};
+
+}
+
+#endif
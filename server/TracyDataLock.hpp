@@ -0,0 +1,72 @@
+#ifndef __TRACYDATALOCK_HPP__
+#define __TRACYDATALOCK_HPP__
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+namespace tracy
+{
+
+// Guards the worker data. It is shared by the ingestion thread, the UI and the
+// save thread. An owner may call Handover() at a point where it keeps no references
+// into the worker data. If some other thread is waiting, the lock is handed over
+// to it and then reacquired. Long draws and ingestion bursts no longer stall
+// each other for their whole duration.
+class DataLock
+{
+public:
+    DataLock()
+        : m_waiting( 0 )
+        , m_acquired( 0 )
+    {
+    }
+
+    DataLock( const DataLock& ) = delete;
+    DataLock& operator=( const DataLock& ) = delete;
+
+    void lock()
+    {
+        m_waiting.fetch_add( 1, std::memory_order_relaxed );
+        m_lock.lock();
+        m_waiting.fetch_sub( 1, std::memory_order_relaxed );
+        m_acquired.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    bool try_lock()
+    {
+        if( !m_lock.try_lock() ) return false;
+        m_acquired.fetch_add( 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    void unlock()
+    {
+        m_lock.unlock();
+    }
+
+    // Must be called by the lock owner. std::mutex makes no fairness guarantees,
+    // so after unlocking, wait until somebody else actually got the lock.
+    // Otherwise the owner could immediately take it back.
+    void Handover()
+    {
+        if( m_waiting.load( std::memory_order_relaxed ) == 0 ) return;
+        const auto acquired = m_acquired.load( std::memory_order_relaxed );
+        m_lock.unlock();
+        while( m_acquired.load( std::memory_order_relaxed ) == acquired && m_waiting.load( std::memory_order_relaxed ) != 0 )
+        {
+            std::this_thread::yield();
+        }
+        lock();
+    }
+
+private:
+    std::mutex m_lock;
+    std::atomic<uint32_t> m_waiting;
+    std::atomic<uint32_t> m_acquired;
+};
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifdef __AVX2__
+#  include <immintrin.h>
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+#  include <arm_neon.h>
+#endif
+
+#include <algorithm>
+
+#include "../public/common/TracyForceInline.hpp"
+#include "TracyDurationStats.hpp"
+
+namespace tracy
+{
+
+static void AggregateScalar( const int64_t* time, size_t cnt, DurationStats& stats )
+{
+    int64_t total = 0;
+    int64_t min = stats.min;
+    int64_t max = stats.max;
+    double sumSq = 0;
+    for( size_t i=0; i<cnt; i++ )
+    {
+        const auto t = time[i];
+        total += t;
+        min = std::min( min, t );
+        max = std::max( max, t );
+        sumSq += double( t ) * t;
+    }
+    stats.count += cnt;
+    stats.total += total;
+    stats.min = min;
+    stats.max = max;
+    stats.sumSq += sumSq;
+}
+
+static void AggregateScalar( const int64_t* start, const int64_t* end, const int64_t* self, size_t cnt, int64_t rangeMin, int64_t rangeMax, DurationStats& stats )
+{
+    size_t count = 0;
+    int64_t total = 0;
+    int64_t min = stats.min;
+    int64_t max = stats.max;
+    double sumSq = 0;
+    for( size_t i=0; i<cnt; i++ )
+    {
+        if( start[i] < rangeMin || end[i] > rangeMax ) continue;
+        const auto t = self ? self[i] : end[i] - start[i];
+        count++;
+        total += t;
+        min = std::min( min, t );
+        max = std::max( max, t );
+        sumSq += double( t ) * t;
+    }
+    stats.count += count;
+    stats.total += total;
+    stats.min = min;
+    stats.max = max;
+    stats.sumSq += sumSq;
+}
+
+#ifdef __AVX2__
+// There is no 64-bit integer to double conversion in AVX2. The value is split
+// into the upper 48 bits and the lower 16 bits, which are placed in mantissas
+// of two doubles with known exponents, and then added together.
+static tracy_force_inline __m256d ToDouble( __m256i v )
+{
+    auto hi = _mm256_srai_epi32( v, 16 );
+    hi = _mm256_blend_epi16( hi, _mm256_setzero_si256(), 0x33 );
+    hi = _mm256_add_epi64( hi, _mm256_castpd_si256( _mm256_set1_pd( 442721857769029238784. ) ) );      // 3 * 2^67
+    const auto lo = _mm256_blend_epi16( v, _mm256_castpd_si256( _mm256_set1_pd( 0x0010000000000000 ) ), 0x88 );   // 2^52
+    const auto f = _mm256_sub_pd( _mm256_castsi256_pd( hi ), _mm256_set1_pd( 442726361368656609280. ) );  // 3 * 2^67 + 2^52
+    return _mm256_add_pd( f, _mm256_castsi256_pd( lo ) );
+}
+
+static tracy_force_inline void Reduce( __m256i vtotal, __m256i vmin, __m256i vmax, __m256d vsq, DurationStats& stats )
+{
+    alignas( 32 ) int64_t total[4], min[4], max[4];
+    alignas( 32 ) double sq[4];
+    _mm256_store_si256( (__m256i*)total, vtotal );
+    _mm256_store_si256( (__m256i*)min, vmin );
+    _mm256_store_si256( (__m256i*)max, vmax );
+    _mm256_store_pd( sq, vsq );
+    for( int i=0; i<4; i++ )
+    {
+        stats.total += total[i];
+        stats.min = std::min( stats.min, min[i] );
+        stats.max = std::max( stats.max, max[i] );
+        stats.sumSq += sq[i];
+    }
+}
+#elif defined __ARM_NEON && defined __aarch64__
+static tracy_force_inline void Reduce( int64x2_t vtotal, int64x2_t vmin, int64x2_t vmax, float64x2_t vsq, DurationStats& stats )
+{
+    stats.total += vaddvq_s64( vtotal );
+    stats.min = std::min( { stats.min, vgetq_lane_s64( vmin, 0 ), vgetq_lane_s64( vmin, 1 ) } );
+    stats.max = std::max( { stats.max, vgetq_lane_s64( vmax, 0 ), vgetq_lane_s64( vmax, 1 ) } );
+    stats.sumSq += vaddvq_f64( vsq );
+}
+#endif
+
+void AggregateDurations( const int64_t* time, size_t cnt, DurationStats& stats )
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    if( cnt >= 8 )
+    {
+        auto vtotal = _mm256_setzero_si256();
+        auto vmin = _mm256_set1_epi64x( stats.min );
+        auto vmax = _mm256_set1_epi64x( stats.max );
+        auto vsq0 = _mm256_setzero_pd();
+        auto vsq1 = _mm256_setzero_pd();
+        for( ; i+8<=cnt; i+=8 )
+        {
+            const auto t0 = _mm256_loadu_si256( (const __m256i*)( time + i ) );
+            const auto t1 = _mm256_loadu_si256( (const __m256i*)( time + i + 4 ) );
+            vtotal = _mm256_add_epi64( vtotal, _mm256_add_epi64( t0, t1 ) );
+            vmin = _mm256_blendv_epi8( vmin, t0, _mm256_cmpgt_epi64( vmin, t0 ) );
+            vmin = _mm256_blendv_epi8( vmin, t1, _mm256_cmpgt_epi64( vmin, t1 ) );
+            vmax = _mm256_blendv_epi8( vmax, t0, _mm256_cmpgt_epi64( t0, vmax ) );
+            vmax = _mm256_blendv_epi8( vmax, t1, _mm256_cmpgt_epi64( t1, vmax ) );
+            const auto d0 = ToDouble( t0 );
+            const auto d1 = ToDouble( t1 );
+            vsq0 = _mm256_add_pd( vsq0, _mm256_mul_pd( d0, d0 ) );
+            vsq1 = _mm256_add_pd( vsq1, _mm256_mul_pd( d1, d1 ) );
+        }
+        stats.count += i;
+        Reduce( vtotal, vmin, vmax, _mm256_add_pd( vsq0, vsq1 ), stats );
+    }
+#elif defined __ARM_NEON && defined __aarch64__
+    if( cnt >= 4 )
+    {
+        auto vtotal = vdupq_n_s64( 0 );
+        auto vmin = vdupq_n_s64( stats.min );
+        auto vmax = vdupq_n_s64( stats.max );
+        auto vsq0 = vdupq_n_f64( 0 );
+        auto vsq1 = vdupq_n_f64( 0 );
+        for( ; i+4<=cnt; i+=4 )
+        {
+            const auto t0 = vld1q_s64( time + i );
+            const auto t1 = vld1q_s64( time + i + 2 );
+            vtotal = vaddq_s64( vtotal, vaddq_s64( t0, t1 ) );
+            vmin = vbslq_s64( vcltq_s64( t0, vmin ), t0, vmin );
+            vmin = vbslq_s64( vcltq_s64( t1, vmin ), t1, vmin );
+            vmax = vbslq_s64( vcgtq_s64( t0, vmax ), t0, vmax );
+            vmax = vbslq_s64( vcgtq_s64( t1, vmax ), t1, vmax );
+            const auto d0 = vcvtq_f64_s64( t0 );
+            const auto d1 = vcvtq_f64_s64( t1 );
+            vsq0 = vfmaq_f64( vsq0, d0, d0 );
+            vsq1 = vfmaq_f64( vsq1, d1, d1 );
+        }
+        stats.count += i;
+        Reduce( vtotal, vmin, vmax, vaddq_f64( vsq0, vsq1 ), stats );
+    }
+#endif
+    AggregateScalar( time + i, cnt - i, stats );
+}
+
+void AggregateDurations( const int64_t* start, const int64_t* end, const int64_t* self, size_t cnt, int64_t rangeMin, int64_t rangeMax, DurationStats& stats )
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    if( cnt >= 4 )
+    {
+        const auto rmin = _mm256_set1_epi64x( rangeMin );
+        const auto rmax = _mm256_set1_epi64x( rangeMax );
+        auto vcount = _mm256_setzero_si256();
+        auto vtotal = _mm256_setzero_si256();
+        auto vmin = _mm256_set1_epi64x( stats.min );
+        auto vmax = _mm256_set1_epi64x( stats.max );
+        auto vsq = _mm256_setzero_pd();
+        for( ; i+4<=cnt; i+=4 )
+        {
+            const auto s = _mm256_loadu_si256( (const __m256i*)( start + i ) );
+            const auto e = _mm256_loadu_si256( (const __m256i*)( end + i ) );
+            const auto t = self ? _mm256_loadu_si256( (const __m256i*)( self + i ) ) : _mm256_sub_epi64( e, s );
+            // Lanes outside of the range are all ones in the mask and are zeroed.
+            const auto out = _mm256_or_si256( _mm256_cmpgt_epi64( rmin, s ), _mm256_cmpgt_epi64( e, rmax ) );
+            const auto tin = _mm256_andnot_si256( out, t );
+            vcount = _mm256_sub_epi64( vcount, _mm256_cmpeq_epi64( out, _mm256_setzero_si256() ) );
+            vtotal = _mm256_add_epi64( vtotal, tin );
+            vmin = _mm256_blendv_epi8( vmin, t, _mm256_andnot_si256( out, _mm256_cmpgt_epi64( vmin, t ) ) );
+            vmax = _mm256_blendv_epi8( vmax, t, _mm256_andnot_si256( out, _mm256_cmpgt_epi64( t, vmax ) ) );
+            const auto d = ToDouble( tin );
+            vsq = _mm256_add_pd( vsq, _mm256_mul_pd( d, d ) );
+        }
+        alignas( 32 ) int64_t count[4];
+        _mm256_store_si256( (__m256i*)count, vcount );
+        stats.count += count[0] + count[1] + count[2] + count[3];
+        Reduce( vtotal, vmin, vmax, vsq, stats );
+    }
+#elif defined __ARM_NEON && defined __aarch64__
+    if( cnt >= 2 )
+    {
+        const auto rmin = vdupq_n_s64( rangeMin );
+        const auto rmax = vdupq_n_s64( rangeMax );
+        auto vcount = vdupq_n_s64( 0 );
+        auto vtotal = vdupq_n_s64( 0 );
+        auto vmin = vdupq_n_s64( stats.min );
+        auto vmax = vdupq_n_s64( stats.max );
+        auto vsq = vdupq_n_f64( 0 );
+        for( ; i+2<=cnt; i+=2 )
+        {
+            const auto s = vld1q_s64( start + i );
+            const auto e = vld1q_s64( end + i );
+            const auto t = self ? vld1q_s64( self + i ) : vsubq_s64( e, s );
+            const auto in = vandq_u64( vcgeq_s64( s, rmin ), vcleq_s64( e, rmax ) );
+            const auto tin = vbslq_s64( in, t, vdupq_n_s64( 0 ) );
+            vcount = vsubq_s64( vcount, vreinterpretq_s64_u64( in ) );
+            vtotal = vaddq_s64( vtotal, tin );
+            vmin = vbslq_s64( vandq_u64( in, vcltq_s64( t, vmin ) ), t, vmin );
+            vmax = vbslq_s64( vandq_u64( in, vcgtq_s64( t, vmax ) ), t, vmax );
+            const auto d = vcvtq_f64_s64( tin );
+            vsq = vfmaq_f64( vsq, d, d );
+        }
+        stats.count += vaddvq_s64( vcount );
+        Reduce( vtotal, vmin, vmax, vsq, stats );
+    }
+#endif
+    AggregateScalar( start + i, end + i, self ? self + i : nullptr, cnt - i, rangeMin, rangeMax, stats );
+}
+
+}
@@ -0,0 +1,29 @@
+#ifndef __TRACYDURATIONSTATS_HPP__
+#define __TRACYDURATIONSTATS_HPP__
+
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tracy
+{
+
+struct DurationStats
+{
+    size_t count = 0;
+    int64_t total = 0;
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = std::numeric_limits<int64_t>::min();
+    double sumSq = 0;
+};
+
+// Both functions add to the already gathered statistics.
+void AggregateDurations( const int64_t* time, size_t cnt, DurationStats& stats );
+
+// Only zones which start at or after rangeMin and end at or before rangeMax
+// are counted. Zone duration is end - start, or the self time, if provided.
+void AggregateDurations( const int64_t* start, const int64_t* end, const int64_t* self, size_t cnt, int64_t rangeMin, int64_t rangeMax, DurationStats& stats );
+
+}
+
+#endif
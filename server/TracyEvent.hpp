@@ -686,6 +686,7 @@ struct ThreadData
     Vector<SampleData> ctxSwitchSamples;
     uint64_t kernelSampleCnt;
     uint8_t isFiber;
+    uint8_t ingestLane;
     ThreadData* fiber;
     uint8_t* stackCount;
 
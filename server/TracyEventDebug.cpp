@@ -300,6 +300,16 @@ void EventDebug( const QueueItem& ev )
         fprintf( f, "\tcore    = %" PRIu32 "\n", ev.cpuTopology.core );
         fprintf( f, "\tthread  = %" PRIu32 "\n", ev.cpuTopology.thread );
         break;
+    case QueueType::ZoneBeginIndexed:
+        fprintf( f, "ev %i (ZoneBeginIndexed)\n", ev.hdr.idx );
+        fprintf( f, "\ttime = %" PRIi64 "\n", ev.zoneBeginLean.time );
+        break;
+    case QueueType::ZoneBeginCompact:
+        fprintf( f, "ev %i (ZoneBeginCompact)\n", ev.hdr.idx );
+        break;
+    case QueueType::ZoneEndCompact:
+        fprintf( f, "ev %i (ZoneEndCompact)\n", ev.hdr.idx );
+        break;
     case QueueType::SingleStringData:
         fprintf( f, "ev %i (SingleStringData)\n", ev.hdr.idx );
         break;
@@ -10,6 +10,34 @@ namespace tracy
 
 static const char Lz4Header[4]  = { 't', 'l', 'Z', 4 };
 static const char ZstdHeader[4] = { 't', 'Z', 's', 't' };
+static const char SectionIndexHeader[4] = { 't', 'I', 'd', 'x' };
+// Section index of a file in which compression streams are restarted every
+// few blocks, so that each group of blocks can be decompressed on its own.
+static const char ChunkedIndexHeader[4] = { 't', 'I', 'd', 'c' };
+
+// Parts of the trace which are compressed as separate streams, so that they
+// can be located through the section index and decoded independently.
+enum class FileSection : uint32_t
+{
+    Frames,
+    Thread,
+    GpuContext,
+    Memory,
+    Callstacks,
+    ContextSwitches,
+    ContextSwitchesPerCpu,
+    SymbolCode,
+    ThreadTimeline,
+    ZoneDropped
+};
+
+struct FileSectionEntry
+{
+    FileSection type;
+    uint32_t id;
+    uint64_t offset;
+    uint64_t size;
+};
 
 static constexpr tracy_force_inline int FileVersion( uint8_t h5, uint8_t h6, uint8_t h7 )
 {
@@ -4,12 +4,16 @@
 #include <assert.h>
 #include <atomic>
 #include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <stdio.h>
 #include <string.h>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include <sys/stat.h>
 
@@ -36,18 +40,23 @@ struct FileReadError : public std::exception {};
 class FileRead
 {
 public:
-    static FileRead* Open( const char* fn )
+    // Chunked files are decompressed ahead on the given number of jobs. Other
+    // files, or a single job, use one decompression thread.
+    static FileRead* Open( const char* fn, int jobs = std::thread::hardware_concurrency() )
     {
         auto f = fopen( fn, "rb" );
-        return f ? new FileRead( f, fn ) : nullptr;
+        return f ? new FileRead( f, fn, jobs ) : nullptr;
     }
 
     ~FileRead()
     {
-        m_exit.store( true, std::memory_order_relaxed );
-        m_decThread.join();
+        if( m_decThread.joinable() )
+        {
+            m_exit.store( true, std::memory_order_relaxed );
+            m_decThread.join();
+        }
+        StopChunkThreads();
 
-        if( m_data ) munmap( m_data, m_dataSize );
         if( m_stream ) LZ4_freeStreamDecode( m_stream );
         if( m_streamZstd ) ZSTD_freeDStream( m_streamZstd );
     }
@@ -328,8 +337,38 @@ public:
 
     const std::string& GetFilename() const { return m_filename; }
 
+    bool HasSectionIndex() const { return m_hasIndex; }
+
+    // Returns a reader of an independently compressed section, or nullptr, if
+    // there's no such section. The returned reader shares the file mapping
+    // with this object and may outlive it. By default it decompresses on the
+    // calling thread, so that many sections can be read in parallel. Large
+    // sections may instead be decompressed ahead on the given number of jobs.
+    FileRead* OpenSection( FileSection type, uint32_t id, int jobs = 1 ) const
+    {
+        auto it = std::lower_bound( m_sections.begin(), m_sections.end(), std::make_pair( type, id ), [] ( const auto& lhs, const auto& rhs ) { return lhs.type < rhs.first || ( lhs.type == rhs.first && lhs.id < rhs.second ); } );
+        if( it == m_sections.end() || it->type != type || it->id != id ) return nullptr;
+        auto f = new FileRead( *this, it->offset );
+        f->StartChunkThreads( jobs );
+        return f;
+    }
+
+    uint64_t GetSectionSize( FileSection type, uint32_t id ) const
+    {
+        auto it = std::lower_bound( m_sections.begin(), m_sections.end(), std::make_pair( type, id ), [] ( const auto& lhs, const auto& rhs ) { return lhs.type < rhs.first || ( lhs.type == rhs.first && lhs.id < rhs.second ); } );
+        if( it == m_sections.end() || it->type != type || it->id != id ) return 0;
+        return it->size;
+    }
+
+    // Returns a reader which keeps the file mapping and the section index
+    // alive, so that sections can be opened after this object is gone.
+    FileRead* ShareSections() const
+    {
+        return new FileRead( *this, m_dataSize );
+    }
+
 private:
-    FileRead( FILE* f, const char* fn )
+    FileRead( FILE* f, const char* fn, int jobs )
         : m_stream( nullptr )
         , m_streamZstd( nullptr )
         , m_data( nullptr )
@@ -337,9 +376,17 @@ private:
         , m_second( m_bufData[0] )
         , m_offset( 0 )
         , m_lastBlock( 0 )
+        , m_decError( false )
+        , m_hasIndex( false )
+        , m_indexOffset( 0 )
+        , m_chunkBlocks( 0 )
+        , m_chunk( nullptr )
+        , m_chunkNext( 0 )
+        , m_chunkBlock( 0 )
         , m_signalSwitch( false )
         , m_signalAvailable( false )
         , m_exit( false )
+        , m_decDone( false )
         , m_filename( fn )
     {
         char hdr[4];
@@ -379,11 +426,267 @@ private:
         {
             throw FileReadError();
         }
+        m_mapping = std::shared_ptr<char>( m_data, [size = m_dataSize] ( char* ptr ) { munmap( ptr, size ); } );
         m_dataOffset = sizeof( hdr );
 
-        ReadBlock( ReadBlockSize() );
-        std::swap( m_buf, m_second );
-        m_decThread = std::thread( [this] { Worker(); } );
+        LoadSectionIndex();
+
+        if( StartChunkThreads( jobs ) )
+        {
+            try
+            {
+                NextChunkBlock();
+            }
+            catch( const FileReadError& )
+            {
+                StopChunkThreads();
+                throw;
+            }
+        }
+        else
+        {
+            if( !ReadBlock( ReadBlockSize() ) ) throw FileReadError();
+            std::swap( m_buf, m_second );
+            m_decThread = std::thread( [this] { Worker(); } );
+        }
+    }
+
+    FileRead( const FileRead& parent, uint64_t offset )
+        : m_stream( nullptr )
+        , m_streamZstd( nullptr )
+        , m_data( parent.m_data )
+        , m_dataSize( parent.m_dataSize )
+        , m_dataOffset( offset )
+        , m_buf( m_bufData[1] )
+        , m_second( m_bufData[0] )
+        , m_offset( BufSize )
+        , m_lastBlock( 0 )
+        , m_decError( false )
+        , m_mapping( parent.m_mapping )
+        , m_hasIndex( parent.m_hasIndex )
+        , m_sections( parent.m_sections )
+        , m_indexOffset( parent.m_indexOffset )
+        , m_chunkBlocks( parent.m_chunkBlocks )
+        , m_chunk( nullptr )
+        , m_chunkNext( 0 )
+        , m_chunkBlock( 0 )
+        , m_signalSwitch( false )
+        , m_signalAvailable( false )
+        , m_exit( false )
+        , m_decDone( false )
+        , m_filename( parent.m_filename )
+    {
+        if( parent.m_stream )
+        {
+            m_stream = LZ4_createStreamDecode();
+        }
+        else
+        {
+            m_streamZstd = ZSTD_createDStream();
+        }
+    }
+
+    void LoadSectionIndex()
+    {
+        uint32_t cnt;
+        uint32_t chunkBlocks = 0;
+        auto trailer = sizeof( cnt ) + sizeof( SectionIndexHeader );
+        if( m_dataSize < sizeof( Lz4Header ) + trailer ) return;
+        const auto hdr = m_data + m_dataSize - sizeof( SectionIndexHeader );
+        if( memcmp( hdr, ChunkedIndexHeader, sizeof( ChunkedIndexHeader ) ) == 0 )
+        {
+            trailer += sizeof( chunkBlocks );
+            if( m_dataSize < sizeof( Lz4Header ) + trailer ) return;
+            memcpy( &chunkBlocks, hdr - sizeof( cnt ) - sizeof( chunkBlocks ), sizeof( chunkBlocks ) );
+        }
+        else if( memcmp( hdr, SectionIndexHeader, sizeof( SectionIndexHeader ) ) != 0 )
+        {
+            return;
+        }
+        memcpy( &cnt, hdr - sizeof( cnt ), sizeof( cnt ) );
+        if( ( m_dataSize - sizeof( Lz4Header ) - trailer ) / sizeof( FileSectionEntry ) < cnt ) return;
+        const auto indexOffset = m_dataSize - trailer - cnt * sizeof( FileSectionEntry );
+
+        m_sections.resize( cnt );
+        if( cnt != 0 ) memcpy( m_sections.data(), m_data + indexOffset, cnt * sizeof( FileSectionEntry ) );
+        for( auto& v : m_sections )
+        {
+            if( v.offset < sizeof( Lz4Header ) || v.offset >= indexOffset )
+            {
+                m_sections.clear();
+                return;
+            }
+        }
+        std::sort( m_sections.begin(), m_sections.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.type < rhs.type || ( lhs.type == rhs.type && lhs.id < rhs.id ); } );
+        m_hasIndex = true;
+        m_indexOffset = indexOffset;
+        m_chunkBlocks = chunkBlocks;
+    }
+
+    // Streams of files with a chunked index are restarted every m_chunkBlocks
+    // blocks. Each job decompresses every n-th chunk into its own buffer,
+    // which gives a ring of n chunks decoded ahead of the reader.
+    bool StartChunkThreads( int jobs )
+    {
+        if( jobs < 2 || m_chunkBlocks == 0 ) return false;
+
+        // Streams are stored one after another, so this one ends where the
+        // next one begins.
+        auto end = m_indexOffset;
+        for( auto& v : m_sections ) if( v.offset > m_dataOffset ) end = std::min( end, v.offset );
+
+        uint64_t offset = m_dataOffset;
+        uint32_t block = 0;
+        while( offset < end )
+        {
+            if( block++ % m_chunkBlocks == 0 ) m_chunkOffset.push_back( offset );
+            uint32_t sz;
+            if( end - offset < sizeof( sz ) ) break;
+            memcpy( &sz, m_data + offset, sizeof( sz ) );
+            offset += sizeof( sz ) + sz;
+        }
+        if( offset != end || m_chunkOffset.size() < 2 )
+        {
+            m_chunkOffset.clear();
+            return false;
+        }
+        m_chunkOffset.push_back( end );
+
+        const auto num = std::min<size_t>( jobs, m_chunkOffset.size() - 1 );
+        m_chunks.resize( num );
+        for( auto& v : m_chunks )
+        {
+            v.data = std::make_unique<char[]>( m_chunkBlocks * BufSize );
+            v.blocks = 0;
+            v.ready = false;
+            v.error = false;
+        }
+        for( size_t i=0; i<num; i++ ) m_chunkThreads.emplace_back( [this, i] { ChunkWorker( i ); } );
+        return true;
+    }
+
+    void ChunkWorker( size_t idx )
+    {
+        auto& chunk = m_chunks[idx];
+        LZ4_streamDecode_t* stream = m_stream ? LZ4_createStreamDecode() : nullptr;
+        ZSTD_DStream* streamZstd = m_stream ? nullptr : ZSTD_createDStream();
+
+        for( size_t i=idx; i<m_chunkOffset.size()-1; i+=m_chunks.size() )
+        {
+            {
+                std::unique_lock<std::mutex> lock( m_chunkLock );
+                m_chunkCv.wait( lock, [this, &chunk] { return !chunk.ready || m_exit.load( std::memory_order_relaxed ); } );
+                if( m_exit.load( std::memory_order_relaxed ) ) break;
+            }
+
+            if( stream )
+            {
+                LZ4_setStreamDecode( stream, nullptr, 0 );
+            }
+            else
+            {
+                ZSTD_DCtx_reset( streamZstd, ZSTD_reset_session_only );
+            }
+
+            auto offset = m_chunkOffset[i];
+            const auto end = m_chunkOffset[i+1];
+            auto dst = chunk.data.get();
+            uint32_t blocks = 0;
+            bool error = false;
+            while( offset < end )
+            {
+                uint32_t sz;
+                memcpy( &sz, m_data + offset, sizeof( sz ) );
+                offset += sizeof( sz );
+                if( stream )
+                {
+                    error = LZ4_decompress_safe_continue( stream, m_data + offset, dst, sz, BufSize ) < 0;
+                }
+                else
+                {
+                    ZSTD_outBuffer out = { dst, BufSize, 0 };
+                    ZSTD_inBuffer in = { m_data + offset, sz, 0 };
+                    error = ZSTD_isError( ZSTD_decompressStream( streamZstd, &out, &in ) );
+                }
+                if( error ) break;
+                offset += sz;
+                dst += BufSize;
+                blocks++;
+            }
+
+            std::lock_guard<std::mutex> lock( m_chunkLock );
+            chunk.blocks = blocks;
+            chunk.error = error;
+            chunk.ready = true;
+            m_chunkCv.notify_all();
+        }
+
+        if( stream ) LZ4_freeStreamDecode( stream );
+        if( streamZstd ) ZSTD_freeDStream( streamZstd );
+    }
+
+    void StopChunkThreads()
+    {
+        if( m_chunkThreads.empty() ) return;
+        {
+            std::lock_guard<std::mutex> lock( m_chunkLock );
+            m_exit.store( true, std::memory_order_relaxed );
+            m_chunkCv.notify_all();
+        }
+        for( auto& v : m_chunkThreads ) v.join();
+        m_chunkThreads.clear();
+    }
+
+    void NextChunkBlock()
+    {
+        if( m_chunk && ++m_chunkBlock < m_chunk->blocks )
+        {
+            m_buf = m_chunk->data.get() + m_chunkBlock * BufSize;
+            m_offset = 0;
+            return;
+        }
+
+        // Reading past the end of the stream means that the data is corrupted.
+        if( m_chunkNext == m_chunkOffset.size() - 1 ) throw FileReadError();
+        std::unique_lock<std::mutex> lock( m_chunkLock );
+        if( m_chunk )
+        {
+            m_chunk->ready = false;
+            m_chunkCv.notify_all();
+        }
+        m_chunk = &m_chunks[m_chunkNext++ % m_chunks.size()];
+        m_chunkCv.wait( lock, [this] { return m_chunk->ready; } );
+        // Decoded data of a corrupted chunk is not used.
+        if( m_chunk->error ) throw FileReadError();
+        m_chunkBlock = 0;
+        m_buf = m_chunk->data.get();
+        m_offset = 0;
+    }
+
+    void NextBlock()
+    {
+        if( !m_chunks.empty() )
+        {
+            NextChunkBlock();
+        }
+        else if( m_decThread.joinable() )
+        {
+            m_signalSwitch.store( true, std::memory_order_relaxed );
+            while( m_signalAvailable.load( std::memory_order_acquire ) == false )
+            {
+                if( m_decDone.load( std::memory_order_acquire ) && m_signalAvailable.load( std::memory_order_acquire ) == false ) throw FileReadError();
+                YieldThread();
+            }
+            m_signalAvailable.store( false, std::memory_order_relaxed );
+            assert( m_offset == 0 );
+            if( m_decError ) throw FileReadError();
+        }
+        else
+        {
+            if( !ReadBlock( ReadBlockSize() ) ) throw FileReadError();
+            std::swap( m_buf, m_second );
+            m_offset = 0;
+        }
     }
 
     tracy_force_inline uint32_t ReadBlockSize()
@@ -399,7 +702,8 @@ private:
         uint32_t blockSz = ReadBlockSize();
         for(;;)
         {
-            ReadBlock( blockSz );
+            // The stream ends on an error, which the reader gets with the block.
+            const auto error = !ReadBlock( blockSz );
             if( m_lastBlock == BufSize ) blockSz = ReadBlockSize();
             for(;;)
             {
@@ -410,8 +714,13 @@ private:
             m_signalSwitch.store( false, std::memory_order_relaxed );
             std::swap( m_buf, m_second );
             m_offset = 0;
+            m_decError = error;
             m_signalAvailable.store( true, std::memory_order_release );
-            if( m_lastBlock != BufSize ) return;
+            if( m_lastBlock != BufSize )
+            {
+                m_decDone.store( true, std::memory_order_release );
+                return;
+            }
         }
     }
 
@@ -432,10 +741,7 @@ private:
             {
                 sz = std::min<size_t>( size, BufSize );
 
-                m_signalSwitch.store( true, std::memory_order_relaxed );
-                while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
-                m_signalAvailable.store( false, std::memory_order_relaxed );
-                assert( m_offset == 0 );
+                NextBlock();
 
                 memcpy( dst, m_buf, sz );
                 m_offset = sz;
@@ -457,12 +763,7 @@ private:
     {
         while( size > 0 )
         {
-            if( m_offset == BufSize )
-            {
-                m_signalSwitch.store( true, std::memory_order_relaxed );
-                while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
-                m_signalAvailable.store( false, std::memory_order_relaxed );
-            }
+            if( m_offset == BufSize ) NextBlock();
 
             const auto sz = std::min( size, BufSize - m_offset );
             m_offset += sz;
@@ -470,12 +771,20 @@ private:
         }
     }
 
-    void ReadBlock( uint32_t sz )
+    // Returns false if the block is corrupted.
+    bool ReadBlock( uint32_t sz )
     {
+        if( m_dataOffset > m_dataSize || sz > m_dataSize - m_dataOffset )
+        {
+            m_lastBlock = 0;
+            return false;
+        }
         if( m_stream )
         {
-            m_lastBlock = (size_t)LZ4_decompress_safe_continue( m_stream, m_data + m_dataOffset, m_second, sz, BufSize );
+            const auto ret = LZ4_decompress_safe_continue( m_stream, m_data + m_dataOffset, m_second, sz, BufSize );
             m_dataOffset += sz;
+            m_lastBlock = ret < 0 ? 0 : size_t( ret );
+            return ret >= 0;
         }
         else
         {
@@ -483,8 +792,13 @@ private:
             ZSTD_inBuffer in = { m_data + m_dataOffset, sz, 0 };
             m_dataOffset += sz;
             const auto ret = ZSTD_decompressStream( m_streamZstd, &out, &in );
-            assert( ret > 0 );
             m_lastBlock = out.pos;
+            if( ZSTD_isError( ret ) )
+            {
+                m_lastBlock = 0;
+                return false;
+            }
+            return true;
         }
     }
 
@@ -500,10 +814,34 @@ private:
     char* m_second;
     size_t m_offset;
     size_t m_lastBlock;
+    bool m_decError;
+    std::shared_ptr<char> m_mapping;
+    bool m_hasIndex;
+    std::vector<FileSectionEntry> m_sections;
+    uint64_t m_indexOffset;
+    uint32_t m_chunkBlocks;
+
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        uint32_t blocks;
+        bool ready;
+        bool error;
+    };
+
+    std::vector<uint64_t> m_chunkOffset;
+    std::vector<Chunk> m_chunks;
+    std::vector<std::thread> m_chunkThreads;
+    std::mutex m_chunkLock;
+    std::condition_variable m_chunkCv;
+    Chunk* m_chunk;
+    size_t m_chunkNext;
+    uint32_t m_chunkBlock;
 
     alignas(64) std::atomic<bool> m_signalSwitch;
     alignas(64) std::atomic<bool> m_signalAvailable;
     alignas(64) std::atomic<bool> m_exit;
+    std::atomic<bool> m_decDone;
 
     std::thread m_decThread;
 
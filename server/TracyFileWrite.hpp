@@ -7,11 +7,16 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <string.h>
 #include <utility>
+#include <vector>
 
 #include "TracyFileHeader.hpp"
+#include "TracyTaskDispatch.hpp"
 #include "../public/common/tracy_lz4.hpp"
 #include "../public/common/tracy_lz4hc.hpp"
 #include "../public/common/TracyForceInline.hpp"
@@ -31,25 +36,52 @@ public:
         Zstd
     };
 
-    static FileWrite* Open( const char* fn, Compression comp = Compression::Fast, int level = 1 )
+    // With more than one job, data is compressed in chunks on a pool of
+    // worker threads. Chunks are written out in order and the file can be
+    // read in the same way as one compressed on a single thread.
+    static FileWrite* Open( const char* fn, Compression comp = Compression::Fast, int level = 1, int jobs = 1 )
     {
         auto f = fopen( fn, "wb" );
-        return f ? new FileWrite( f, comp, level ) : nullptr;
+        return f ? new FileWrite( f, comp, level, jobs ) : nullptr;
     }
 
     ~FileWrite()
     {
-        if( m_offset > 0 ) WriteLz4Block();
+        Finish();
         fclose( m_file );
 
         if( m_stream ) LZ4_freeStream( m_stream );
         if( m_streamHC ) LZ4_freeStreamHC( m_streamHC );
         if( m_streamZstd ) ZSTD_freeCStream( m_streamZstd );
+
+        for( auto& chunk : m_chunks )
+        {
+            if( chunk->stream ) LZ4_freeStream( chunk->stream );
+            if( chunk->streamHC ) LZ4_freeStreamHC( chunk->streamHC );
+            if( chunk->streamZstd ) ZSTD_freeCCtx( chunk->streamZstd );
+        }
     }
 
     void Finish()
     {
-        if( m_offset > 0 ) WriteLz4Block();
+        if( m_finished ) return;
+        m_finished = true;
+        FinishStream();
+        while( m_chunkCount != 0 ) WriteChunk();
+        WriteIndex();
+    }
+
+    // Terminates the current compression stream and starts a new one, which
+    // can be located and decompressed on its own through the section index.
+    void BeginSection( FileSection type, uint32_t id )
+    {
+        assert( !m_finished );
+        FinishStream();
+        // Offset of a section compressed in parallel is known only when its
+        // first chunk is written.
+        if( m_dispatch ) m_pendingSection = int( m_sections.size() );
+        m_sections.emplace_back( FileSectionEntry { type, id, m_fileOffset, 0 } );
+        m_sectionStart = m_srcBytes;
     }
 
     tracy_force_inline void Write( const void* ptr, size_t size )
@@ -67,7 +99,30 @@ public:
     std::pair<size_t, size_t> GetCompressionStatistics() const { return std::make_pair( m_srcBytes, m_dstBytes ); }
 
 private:
-    FileWrite( FILE* f, Compression comp, int level )
+    enum { BufSize = 64 * 1024 };
+    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
+    enum { ChunkBlocks = 32 };
+    enum { ChunkSize = ChunkBlocks * BufSize };
+
+    // Compression state is reset every ChunkBlocks blocks, so that each chunk
+    // can be compressed and decompressed on its own. Zstd chunks are separate
+    // frames.
+    struct Chunk
+    {
+        LZ4_stream_t* stream;
+        LZ4_streamHC_t* streamHC;
+        ZSTD_CCtx* streamZstd;
+        size_t size;
+        size_t dstSize;
+        size_t dstBytes;
+        int section;
+        bool last;
+        bool done;
+        char src[ChunkSize];
+        char dst[ChunkBlocks * ( sizeof( uint32_t ) + LZ4Size )];
+    };
+
+    FileWrite( FILE* f, Compression comp, int level, int jobs )
         : m_stream( nullptr )
         , m_streamHC( nullptr )
         , m_streamZstd( nullptr )
@@ -77,8 +132,38 @@ private:
         , m_offset( 0 )
         , m_srcBytes( 0 )
         , m_dstBytes( 0 )
+        , m_fileOffset( sizeof( Lz4Header ) )
+        , m_sectionStart( 0 )
+        , m_levelHC( LZ4HC_CLEVEL_DEFAULT )
+        , m_finished( false )
+        , m_fill( nullptr )
+        , m_chunkWrite( 0 )
+        , m_chunkCount( 0 )
+        , m_pendingSection( -1 )
+        , m_chunkBlock( 0 )
     {
-        switch( comp )
+        if( comp == Compression::Extreme ) m_levelHC = LZ4HC_CLEVEL_MAX;
+
+        if( jobs > 1 )
+        {
+            m_dispatch = std::make_unique<TaskDispatch>( jobs, "File Compress" );
+            m_chunks.resize( jobs * 2 );
+            for( auto& chunk : m_chunks )
+            {
+                chunk = std::make_unique<Chunk>();
+                chunk->stream = comp == Compression::Fast ? LZ4_createStream() : nullptr;
+                chunk->streamHC = comp == Compression::Slow || comp == Compression::Extreme ? LZ4_createStreamHC() : nullptr;
+                chunk->streamZstd = comp == Compression::Zstd ? ZSTD_createCCtx() : nullptr;
+                if( chunk->streamZstd )
+                {
+                    ZSTD_CCtx_setParameter( chunk->streamZstd, ZSTD_c_compressionLevel, level );
+                    ZSTD_CCtx_setParameter( chunk->streamZstd, ZSTD_c_contentSizeFlag, 0 );
+                    // Lets the reader reject corrupted chunks, which decode without errors otherwise.
+                    ZSTD_CCtx_setParameter( chunk->streamZstd, ZSTD_c_checksumFlag, 1 );
+                }
+            }
+        }
+        else switch( comp )
         {
         case Compression::Fast:
             m_stream = LZ4_createStream();
@@ -88,12 +173,13 @@ private:
             break;
         case Compression::Extreme:
             m_streamHC = LZ4_createStreamHC();
-            LZ4_resetStreamHC( m_streamHC, LZ4HC_CLEVEL_MAX );
+            LZ4_resetStreamHC( m_streamHC, m_levelHC );
             break;
         case Compression::Zstd:
             m_streamZstd = ZSTD_createCStream();
             ZSTD_CCtx_setParameter( m_streamZstd, ZSTD_c_compressionLevel, level );
             ZSTD_CCtx_setParameter( m_streamZstd, ZSTD_c_contentSizeFlag, 0 );
+            ZSTD_CCtx_setParameter( m_streamZstd, ZSTD_c_checksumFlag, 1 );
             break;
         default:
             assert( false );
@@ -134,8 +220,16 @@ private:
         }
     }
 
-    void WriteLz4Block()
+    void WriteLz4Block( bool last = false )
     {
+        if( m_dispatch )
+        {
+            QueueBlock( last );
+            return;
+        }
+
+        const bool chunkEnd = last || ++m_chunkBlock == ChunkBlocks;
+
         char lz4[LZ4Size];
         uint32_t sz;
         if( m_stream )
@@ -146,8 +240,9 @@ private:
         {
             ZSTD_outBuffer out = { lz4, LZ4Size, 0 };
             ZSTD_inBuffer in = { m_buf, m_offset, 0 };
-            const auto ret = ZSTD_compressStream2( m_streamZstd, &out, &in, ZSTD_e_flush );
+            const auto ret = ZSTD_compressStream2( m_streamZstd, &out, &in, chunkEnd ? ZSTD_e_end : ZSTD_e_flush );
             assert( ret == 0 );
+            (void)ret;
             sz = out.pos;
         }
         else
@@ -160,12 +255,149 @@ private:
 
         fwrite( &sz, 1, sizeof( sz ), m_file );
         fwrite( lz4, 1, sz, m_file );
+        m_fileOffset += sizeof( sz ) + sz;
         m_offset = 0;
         std::swap( m_buf, m_second );
+
+        if( chunkEnd )
+        {
+            m_chunkBlock = 0;
+            if( m_stream )
+            {
+                LZ4_resetStream_fast( m_stream );
+            }
+            else if( m_streamHC )
+            {
+                LZ4_resetStreamHC_fast( m_streamHC, m_levelHC );
+            }
+        }
     }
 
-    enum { BufSize = 64 * 1024 };
-    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
+    // Stream end is marked by a block which is shorter than BufSize, so the
+    // final block has to be written even if there's no data left. Small writes
+    // may fill the buffer completely, in which case it is written out first,
+    // and an empty block ends the stream.
+    void FinishStream()
+    {
+        if( m_offset == BufSize ) WriteLz4Block();
+        WriteLz4Block( true );
+        if( !m_sections.empty() ) m_sections.back().size = m_srcBytes - m_sectionStart;
+    }
+
+    void QueueBlock( bool last )
+    {
+        if( !m_fill )
+        {
+            if( m_chunkCount == m_chunks.size() ) WriteChunk();
+            m_fill = m_chunks[( m_chunkWrite + m_chunkCount ) % m_chunks.size()].get();
+            m_chunkCount++;
+            m_fill->size = 0;
+            m_fill->section = m_pendingSection;
+            m_fill->done = false;
+            m_pendingSection = -1;
+        }
+
+        memcpy( m_fill->src + m_fill->size, m_buf, m_offset );
+        m_fill->size += m_offset;
+        m_srcBytes += m_offset;
+        m_offset = 0;
+        if( !last && m_fill->size != ChunkSize ) return;
+
+        auto chunk = m_fill;
+        m_fill = nullptr;
+        chunk->last = last;
+        m_dispatch->Queue( [this, chunk] {
+            CompressChunk( *chunk );
+            std::lock_guard<std::mutex> lock( m_chunkLock );
+            chunk->done = true;
+            m_chunkCv.notify_all();
+        } );
+    }
+
+    void CompressChunk( Chunk& chunk )
+    {
+        // The stream has to end with a block shorter than BufSize, even if
+        // it's empty. A full chunk is always queued before the final block is
+        // added, see FinishStream(), so the last chunk has room for it.
+        const auto blocks = chunk.last ? chunk.size / BufSize + 1 : chunk.size / BufSize;
+        assert( blocks <= ChunkBlocks );
+
+        if( chunk.stream )
+        {
+            LZ4_resetStream_fast( chunk.stream );
+        }
+        else if( chunk.streamHC )
+        {
+            LZ4_resetStreamHC_fast( chunk.streamHC, m_levelHC );
+        }
+        else
+        {
+            ZSTD_CCtx_reset( chunk.streamZstd, ZSTD_reset_session_only );
+            ZSTD_CCtx_setPledgedSrcSize( chunk.streamZstd, chunk.size );
+        }
+
+        auto src = chunk.src;
+        auto dst = chunk.dst;
+        auto left = chunk.size;
+        chunk.dstBytes = 0;
+        for( size_t i=0; i<blocks; i++ )
+        {
+            const auto size = std::min<size_t>( left, BufSize );
+            auto lz4 = dst + sizeof( uint32_t );
+            uint32_t sz;
+            if( chunk.stream )
+            {
+                sz = LZ4_compress_fast_continue( chunk.stream, src, lz4, size, LZ4Size, 1 );
+            }
+            else if( chunk.streamHC )
+            {
+                sz = LZ4_compress_HC_continue( chunk.streamHC, src, lz4, size, LZ4Size );
+            }
+            else
+            {
+                ZSTD_outBuffer out = { lz4, LZ4Size, 0 };
+                ZSTD_inBuffer in = { src, size, 0 };
+                const auto ret = ZSTD_compressStream2( chunk.streamZstd, &out, &in, i == blocks - 1 ? ZSTD_e_end : ZSTD_e_flush );
+                assert( ret == 0 );
+                (void)ret;
+                sz = out.pos;
+            }
+            memcpy( dst, &sz, sizeof( sz ) );
+            dst += sizeof( sz ) + sz;
+            chunk.dstBytes += sz;
+            src += size;
+            left -= size;
+        }
+        chunk.dstSize = dst - chunk.dst;
+    }
+
+    void WriteChunk()
+    {
+        assert( m_chunkCount != 0 );
+        auto& chunk = *m_chunks[m_chunkWrite];
+        {
+            std::unique_lock<std::mutex> lock( m_chunkLock );
+            m_chunkCv.wait( lock, [&chunk] { return chunk.done; } );
+        }
+
+        if( chunk.section >= 0 ) m_sections[chunk.section].offset = m_fileOffset;
+        fwrite( chunk.dst, 1, chunk.dstSize, m_file );
+        m_fileOffset += chunk.dstSize;
+        m_dstBytes += chunk.dstBytes;
+
+        m_chunkWrite = ( m_chunkWrite + 1 ) % m_chunks.size();
+        m_chunkCount--;
+    }
+
+    void WriteIndex()
+    {
+        const uint32_t sz = uint32_t( m_sections.size() );
+        const uint32_t chunkBlocks = ChunkBlocks;
+        if( sz != 0 ) fwrite( m_sections.data(), 1, sizeof( FileSectionEntry ) * sz, m_file );
+        fwrite( &chunkBlocks, 1, sizeof( chunkBlocks ), m_file );
+        fwrite( &sz, 1, sizeof( sz ), m_file );
+        fwrite( ChunkedIndexHeader, 1, sizeof( ChunkedIndexHeader ), m_file );
+    }
 
     LZ4_stream_t* m_stream;
     LZ4_streamHC_t* m_streamHC;
@@ -177,6 +409,21 @@ private:
     size_t m_offset;
     size_t m_srcBytes;
     size_t m_dstBytes;
+    uint64_t m_fileOffset;
+    uint64_t m_sectionStart;
+    int m_levelHC;
+    bool m_finished;
+    std::vector<FileSectionEntry> m_sections;
+
+    std::unique_ptr<TaskDispatch> m_dispatch;
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    Chunk* m_fill;
+    size_t m_chunkWrite;
+    size_t m_chunkCount;
+    int m_pendingSection;
+    size_t m_chunkBlock;
+    std::mutex m_chunkLock;
+    std::condition_variable m_chunkCv;
 };
 
 }
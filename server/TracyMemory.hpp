@@ -1,12 +1,14 @@
 #ifndef __TRACYMEMORY_HPP__
 #define __TRACYMEMORY_HPP__
 
+#include <atomic>
 #include <stdlib.h>
 
 namespace tracy
 {
 
-extern size_t memUsage;
+// Updated from the ingestion lanes in parallel, so it has to be atomic.
+extern std::atomic<size_t> memUsage;
 
 }
 
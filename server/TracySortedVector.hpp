@@ -49,6 +49,8 @@ public:
     tracy_force_inline bool empty() const { return v.empty(); }
     tracy_force_inline size_t size() const { return v.size(); }
     tracy_force_inline bool is_sorted() const { return sortedEnd == 0; }
+    tracy_force_inline size_t sorted_end() const { return sortedEnd; }
+    tracy_force_inline void mark_sorted() { sortedEnd = 0; }
 
     tracy_force_inline T* data() { return v.data(); }
     tracy_force_inline const T* data() const { return v.data(); };
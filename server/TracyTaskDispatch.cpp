@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
 
@@ -59,6 +60,42 @@ void TaskDispatch::Sync()
     m_cvJobs.wait( lock, [this]{ return m_jobs == 0; } );
 }
 
+// Calls f( 0 ) ... f( count-1 ) on the calling thread and on the workers. Only
+// these calls are waited for, so a single dispatch can be used by several
+// threads at once, which is not the case with Sync().
+void TaskDispatch::Run( size_t count, const std::function<void(size_t)>& f )
+{
+    if( count == 0 ) return;
+
+    struct State
+    {
+        std::function<void(size_t)> f;
+        size_t count;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+    };
+    auto state = std::make_shared<State>();
+    state->f = f;
+    state->count = count;
+    state->next.store( 0, std::memory_order_relaxed );
+    state->done.store( 0, std::memory_order_relaxed );
+
+    // The state is shared, as helper jobs may be picked up after this call has
+    // already returned. In such case they have nothing left to do.
+    auto job = [state] {
+        size_t i;
+        while( ( i = state->next.fetch_add( 1, std::memory_order_relaxed ) ) < state->count )
+        {
+            state->f( i );
+            state->done.fetch_add( 1, std::memory_order_release );
+        }
+    };
+    const auto helpers = std::min( count - 1, m_workers.size() );
+    for( size_t i=0; i<helpers; i++ ) Queue( job );
+    job();
+    while( state->done.load( std::memory_order_acquire ) != count ) std::this_thread::yield();
+}
+
 void TaskDispatch::Worker()
 {
     for(;;)
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -22,6 +23,10 @@ public:
 
     void Sync();
 
+    void Run( size_t count, const std::function<void(size_t)>& f );
+
+    size_t NumberOfWorkers() const { return m_workers.size(); }
+
 private:
     void Worker();
     void SetName( const char* name, size_t num );
@@ -34,6 +34,7 @@ bool TimelineItemThread::IsEmpty() const
     auto& crash = m_worker.GetCrashEvent();
     return crash.thread != m_thread->id &&
         m_thread->timeline.empty() &&
+        !m_worker.IsTimelinePending( m_thread ) &&
         m_thread->messages.empty() &&
         m_thread->ghostZones.empty();
 }
@@ -72,6 +73,7 @@ int64_t TimelineItemThread::RangeBegin() const
     {
         first = ctx->v.begin()->Start();
     }
+    m_worker.LoadTimeline( m_thread );
     if( !m_thread->timeline.empty() )
     {
         if( m_thread->timeline.is_magic() )
@@ -111,6 +113,7 @@ int64_t TimelineItemThread::RangeEnd() const
         const auto& back = ctx->v.back();
         last = back.IsEndValid() ? back.End() : back.Start();
     }
+    m_worker.LoadTimeline( m_thread );
     if( !m_thread->timeline.empty() )
     {
         if( m_thread->timeline.is_magic() )
@@ -291,6 +294,10 @@ void TimelineItemThread::Preprocess( const TimelineContext& ctx, TaskDispatch& t
     assert( m_msgDraw.empty() );
     assert( m_lockDraw.empty() );
 
+    // Item layout is not known before it was drawn once. Loading lazy timelines
+    // before that would bring all of them in at once.
+    if( visible && GetHeight() != 0 ) m_worker.LoadTimeline( m_thread );
+
     td.Queue( [this, &ctx, visible] {
 #ifndef TRACY_NO_STATISTICS
         if( m_worker.AreGhostZonesReady() && ( m_ghost || ( m_view.GetViewData().ghostZones && m_thread->timeline.empty() ) ) )
@@ -71,7 +71,7 @@ View::View( void(*cbMainThread)(const std::function<void()>&, bool), const char*
 }
 
 View::View( void(*cbMainThread)(const std::function<void()>&, bool), FileRead& f, ImFont* fixedWidth, ImFont* smallFont, ImFont* bigFont, SetTitleCallback stcb, SetScaleCallback sscb, AttentionCallback acb, const Config& config )
-    : m_worker( f )
+    : m_worker( f, EventType::All, true, false, uint64_t( config.timelineMemoryBudget ) * 1024 * 1024 )
     , m_filename( f.GetFilename() )
     , m_staticView( true )
     , m_viewMode( ViewMode::Paused )
@@ -796,8 +796,13 @@ bool View::DrawImpl()
             ImGui::EndPopup();
         }
     }
-    std::lock_guard<std::mutex> lock( m_worker.GetDataLock() );
+    // Each window is drawn in full before the lock is yielded. No references into
+    // the worker data may be carried over a yield point, because the ingestion
+    // thread may reallocate the containers in the meantime.
+    auto& dataLock = m_worker.GetDataLock();
+    std::lock_guard<DataLock> lock( dataLock );
     m_worker.DoPostponedWork();
+    m_worker.TrimTimelines( [this] ( const ThreadData* td ) { ForgetThreadZones( td ); } );
     if( !m_worker.IsDataStatic() )
     {
         if( m_worker.IsConnected() )
@@ -1011,12 +1016,12 @@ bool View::DrawImpl()
         if( dx < targetLabelSize ) ImGui::SameLine( cx + targetLabelSize );
 
         cx = ImGui::GetCursorPosX();
-        ImGui::Text( ICON_FA_MEMORY " %s", MemSizeToString( memUsage ) );
+        ImGui::Text( ICON_FA_MEMORY " %s", MemSizeToString( memUsage.load( std::memory_order_relaxed ) ) );
         TooltipIfHovered( "Profiler memory usage" );
         if( m_totalMemory != 0 )
         {
             ImGui::SameLine();
-            const auto memUse = float( memUsage ) / m_totalMemory * 100;
+            const auto memUse = float( memUsage.load( std::memory_order_relaxed ) ) / m_totalMemory * 100;
             if( memUse < 80 )
             {
                 ImGui::TextDisabled( "(%.2f%%)", memUse );
@@ -1060,6 +1065,7 @@ bool View::DrawImpl()
 #endif
     }
 
+    dataLock.Handover();
     DrawTimeline();
 
     ImGui::End();
@@ -1068,15 +1074,21 @@ bool View::DrawImpl()
     m_zoneHighlight = nullptr;
     m_gpuHighlight = nullptr;
 
+    dataLock.Handover();
     DrawInfoWindow();
 
     if( m_showOptions ) DrawOptions();
     if( m_showMessages ) DrawMessages();
+    dataLock.Handover();
     if( m_findZone.show ) DrawFindZone();
+    dataLock.Handover();
     if( m_showStatistics ) DrawStatistics();
+    dataLock.Handover();
     if( m_memInfo.show ) DrawMemory();
     if( m_memInfo.showAllocList ) DrawAllocList();
+    dataLock.Handover();
     if( m_compare.show ) DrawCompare();
+    dataLock.Handover();
     if( m_callstackInfoWindow != 0 ) DrawCallstackWindow();
     if( m_memoryAllocInfoWindow >= 0 ) DrawMemoryAllocWindow();
     if( m_showInfo ) DrawInfo();
@@ -1355,13 +1367,14 @@ void View::DrawSourceTooltip( const char* filename, uint32_t srcline, int before
 
 bool View::Save( const char* fn, FileWrite::Compression comp, int zlevel, bool buildDict )
 {
-    std::unique_ptr<FileWrite> f( FileWrite::Open( fn, comp, zlevel ) );
+    const auto jobs = std::max( 1u, std::thread::hardware_concurrency() );
+    std::unique_ptr<FileWrite> f( FileWrite::Open( fn, comp, zlevel, jobs ) );
     if( !f ) return false;
 
     m_userData.StateShouldBePreserved();
     m_saveThreadState.store( SaveThreadState::Saving, std::memory_order_relaxed );
     m_saveThread = std::thread( [this, f{std::move( f )}, buildDict] {
-        std::lock_guard<std::mutex> lock( m_worker.GetDataLock() );
+        std::lock_guard<DataLock> lock( m_worker.GetDataLock() );
         m_worker.Write( *f, buildDict );
         f->Finish();
         const auto stats = f->GetCompressionStatistics();
@@ -248,6 +248,11 @@ private:
     void DrawFindZone();
     void AccumulationModeComboBox();
     void DrawStatistics();
+#ifndef TRACY_NO_STATISTICS
+    void CalcRangeStatistics( int16_t srcloc, size_t& cnt, int64_t& total, uint16_t& threadNum );
+    bool EstimateDroppedZones( int16_t srcloc, size_t cnt, size_t& droppedCnt, int64_t& droppedTotal ) const;
+    void AddDroppedZones( int16_t srcloc, size_t& cnt, int64_t& total ) const;
+#endif
     void DrawSamplesStatistics(Vector<SymList>& data, int64_t timeRange, AccumulationMode accumulationMode);
     void DrawMemory();
     void DrawAllocList();
@@ -274,7 +279,7 @@ private:
     unordered_flat_map<uint64_t, MemCallstackFrameTree> GetCallstackFrameTreeBottomUp( const MemData& mem ) const;
     unordered_flat_map<uint64_t, MemCallstackFrameTree> GetCallstackFrameTreeTopDown( const MemData& mem ) const;
     void DrawFrameTreeLevel( const unordered_flat_map<uint64_t, MemCallstackFrameTree>& tree, int& idx );
-    void DrawZoneList( int id, const Vector<short_ptr<ZoneEvent>>& zones );
+    void DrawZoneList( int id, int16_t srcloc, const Vector<uint32_t>& zones );
 
     unordered_flat_map<uint64_t, CallstackFrameTree> GetCallstackFrameTreeBottomUp( const unordered_flat_map<uint32_t, uint64_t>& stacks, bool group ) const;
     unordered_flat_map<uint64_t, CallstackFrameTree> GetCallstackFrameTreeTopDown( const unordered_flat_map<uint32_t, uint64_t>& stacks, bool group ) const;
@@ -326,11 +331,11 @@ private:
     const ZoneEvent* GetZoneParent( const ZoneEvent& zone, uint64_t tid ) const;
     const ZoneEvent* GetZoneChild( const ZoneEvent& zone, int64_t time ) const;
     bool IsZoneReentry( const ZoneEvent& zone ) const;
-    bool IsZoneReentry( const ZoneEvent& zone, uint64_t tid ) const;
     const GpuEvent* GetZoneParent( const GpuEvent& zone ) const;
     const ThreadData* GetZoneThreadData( const ZoneEvent& zone ) const;
     uint64_t GetZoneThread( const ZoneEvent& zone ) const;
     uint64_t GetZoneThread( const GpuEvent& zone ) const;
+    void ForgetThreadZones( const ThreadData* td );
     const GpuCtxData* GetZoneCtx( const GpuEvent& zone ) const;
     bool FindMatchingZone( int prev0, int prev1, int flags );
     const ZoneEvent* FindZoneAtTime( uint64_t thread, int64_t time ) const;
@@ -351,11 +356,11 @@ private:
     void SetViewToLastFrames();
     int64_t GetZoneChildTime( const ZoneEvent& zone );
     int64_t GetZoneChildTime( const GpuEvent& zone );
-    int64_t GetZoneChildTimeFast( const ZoneEvent& zone );
     int64_t GetZoneChildTimeFastClamped( const ZoneEvent& zone, int64_t t0, int64_t t1 );
     int64_t GetZoneSelfTime( const ZoneEvent& zone );
     int64_t GetZoneSelfTime( const GpuEvent& zone );
     bool GetZoneRunningTime( const ContextSwitch* ctx, const ZoneEvent& ev, int64_t& time, uint64_t& cnt );
+    bool GetZoneRunningTime( const ContextSwitch* ctx, int64_t start, int64_t end, int64_t& time, uint64_t& cnt );
     const char* GetThreadContextData( uint64_t thread, bool& local, bool& untracked, const char*& program );
 
     tracy_force_inline void CalcZoneTimeData( unordered_flat_map<int16_t, ZoneTimeData>& data, int64_t& ztime, const ZoneEvent& zone );
@@ -598,15 +603,24 @@ private:
     int m_gpuIdx = 0;
 
     struct FindZone {
-        enum : uint64_t { Unselected = std::numeric_limits<uint64_t>::max() - 1 };
+        enum : uint64_t { Unselected = std::numeric_limits<uint64_t>::max() - 1, FilteredGid = std::numeric_limits<uint64_t>::max() - 2 };
         enum class GroupBy : int { Thread, UserText, ZoneName, Callstack, Parent, NoGrouping };
         enum class SortBy : int { Order, Count, Time, Mtpc };
+        enum class MatchResult : uint8_t { Skip, Filtered, Pending, Match };
+
+        struct ZoneMatch
+        {
+            uint64_t gid;
+            int64_t time;
+            MatchResult result;
+        };
 
+        // Zones are kept as indices into the zone list of the source location,
+        // as the zones of evicted timelines have no pointers.
         struct Group
         {
             uint16_t id;
-            Vector<short_ptr<ZoneEvent>> zones;
-            Vector<uint16_t> zonesTids;
+            Vector<uint32_t> zones;
             int64_t time = 0;
         };
 
@@ -615,6 +629,11 @@ private:
         std::vector<int16_t> match;
         unordered_flat_map<uint64_t, Group> groups;
         size_t processed;
+        // If grouping needs zone data, group ids of lazily loaded traces are
+        // found one thread at a time, in the order of gidOrder.
+        std::vector<uint64_t> gids;
+        std::vector<uint32_t> gidOrder;
+        size_t gidResolved;
         uint16_t groupId;
         int selMatch = 0;
         uint64_t selGroup = Unselected;
@@ -635,6 +654,7 @@ private:
         float average, selAverage;
         float median, selMedian;
         int64_t total, selTotal;
+        double sumSq;
         int64_t selTime;
         bool drawAvgMed = true;
         bool drawSelAvgMed = true;
@@ -677,6 +697,7 @@ private:
             average = 0;
             median = 0;
             total = 0;
+            sumSq = 0;
             tmin = std::numeric_limits<int64_t>::max();
             tmax = std::numeric_limits<int64_t>::min();
         }
@@ -686,6 +707,9 @@ private:
             ResetSelection();
             groups.clear();
             processed = 0;
+            gids.clear();
+            gidOrder.clear();
+            gidResolved = 0;
             groupId = 0;
             selCs = 0;
             selGroup = Unselected;
@@ -727,6 +751,13 @@ private:
     } m_findZone;
 
     tracy_force_inline uint64_t GetSelectionTarget( const Worker::ZoneThreadData& ev, FindZone::GroupBy groupBy ) const;
+    tracy_force_inline uint64_t GetFindZoneTarget( const Worker::ZoneThreadData& ev, size_t idx ) const;
+    bool IsFindZoneFiltered( const ZoneEvent& zone ) const;
+    bool ResolveFindZoneGroups( int16_t srcloc );
+    FindZone::MatchResult MatchFindZone( const Worker::ZoneThreadData& ev, size_t idx, int64_t start, int64_t end, int64_t selfTime, uint64_t& gid, int64_t& time );
+    void RunFindZoneJobs( size_t count, const std::function<void(size_t, size_t)>& f );
+
+    std::unique_ptr<TaskDispatch> m_findZoneDispatch;
 
     struct CompVal
     {
@@ -3,6 +3,7 @@
 
 #include "../dtl/dtl.hpp"
 
+#include "TracyDurationStats.hpp"
 #include "TracyImGui.hpp"
 #include "TracyFileRead.hpp"
 #include "TracyFileselector.hpp"
@@ -221,6 +222,10 @@ void View::DrawCompare()
                                 m_compare.badVer.state = BadVersionState::UnsupportedVersion;
                                 m_compare.badVer.version = e.version;
                             }
+                            catch( const tracy::FileReadError& )
+                            {
+                                m_compare.badVer.state = BadVersionState::ReadError;
+                            }
                         } );
                     }
                 }
@@ -686,8 +691,8 @@ void View::DrawCompare()
                 auto& zoneData1 = m_compare.second->GetZonesForSourceLocation( m_compare.match[1][m_compare.selMatch[1]] );
                 auto& zones0 = zoneData0.zones;
                 auto& zones1 = zoneData1.zones;
-                zones0.ensure_sorted();
-                zones1.ensure_sorted();
+                zoneData0.EnsureSorted();
+                zoneData1.EnsureSorted();
 
                 tmin = std::min( zoneData0.min, zoneData1.min );
                 tmax = std::max( zoneData0.max, zoneData1.max );
@@ -704,18 +709,20 @@ void View::DrawCompare()
                 {
                     if( m_compare.sortedNum[k] != zsz[k] )
                     {
-                        auto& zones = k == 0 ? zones0 : zones1;
+                        auto& zoneData = k == 0 ? zoneData0 : zoneData1;
                         auto& vec = m_compare.sorted[k];
                         vec.reserve( zsz[k] );
                         int64_t total = m_compare.total[k];
+                        const auto zstart = zoneData.start.data();
+                        const auto zend = zoneData.end.data();
                         size_t i;
                         for( i=m_compare.sortedNum[k]; i<zsz[k]; i++ )
                         {
-                            auto& zone = *zones[i].Zone();
-                            const auto t = zone.End() - zone.Start();
-                            vec.emplace_back( t );
-                            total += t;
+                            vec.emplace_back( zend[i] - zstart[i] );
                         }
+                        DurationStats stats;
+                        AggregateDurations( vec.data() + m_compare.sortedNum[k], vec.size() - m_compare.sortedNum[k], stats );
+                        total += stats.total;
                         auto mid = vec.begin() + m_compare.sortedNum[k];
                         pdqsort_branchless( mid, vec.end() );
                         std::inplace_merge( vec.begin(), mid, vec.end() );
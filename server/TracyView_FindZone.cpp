@@ -1,8 +1,10 @@
+#include <chrono>
 #include <numeric>
 
 #include "imgui.h"
 
 #include "../public/common/TracyStackFrames.hpp"
+#include "TracyDurationStats.hpp"
 #include "TracyFilesystem.hpp"
 #include "TracyImGui.hpp"
 #include "TracyMouse.hpp"
@@ -60,7 +62,7 @@ uint64_t View::GetSelectionTarget( const Worker::ZoneThreadData& ev, FindZone::G
     case FindZone::GroupBy::Parent:
     {
         const auto parent = GetZoneParent( *ev.Zone(), m_worker.DecompressThread( ev.Thread() ) );
-        return parent ? uint64_t( parent->SrcLoc() ) : 0;
+        return parent ? uint64_t( uint16_t( parent->SrcLoc() ) ) : 0;
     }
     case FindZone::GroupBy::NoGrouping:
         return 0;
@@ -70,8 +72,144 @@ uint64_t View::GetSelectionTarget( const Worker::ZoneThreadData& ev, FindZone::G
     }
 }
 
-void View::DrawZoneList( int id, const Vector<short_ptr<ZoneEvent>>& zones )
+uint64_t View::GetFindZoneTarget( const Worker::ZoneThreadData& ev, size_t idx ) const
 {
+    return m_findZone.gids.empty() ? GetSelectionTarget( ev, m_findZone.groupBy ) : m_findZone.gids[idx];
+}
+
+bool View::IsFindZoneFiltered( const ZoneEvent& zone ) const
+{
+    if( !m_userTextFilter.IsActive() ) return false;
+    if( !m_worker.HasZoneExtra( zone ) || !m_worker.GetZoneExtra( zone ).text.Active() ) return true;
+    return !m_userTextFilter.PassFilter( m_worker.GetString( m_worker.GetZoneExtra( zone ).text ) );
+}
+
+// Zones are evaluated in parts of this size, which are spread over the workers.
+enum { FindZoneChunkSize = 16 * 1024 };
+
+// Calls f( begin, end ) on consecutive parts of the [0, count) range, in parallel
+// if there is enough work to do. Returns when all parts are done.
+void View::RunFindZoneJobs( size_t count, const std::function<void(size_t, size_t)>& f )
+{
+    const auto chunks = ( count + FindZoneChunkSize - 1 ) / FindZoneChunkSize;
+    if( chunks <= 1 )
+    {
+        if( count != 0 ) f( 0, count );
+        return;
+    }
+    if( !m_findZoneDispatch )
+    {
+#ifdef __EMSCRIPTEN__
+        m_findZoneDispatch = std::make_unique<TaskDispatch>( 0, "Find Zone" );
+#else
+        m_findZoneDispatch = std::make_unique<TaskDispatch>( (size_t)std::max( 0, (int)std::thread::hardware_concurrency() - 1 ), "Find Zone" );
+#endif
+    }
+    m_findZoneDispatch->Run( chunks, [count, &f] ( size_t chunk ) {
+        const auto begin = chunk * FindZoneChunkSize;
+        f( begin, std::min<size_t>( begin + FindZoneChunkSize, count ) );
+    } );
+}
+
+// Grouping by zone data, or filtering by user text, needs the zone pointers,
+// which evicted timelines don't have. Group ids of these traces are found
+// ahead of matching, one thread at a time, so that the timelines don't have to
+// be loaded all at once. Returns false while there are threads left.
+bool View::ResolveFindZoneGroups( int16_t srcloc )
+{
+    const auto groupBy = m_findZone.groupBy;
+    if( !m_worker.HasLazyTimelines() ) return true;
+    if( !m_userTextFilter.IsActive() && ( groupBy == FindZone::GroupBy::Thread || groupBy == FindZone::GroupBy::NoGrouping ) ) return true;
+
+    const auto& zoneData = m_worker.GetZonesForSourceLocation( srcloc );
+    const auto zsz = zoneData.zones.size();
+    auto& gids = m_findZone.gids;
+    auto& order = m_findZone.gidOrder;
+    if( gids.size() != zsz )
+    {
+        // Counting sort by thread, which keeps the list order within threads.
+        std::vector<uint32_t> first( 64*1024 + 1 );
+        for( auto t : zoneData.thread ) first[t+1]++;
+        for( size_t i=1; i<first.size(); i++ ) first[i] += first[i-1];
+        order.resize( zsz );
+        for( size_t i=0; i<zsz; i++ ) order[first[zoneData.thread[i]]++] = uint32_t( i );
+        gids.assign( zsz, 0 );
+        m_findZone.gidResolved = 0;
+    }
+
+    // At least one timeline is loaded in each frame. More are loaded only while
+    // within the memory budget, as the previous ones are evicted by the next trim.
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    bool loaded = false;
+    while( m_findZone.gidResolved < zsz )
+    {
+        const auto begin = m_findZone.gidResolved;
+        const auto thread = zoneData.thread[order[begin]];
+        auto td = m_worker.GetThreadData( m_worker.DecompressThread( thread ) );
+        if( m_worker.IsTimelinePending( td ) )
+        {
+            if( loaded && ( m_worker.GetTimelineMemoryUsage() >= m_worker.GetTimelineMemoryBudget() || std::chrono::high_resolution_clock::now() - t0 > std::chrono::milliseconds( 50 ) ) ) return false;
+            loaded = true;
+        }
+        m_worker.LoadTimeline( td );
+        auto end = begin;
+        while( end < zsz && zoneData.thread[order[end]] == thread ) end++;
+        RunFindZoneJobs( end - begin, [&] ( size_t b, size_t e ) {
+            for( size_t j=begin+b; j<begin+e; j++ )
+            {
+                const auto idx = order[j];
+                auto& ev = zoneData.zones[idx];
+                gids[idx] = IsFindZoneFiltered( *ev.Zone() ) ? FindZone::FilteredGid : GetSelectionTarget( ev, groupBy );
+            }
+        } );
+        m_findZone.gidResolved = end;
+    }
+    return true;
+}
+
+// Decides if the zone belongs to a group, and finds the group and the zone time.
+// May be called from several threads at once, unless running time is used.
+View::FindZone::MatchResult View::MatchFindZone( const Worker::ZoneThreadData& ev, size_t idx, int64_t start, int64_t end, int64_t selfTime, uint64_t& gid, int64_t& time )
+{
+    if( m_findZone.range.active && ( start < m_findZone.range.min || end > m_findZone.range.max ) ) return FindZone::MatchResult::Skip;
+
+    if( !m_findZone.gids.empty() )
+    {
+        if( m_findZone.gids[idx] == FindZone::FilteredGid ) return FindZone::MatchResult::Filtered;
+    }
+    else if( m_userTextFilter.IsActive() && IsFindZoneFiltered( *ev.Zone() ) )
+    {
+        return FindZone::MatchResult::Filtered;
+    }
+
+    time = end - start;
+    assert( time != 0 );
+    if( m_findZone.selfTime )
+    {
+        time = selfTime;
+    }
+    else if( m_findZone.runningTime )
+    {
+        const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( ev.Thread() ) );
+        if( !ctx ) return FindZone::MatchResult::Pending;
+        uint64_t cnt;
+        if( !GetZoneRunningTime( ctx, start, end, time, cnt ) ) return FindZone::MatchResult::Pending;
+    }
+
+    if( m_findZone.highlight.active )
+    {
+        const auto hmin = std::min( m_findZone.highlight.start, m_findZone.highlight.end );
+        const auto hmax = std::max( m_findZone.highlight.start, m_findZone.highlight.end );
+        if( time < hmin || time > hmax ) return FindZone::MatchResult::Skip;
+    }
+
+    gid = GetFindZoneTarget( ev, idx );
+    return FindZone::MatchResult::Match;
+}
+
+void View::DrawZoneList( int id, int16_t srcloc, const Vector<uint32_t>& zones )
+{
+    auto& zoneData = m_worker.GetZonesForSourceLocation( srcloc );
     const auto zsz = zones.size();
     char buf[32];
     sprintf( buf, "%i##zonelist", id );
@@ -86,8 +224,16 @@ void View::DrawZoneList( int id, const Vector<short_ptr<ZoneEvent>>& zones )
     ImGui::TableSetupColumn( "Name", ImGuiTableColumnFlags_NoSort );
     ImGui::TableHeadersRow();
 
-    const Vector<short_ptr<ZoneEvent>>* zonesToIterate = &zones;
-    Vector<short_ptr<ZoneEvent>> sortedZones;
+    const auto RunningTime = [this, &zoneData] ( uint32_t idx ) {
+        const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( zoneData.thread[idx] ) );
+        int64_t time;
+        uint64_t cnt;
+        if( !ctx || !GetZoneRunningTime( ctx, zoneData.start[idx], zoneData.end[idx], time, cnt ) ) return int64_t( 0 );
+        return time;
+    };
+
+    const Vector<uint32_t>* zonesToIterate = &zones;
+    Vector<uint32_t> sortedZones;
 
     const auto& sortspec = *ImGui::TableGetSortSpecs()->Specs;
     if( sortspec.ColumnIndex != 0 || sortspec.SortDirection != ImGuiSortDirection_Ascending )
@@ -105,84 +251,79 @@ void View::DrawZoneList( int id, const Vector<short_ptr<ZoneEvent>>& zones )
         case 1:
             if( m_findZone.selfTime )
             {
+                const auto self = zoneData.self.data();
                 if( sortspec.SortDirection == ImGuiSortDirection_Descending )
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        return m_worker.GetZoneEndDirect( *lhs ) - lhs->Start() - this->GetZoneChildTimeFast( *lhs ) >
-                            m_worker.GetZoneEndDirect( *rhs ) - rhs->Start() - this->GetZoneChildTimeFast( *rhs );
-                        } );
+                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [self]( const auto& lhs, const auto& rhs ) { return self[lhs] > self[rhs]; } );
                 }
                 else
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        return m_worker.GetZoneEndDirect( *lhs ) - lhs->Start() - this->GetZoneChildTimeFast( *lhs ) <
-                            m_worker.GetZoneEndDirect( *rhs ) - rhs->Start() - this->GetZoneChildTimeFast( *rhs );
-                        } );
+                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [self]( const auto& lhs, const auto& rhs ) { return self[lhs] < self[rhs]; } );
                 }
             }
             else if( m_findZone.runningTime )
             {
+                // Running times are looked up once, and not in each comparison.
+                std::vector<std::pair<int64_t, uint32_t>> runningTimes;
+                runningTimes.reserve( zones.size() );
+                for( auto idx : zones ) runningTimes.emplace_back( RunningTime( idx ), idx );
                 if( sortspec.SortDirection == ImGuiSortDirection_Descending )
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        const auto ctx0 = m_worker.GetContextSwitchData( GetZoneThread( *lhs ) );
-                        const auto ctx1 = m_worker.GetContextSwitchData( GetZoneThread( *rhs ) );
-                        int64_t t0, t1;
-                        uint64_t c0, c1;
-                        GetZoneRunningTime( ctx0, *lhs, t0, c0 );
-                        GetZoneRunningTime( ctx1, *rhs, t1, c1 );
-                        return t0 > t1;
-                        } );
+                    pdqsort_branchless( runningTimes.begin(), runningTimes.end(), []( const auto& lhs, const auto& rhs ) { return lhs.first > rhs.first; } );
                 }
                 else
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        const auto ctx0 = m_worker.GetContextSwitchData( GetZoneThread( *lhs ) );
-                        const auto ctx1 = m_worker.GetContextSwitchData( GetZoneThread( *rhs ) );
-                        int64_t t0, t1;
-                        uint64_t c0, c1;
-                        GetZoneRunningTime( ctx0, *lhs, t0, c0 );
-                        GetZoneRunningTime( ctx1, *rhs, t1, c1 );
-                        return t0 < t1;
-                        } );
+                    pdqsort_branchless( runningTimes.begin(), runningTimes.end(), []( const auto& lhs, const auto& rhs ) { return lhs.first < rhs.first; } );
                 }
+                for( size_t i=0; i<runningTimes.size(); i++ ) sortedZones[i] = runningTimes[i].second;
             }
             else
             {
+                const auto start = zoneData.start.data();
+                const auto end = zoneData.end.data();
                 if( sortspec.SortDirection == ImGuiSortDirection_Descending )
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        return m_worker.GetZoneEndDirect( *lhs ) - lhs->Start() > m_worker.GetZoneEndDirect( *rhs ) - rhs->Start();
+                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [start, end]( const auto& lhs, const auto& rhs ) {
+                        return end[lhs] - start[lhs] > end[rhs] - start[rhs];
                         } );
                 }
                 else
                 {
-                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                        return m_worker.GetZoneEndDirect( *lhs ) - lhs->Start() < m_worker.GetZoneEndDirect( *rhs ) - rhs->Start();
+                    pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [start, end]( const auto& lhs, const auto& rhs ) {
+                        return end[lhs] - start[lhs] < end[rhs] - start[rhs];
                         } );
                 }
             }
             break;
         case 2:
+        {
+            const auto HasName = [this, &zoneData] ( uint32_t idx ) {
+                auto ev = m_worker.LoadSourceLocationZone( zoneData, idx );
+                return m_worker.HasZoneExtra( *ev ) && m_worker.GetZoneExtra( *ev ).name.Active();
+            };
+            const auto Name = [this, &zoneData] ( uint32_t idx ) {
+                return m_worker.GetString( m_worker.GetZoneExtra( *m_worker.LoadSourceLocationZone( zoneData, idx ) ).name );
+            };
             if( sortspec.SortDirection == ImGuiSortDirection_Descending )
             {
-                pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                    const auto hle = m_worker.HasZoneExtra( *lhs );
-                    const auto hre = m_worker.HasZoneExtra( *rhs );
+                pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [&]( const auto& lhs, const auto& rhs ) {
+                    const auto hle = HasName( lhs );
+                    const auto hre = HasName( rhs );
                     if( !( hle & hre ) ) return hle > hre;
-                    return strcmp( m_worker.GetString( m_worker.GetZoneExtra( *lhs ).name ), m_worker.GetString( m_worker.GetZoneExtra( *rhs ).name ) ) < 0;
+                    return strcmp( Name( lhs ), Name( rhs ) ) < 0;
                     } );
             }
             else
             {
-                pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [this]( const auto& lhs, const auto& rhs ) {
-                    const auto hle = m_worker.HasZoneExtra( *lhs );
-                    const auto hre = m_worker.HasZoneExtra( *rhs );
+                pdqsort_branchless( sortedZones.begin(), sortedZones.end(), [&]( const auto& lhs, const auto& rhs ) {
+                    const auto hle = HasName( lhs );
+                    const auto hre = HasName( rhs );
                     if( !( hle & hre ) ) return hle < hre;
-                    return strcmp( m_worker.GetString( m_worker.GetZoneExtra( *lhs ).name ), m_worker.GetString( m_worker.GetZoneExtra( *rhs ).name ) ) > 0;
+                    return strcmp( Name( lhs ), Name( rhs ) ) > 0;
                     } );
             }
             break;
+        }
         default:
             assert( false );
             break;
@@ -198,24 +339,22 @@ void View::DrawZoneList( int id, const Vector<short_ptr<ZoneEvent>>& zones )
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
 
-            auto ev = (*zonesToIterate)[i].get();
-            const auto end = m_worker.GetZoneEndDirect( *ev );
+            // Only the shown zones are needed, so only their timelines are loaded.
+            const auto idx = (*zonesToIterate)[i];
+            auto ev = m_worker.LoadSourceLocationZone( zoneData, idx );
             int64_t timespan;
             if( m_findZone.runningTime )
             {
-                const auto ctx = m_worker.GetContextSwitchData( GetZoneThread( *ev ) );
-                uint64_t cnt;
-                GetZoneRunningTime( ctx, *ev, timespan, cnt );
+                timespan = RunningTime( idx );
             }
             else
             {
-                timespan = end - ev->Start();
-                if( m_findZone.selfTime ) timespan -= GetZoneChildTimeFast( *ev );
+                timespan = m_findZone.selfTime ? zoneData.self[idx] : zoneData.end[idx] - zoneData.start[idx];
             }
 
             ImGui::PushID( ev );
             if( m_zoneHover == ev ) ImGui::PushStyleColor( ImGuiCol_Text, ImVec4( 0, 1, 0, 1 ) );
-            if( ImGui::Selectable( TimeToStringExact( ev->Start() ), m_zoneInfoWindow == ev, ImGuiSelectableFlags_SpanAllColumns ) )
+            if( ImGui::Selectable( TimeToStringExact( zoneData.start[idx] ), m_zoneInfoWindow == ev, ImGuiSelectableFlags_SpanAllColumns ) )
             {
                 ShowZoneInfo( *ev );
             }
@@ -394,7 +533,30 @@ void View::DrawFindZone()
 
         auto& zoneData = m_worker.GetZonesForSourceLocation( m_findZone.match[m_findZone.selMatch] );
         auto& zones = zoneData.zones;
-        zones.ensure_sorted();
+        if( !zones.is_sorted() && ( m_findZone.processed > 0 || m_findZone.sortedNum > 0 ) )
+        {
+            // Groups keep list indices, and the histogram data covers a list prefix.
+            // Sorting in the new zones may move them into the part already done.
+            const auto se = zones.sorted_end();
+            const auto tailMin = *std::min_element( zoneData.start.begin() + se, zoneData.start.end() );
+            auto moved = [&] ( size_t num ) { return num > se || ( num > 0 && zoneData.start[num - 1] >= tailMin ); };
+            const bool histogramMoved = moved( m_findZone.sortedNum );
+            if( histogramMoved || moved( m_findZone.processed ) )
+            {
+                const auto selGroup = m_findZone.selGroup;
+                if( histogramMoved )
+                {
+                    m_findZone.ResetMatch();
+                }
+                else
+                {
+                    m_findZone.ResetGroups();
+                }
+                m_findZone.selGroup = selGroup;
+                m_filteredZones.clear();
+            }
+        }
+        zoneData.EnsureSorted();
         if( ImGui::TreeNodeEx( "Histogram", ImGuiTreeNodeFlags_DefaultOpen ) )
         {
             const auto ty = ImGui::GetTextLineHeight();
@@ -415,95 +577,81 @@ void View::DrawFindZone()
                     {
                         for( i=m_findZone.sortedNum; i<zsz; i++ )
                         {
-                            auto& zone = *zones[i].Zone();
-                            const auto end = zone.End();
-                            if( end > rangeMax || zone.Start() < rangeMin ) continue;
+                            if( zoneData.end[i] > rangeMax || zoneData.start[i] < rangeMin ) continue;
                             const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( zones[i].Thread() ) );
                             if( !ctx ) break;
                             int64_t t;
                             uint64_t cnt;
-                            if( !GetZoneRunningTime( ctx, zone, t, cnt ) ) break;
+                            if( !GetZoneRunningTime( ctx, zoneData.start[i], zoneData.end[i], t, cnt ) ) break;
                             vec.push_back_no_space_check( t );
-                            total += t;
-                            if( t < tmin ) tmin = t;
-                            else if( t > tmax ) tmax = t;
                         }
                     }
                     else
                     {
                         for( i=m_findZone.sortedNum; i<zsz; i++ )
                         {
-                            auto& zone = *zones[i].Zone();
                             const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( zones[i].Thread() ) );
                             if( !ctx ) break;
                             int64_t t;
                             uint64_t cnt;
-                            if( !GetZoneRunningTime( ctx, zone, t, cnt ) ) break;
+                            if( !GetZoneRunningTime( ctx, zoneData.start[i], zoneData.end[i], t, cnt ) ) break;
                             vec.push_back_no_space_check( t );
-                            total += t;
-                            if( t < tmin ) tmin = t;
-                            else if( t > tmax ) tmax = t;
                         }
                     }
                 }
-                else if( m_findZone.selfTime )
+                else
                 {
-                    tmin = zoneData.selfMin;
-                    tmax = zoneData.selfMax;
-                    if( m_findZone.range.active )
+                    if( m_findZone.selfTime )
                     {
-                        for( i=m_findZone.sortedNum; i<zsz; i++ )
-                        {
-                            auto& zone = *zones[i].Zone();
-                            const auto end = zone.End();
-                            const auto start = zone.Start();
-                            if( end > rangeMax || start < rangeMin ) continue;
-                            const auto t = end - start - GetZoneChildTimeFast( zone );
-                            vec.push_back_no_space_check( t );
-                            total += t;
-                        }
+                        tmin = zoneData.selfMin;
+                        tmax = zoneData.selfMax;
                     }
                     else
                     {
-                        for( i=m_findZone.sortedNum; i<zsz; i++ )
+                        tmin = zoneData.min;
+                        tmax = zoneData.max;
+                    }
+                    const auto base = m_findZone.sortedNum;
+                    const auto selfTime = m_findZone.selfTime;
+                    const auto limitRange = m_findZone.range.active;
+                    const auto zstart = zoneData.start.data() + base;
+                    const auto zend = zoneData.end.data() + base;
+                    const auto zself = zoneData.self.data() + base;
+                    // Zones outside of the range are marked with the minimum value.
+                    std::vector<int64_t> times( zsz - base );
+                    RunFindZoneJobs( zsz - base, [&] ( size_t begin, size_t end ) {
+                        if( selfTime )
                         {
-                            auto& zone = *zones[i].Zone();
-                            const auto end = zone.End();
-                            const auto t = end - zone.Start() - GetZoneChildTimeFast( zone );
-                            vec.push_back_no_space_check( t );
-                            total += t;
+                            for( size_t j=begin; j<end; j++ ) times[j] = zself[j];
                         }
-                    }
-                }
-                else
-                {
-                    tmin = zoneData.min;
-                    tmax = zoneData.max;
-                    if( m_findZone.range.active )
-                    {
-                        for( i=m_findZone.sortedNum; i<zsz; i++ )
+                        else
                         {
-                            auto& zone = *zones[i].Zone();
-                            const auto end = zone.End();
-                            const auto start = zone.Start();
-                            if( end > rangeMax || start < rangeMin ) continue;
-                            const auto t = end - start;
-                            vec.push_back_no_space_check( t );
-                            total += t;
+                            for( size_t j=begin; j<end; j++ ) times[j] = zend[j] - zstart[j];
                         }
-                    }
-                    else
-                    {
-                        for( i=m_findZone.sortedNum; i<zsz; i++ )
+                        if( limitRange )
                         {
-                            auto& zone = *zones[i].Zone();
-                            const auto end = zone.End();
-                            const auto t = end - zone.Start();
-                            vec.push_back_no_space_check( t );
-                            total += t;
+                            for( size_t j=begin; j<end; j++ )
+                            {
+                                if( zend[j] > rangeMax || zstart[j] < rangeMin ) times[j] = std::numeric_limits<int64_t>::min();
+                            }
                         }
+                    } );
+                    for( auto t : times )
+                    {
+                        if( t != std::numeric_limits<int64_t>::min() ) vec.push_back_no_space_check( t );
                     }
+                    i = zsz;
+                }
+
+                DurationStats stats;
+                AggregateDurations( vec.data() + vszorig, vec.size() - vszorig, stats );
+                total += stats.total;
+                if( m_findZone.runningTime )
+                {
+                    tmin = std::min( tmin, stats.min );
+                    tmax = std::max( tmax, stats.max );
                 }
+
                 auto mid = vec.begin() + vszorig;
 #ifdef NO_PARALLEL_SORT
                 pdqsort_branchless( mid, vec.end() );
@@ -518,6 +666,7 @@ void View::DrawFindZone()
                     m_findZone.average = float( total ) / vsz;
                     m_findZone.median = vec[vsz/2];
                     m_findZone.total = total;
+                    m_findZone.sumSq += stats.sumSq;
                     m_findZone.sortedNum = i;
                     m_findZone.tmin = tmin;
                     m_findZone.tmax = tmax;
@@ -529,7 +678,6 @@ void View::DrawFindZone()
                 if( m_findZone.selSortNum != m_findZone.sortedNum )
                 {
                     const auto selGroup = m_findZone.selGroup;
-                    const auto groupBy = m_findZone.groupBy;
 
                     auto& vec = m_findZone.selSort;
                     vec.reserve( zsz );
@@ -542,17 +690,15 @@ void View::DrawFindZone()
                             for( size_t i=m_findZone.selSortNum; i<m_findZone.sortedNum; i++ )
                             {
                                 auto& ev = zones[i];
-                                if( ev.Zone()->End() > rangeMax || ev.Zone()->Start() < rangeMin ) continue;
+                                if( zoneData.end[i] > rangeMax || zoneData.start[i] < rangeMin ) continue;
                                 if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
+                                if( selGroup == GetFindZoneTarget( ev, i ) )
                                 {
                                     const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( zones[i].Thread() ) );
                                     int64_t t;
                                     uint64_t cnt;
-                                    GetZoneRunningTime( ctx, *ev.Zone(), t, cnt );
+                                    GetZoneRunningTime( ctx, zoneData.start[i], zoneData.end[i], t, cnt );
                                     vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
                                 }
                             }
                         }
@@ -562,87 +708,51 @@ void View::DrawFindZone()
                             {
                                 auto& ev = zones[i];
                                 if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
+                                if( selGroup == GetFindZoneTarget( ev, i ) )
                                 {
                                     const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( zones[i].Thread() ) );
                                     int64_t t;
                                     uint64_t cnt;
-                                    GetZoneRunningTime( ctx, *ev.Zone(), t, cnt );
+                                    GetZoneRunningTime( ctx, zoneData.start[i], zoneData.end[i], t, cnt );
                                     vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
-                                }
-                            }
-                        }
-                    }
-                    else if( m_findZone.selfTime )
-                    {
-                        if( m_findZone.range.active )
-                        {
-                            for( size_t i=m_findZone.selSortNum; i<m_findZone.sortedNum; i++ )
-                            {
-                                auto& ev = zones[i];
-                                if( ev.Zone()->End() > rangeMax || ev.Zone()->Start() < rangeMin ) continue;
-                                if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
-                                {
-                                    const auto t = ev.Zone()->End() - ev.Zone()->Start() - GetZoneChildTimeFast( *ev.Zone() );
-                                    vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            for( size_t i=m_findZone.selSortNum; i<m_findZone.sortedNum; i++ )
-                            {
-                                auto& ev = zones[i];
-                                if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
-                                {
-                                    const auto t = ev.Zone()->End() - ev.Zone()->Start() - GetZoneChildTimeFast( *ev.Zone() );
-                                    vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
                                 }
                             }
                         }
                     }
                     else
                     {
-                        if( m_findZone.range.active )
-                        {
-                            for( size_t i=m_findZone.selSortNum; i<m_findZone.sortedNum; i++ )
+                        const auto base = m_findZone.selSortNum;
+                        const auto selfTime = m_findZone.selfTime;
+                        const auto limitRange = m_findZone.range.active;
+                        const auto zstart = zoneData.start.data();
+                        const auto zend = zoneData.end.data();
+                        const auto zself = zoneData.self.data();
+                        // Zones which are not selected are marked with the minimum value.
+                        std::vector<int64_t> times( m_findZone.sortedNum - base );
+                        RunFindZoneJobs( m_findZone.sortedNum - base, [&] ( size_t begin, size_t end ) {
+                            for( size_t j=begin; j<end; j++ )
                             {
+                                const auto i = base + j;
                                 auto& ev = zones[i];
-                                if( ev.Zone()->End() > rangeMax || ev.Zone()->Start() < rangeMin ) continue;
-                                if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
+                                if( ( limitRange && ( zend[i] > rangeMax || zstart[i] < rangeMin ) ) || m_filteredZones.contains( &ev ) || selGroup != GetFindZoneTarget( ev, i ) )
                                 {
-                                    const auto t = ev.Zone()->End() - ev.Zone()->Start();
-                                    vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
+                                    times[j] = std::numeric_limits<int64_t>::min();
                                 }
-                            }
-                        }
-                        else
-                        {
-                            for( size_t i=m_findZone.selSortNum; i<m_findZone.sortedNum; i++ )
-                            {
-                                auto& ev = zones[i];
-                                if( m_filteredZones.contains( &ev ) ) continue;
-                                if( selGroup == GetSelectionTarget( ev, groupBy ) )
+                                else
                                 {
-                                    const auto t = ev.Zone()->End() - ev.Zone()->Start();
-                                    vec.push_back_no_space_check( t );
-                                    act++;
-                                    total += t;
+                                    times[j] = selfTime ? zself[i] : zend[i] - zstart[i];
                                 }
                             }
+                        } );
+                        for( auto t : times )
+                        {
+                            if( t != std::numeric_limits<int64_t>::min() ) vec.push_back_no_space_check( t );
                         }
                     }
+                    DurationStats stats;
+                    AggregateDurations( vec.data() + act, vec.size() - act, stats );
+                    act += stats.count;
+                    total += stats.total;
                     if( !vec.empty() )
                     {
                         auto mid = vec.begin() + m_findZone.selSortActive;
@@ -929,6 +1039,19 @@ void View::DrawFindZone()
                         ImGui::Spacing();
                         ImGui::SameLine();
                         TextFocused( "Max counts:", cumulateTime ? TimeToString( maxVal ) : RealToString( maxVal ) );
+                        size_t droppedCnt;
+                        int64_t droppedTotal;
+                        if( EstimateDroppedZones( m_findZone.match[m_findZone.selMatch], m_findZone.sorted.size(), droppedCnt, droppedTotal ) )
+                        {
+                            ImGui::SameLine();
+                            ImGui::Spacing();
+                            ImGui::SameLine();
+                            TextFocused( "Sampled, not sent:", RealToString( droppedCnt ) );
+                            ImGui::SameLine();
+                            ImGui::TextDisabled( "(%s)", TimeToString( droppedTotal ) );
+                            ImGui::SameLine();
+                            DrawHelpMarker( "This zone is sampled. Instances which were not sent have no timestamps and are not included in the histogram, total time or the statistics below. Their count and time are scaled to the share of the sent instances that are shown." );
+                        }
                         TextFocused( "Mean:", TimeToString( m_findZone.average ) );
                         ImGui::SameLine();
                         ImGui::Spacing();
@@ -953,11 +1076,11 @@ void View::DrawFindZone()
                             }
                             TextFocused( "Mode:", TimeToString( ( t0 + t1 ) / 2 ) );
                         }
-                        if( !m_findZone.range.active && m_findZone.sorted.size() > 1 )
+                        if( m_findZone.sorted.size() > 1 )
                         {
                             const auto sz = m_findZone.sorted.size();
                             const auto avg = m_findZone.average;
-                            const auto ss = zoneData.sumSq - 2. * zoneData.total * avg + avg * avg * sz;
+                            const auto ss = m_findZone.sumSq - 2. * m_findZone.total * avg + avg * avg * sz;
                             const auto sd = sqrt( ss / ( sz - 1 ) );
 
                             ImGui::SameLine();
@@ -1433,121 +1556,62 @@ void View::DrawFindZone()
         ImGui::SameLine();
         DrawHelpMarker( "Mean time per call" );
 
-        const auto hmin = std::min( m_findZone.highlight.start, m_findZone.highlight.end );
-        const auto hmax = std::max( m_findZone.highlight.start, m_findZone.highlight.end );
         const auto groupBy = m_findZone.groupBy;
-        const auto highlightActive = m_findZone.highlight.active;
-        const auto limitRange = m_findZone.range.active;
+        const bool groupsResolved = ResolveFindZoneGroups( m_findZone.match[m_findZone.selMatch] );
+        if( !groupsResolved )
+        {
+            ImGui::TextDisabled( "Loading timelines: %s / %s zones", RealToString( m_findZone.gidResolved ), RealToString( zones.size() ) );
+        }
         FindZone::Group* group = nullptr;
         constexpr uint64_t invalidGid = std::numeric_limits<uint64_t>::max() - 1;
         uint64_t lastGid = invalidGid;
-        auto zptr = zones.data() + m_findZone.processed;
-        const auto zend = zones.data() + zones.size();
-        while( zptr < zend )
+        const auto zbegin = zones.data() + m_findZone.processed;
+        const auto zend = groupsResolved ? zones.data() + zones.size() : zbegin;
+        const auto zstart = zoneData.start.data() + m_findZone.processed;
+        const auto zfinish = zoneData.end.data() + m_findZone.processed;
+        const auto zself = zoneData.self.data() + m_findZone.processed;
+        // Matching is done in parallel, except for running time, as context switch
+        // data lookups are not thread safe. Zones are added to groups in order.
+        std::vector<FindZone::ZoneMatch> matches;
+        if( !m_findZone.runningTime && zbegin < zend )
         {
-            auto& ev = *zptr;
-            const auto end = ev.Zone()->End();
-            const auto start = ev.Zone()->Start();
-            if( limitRange && ( start < rangeMin || end > rangeMax ) )
-            {
-                zptr++;
-                continue;
-            }
-
-            if( m_userTextFilter.IsActive() )
-            {
-                bool keep = false;
-                if ( m_worker.HasZoneExtra( *ev.Zone() ) && m_worker.GetZoneExtra( *ev.Zone() ).text.Active() )
+            matches.resize( zend - zbegin );
+            RunFindZoneJobs( zend - zbegin, [&] ( size_t begin, size_t end ) {
+                for( size_t j=begin; j<end; j++ )
                 {
-                    auto text = m_worker.GetString( m_worker.GetZoneExtra( *ev.Zone() ).text );
-                    if( m_userTextFilter.PassFilter( text ) )
-                    {
-                        keep = true;
-                    }
+                    auto& m = matches[j];
+                    m.result = MatchFindZone( zbegin[j], m_findZone.processed + j, zstart[j], zfinish[j], zself[j], m.gid, m.time );
                 }
-                if( !keep )
-                {
-                    m_filteredZones.insert( &ev );
-                    zptr++;
-                    continue;
-                }
-            }
-
-            auto timespan = end - start;
-            assert( timespan != 0 );
-            if( m_findZone.selfTime )
-            {
-                timespan -= GetZoneChildTimeFast( *ev.Zone() );
-            }
-            else if( m_findZone.runningTime )
+            } );
+        }
+        auto zptr = zbegin;
+        while( zptr < zend )
+        {
+            auto& ev = *zptr;
+            const auto j = zptr - zbegin;
+            uint64_t gid;
+            int64_t timespan;
+            FindZone::MatchResult result;
+            if( matches.empty() )
             {
-                const auto ctx = m_worker.GetContextSwitchData( m_worker.DecompressThread( ev.Thread() ) );
-                if( !ctx ) break;
-                int64_t t;
-                uint64_t cnt;
-                if( !GetZoneRunningTime( ctx, *ev.Zone(), t, cnt ) ) break;
-                timespan = t;
+                result = MatchFindZone( ev, m_findZone.processed + j, zstart[j], zfinish[j], zself[j], gid, timespan );
             }
-
-            if( highlightActive )
+            else
             {
-                if( timespan < hmin || timespan > hmax )
-                {
-                    zptr++;
-                    continue;
-                }
+                const auto& m = matches[j];
+                result = m.result;
+                gid = m.gid;
+                timespan = m.time;
             }
-
+            if( result == FindZone::MatchResult::Pending ) break;
             zptr++;
-            uint64_t gid = 0;
-            switch( groupBy )
-            {
-            case FindZone::GroupBy::Thread:
-                gid = ev.Thread();
-                break;
-            case FindZone::GroupBy::UserText:
-            {
-                const auto& zone = *ev.Zone();
-                if( !m_worker.HasZoneExtra( zone ) )
-                {
-                    gid = std::numeric_limits<uint64_t>::max();
-                }
-                else
-                {
-                    const auto& extra = m_worker.GetZoneExtra( zone );
-                    gid = extra.text.Active() ? extra.text.Idx() : std::numeric_limits<uint64_t>::max();
-                }
-                break;
-            }
-            case FindZone::GroupBy::ZoneName:
-            {
-                const auto& zone = *ev.Zone();
-                if( !m_worker.HasZoneExtra( zone ) )
-                {
-                    gid = std::numeric_limits<uint64_t>::max();
-                }
-                else
-                {
-                    const auto& extra = m_worker.GetZoneExtra( zone );
-                    gid = extra.name.Active() ? extra.name.Idx() : std::numeric_limits<uint64_t>::max();
-                }
-                break;
-            }
-            case FindZone::GroupBy::Callstack:
-                gid = m_worker.GetZoneExtra( *ev.Zone() ).callstack.Val();
-                break;
-            case FindZone::GroupBy::Parent:
+            if( result == FindZone::MatchResult::Filtered )
             {
-                const auto parent = GetZoneParent( *ev.Zone(), m_worker.DecompressThread( ev.Thread() ) );
-                if( parent ) gid = uint64_t( uint16_t( parent->SrcLoc() ) );
-                break;
-            }
-            case FindZone::GroupBy::NoGrouping:
-                break;
-            default:
-                assert( false );
-                break;
+                m_filteredZones.insert( &ev );
+                continue;
             }
+            if( result == FindZone::MatchResult::Skip ) continue;
+
             if( lastGid != gid )
             {
                 lastGid = gid;
@@ -1556,15 +1620,11 @@ void View::DrawFindZone()
                 {
                     it = m_findZone.groups.emplace( gid, FindZone::Group { m_findZone.groupId++ } ).first;
                     it->second.zones.reserve( 1024 );
-                    if( m_findZone.samples.enabled )
-                        it->second.zonesTids.reserve( 1024 );
                 }
                 group = &it->second;
             }
             group->time += timespan;
-            group->zones.push_back_non_empty( ev.Zone() );
-            if( m_findZone.samples.enabled )
-                group->zonesTids.push_back_non_empty( ev.Thread() );
+            group->zones.push_back_non_empty( uint32_t( &ev - zones.data() ) );
         }
         m_findZone.processed = zptr - zones.data();
 
@@ -1725,7 +1785,7 @@ void View::DrawFindZone()
                 ImGui::Spacing();
                 if( ImGui::TreeNodeEx( "Zone list" ) )
                 {
-                    DrawZoneList( group->second.id, group->second.zones );
+                    DrawZoneList( group->second.id, m_findZone.match[m_findZone.selMatch], group->second.zones );
                 }
             }
         }
@@ -1817,7 +1877,7 @@ void View::DrawFindZone()
                 ImGui::TextColored( ImVec4( 0.5f, 0.5f, 0.5f, 1.0f ), "(%s) %s", RealToString( v->second.zones.size() ), TimeToString( v->second.time ) );
                 if( expand )
                 {
-                    DrawZoneList( v->second.id, v->second.zones );
+                    DrawZoneList( v->second.id, m_findZone.match[m_findZone.selMatch], v->second.zones );
                 }
             }
         }
@@ -1832,14 +1892,16 @@ void View::DrawFindZone()
 
             struct GroupRange {
                 const FindZone::Group* group;
-                Vector<short_ptr<ZoneEvent>>::const_iterator begin;
-                Vector<short_ptr<ZoneEvent>>::const_iterator end;
+                Vector<uint32_t>::const_iterator begin;
+                Vector<uint32_t>::const_iterator end;
             };
+            const auto zstart = zoneData.start.data();
+            const auto zend = zoneData.end.data();
+            const auto zthread = zoneData.thread.data();
             Vector<GroupRange> selectedGroups;
             selectedGroups.reserve( m_findZone.groups.size() );
             for( auto it = m_findZone.groups.begin(); it != m_findZone.groups.end(); ++it )
             {
-                assert( it->second.zones.size() == it->second.zonesTids.size() );
                 if( ( m_findZone.selGroup == m_findZone.Unselected || it->first == m_findZone.selGroup )
                     && !it->second.zones.empty() )
                 {
@@ -1884,8 +1946,8 @@ void View::DrawFindZone()
                 for( auto& g: selectedGroups )
                 {
                     const auto& zones = g.group->zones;
-                    auto begin = std::lower_bound( zones.begin(), zones.end(), firstTime, [] ( const auto& l, const auto& r ) { return l->Start() < r; } );
-                    auto end = std::upper_bound( begin, zones.end(), lastTime, [] ( const auto& l, const auto& r ) { return l <= r->Start(); } );
+                    auto begin = std::lower_bound( zones.begin(), zones.end(), firstTime, [zstart] ( const auto& l, const auto& r ) { return zstart[l] < r; } );
+                    auto end = std::upper_bound( begin, zones.end(), lastTime, [zstart] ( const auto& l, const auto& r ) { return l <= zstart[r]; } );
                     g.begin = begin;
                     g.end = end;
                     empty = empty && (begin == end);
@@ -1899,16 +1961,13 @@ void View::DrawFindZone()
                     bool pass = false;
                     for( auto& g: selectedGroups )
                     {
-                        while( g.begin != g.end && time > (*g.begin)->End() ) ++g.begin;
+                        while( g.begin != g.end && time > zend[*g.begin] ) ++g.begin;
                         if( g.begin == g.end ) continue;
-                        if( time < (*g.begin)->Start() ) continue;
+                        if( time < zstart[*g.begin] ) continue;
 
-                        const auto& tids = g.group->zonesTids;
-                        const auto firstZone = g.group->zones.begin();
-                        for (auto z = g.begin; z != g.end && (*z)->Start() <= time; ++z)
+                        for (auto z = g.begin; z != g.end && zstart[*z] <= time; ++z)
                         {
-                            auto zoneIndex = z - firstZone;
-                            if( (*z)->End() > time && it->thread == tids[zoneIndex] )
+                            if( zend[*z] > time && it->thread == zthread[*z] )
                             {
                                 pass = true;
                                 break;
@@ -1952,7 +2011,6 @@ void View::DrawFindZone()
             {
                 m_findZone.samples.enabled = true;
                 m_findZone.samples.scheduleUpdate = true;
-                m_findZone.scheduleResetMatch = true;
             }
 
             Vector<SymList> data;
@@ -1970,7 +2028,6 @@ void View::DrawFindZone()
                 m_findZone.samples.enabled = false;
                 m_findZone.samples.scheduleUpdate = false;
                 m_findZone.samples.counts = Vector<SymList>();
-                for( auto& it: m_findZone.groups ) it.second.zonesTids.clear();
             }
         }
 
@@ -262,8 +262,17 @@ void View::DrawFrames()
     if( m_worker.AreSourceLocationZonesReady() && m_findZone.show && m_findZone.showZoneInFrames && !m_findZone.match.empty() )
     {
         auto& zoneData = m_worker.GetZonesForSourceLocation( m_findZone.match[m_findZone.selMatch] );
-        zoneData.zones.ensure_sorted();
-        auto begin = zoneData.zones.begin();
+        zoneData.EnsureSorted();
+        const auto zstart = zoneData.start.data();
+        const auto zend = zoneData.end.data();
+        const auto zsz = zoneData.zones.size();
+        // Zones cut by the frame bounds need their children to get the self time.
+        // The others have it in the list, and don't need their timeline loaded.
+        const auto SelfTime = [&] ( size_t k, int64_t t0, int64_t t1 ) {
+            if( t0 == zstart[k] && t1 == zend[k] ) return zoneData.self[k];
+            return t1 - t0 - GetZoneChildTimeFastClamped( *m_worker.LoadSourceLocationZone( zoneData, k ), t0, t1 );
+        };
+        size_t begin = 0;
         while( i < onScreen && m_vd.frameStart + idx < total )
         {
             const auto f0 = m_worker.GetFrameBegin( *m_frames, m_vd.frameStart + idx );
@@ -281,19 +290,19 @@ void View::DrawFrames()
 
             int64_t zoneTime = 0;
             // This search is not valid, as zones are sorted according to their start time, not end time.
-            auto itStart = std::lower_bound( begin, zoneData.zones.end(), f0, [] ( const auto& l, const auto& r ) { return l.Zone()->End() < r; } );
-            if( itStart != zoneData.zones.end() )
+            auto itStart = size_t( std::lower_bound( zend + begin, zend + zsz, f0 ) - zend );
+            if( itStart != zsz )
             {
-                auto itEnd = std::lower_bound( itStart, zoneData.zones.end(), f1, [] ( const auto& l, const auto& r ) { return l.Zone()->Start() < r; } );
+                auto itEnd = size_t( std::lower_bound( zstart + itStart, zstart + zsz, f1 ) - zstart );
                 if( m_frames->continuous )
                 {
                     if( m_findZone.selfTime )
                     {
                         while( itStart != itEnd )
                         {
-                            const auto t0 = clamp( itStart->Zone()->Start(), f0, f1 );
-                            const auto t1 = clamp( m_worker.GetZoneEndDirect( *itStart->Zone() ), f0, f1 );
-                            zoneTime += t1 - t0 - GetZoneChildTimeFastClamped( *itStart->Zone(), t0, t1 );
+                            const auto t0 = clamp( zstart[itStart], f0, f1 );
+                            const auto t1 = clamp( zend[itStart], f0, f1 );
+                            zoneTime += SelfTime( itStart, t0, t1 );
                             itStart++;
                         }
                     }
@@ -301,8 +310,8 @@ void View::DrawFrames()
                     {
                         while( itStart != itEnd )
                         {
-                            const auto t0 = clamp( itStart->Zone()->Start(), f0, f1 );
-                            const auto t1 = clamp( m_worker.GetZoneEndDirect( *itStart->Zone() ), f0, f1 );
+                            const auto t0 = clamp( zstart[itStart], f0, f1 );
+                            const auto t1 = clamp( zend[itStart], f0, f1 );
                             zoneTime += t1 - t0;
                             itStart++;
                         }
@@ -319,9 +328,9 @@ void View::DrawFrames()
                             {
                                 const auto ft0 = m_worker.GetFrameBegin( *m_frames, m_vd.frameStart + idx + j );
                                 const auto ft1 = m_worker.GetFrameEnd( *m_frames, m_vd.frameStart + idx + j );
-                                const auto t0 = clamp( itStart->Zone()->Start(), ft0, ft1 );
-                                const auto t1 = clamp( m_worker.GetZoneEndDirect( *itStart->Zone() ), ft0, ft1 );
-                                zoneTime += t1 - t0 - GetZoneChildTimeFastClamped( *itStart->Zone(), t0, t1 );
+                                const auto t0 = clamp( zstart[itStart], ft0, ft1 );
+                                const auto t1 = clamp( zend[itStart], ft0, ft1 );
+                                zoneTime += SelfTime( itStart, t0, t1 );
                             }
                             itStart++;
                         }
@@ -335,8 +344,8 @@ void View::DrawFrames()
                             {
                                 const auto ft0 = m_worker.GetFrameBegin( *m_frames, m_vd.frameStart + idx + j );
                                 const auto ft1 = m_worker.GetFrameEnd( *m_frames, m_vd.frameStart + idx + j );
-                                const auto t0 = clamp( itStart->Zone()->Start(), ft0, ft1 );
-                                const auto t1 = clamp( m_worker.GetZoneEndDirect( *itStart->Zone() ), ft0, ft1 );
+                                const auto t0 = clamp( zstart[itStart], ft0, ft1 );
+                                const auto t1 = clamp( zend[itStart], ft0, ft1 );
                                 zoneTime += t1 - t0;
                             }
                             itStart++;
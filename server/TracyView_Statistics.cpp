@@ -1,7 +1,9 @@
 #include <sstream>
 
+#include "TracyDurationStats.hpp"
 #include "TracyFilesystem.hpp"
 #include "TracyImGui.hpp"
+#include "TracyPopcnt.hpp"
 #include "TracyPrint.hpp"
 #include "TracyView.hpp"
 
@@ -33,6 +35,113 @@ void View::AccumulationModeComboBox()
     m_statAccumulationMode = static_cast<AccumulationMode>( accumulationMode );
 }
 
+#ifndef TRACY_NO_STATISTICS
+// Instances skipped by zone sampling carry no timestamps and are accounted for
+// as if they had no children. When only cnt of the sent instances are
+// considered (e.g. in a range), the dropped ones are assumed to be spread the
+// same way, and their count and time are scaled by the same share.
+bool View::EstimateDroppedZones( int16_t srcloc, size_t cnt, size_t& droppedCnt, int64_t& droppedTotal ) const
+{
+    auto& dropped = m_worker.GetSourceLocationDropped();
+    auto it = dropped.find( srcloc );
+    if( it == dropped.end() ) return false;
+    const auto sent = m_worker.GetZonesForSourceLocation( srcloc ).zones.size();
+    if( cnt >= sent )
+    {
+        droppedCnt = it->second.count;
+        droppedTotal = it->second.total;
+    }
+    else
+    {
+        const auto share = double( cnt ) / sent;
+        droppedCnt = size_t( it->second.count * share + 0.5 );
+        droppedTotal = int64_t( it->second.total * share );
+    }
+    return true;
+}
+
+void View::AddDroppedZones( int16_t srcloc, size_t& cnt, int64_t& total ) const
+{
+    size_t droppedCnt;
+    int64_t droppedTotal;
+    if( cnt != 0 && EstimateDroppedZones( srcloc, cnt, droppedCnt, droppedTotal ) )
+    {
+        cnt += droppedCnt;
+        total += droppedTotal;
+    }
+}
+
+// Uses the worker's range index if it's available, otherwise goes through all zones.
+void View::CalcRangeStatistics( int16_t srcloc, size_t& cnt, int64_t& total, uint16_t& threadNum )
+{
+    const auto min = m_statRange.min;
+    const auto max = m_statRange.max;
+
+    Worker::ZoneRangeStatistics rs;
+    if( m_worker.GetZoneRangeStatistics( srcloc, min, max, rs ) )
+    {
+        switch( m_statAccumulationMode )
+        {
+        case AccumulationMode::SelfOnly:
+            cnt = rs.count;
+            total = rs.selfTotal;
+            threadNum = rs.threadNum;
+            break;
+        case AccumulationMode::AllChildren:
+            cnt = rs.count;
+            total = rs.total;
+            threadNum = rs.threadNum;
+            break;
+        case AccumulationMode::NonReentrantChildren:
+            cnt = rs.nonReentrantCount;
+            total = rs.nonReentrantTotal;
+            threadNum = rs.nonReentrantThreadNum;
+            break;
+        }
+        AddDroppedZones( srcloc, cnt, total );
+        return;
+    }
+
+    // Zones are sorted by start time, so only the ones which start within the range have to be checked.
+    auto& slz = m_worker.GetZonesForSourceLocation( srcloc );
+    slz.EnsureSorted();
+    const auto zbegin = size_t( std::lower_bound( slz.start.begin(), slz.start.end(), min ) - slz.start.begin() );
+    const auto zend = size_t( std::upper_bound( slz.start.begin() + zbegin, slz.start.end(), max ) - slz.start.begin() );
+
+    uint64_t threads[64*1024/64] = {};
+    if( m_statAccumulationMode == AccumulationMode::NonReentrantChildren )
+    {
+        cnt = 0;
+        total = 0;
+        for( size_t i=zbegin; i<zend; i++ )
+        {
+            if( slz.end[i] <= max && !slz.reentrant[i] )
+            {
+                total += slz.end[i] - slz.start[i];
+                cnt++;
+                threads[slz.thread[i] / 64] |= uint64_t( 1 ) << ( slz.thread[i] % 64 );
+            }
+        }
+    }
+    else
+    {
+        DurationStats stats;
+        const auto self = m_statAccumulationMode == AccumulationMode::SelfOnly ? slz.self.data() + zbegin : nullptr;
+        AggregateDurations( slz.start.data() + zbegin, slz.end.data() + zbegin, self, zend - zbegin, min, max, stats );
+        cnt = stats.count;
+        total = stats.total;
+        for( size_t i=zbegin; i<zend; i++ )
+        {
+            if( slz.end[i] <= max ) threads[slz.thread[i] / 64] |= uint64_t( 1 ) << ( slz.thread[i] % 64 );
+        }
+    }
+    size_t num = 0;
+    for( auto v : threads ) num += TracyCountBits( v );
+    threadNum = (uint16_t)num;
+    AddDroppedZones( srcloc, cnt, total );
+}
+#endif
+
 void View::DrawStatistics()
 {
     const auto scale = GetScale();
@@ -127,32 +236,10 @@ void View::DrawStatistics()
                         }
                         else
                         {
-                            unordered_flat_set<uint16_t> threads;
-                            size_t cnt = 0;
-                            int64_t total = 0;
-                            for( auto& v : it->second.zones )
-                            {
-                                auto& z = *v.Zone();
-                                const auto start = z.Start();
-                                const auto end = z.End();
-                                if( start >= min && end <= max )
-                                {
-                                    const auto zt = end - start;
-                                    if( m_statAccumulationMode == AccumulationMode::SelfOnly )
-                                    {
-                                        total += zt - GetZoneChildTimeFast( z );
-                                        cnt++;
-                                        threads.emplace( v.Thread() );
-                                    }
-                                    else if( m_statAccumulationMode == AccumulationMode::AllChildren || !IsZoneReentry( z ) )
-                                    {
-                                        total += zt;
-                                        cnt++;
-                                        threads.emplace( v.Thread() );
-                                    }
-                                }
-                            }
-                            const auto threadNum = (uint16_t)threads.size();
+                            size_t cnt;
+                            int64_t total;
+                            uint16_t threadNum;
+                            CalcRangeStatistics( it->first, cnt, total, threadNum );
                             if( cnt != 0 )
                             {
                                 slzcnt++;
@@ -178,32 +265,10 @@ void View::DrawStatistics()
                             }
                             else
                             {
-                                unordered_flat_set<uint16_t> threads;
-                                size_t cnt = 0;
-                                int64_t total = 0;
-                                for( auto& v : it->second.zones )
-                                {
-                                    auto& z = *v.Zone();
-                                    const auto start = z.Start();
-                                    const auto end = z.End();
-                                    if( start >= min && end <= max )
-                                    {
-                                        const auto zt = end - start;
-                                        if( m_statAccumulationMode == AccumulationMode::SelfOnly )
-                                        {
-                                            total += zt - GetZoneChildTimeFast( z );
-                                            cnt++;
-                                            threads.emplace( v.Thread() );
-                                        }
-                                        else if( m_statAccumulationMode == AccumulationMode::AllChildren || !IsZoneReentry( z ) )
-                                        {
-                                            total += zt;
-                                            cnt++;
-                                            threads.emplace( v.Thread() );
-                                        }
-                                    }
-                                }
-                                const auto threadNum = (uint16_t)threads.size();
+                                size_t cnt;
+                                int64_t total;
+                                uint16_t threadNum;
+                                CalcRangeStatistics( it->first, cnt, total, threadNum );
                                 if( cnt != 0 )
                                 {
                                     srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, threadNum, cnt, total } );
@@ -239,6 +304,7 @@ void View::DrawStatistics()
                         total = it->second.nonReentrantTotal;
                         break;
                     }
+                    AddDroppedZones( it->first, count, total );
                     if( !filterActive )
                     {
                         srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, (uint16_t)it->second.threadCnt.size(), count, total } );
@@ -225,10 +225,11 @@ const ZoneEvent* View::GetZoneParent( const ZoneEvent& zone ) const
         auto& slz = m_worker.GetZonesForSourceLocation( zone.SrcLoc() );
         if( !slz.zones.empty() && slz.zones.is_sorted() )
         {
-            auto it = std::lower_bound( slz.zones.begin(), slz.zones.end(), zone.Start(), [] ( const auto& lhs, const auto& rhs ) { return lhs.Zone()->Start() < rhs; } );
-            if( it != slz.zones.end() && it->Zone() == &zone )
+            auto it = std::lower_bound( slz.start.begin(), slz.start.end(), zone.Start() );
+            const auto idx = size_t( it - slz.start.begin() );
+            if( it != slz.start.end() && slz.zones[idx].Zone() == &zone )
             {
-                return GetZoneParent( zone, m_worker.DecompressThread( it->Thread() ) );
+                return GetZoneParent( zone, m_worker.DecompressThread( slz.thread[idx] ) );
             }
         }
     }
@@ -308,10 +309,11 @@ bool View::IsZoneReentry( const ZoneEvent& zone ) const
         auto& slz = m_worker.GetZonesForSourceLocation( zone.SrcLoc() );
         if( !slz.zones.empty() && slz.zones.is_sorted() )
         {
-            auto it = std::lower_bound( slz.zones.begin(), slz.zones.end(), zone.Start(), [] ( const auto& lhs, const auto& rhs ) { return lhs.Zone()->Start() < rhs; } );
-            if( it != slz.zones.end() && it->Zone() == &zone )
+            auto it = std::lower_bound( slz.start.begin(), slz.start.end(), zone.Start() );
+            const auto idx = size_t( it - slz.start.begin() );
+            if( it != slz.start.end() && slz.zones[idx].Zone() == &zone )
             {
-                return IsZoneReentry( zone, m_worker.DecompressThread( it->Thread() ) );
+                return slz.reentrant[idx] != 0;
             }
         }
     }
@@ -352,41 +354,6 @@ bool View::IsZoneReentry( const ZoneEvent& zone ) const
     return false;
 }
 
-bool View::IsZoneReentry( const ZoneEvent& zone, uint64_t tid ) const
-{
-    const auto thread = m_worker.GetThreadData( tid );
-    const ZoneEvent* parent = nullptr;
-    const Vector<short_ptr<ZoneEvent>>* timeline = &thread->timeline;
-    if( timeline->empty() ) return false;
-    for(;;)
-    {
-        if( timeline->is_magic() )
-        {
-            auto vec = (Vector<ZoneEvent>*)timeline;
-            auto it = std::upper_bound( vec->begin(), vec->end(), zone.Start(), [] ( const auto& l, const auto& r ) { return l < r.Start(); } );
-            if( it != vec->begin() ) --it;
-            if( zone.IsEndValid() && it->Start() > zone.End() ) break;
-            if( it == &zone ) return false;
-            if( !it->HasChildren() ) break;
-            parent = it;
-            if (parent->SrcLoc() == zone.SrcLoc() ) return true;
-            timeline = &m_worker.GetZoneChildren( parent->Child() );
-        }
-        else
-        {
-            auto it = std::upper_bound( timeline->begin(), timeline->end(), zone.Start(), [] ( const auto& l, const auto& r ) { return l < r->Start(); } );
-            if( it != timeline->begin() ) --it;
-            if( zone.IsEndValid() && (*it)->Start() > zone.End() ) break;
-            if( *it == &zone ) return false;
-            if( !(*it)->HasChildren() ) break;
-            parent = *it;
-            if (parent->SrcLoc() == zone.SrcLoc() ) return true;
-            timeline = &m_worker.GetZoneChildren( parent->Child() );
-        }
-    }
-    return false;
-}
-
 const GpuEvent* View::GetZoneParent( const GpuEvent& zone ) const
 {
     for( const auto& ctx : m_worker.GetGpuData() )
@@ -433,10 +400,11 @@ const ThreadData* View::GetZoneThreadData( const ZoneEvent& zone ) const
         auto& slz = m_worker.GetZonesForSourceLocation( zone.SrcLoc() );
         if( !slz.zones.empty() && slz.zones.is_sorted() )
         {
-            auto it = std::lower_bound( slz.zones.begin(), slz.zones.end(), zone.Start(), [] ( const auto& lhs, const auto& rhs ) { return lhs.Zone()->Start() < rhs; } );
-            if( it != slz.zones.end() && it->Zone() == &zone )
+            auto it = std::lower_bound( slz.start.begin(), slz.start.end(), zone.Start() );
+            const auto idx = size_t( it - slz.start.begin() );
+            if( it != slz.start.end() && slz.zones[idx].Zone() == &zone )
             {
-                return m_worker.GetThreadData( m_worker.DecompressThread( it->Thread() ) );
+                return m_worker.GetThreadData( m_worker.DecompressThread( slz.thread[idx] ) );
             }
         }
     }
@@ -472,6 +440,25 @@ const ThreadData* View::GetZoneThreadData( const ZoneEvent& zone ) const
     return nullptr;
 }
 
+// Drops references to zones of a timeline which is about to be evicted. Each
+// zone is still valid here, as references are dropped with every eviction.
+void View::ForgetThreadZones( const ThreadData* td )
+{
+    const auto InThread = [this, td] ( const ZoneEvent* zone ) { return zone && GetZoneThreadData( *zone ) == td; };
+    if( InThread( m_zoneInfoWindow ) ) m_zoneInfoWindow = nullptr;
+    if( InThread( m_zoneHighlight ) ) m_zoneHighlight = nullptr;
+    if( InThread( m_zoneHover ) ) m_zoneHover = nullptr;
+    if( InThread( m_zoneHover2 ) ) m_zoneHover2 = nullptr;
+    if( InThread( m_cache.zoneSelfTime.first ) ) m_cache.zoneSelfTime = { nullptr, 0 };
+    if( InThread( m_cache.zoneSelfTime2.first ) ) m_cache.zoneSelfTime2 = { nullptr, 0 };
+    if( InThread( m_timeDist.dataValidFor ) ) m_timeDist.dataValidFor = nullptr;
+    for( size_t i=0; i<m_zoneInfoStack.size(); )
+    {
+        if( InThread( m_zoneInfoStack[i] ) ) m_zoneInfoStack.erase( m_zoneInfoStack.begin() + i );
+        else i++;
+    }
+}
+
 uint64_t View::GetZoneThread( const ZoneEvent& zone ) const
 {
     auto threadData = GetZoneThreadData( zone );
@@ -607,33 +594,6 @@ int64_t View::GetZoneChildTime( const GpuEvent& zone )
     return time;
 }
 
-int64_t View::GetZoneChildTimeFast( const ZoneEvent& zone )
-{
-    int64_t time = 0;
-    if( zone.HasChildren() )
-    {
-        auto& children = m_worker.GetZoneChildren( zone.Child() );
-        if( children.is_magic() )
-        {
-            auto& vec = *(Vector<ZoneEvent>*)&children;
-            for( auto& v : vec )
-            {
-                assert( v.IsEndValid() );
-                time += v.End() - v.Start();
-            }
-        }
-        else
-        {
-            for( auto& v : children )
-            {
-                assert( v->IsEndValid() );
-                time += v->End() - v->Start();
-            }
-        }
-    }
-    return time;
-}
-
 int64_t View::GetZoneChildTimeFastClamped( const ZoneEvent& zone, int64_t t0, int64_t t1 )
 {
     int64_t time = 0;
@@ -677,13 +637,10 @@ int64_t View::GetZoneSelfTime( const ZoneEvent& zone )
 {
     if( m_cache.zoneSelfTime.first == &zone ) return m_cache.zoneSelfTime.second;
     if( m_cache.zoneSelfTime2.first == &zone ) return m_cache.zoneSelfTime2.second;
-    const auto ztime = m_worker.GetZoneEnd( zone ) - zone.Start();
-    const auto selftime = ztime - GetZoneChildTime( zone );
-    if( zone.IsEndValid() )
-    {
-        m_cache.zoneSelfTime2 = m_cache.zoneSelfTime;
-        m_cache.zoneSelfTime = std::make_pair( &zone, selftime );
-    }
+    if( !zone.IsEndValid() ) return m_worker.GetZoneEnd( zone ) - zone.Start() - GetZoneChildTime( zone );
+    const auto selftime = m_worker.GetZoneSelfTime( zone );
+    m_cache.zoneSelfTime2 = m_cache.zoneSelfTime;
+    m_cache.zoneSelfTime = std::make_pair( &zone, selftime );
     return selftime;
 }
 
@@ -703,20 +660,24 @@ int64_t View::GetZoneSelfTime( const GpuEvent& zone )
 
 bool View::GetZoneRunningTime( const ContextSwitch* ctx, const ZoneEvent& ev, int64_t& time, uint64_t& cnt )
 {
-    auto it = std::lower_bound( ctx->v.begin(), ctx->v.end(), ev.Start(), [] ( const auto& l, const auto& r ) { return (uint64_t)l.End() < (uint64_t)r; } );
+    return GetZoneRunningTime( ctx, ev.Start(), m_worker.GetZoneEnd( ev ), time, cnt );
+}
+
+bool View::GetZoneRunningTime( const ContextSwitch* ctx, int64_t start, int64_t end, int64_t& time, uint64_t& cnt )
+{
+    auto it = std::lower_bound( ctx->v.begin(), ctx->v.end(), start, [] ( const auto& l, const auto& r ) { return (uint64_t)l.End() < (uint64_t)r; } );
     if( it == ctx->v.end() ) return false;
-    const auto end = m_worker.GetZoneEnd( ev );
     const auto eit = std::upper_bound( it, ctx->v.end(), end, [] ( const auto& l, const auto& r ) { return l < r.Start(); } );
     if( eit == ctx->v.end() ) return false;
     cnt = std::distance( it, eit );
     if( cnt == 0 ) return false;
     if( cnt == 1 )
     {
-        time = end - ev.Start();
+        time = end - start;
     }
     else
     {
-        int64_t running = it->End() - ev.Start();
+        int64_t running = it->End() - start;
         ++it;
         for( uint64_t i=0; i<cnt-2; i++ )
         {
@@ -13,6 +13,8 @@
 #include <cctype>
 #include <chrono>
 #include <math.h>
+#include <numeric>
+#include <tuple>
 #include <string.h>
 
 #ifdef __MINGW32__
@@ -25,8 +27,10 @@
 
 #define ZDICT_STATIC_LINKING_ONLY
 #include "../zstd/zdict.h"
+#include "../zstd/zstd.h"
 
 #include "../public/common/TracyProtocol.hpp"
+#include "../public/common/TracySharedMemory.hpp"
 #include "../public/common/TracySystem.hpp"
 #include "../public/common/TracyYield.hpp"
 #include "../public/common/TracyStackFrames.hpp"
@@ -260,13 +264,13 @@ static bool IsQueryPrio( ServerQuery type )
 
 LoadProgress Worker::s_loadProgress;
 
-Worker::Worker( const char* addr, uint16_t port )
+Worker::Worker( const char* addr, uint16_t port, size_t netBufferSize, TaskDispatch* ingestDispatch, uint8_t wireCodec, bool pooled )
     : m_addr( addr )
     , m_port( port )
     , m_hasData( false )
     , m_stream( LZ4_createStreamDecode() )
-    , m_buffer( new char[TargetFrameSize*3 + 1] )
-    , m_bufferOffset( 0 )
+    , m_wireCodecRequest( wireCodec )
+    , m_bufferSize( std::min<size_t>( std::max<size_t>( netBufferSize, TargetFrameSize * 3 ), MaxNetBufferSize ) )
     , m_inconsistentSamples( false )
     , m_pendingStrings( 0 )
     , m_pendingThreads( 0 )
@@ -287,6 +291,7 @@ Worker::Worker( const char* addr, uint16_t port )
     m_data.symbolLocInline.push_back( std::numeric_limits<uint64_t>::max() );
     m_data.memory = m_slab.AllocInit<MemData>();
     m_data.memNameMap.emplace( 0, m_data.memory );
+    m_buffer = new char[m_bufferSize];
 
     memset( (char*)m_gpuCtxMap, 0, sizeof( m_gpuCtxMap ) );
 
@@ -299,8 +304,35 @@ Worker::Worker( const char* addr, uint16_t port )
     m_data.symbolSamplesReady = true;
 #endif
 
-    m_thread = std::thread( [this] { SetThreadName( "Tracy Worker" ); Exec(); } );
-    m_threadNet = std::thread( [this] { SetThreadName( "Tracy Network" ); Network(); } );
+    // A dispatch shared between several workers bounds the total number of
+    // ingestion threads, regardless of how many clients are connected.
+    size_t ingestLanes;
+    if( ingestDispatch )
+    {
+        ingestLanes = std::min<size_t>( ingestDispatch->NumberOfWorkers() + 1, MaxIngestLanes );
+        if( ingestLanes > 1 ) m_ingestDispatch = ingestDispatch;
+    }
+    else
+    {
+        const auto hwThreads = std::thread::hardware_concurrency();
+        ingestLanes = hwThreads > 2 ? std::min<size_t>( hwThreads - 2, MaxIngestLanes ) : 1;
+        if( ingestLanes > 1 )
+        {
+            m_ingestDispatchOwned = std::make_unique<TaskDispatch>( ingestLanes - 1, "Tracy Ingest" );
+            m_ingestDispatch = m_ingestDispatchOwned.get();
+        }
+    }
+    for( size_t i=0; i<ingestLanes; i++ ) m_ingestLanes.emplace_back( std::make_unique<IngestLane>() );
+
+    if( pooled )
+    {
+        m_pooled = true;
+    }
+    else
+    {
+        m_thread = std::thread( [this] { SetThreadName( "Tracy Worker" ); Exec(); } );
+        m_threadNet = std::thread( [this] { SetThreadName( "Tracy Network" ); Network(); } );
+    }
 }
 
 Worker::Worker( const char* name, const char* program, const std::vector<ImportEventTimeline>& timeline, const std::vector<ImportEventMessages>& messages, const std::vector<ImportEventPlots>& plots, const std::unordered_map<uint64_t, std::string>& threadNames )
@@ -315,6 +347,7 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
     , m_samplingPeriod( 0 )
     , m_stream( nullptr )
     , m_buffer( nullptr )
+    , m_bufferSize( 0 )
     , m_onDemand( false )
     , m_inconsistentSamples( false )
     , m_traceVersion( CurrentVersion )
@@ -406,7 +439,7 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
             td->zoneIdStack.pop_back();
             auto& stack = td->stack;
             auto zone = stack.back_and_pop();
-            td->DecStackCount( zone->SrcLoc() );
+            const auto reentrant = td->DecStackCount( zone->SrcLoc() );
             zone->SetEnd( v.timestamp );
 
 #ifndef TRACY_NO_STATISTICS
@@ -414,8 +447,9 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
             ztd.SetZone( zone );
             ztd.SetThread( CompressThread( v.tid ) );
             auto slz = GetSourceLocationZones( zone->SrcLoc() );
-            slz->zones.push_back( ztd );
+            slz->Add( ztd, zone->Start(), v.timestamp, v.timestamp - zone->Start() - GetZoneChildTime( *zone ), reentrant );
 #else
+            (void)reentrant;
             CountZoneStatistics( zone );
 #endif
         }
@@ -554,10 +588,11 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
     }
 }
 
-Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allowStringModification)
+Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allowStringModification, uint64_t timelineMemoryBudget )
     : m_hasData( true )
     , m_stream( nullptr )
     , m_buffer( nullptr )
+    , m_bufferSize( 0 )
     , m_inconsistentSamples( false )
     , m_allowStringModification(allowStringModification)
 {
@@ -662,48 +697,93 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
 
     f.Read( &m_data.crashEvent, sizeof( m_data.crashEvent ) );
 
-    f.Read( sz );
-    m_data.frames.Data().reserve_exact( sz, m_slab );
-    for( uint64_t i=0; i<sz; i++ )
+    // Since 0.10.1 the bulk of trace data is stored in separately compressed
+    // sections, which are decoded in parallel while the main stream is parsed.
+    std::mutex sectionLock;
+    std::vector<LoadSlab*> freeSlabs;
+    auto AcquireSlab = [this, &sectionLock, &freeSlabs] {
+        std::lock_guard<std::mutex> lock( sectionLock );
+        if( freeSlabs.empty() )
+        {
+            m_loadSlabs.emplace_back( std::make_unique<LoadSlab>() );
+            return m_loadSlabs.back().get();
+        }
+        auto slab = freeSlabs.back();
+        freeSlabs.pop_back();
+        return slab;
+    };
+    auto ReleaseSection = [this, &sectionLock, &freeSlabs] ( SectionLoad& sl ) {
+        std::lock_guard<std::mutex> lock( sectionLock );
+        freeSlabs.emplace_back( sl.slab );
+#ifdef TRACY_NO_STATISTICS
+        for( auto& v : sl.zonesCnt ) m_data.sourceLocationZonesCnt[v.first] += v.second;
+#endif
+    };
+
+    // Set by section jobs which found corrupted data. The load fails once all
+    // the jobs are done.
+    std::atomic<bool> readError( false );
+    std::unique_ptr<TaskDispatch> dispatch;
+    if( fileVer >= FileVersion( 0, 10, 1 ) )
     {
-        auto ptr = m_slab.AllocInit<FrameData>();
-        uint64_t fsz;
-        f.Read3( ptr->name, ptr->continuous, fsz );
-        ptr->frames.reserve_exact( fsz, m_slab );
-        int64_t refTime = 0;
-        if( ptr->continuous )
+        if( !f.HasSectionIndex() )
         {
-            for( uint64_t j=0; j<fsz; j++ )
-            {
-                ptr->frames[j].start = ReadTimeOffset( f, refTime );
-                ptr->frames[j].end = -1;
-                f.Read( &ptr->frames[j].frameImage, sizeof( int32_t ) );
-            }
+            s_loadProgress.total.store( 0, std::memory_order_relaxed );
+            throw LoadFailure( "Trace file section index is missing" );
         }
-        else
+#ifdef __EMSCRIPTEN__
+        const int jobs = 1;
+#else
+        // Leave one thread for file reader
+        const auto jobs = std::max<int>( std::thread::hardware_concurrency() - 1, 1 );
+#endif
+        dispatch = std::make_unique<TaskDispatch>( jobs, "Load Section" );
+    }
+    const bool sectioned = (bool)dispatch;
+    const bool lazy = sectioned && timelineMemoryBudget != 0;
+    if( lazy )
+    {
+        m_lazyFile.reset( f.ShareSections() );
+        m_lazyBudget = timelineMemoryBudget;
+    }
+
+    // Sections of older traces are stored inline in the main stream and are
+    // read right away.
+    auto LoadSection = [this, &f, &dispatch, &readError, &AcquireSlab, &ReleaseSection] ( FileSection type, uint32_t id, std::function<void(FileRead&, SectionLoad&)>&& fn ) {
+        if( dispatch )
         {
-            for( uint64_t j=0; j<fsz; j++ )
+            // Large sections would be the last ones to finish loading, so their
+            // decompression is additionally spread over all cores.
+            const int decodeJobs = f.GetSectionSize( type, id ) >= 32*1024*1024 ? std::thread::hardware_concurrency() : 1;
+            std::shared_ptr<FileRead> sf( f.OpenSection( type, id, decodeJobs ) );
+            if( !sf )
             {
-                ptr->frames[j].start = ReadTimeOffset( f, refTime );
-                ptr->frames[j].end = ReadTimeOffset( f, refTime );
-                f.Read( &ptr->frames[j].frameImage, sizeof( int32_t ) );
+                dispatch->Sync();
+                s_loadProgress.total.store( 0, std::memory_order_relaxed );
+                throw LoadFailure( "Trace file section is missing" );
             }
+            dispatch->Queue( [sf, fn = std::move( fn ), &readError, &AcquireSlab, &ReleaseSection] {
+                SectionLoad sl { AcquireSlab(), 0 };
+                try
+                {
+                    fn( *sf, sl );
+                }
+                catch( const FileReadError& )
+                {
+                    readError.store( true, std::memory_order_relaxed );
+                }
+                ReleaseSection( sl );
+            } );
         }
-        for( uint64_t j=0; j<fsz; j++ )
+        else
         {
-            const auto timeSpan = GetFrameTime( *ptr, j );
-            if( timeSpan > 0 )
-            {
-                ptr->min = std::min( ptr->min, timeSpan );
-                ptr->max = std::max( ptr->max, timeSpan );
-                ptr->total += timeSpan;
-                ptr->sumSq += double( timeSpan ) * timeSpan;
-            }
+            SectionLoad sl { AcquireSlab(), 0 };
+            fn( f, sl );
+            ReleaseSection( sl );
         }
-        m_data.frames.Data()[i] = ptr;
-    }
-    m_data.framesBase = m_data.frames.Data()[0];
-    assert( m_data.framesBase->name == 0 );
+    };
+
+    LoadSection( FileSection::Frames, 0, [this] ( FileRead& sf, SectionLoad& sl ) { ReadFrames( sf, sl ); } );
 
     unordered_flat_map<uint64_t, const char*> pointerMap;
 
@@ -828,7 +908,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         f.Read2( id, cnt );
         auto status = m_data.sourceLocationZones.emplace( id, SourceLocationZones() );
         assert( status.second );
-        status.first->second.zones.reserve( cnt );
+        status.first->second.Reserve( cnt );
     }
 
     f.Read( sz );
@@ -984,73 +1064,28 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         f.Read4( tid, td->count, td->kernelSampleCnt, td->isFiber );
         td->id = tid;
         m_data.zonesCnt += td->count;
-        uint32_t tsz;
-        f.Read( tsz );
-        if( tsz != 0 )
-        {
-            ReadTimeline( f, td->timeline, tsz, 0, childIdx );
-        }
-        uint64_t msz;
-        f.Read( msz );
-        if( eventMask & EventType::Messages )
+        const auto ctid = ( eventMask & EventType::Messages ) ? CompressThread( tid ) : 0;
+        if( lazy && td->count != 0 )
         {
-            const auto ctid = CompressThread( tid );
-            td->messages.reserve_exact( msz, m_slab );
-            for( uint64_t j=0; j<msz; j++ )
+            if( f.GetSectionSize( FileSection::ThreadTimeline, i ) == 0 )
             {
-                uint64_t ptr;
-                f.Read( ptr );
-                auto md = msgMap[ptr];
-                td->messages[j] = md;
-                md->thread = ctid;
+                dispatch->Sync();
+                s_loadProgress.total.store( 0, std::memory_order_relaxed );
+                throw LoadFailure( "Trace file section is missing" );
             }
+            m_lazyTimelines.emplace( td, LazyTimeline { uint32_t( i ), 0, 0, 0, false, false } );
         }
         else
         {
-            f.Skip( msz * sizeof( uint64_t ) );
-        }
-        uint64_t ssz;
-        f.Read( ssz );
-        if( ssz != 0 )
-        {
-            if( eventMask & EventType::Samples )
-            {
-                int64_t refTime = 0;
-                td->ctxSwitchSamples.reserve_exact( ssz, m_slab );
-                auto ptr = td->ctxSwitchSamples.data();
-                for( uint64_t j=0; j<ssz; j++ )
-                {
-                    ptr->time.SetVal( ReadTimeOffset( f, refTime ) );
-                    f.Read( &ptr->callstack, sizeof( ptr->callstack ) );
-                    ptr++;
-                }
-            }
-            else
-            {
-                f.Skip( ssz * ( 8 + 3 ) );
-            }
-        }
-        f.Read( ssz );
-        if( ssz != 0 )
-        {
-            if( eventMask & EventType::Samples )
-            {
-                m_data.samplesCnt += ssz;
-                int64_t refTime = 0;
-                td->samples.reserve_exact( ssz, m_slab );
-                auto ptr = td->samples.data();
-                for( uint64_t j=0; j<ssz; j++ )
-                {
-                    ptr->time.SetVal( ReadTimeOffset( f, refTime ) );
-                    f.Read( &ptr->callstack, sizeof( ptr->callstack ) );
-                    ptr++;
-                }
-            }
-            else
-            {
-                f.Skip( ssz * ( 8 + 3 ) );
-            }
+            LoadSection( FileSection::ThreadTimeline, i, [this, td, sectioned, &childIdx] ( FileRead& sf, SectionLoad& sl ) {
+                if( sectioned ) sf.Read( sl.childIdx ); else sl.childIdx = childIdx;
+                ReadThreadTimeline( sf, td, sl );
+                if( !sectioned ) childIdx = sl.childIdx;
+            } );
         }
+        LoadSection( FileSection::Thread, i, [this, td, ctid, &msgMap, eventMask] ( FileRead& sf, SectionLoad& sl ) {
+            ReadThread( sf, td, ctid, msgMap, eventMask, sl );
+        } );
         m_data.threads[i] = td;
         m_threadMap.emplace( tid, td );
     }
@@ -1073,20 +1108,11 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         ctx->hasCalibration = calibration;
         ctx->hasPeriod = ctx->period != 1.f;
         m_data.gpuCnt += ctx->count;
-        uint64_t tdsz;
-        f.Read( tdsz );
-        for( uint64_t j=0; j<tdsz; j++ )
-        {
-            uint64_t tid, tsz;
-            f.Read2( tid, tsz );
-            if( tsz != 0 )
-            {
-                int64_t refTime = 0;
-                int64_t refGpuTime = 0;
-                auto td = ctx->threadData.emplace( tid, GpuCtxThreadData {} ).first;
-                ReadTimeline( f, td->second.timeline, tsz, refTime, refGpuTime, childIdx );
-            }
-        }
+        LoadSection( FileSection::GpuContext, i, [this, ctx, sectioned, &childIdx] ( FileRead& sf, SectionLoad& sl ) {
+            if( sectioned ) sf.Read( sl.childIdx ); else sl.childIdx = childIdx;
+            ReadGpuContext( sf, ctx, sl );
+            if( !sectioned ) childIdx = sl.childIdx;
+        } );
         m_data.gpuData[i] = ctx;
     }
 
@@ -1142,53 +1168,11 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         {
             auto mit = m_data.memNameMap.emplace( memname, m_slab.AllocInit<MemData>() );
             if( memname == 0 ) m_data.memory = mit.first->second;
-            auto& memdata = *mit.first->second;
-            memdata.data.reserve_exact( sz, m_slab );
-            uint64_t activeSz, freesSz;
-            f.Read2( activeSz, freesSz );
-            memdata.active.reserve( activeSz );
-            memdata.frees.reserve_exact( freesSz, m_slab );
-            auto mem = memdata.data.data();
-            s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
-            size_t fidx = 0;
-            int64_t refTime = 0;
-            auto& frees = memdata.frees;
-            auto& active = memdata.active;
-
-            for( uint64_t i=0; i<sz; i++ )
-            {
-                s_loadProgress.subProgress.store( memload+i, std::memory_order_relaxed );
-                uint64_t ptr, size;
-                Int24 csAlloc;
-                int64_t timeAlloc, timeFree;
-                uint16_t threadAlloc, threadFree;
-                f.Read8( ptr, size, csAlloc, mem->csFree, timeAlloc, timeFree, threadAlloc, threadFree );
-                mem->SetPtr( ptr );
-                mem->SetSize( size );
-                mem->SetCsAlloc( csAlloc.Val() );
-                refTime += timeAlloc;
-                mem->SetTimeThreadAlloc( refTime, threadAlloc );
-                if( timeFree >= 0 )
-                {
-                    mem->SetTimeThreadFree( timeFree + refTime, threadFree );
-                    frees[fidx++] = i;
-                }
-                else
-                {
-                    mem->SetTimeThreadFree( timeFree, threadFree );
-                    active.emplace( ptr, i );
-                }
-                mem++;
-            }
+            auto memdata = mit.first->second;
+            LoadSection( FileSection::Memory, k, [this, memdata, sz, memload] ( FileRead& sf, SectionLoad& sl ) { ReadMemory( sf, *memdata, sz, memload, sl ); } );
             memload += sz;
-            f.Read4( memdata.high, memdata.low, memdata.usage, memdata.name );
-
-            if( sz != 0 )
-            {
-                memdata.reconstruct = true;
-            }
         }
-        else
+        else if( !sectioned )
         {
             f.Skip( 2 * sizeof( uint64_t ) );
             f.Skip( sz * ( sizeof( uint64_t ) + sizeof( uint64_t ) + sizeof( Int24 ) + sizeof( Int24 ) + sizeof( int64_t ) * 2 + sizeof( uint16_t ) * 2 ) );
@@ -1198,39 +1182,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
 
     s_loadProgress.subTotal.store( 0, std::memory_order_relaxed );
     s_loadProgress.progress.store( LoadProgress::CallStacks, std::memory_order_relaxed );
-    f.Read( sz );
-    m_data.callstackPayload.reserve_exact( sz+1, m_slab );
-    m_data.callstackPayload[0] = nullptr;
-    for( uint64_t i=0; i<sz; i++ )
-    {
-        uint16_t csz;
-        f.Read( csz );
-
-        const auto memsize = sizeof( VarArray<CallstackFrameId> ) + csz * sizeof( CallstackFrameId );
-        auto mem = (char*)m_slab.AllocRaw( memsize );
-
-        auto data = (CallstackFrameId*)mem;
-        f.Read( data, csz * sizeof( CallstackFrameId ) );
-
-        auto arr = (VarArray<CallstackFrameId>*)( mem + csz * sizeof( CallstackFrameId ) );
-        new(arr) VarArray<CallstackFrameId>( csz, data );
-
-        m_data.callstackPayload[i+1] = arr;
-    }
-
-    f.Read( sz );
-    m_data.callstackFrameMap.reserve( sz );
-    for( uint64_t i=0; i<sz; i++ )
-    {
-        CallstackFrameId id;
-        auto frameData = m_slab.Alloc<CallstackFrameData>();
-        f.Read3( id, frameData->size, frameData->imageName );
-
-        frameData->data = m_slab.Alloc<CallstackFrame>( frameData->size );
-        f.Read( frameData->data, sizeof( CallstackFrame ) * frameData->size );
-
-        m_data.callstackFrameMap.emplace( id, frameData );
-    }
+    LoadSection( FileSection::Callstacks, 0, [this] ( FileRead& sf, SectionLoad& sl ) { ReadCallstacks( sf, sl ); } );
 
     f.Read( sz );
     if( sz > 0 )
@@ -1347,17 +1299,6 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                 delete[] data[i].buf;
                 delete[] data[i].outbuf;
             }
-
-            const auto& frames = GetFramesBase()->frames;
-            const auto fsz = uint32_t( frames.size() );
-            for( uint32_t i=0; i<fsz; i++ )
-            {
-                const auto& f = frames[i];
-                if( f.frameImage != -1 )
-                {
-                    m_data.frameImage[f.frameImage]->frameRef = i;
-                }
-            }
         }
 
         ZSTD_freeCDict( cdict );
@@ -1377,10 +1318,6 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
             const auto fisz = w * h / 2;
             f.Skip( fisz + sizeof( FrameImage::flip ) );
         }
-        for( auto& v : m_data.framesBase->frames )
-        {
-            v.frameImage = -1;
-        }
     }
 
     s_loadProgress.subTotal.store( 0, std::memory_order_relaxed );
@@ -1388,40 +1325,11 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
 
     if( eventMask & EventType::ContextSwitches )
     {
-        f.Read( sz );
-        s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
-        m_data.ctxSwitch.reserve( sz );
-        for( uint64_t i=0; i<sz; i++ )
-        {
-            s_loadProgress.subProgress.store( i, std::memory_order_relaxed );
-            uint64_t thread, csz;
-            f.Read2( thread, csz );
-            auto data = m_slab.AllocInit<ContextSwitch>();
-            data->v.reserve_exact( csz, m_slab );
-            int64_t runningTime = 0;
-            int64_t refTime = 0;
-            auto ptr = data->v.data();
-            for( uint64_t j=0; j<csz; j++ )
-            {
-                int64_t deltaWakeup, deltaStart, diff, thread;
-                uint8_t cpu;
-                int8_t reason, state;
-                f.Read7( deltaWakeup, deltaStart, diff, cpu, reason, state, thread );
-                refTime += deltaWakeup;
-                ptr->SetWakeup( refTime );
-                refTime += deltaStart;
-                ptr->SetStartCpu( refTime, cpu );
-                if( diff > 0 ) runningTime += diff;
-                refTime += diff;
-                ptr->SetEndReasonState( refTime, reason, state );
-                ptr->SetThread( CompressThread( thread ) );
-                ptr++;
-            }
-            data->runningTime = runningTime;
-            m_data.ctxSwitch.emplace( thread, data );
-        }
+        LoadSection( FileSection::ContextSwitches, 0, [this] ( FileRead& sf, SectionLoad& sl ) { ReadContextSwitches( sf, sl ); } );
+        s_loadProgress.progress.store( LoadProgress::ContextSwitchesPerCpu, std::memory_order_relaxed );
+        LoadSection( FileSection::ContextSwitchesPerCpu, 0, [this] ( FileRead& sf, SectionLoad& sl ) { ReadContextSwitchesPerCpu( sf, sl ); } );
     }
-    else
+    else if( !sectioned )
     {
         f.Read( sz );
         s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
@@ -1433,42 +1341,10 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
             f.Read( csz );
             f.Skip( csz * ( sizeof( int64_t ) * 4 + sizeof( int8_t ) * 3 ) );
         }
-    }
 
-    s_loadProgress.subTotal.store( 0, std::memory_order_relaxed );
-    s_loadProgress.progress.store( LoadProgress::ContextSwitchesPerCpu, std::memory_order_relaxed );
-    f.Read( sz );
-    s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
-    if( eventMask & EventType::ContextSwitches )
-    {
-        uint64_t cnt = 0;
-        for( int i=0; i<256; i++ )
-        {
-            int64_t refTime = 0;
-            f.Read( sz );
-            if( sz != 0 )
-            {
-                m_data.cpuDataCount = i+1;
-                m_data.cpuData[i].cs.reserve_exact( sz, m_slab );
-                auto ptr = m_data.cpuData[i].cs.data();
-                for( uint64_t j=0; j<sz; j++ )
-                {
-                    int64_t deltaStart, deltaEnd;
-                    uint16_t thread;
-                    f.Read3( deltaStart, deltaEnd, thread );
-                    refTime += deltaStart;
-                    ptr->SetStartThread( refTime, thread );
-                    refTime += deltaEnd;
-                    ptr->SetEnd( refTime );
-                    ptr++;
-                }
-                cnt += sz;
-            }
-            s_loadProgress.subProgress.store( cnt, std::memory_order_relaxed );
-        }
-    }
-    else
-    {
+        s_loadProgress.subTotal.store( 0, std::memory_order_relaxed );
+        s_loadProgress.progress.store( LoadProgress::ContextSwitchesPerCpu, std::memory_order_relaxed );
+        f.Read( sz );
         for( int i=0; i<256; i++ )
         {
             f.Read( sz );
@@ -1527,25 +1403,13 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
     std::sort( std::execution::par_unseq, m_data.symbolLocInline.begin(), m_data.symbolLocInline.end() );
 #endif
 
-    f.Read( sz );
     if( eventMask & EventType::SymbolCode )
     {
-        uint64_t ssz = 0;
-        m_data.symbolCode.reserve( sz );
-        for( uint64_t i=0; i<sz; i++ )
-        {
-            uint64_t symAddr;
-            uint32_t len;
-            f.Read2( symAddr, len );
-            ssz += len;
-            auto ptr = (char*)m_slab.AllocBig( len );
-            f.Read( ptr, len );
-            m_data.symbolCode.emplace( symAddr, MemoryBlock { ptr, len } );
-        }
-        m_data.symbolCodeSize = ssz;
+        LoadSection( FileSection::SymbolCode, 0, [this] ( FileRead& sf, SectionLoad& sl ) { ReadSymbolCode( sf, sl ); } );
     }
-    else
+    else if( !sectioned )
     {
+        f.Read( sz );
         for( uint64_t i=0; i<sz; i++ )
         {
             uint64_t symAddr;
@@ -1555,6 +1419,11 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         }
     }
 
+    if( f.GetSectionSize( FileSection::ZoneDropped, 0 ) != 0 )
+    {
+        LoadSection( FileSection::ZoneDropped, 0, [this] ( FileRead& sf, SectionLoad& ) { ReadZoneDropped( sf ); } );
+    }
+
     f.Read( sz );
     m_data.codeSymbolMap.reserve( sz );
     for( uint64_t i=0; i<sz; i++ )
@@ -1608,6 +1477,43 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
         }
     }
 
+    if( dispatch )
+    {
+        dispatch->Sync();
+        dispatch.reset();
+        if( readError.load( std::memory_order_relaxed ) )
+        {
+            s_loadProgress.total.store( 0, std::memory_order_relaxed );
+            throw FileReadError();
+        }
+    }
+
+    if( eventMask & EventType::Samples )
+    {
+        for( auto& t : m_data.threads ) m_data.samplesCnt += t->samples.size();
+    }
+
+    if( eventMask & EventType::FrameImages )
+    {
+        const auto& frames = GetFramesBase()->frames;
+        const auto fsz = uint32_t( frames.size() );
+        for( uint32_t i=0; i<fsz; i++ )
+        {
+            const auto& f = frames[i];
+            if( f.frameImage != -1 )
+            {
+                m_data.frameImage[f.frameImage]->frameRef = i;
+            }
+        }
+    }
+    else
+    {
+        for( auto& v : m_data.framesBase->frames )
+        {
+            v.frameImage = -1;
+        }
+    }
+
     s_loadProgress.total.store( 0, std::memory_order_relaxed );
     m_loadTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - loadStart ).count();
 
@@ -1632,37 +1538,110 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                 if( mem.second->reconstruct ) jobs.emplace_back( std::thread( [this, mem = mem.second] { ReconstructMemAllocPlot( *mem ); } ) );
             }
 
-            std::function<void(uint8_t*, Vector<short_ptr<ZoneEvent>>&, uint16_t)> ProcessTimeline;
-            ProcessTimeline = [this, &ProcessTimeline] ( uint8_t* countMap, Vector<short_ptr<ZoneEvent>>& _vec, uint16_t thread )
-            {
+            jobs.emplace_back( std::thread( [this] {
+                // Thread timelines are walked in parallel. Zone records of each
+                // thread are kept apart, and then merged into the statistics of
+                // each source location in thread order.
+                std::vector<ThreadData*> threads;
+                for( auto& t : m_data.threads )
+                {
+                    // Lazy timelines are streamed through below.
+                    if( !t->timeline.empty() && m_lazyTimelines.find( t ) == m_lazyTimelines.end() ) threads.emplace_back( t );
+                }
+#ifdef __EMSCRIPTEN__
+                TaskDispatch dispatch( 0, "Zone Stats" );
+#else
+                TaskDispatch dispatch( std::max<int>( std::thread::hardware_concurrency() - 1, 0 ), "Zone Stats" );
+#endif
+                std::vector<unordered_flat_map<int16_t, std::vector<ZoneRangeRecord>>> threadRecords( threads.size() );
+                dispatch.Run( threads.size(), [this, &threads, &threadRecords] ( size_t i ) {
+                    auto countMap = std::make_unique<uint8_t[]>( 64*1024 );
+                    // Don't touch thread compression cache in a thread.
+                    GatherZoneRecords( countMap.get(), threads[i]->timeline, m_data.localThreadCompress.DecompressMustRaw( threads[i]->id ), threadRecords[i] );
+                } );
                 if( m_shutdown.load( std::memory_order_relaxed ) ) return;
-                assert( _vec.is_magic() );
-                auto& vec = *(Vector<ZoneEvent>*)( &_vec );
-                for( auto& zone : vec )
+
+                // Lazy timelines are streamed through one at a time, so that
+                // only one of them is loaded on top of what the view uses. The
+                // records don't keep their zone pointers, as the view may evict
+                // the timeline before the lists are ready.
+                for( auto& t : m_data.threads )
                 {
-                    if( zone.IsEndValid() ) ReconstructZoneStatistics( countMap, zone, thread );
-                    if( zone.HasChildren() )
+                    auto it = m_lazyTimelines.find( t );
+                    if( it == m_lazyTimelines.end() ) continue;
+                    if( m_shutdown.load( std::memory_order_relaxed ) ) return;
+                    threadRecords.emplace_back();
+                    auto& records = threadRecords.back();
+                    {
+                        std::lock_guard<DataLock> lock( m_data.lock );
+                        const auto resident = it->second.loaded;
+                        if( !resident ) LoadTimeline( t );
+                        auto countMap = std::make_unique<uint8_t[]>( 64*1024 );
+                        if( !t->timeline.empty() ) GatherZoneRecords( countMap.get(), t->timeline, m_data.localThreadCompress.DecompressMustRaw( t->id ), records );
+                        if( !resident ) EvictTimeline( t );
+                    }
+                    for( auto& v : records )
                     {
-                        countMap[uint16_t(zone.SrcLoc())]++;
-                        ProcessTimeline( countMap, GetZoneChildrenMutable( zone.Child() ), thread );
-                        countMap[uint16_t(zone.SrcLoc())]--;
+                        for( auto& r : v.second ) r.zone = nullptr;
                     }
                 }
-            };
 
-            jobs.emplace_back( std::thread( [this, ProcessTimeline] {
-                for( auto& t : m_data.threads )
+                unordered_flat_map<int16_t, std::vector<ZoneRangeRecord>> rangeRecords;
+                for( auto& tr : threadRecords )
                 {
+                    for( auto& v : tr ) rangeRecords.emplace( v.first, std::vector<ZoneRangeRecord>() );
+                }
+                std::vector<std::pair<int16_t, std::vector<ZoneRangeRecord>*>> srclocs;
+                srclocs.reserve( rangeRecords.size() );
+                for( auto& v : rangeRecords ) srclocs.emplace_back( v.first, &v.second );
+                dispatch.Run( srclocs.size(), [this, &srclocs, &threadRecords] ( size_t i ) {
                     if( m_shutdown.load( std::memory_order_relaxed ) ) return;
-                    if( !t->timeline.empty() )
+                    const auto srcloc = srclocs[i].first;
+                    auto& rec = *srclocs[i].second;
+                    size_t cnt = 0;
+                    for( auto& tr : threadRecords )
+                    {
+                        auto it = tr.find( srcloc );
+                        if( it != tr.end() ) cnt += it->second.size();
+                    }
+                    for( auto& tr : threadRecords )
+                    {
+                        auto it = tr.find( srcloc );
+                        if( it == tr.end() ) continue;
+                        if( it->second.size() == cnt )
+                        {
+                            // Zones of this source location are in a single thread.
+                            rec.swap( it->second );
+                            break;
+                        }
+                        rec.reserve( cnt );
+                        rec.insert( rec.end(), it->second.begin(), it->second.end() );
+                        std::vector<ZoneRangeRecord>().swap( it->second );
+                    }
+                    auto sit = m_data.sourceLocationZones.find( srcloc );
+                    assert( sit != m_data.sourceLocationZones.end() );
+                    ReconstructZoneStatistics( sit->second, rec );
+                    std::vector<ZoneRangeRecord>().swap( rec );
+                    // The range index refers to the zones by their position in the list.
+                    sit->second.EnsureSorted();
+                } );
+                if( m_shutdown.load( std::memory_order_relaxed ) ) return;
+                decltype( threadRecords )().swap( threadRecords );
+                std::vector<int16_t> indexed;
+                indexed.reserve( srclocs.size() );
+                for( auto& v : srclocs ) indexed.emplace_back( v.first );
+                decltype( srclocs )().swap( srclocs );
+                decltype( rangeRecords )().swap( rangeRecords );
+
+                {
+                    std::lock_guard<DataLock> lock( m_data.lock );
+                    for( auto& v : m_lazyTimelines )
                     {
-                        uint8_t countMap[64*1024];
-                        // Don't touch thread compression cache in a thread.
-                        ProcessTimeline( countMap, t->timeline, m_data.localThreadCompress.DecompressMustRaw( t->id ) );
+                        if( v.second.loaded ) AttachTimelineZones( v.first );
                     }
+                    m_data.sourceLocationZonesReady = true;
                 }
-                std::lock_guard<std::mutex> lock( m_data.lock );
-                m_data.sourceLocationZonesReady = true;
+                BuildZoneRangeIndex( indexed );
             } ) );
 
             std::function<void(Vector<short_ptr<GpuEvent>>&, uint16_t)> ProcessTimelineGpu;
@@ -1693,7 +1672,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                         }
                     }
                 }
-                std::lock_guard<std::mutex> lock( m_data.lock );
+                std::lock_guard<DataLock> lock( m_data.lock );
                 m_data.gpuSourceLocationZonesReady = true;
             } ) );
 
@@ -1760,7 +1739,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                         }
                         for( auto& v : counts ) UpdateSampleStatistics( v.first, v.second, false );
                     }
-                    std::lock_guard<std::mutex> lock( m_data.lock );
+                    std::lock_guard<DataLock> lock( m_data.lock );
                     m_data.callstackSamplesReady = true;
                 } ) );
 
@@ -1788,7 +1767,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                             }
                         }
                     }
-                    std::lock_guard<std::mutex> lock( m_data.lock );
+                    std::lock_guard<DataLock> lock( m_data.lock );
                     m_data.ghostZonesReady = true;
                     m_data.ghostCnt = gcnt;
                 } ) );
@@ -1842,7 +1821,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, bool allow
                     {
                         pdqsort_branchless( v.second.begin(), v.second.end(), []( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
                     }
-                    std::lock_guard<std::mutex> lock( m_data.lock );
+                    std::lock_guard<DataLock> lock( m_data.lock );
                     m_data.symbolSamplesReady = true;
                 } ) );
             }
@@ -1865,7 +1844,16 @@ Worker::~Worker()
     if( m_threadBackground.joinable() ) m_threadBackground.join();
 
     delete[] m_buffer;
+#ifdef TRACY_HAS_SHARED_MEMORY
+    delete m_shm;
+#endif
     LZ4_freeStreamDecode( (LZ4_streamDecode_t*)m_stream );
+    if( m_zstdStream ) ZSTD_freeDCtx( (ZSTD_DCtx*)m_zstdStream );
+    for( auto& stream : m_pollStreams )
+    {
+        LZ4_freeStreamDecode( (LZ4_streamDecode_t*)stream.lz4 );
+        if( stream.zstd ) ZSTD_freeDCtx( (ZSTD_DCtx*)stream.zstd );
+    }
 
     delete[] m_frameImageBuffer;
     delete[] m_tmpBuf;
@@ -2314,15 +2302,51 @@ int64_t Worker::GetZoneEndImpl( const GpuEvent& ev )
     }
 }
 
-uint32_t Worker::FindStringIdx( const char* str ) const
+int64_t Worker::GetZoneChildTime( const ZoneEvent& zone ) const
 {
-    if( !str ) return 0;
-    charutil::StringKey key = { str, strlen( str ) };
-    auto sit = m_data.stringMap.find( key );
-    if( sit == m_data.stringMap.end() )
+    int64_t time = 0;
+    if( zone.HasChildren() )
     {
-        return 0;
-    }
+        auto& children = GetZoneChildren( zone.Child() );
+        if( children.is_magic() )
+        {
+            auto& vec = *(Vector<ZoneEvent>*)&children;
+            for( auto& v : vec )
+            {
+                time += std::max( int64_t( 0 ), v.End() - v.Start() );
+            }
+        }
+        else
+        {
+            for( auto& v : children )
+            {
+                time += std::max( int64_t( 0 ), v->End() - v->Start() );
+            }
+        }
+    }
+    return time;
+}
+
+int64_t Worker::GetZoneSelfTime( const ZoneEvent& ev ) const
+{
+    assert( ev.IsEndValid() );
+#ifndef TRACY_NO_STATISTICS
+    size_t idx;
+    auto slz = FindSourceLocationZone( ev, idx );
+    if( slz ) return slz->self[idx];
+#endif
+    return ev.End() - ev.Start() - GetZoneChildTime( ev );
+}
+
+uint32_t Worker::FindStringIdx( const char* str ) const
+{
+    if( !str ) return 0;
+    charutil::StringKey key = { str, strlen( str ) };
+    auto sit = m_data.stringMap.find( key );
+    if( sit == m_data.stringMap.end() )
+    {
+        return 0;
+    }
     else
     {
         return sit->second;
@@ -2368,6 +2392,15 @@ const char* Worker::GetString( const StringIdx& idx ) const
     return m_data.stringData[idx.Idx()];
 }
 
+// Pointer strings are retrieved from the client some time after they are first referenced.
+bool Worker::IsStringAvailable( const StringRef& ref ) const
+{
+    if( ref.isidx ) return ref.active;
+    if( !ref.active ) return false;
+    const auto it = m_data.strings.find( ref.str );
+    return it != m_data.strings.end() && it->second != nullptr && strcmp( it->second, "???" ) != 0;
+}
+
 static const char* BadExternalThreadNames[] = {
     "ntdll.dll",
     "???",
@@ -2576,6 +2609,98 @@ const Worker::SourceLocationZones& Worker::GetZonesForSourceLocation( int16_t sr
     return it != m_data.sourceLocationZones.end() ? it->second : empty;
 }
 
+// Counts only the zones which are entirely within the range. Returns false if
+// the range index is not available for the source location, for example because
+// it hasn't been built yet, or because zones were added after it was built.
+bool Worker::GetZoneRangeStatistics( int16_t srcloc, int64_t min, int64_t max, ZoneRangeStatistics& out ) const
+{
+    if( !m_data.zoneRangeIndexReady ) return false;
+    auto it = m_data.zoneRangeIndex.find( srcloc );
+    if( it == m_data.zoneRangeIndex.end() ) return false;
+    const auto& idx = it->second;
+    const auto& slz = GetZonesForSourceLocation( srcloc );
+    if( idx.total.size() != slz.zones.size() + 1 || !slz.zones.is_sorted() ) return false;
+
+    memset( &out, 0, sizeof( out ) );
+    const auto i0 = size_t( std::lower_bound( slz.start.begin(), slz.start.end(), min ) - slz.start.begin() );
+    const auto i1 = size_t( std::upper_bound( slz.start.begin() + i0, slz.start.end(), max ) - slz.start.begin() );
+    if( i0 >= i1 ) return true;
+
+    out.count = i1 - i0;
+    out.total = idx.total[i1] - idx.total[i0];
+    out.selfTotal = idx.selfTotal[i1] - idx.selfTotal[i0];
+    out.nonReentrantCount = idx.nonReentrantCount[i1] - idx.nonReentrantCount[i0];
+    out.nonReentrantTotal = idx.nonReentrantTotal[i1] - idx.nonReentrantTotal[i0];
+
+    // Remove the zones which end after the range. Blocks (and subtrees of blocks)
+    // which end within the range don't have to be visited.
+    unordered_flat_map<uint16_t, std::pair<uint32_t, uint32_t>> threadStraddling;
+    const auto blocks = idx.blockEnd.size() / 2;
+    std::vector<size_t> nodes;
+    for( size_t lo = i0 / ZoneRangeIndex::BlockSize + blocks, hi = ( i1 - 1 ) / ZoneRangeIndex::BlockSize + blocks + 1; lo < hi; lo >>= 1, hi >>= 1 )
+    {
+        if( lo & 1 ) nodes.push_back( lo++ );
+        if( hi & 1 ) nodes.push_back( --hi );
+    }
+    while( !nodes.empty() )
+    {
+        const auto node = nodes.back();
+        nodes.pop_back();
+        if( idx.blockEnd[node] <= max ) continue;
+        if( node < blocks )
+        {
+            nodes.push_back( node * 2 );
+            nodes.push_back( node * 2 + 1 );
+            continue;
+        }
+        const auto block = node - blocks;
+        const auto zbegin = std::max( i0, block * ZoneRangeIndex::BlockSize );
+        const auto zend = std::min( i1, ( block + 1 ) * ZoneRangeIndex::BlockSize );
+        for( auto i=zbegin; i<zend; i++ )
+        {
+            if( slz.end[i] <= max ) continue;
+            const auto nonReentrant = idx.nonReentrantCount[i+1] != idx.nonReentrantCount[i];
+            out.count--;
+            out.total -= idx.total[i+1] - idx.total[i];
+            out.selfTotal -= idx.selfTotal[i+1] - idx.selfTotal[i];
+            if( nonReentrant )
+            {
+                out.nonReentrantCount--;
+                out.nonReentrantTotal -= idx.nonReentrantTotal[i+1] - idx.nonReentrantTotal[i];
+            }
+            if( !idx.threads.empty() )
+            {
+                auto& ts = threadStraddling[slz.thread[i]];
+                ts.first++;
+                if( nonReentrant ) ts.second++;
+            }
+        }
+    }
+
+    if( idx.threads.empty() )
+    {
+        out.threadNum = out.count != 0 ? 1 : 0;
+        out.nonReentrantThreadNum = out.nonReentrantCount != 0 ? 1 : 0;
+    }
+    else
+    {
+        for( auto& tz : idx.threads )
+        {
+            auto cnt = std::lower_bound( tz.zones.begin(), tz.zones.end(), i1 ) - std::lower_bound( tz.zones.begin(), tz.zones.end(), i0 );
+            auto nrCnt = std::lower_bound( tz.nonReentrant.begin(), tz.nonReentrant.end(), i1 ) - std::lower_bound( tz.nonReentrant.begin(), tz.nonReentrant.end(), i0 );
+            auto sit = threadStraddling.find( tz.thread );
+            if( sit != threadStraddling.end() )
+            {
+                cnt -= sit->second.first;
+                nrCnt -= sit->second.second;
+            }
+            if( cnt != 0 ) out.threadNum++;
+            if( nrCnt != 0 ) out.nonReentrantThreadNum++;
+        }
+    }
+    return true;
+}
+
 const SymbolStats* Worker::GetSymbolStats( uint64_t symAddr ) const
 {
     assert( AreCallstackSamplesReady() );
@@ -2605,69 +2730,332 @@ const unordered_flat_map<CallstackFrameId, uint32_t, Worker::CallstackFrameIdHas
 }
 #endif
 
+// Reads one frame from the client and decodes it to dst. Returns the decoded size, or -1.
+template<typename T>
+static int ReadWireFrame( Socket& sock, uint8_t codec, char* dst, char* lz4buf, LZ4_streamDecode_t* lz4, ZSTD_DCtx* zstd, lz4sz_t& lz4sz, const T& ShouldExit )
+{
+    if( !sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) return -1;
+    if( lz4sz > LZ4Size ) return -1;
+
+    switch( codec )
+    {
+    case WireCodecNone:
+        if( lz4sz > TargetFrameSize ) return -1;
+        if( !sock.Read( dst, lz4sz, 10, ShouldExit ) ) return -1;
+        return int( lz4sz );
+    case WireCodecZstd:
+    {
+        if( !sock.Read( lz4buf, lz4sz, 10, ShouldExit ) ) return -1;
+        ZSTD_inBuffer in = { lz4buf, lz4sz, 0 };
+        ZSTD_outBuffer out = { dst, TargetFrameSize, 0 };
+        while( in.pos < in.size )
+        {
+            const auto ret = ZSTD_decompressStream( zstd, &out, &in );
+            if( ZSTD_isError( ret ) || ( out.pos == out.size && in.pos < in.size ) ) return -1;
+        }
+        return int( out.pos );
+    }
+    default:
+    {
+        if( !sock.Read( lz4buf, lz4sz, 10, ShouldExit ) ) return -1;
+        const auto sz = LZ4_decompress_safe_continue( lz4, lz4buf, dst, lz4sz, TargetFrameSize );
+        assert( sz >= 0 );
+        return sz;
+    }
+    }
+}
+
 void Worker::Network()
 {
     auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
     auto lz4buf = std::unique_ptr<char[]>( new char[LZ4Size] );
+    uint64_t pos = 0;
+    uint64_t writePos = 0;
+
+    // Frames in the buffer are decompressed one after another, until there is
+    // not enough space left for a full frame. LZ4 then resumes from the buffer
+    // start, finding the previous 64 KB of data at the end of the buffer.
+    auto HasSpace = [this, &pos, &writePos] {
+        return ( m_shm || pos + TargetFrameSize <= m_netReleased.load() + m_bufferSize ) &&
+            writePos - m_netReadPos.load() < NetBufferSlots;
+    };
+    auto WaitForSpace = [this, &HasSpace] {
+        if( HasSpace() ) return true;
+        std::unique_lock<std::mutex> lock( m_netWriteLock );
+        m_netWriteSleep.fetch_add( 1 );
+        m_netWriteCv.wait( lock, [this, &HasSpace] { return HasSpace() || m_shutdown.load( std::memory_order_relaxed ); } );
+        m_netWriteSleep.fetch_sub( 1, std::memory_order_relaxed );
+        return !m_shutdown.load( std::memory_order_relaxed );
+    };
 
-    for(;;)
     {
+        std::unique_lock<std::mutex> lock( m_netWriteLock );
+        m_netWriteCv.wait( lock, [this] { return m_netStart || m_shutdown.load( std::memory_order_relaxed ); } );
+        if( m_shutdown.load( std::memory_order_relaxed ) ) goto close;
+    }
+
+    if( m_streams > 1 )
+    {
+        NetworkStreams();
+        return;
+    }
+
+#ifdef TRACY_HAS_SHARED_MEMORY
+    if( m_shm )
+    {
+        // Frames are processed in place. The client writes no more data to the
+        // socket, so it becoming readable means the client has disconnected.
+        for(;;)
         {
-            std::unique_lock<std::mutex> lock( m_netWriteLock );
-            m_netWriteCv.wait( lock, [this] { return m_netWriteCnt > 0 || m_shutdown.load( std::memory_order_relaxed ); } );
-            if( m_shutdown.load( std::memory_order_relaxed ) ) goto close;
-            m_netWriteCnt--;
+            uint32_t sz;
+            uint64_t end;
+            auto ptr = m_shm->Read( sz, end );
+            if( !ptr )
+            {
+                if( ShouldExit() || m_shm->IsCorrupt() ) goto close;
+                if( !m_sock.HasData() )
+                {
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+                    continue;
+                }
+                ptr = m_shm->Read( sz, end );
+                if( !ptr ) goto close;
+            }
+            if( !WaitForSpace() ) goto close;
+
+            auto bb = m_bytes.load( std::memory_order_relaxed );
+            m_bytes.store( bb + sizeof( sz ) + sz, std::memory_order_relaxed );
+            bb = m_decBytes.load( std::memory_order_relaxed );
+            m_decBytes.store( bb + sz, std::memory_order_relaxed );
+
+            m_netRead[writePos % NetBufferSlots] = NetBuffer { int( ptr - m_netData ), int( sz ), end };
+            m_netWritePos.store( ++writePos );
+            if( m_netReadSleep.load() )
+            {
+                std::lock_guard<std::mutex> lock( m_netReadLock );
+                m_netReadCv.notify_one();
+            }
         }
+    }
+#endif
+
+    for(;;)
+    {
+        const auto tail = m_bufferSize - pos % m_bufferSize;
+        if( tail < TargetFrameSize ) pos += tail;
+        if( !WaitForSpace() ) goto close;
 
-        auto buf = m_buffer + m_bufferOffset;
+        const auto bufferOffset = int( pos % m_bufferSize );
         lz4sz_t lz4sz;
-        if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) goto close;
-        if( !m_sock.Read( lz4buf.get(), lz4sz, 10, ShouldExit ) ) goto close;
+        const auto sz = ReadWireFrame( m_sock, m_wireCodec, m_buffer + bufferOffset, lz4buf.get(), (LZ4_streamDecode_t*)m_stream, (ZSTD_DCtx*)m_zstdStream, lz4sz, ShouldExit );
+        if( sz < 0 ) goto close;
+
         auto bb = m_bytes.load( std::memory_order_relaxed );
         m_bytes.store( bb + sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
-
-        auto sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
-        assert( sz >= 0 );
         bb = m_decBytes.load( std::memory_order_relaxed );
         m_decBytes.store( bb + sz, std::memory_order_relaxed );
 
+        pos += sz;
+        m_netRead[writePos % NetBufferSlots] = NetBuffer { bufferOffset, sz, pos };
+        m_netWritePos.store( ++writePos );
+        if( m_netReadSleep.load() )
         {
             std::lock_guard<std::mutex> lock( m_netReadLock );
-            m_netRead.push_back( NetBuffer { m_bufferOffset, sz } );
             m_netReadCv.notify_one();
         }
-
-        m_bufferOffset += sz;
-        if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
     }
 
 close:
+#ifdef TRACY_HAS_SHARED_MEMORY
+    // Don't let the client wait for ring space that will never be released.
+    if( m_shm ) m_shm->Detach();
+#endif
+    // Worker thread waits for the end of stream marker, unless it is shutting down.
+    if( !WaitForSpace() ) return;
+    m_netRead[writePos % NetBufferSlots] = NetBuffer { -1 };
+    m_netWritePos.store( writePos + 1 );
     std::lock_guard<std::mutex> lock( m_netReadLock );
-    m_netRead.push_back( NetBuffer { -1 } );
     m_netReadCv.notify_one();
 }
 
-void Worker::Exec()
+void Worker::NetworkStreams()
 {
-    auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
+    std::vector<std::thread> threads;
+    for( int i=1; i<m_streams; i++ )
+    {
+        threads.emplace_back( [this, i] { SetThreadName( "Tracy Stream" ); NetworkStream( *m_streamSock[i-1], i ); } );
+    }
+    NetworkStream( m_sock, 0 );
+    for( auto& t : threads ) t.join();
+    for( auto& sock : m_streamSock ) sock->Close();
+
+    // Frames past a missing one are dropped. Worker thread waits for the end of stream marker, unless it is shutting down.
+    const auto writePos = m_netWritePos.load();
+    auto HasSpace = [this, writePos] { return writePos - m_netReadPos.load() < NetBufferSlots; };
+    if( !HasSpace() )
+    {
+        std::unique_lock<std::mutex> lock( m_netWriteLock );
+        m_netWriteSleep.fetch_add( 1 );
+        m_netWriteCv.wait( lock, [this, &HasSpace] { return HasSpace() || m_shutdown.load( std::memory_order_relaxed ); } );
+        m_netWriteSleep.fetch_sub( 1, std::memory_order_relaxed );
+        if( !HasSpace() ) return;
+    }
+    m_netRead[writePos % NetBufferSlots] = NetBuffer { -1 };
+    m_netWritePos.store( writePos + 1 );
+    std::lock_guard<std::mutex> lock( m_netReadLock );
+    m_netReadCv.notify_one();
+}
+
+void Worker::NetworkStream( Socket& sock, uint64_t seq )
+{
+    auto ShouldExit = [this, &seq] { return m_shutdown.load( std::memory_order_relaxed ) || m_netStreamEnd.load( std::memory_order_relaxed ) < seq; };
+    auto lz4buf = std::unique_ptr<char[]>( new char[LZ4Size] );
+    auto decbuf = std::unique_ptr<char[]>( new char[TargetFrameSize * 2] );
+    auto lz4 = LZ4_createStreamDecode();
+    auto zstd = m_wireCodec == WireCodecZstd ? ZSTD_createDCtx() : nullptr;
+    int decIdx = 0;
+
+    const uint64_t slots = m_bufferSize / TargetFrameSize;
+    auto HasSpace = [this, &seq, slots] {
+        return ( seq + 1 ) * TargetFrameSize <= m_netReleased.load() + slots * TargetFrameSize &&
+            seq - m_netReadPos.load() < NetBufferSlots;
+    };
+
+    for(;;)
+    {
+        // Frames are decoded into alternate halves, so that LZ4 finds the previous one in place.
+        auto dec = decbuf.get() + decIdx * TargetFrameSize;
+        decIdx ^= 1;
+        lz4sz_t lz4sz;
+        const auto sz = ReadWireFrame( sock, m_wireCodec, dec, lz4buf.get(), lz4, zstd, lz4sz, ShouldExit );
+        if( sz < 0 ) break;
+
+        if( !HasSpace() )
+        {
+            std::unique_lock<std::mutex> lock( m_netWriteLock );
+            m_netWriteSleep.fetch_add( 1 );
+            m_netWriteCv.wait( lock, [&HasSpace, &ShouldExit] { return HasSpace() || ShouldExit(); } );
+            m_netWriteSleep.fetch_sub( 1, std::memory_order_relaxed );
+            if( ShouldExit() ) break;
+        }
+
+        PublishStreamFrame( seq, dec, sz, lz4sz );
+        seq += m_streams;
+    }
+
+    // Streams waiting to publish a later frame won't ever be able to.
+    auto end = m_netStreamEnd.load();
+    while( seq < end && !m_netStreamEnd.compare_exchange_weak( end, seq ) ) {}
+    WakeNetwork();
+
+    LZ4_freeStreamDecode( lz4 );
+    if( zstd ) ZSTD_freeDCtx( zstd );
+}
+
+void Worker::PublishStreamFrame( uint64_t seq, const char* dec, int sz, lz4sz_t lz4sz )
+{
+    const uint64_t slots = m_bufferSize / TargetFrameSize;
+    const auto bufferOffset = int( seq % slots * TargetFrameSize );
+    memcpy( m_buffer + bufferOffset, dec, sz );
+    m_bytes.fetch_add( sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
+    m_decBytes.fetch_add( sz, std::memory_order_relaxed );
+    m_netRead[seq % NetBufferSlots] = NetBuffer { bufferOffset, sz, ( seq + 1 ) * TargetFrameSize };
+
+    {
+        std::lock_guard<std::mutex> lock( m_netPublishLock );
+        m_netReady[seq % NetBufferSlots] = true;
+        auto writePos = m_netWritePos.load( std::memory_order_relaxed );
+        while( m_netReady[writePos % NetBufferSlots] )
+        {
+            m_netReady[writePos % NetBufferSlots] = false;
+            writePos++;
+        }
+        m_netWritePos.store( writePos );
+    }
+    if( m_netReadSleep.load() )
+    {
+        std::lock_guard<std::mutex> lock( m_netReadLock );
+        m_netReadCv.notify_one();
+    }
+}
+
+void Worker::ReadNetBuffer( NetBuffer& netbuf )
+{
+    const auto readPos = m_netReadPos.load( std::memory_order_relaxed );
+    if( m_netWritePos.load() == readPos )
+    {
+        std::unique_lock<std::mutex> lock( m_netReadLock );
+        m_netReadSleep.store( true );
+        m_netReadCv.wait( lock, [this, readPos] { return m_netWritePos.load() != readPos; } );
+        m_netReadSleep.store( false, std::memory_order_relaxed );
+    }
+    netbuf = m_netRead[readPos % NetBufferSlots];
+    m_netReadEnd = netbuf.end;
+    m_netReadPos.store( readPos + 1 );
+}
 
+void Worker::ReleaseNetBuffer()
+{
+    m_netReleased.store( m_netReadEnd );
+#ifdef TRACY_HAS_SHARED_MEMORY
+    if( m_shm ) m_shm->Release( m_netReadEnd );
+#endif
+    if( m_netWriteSleep.load() != 0 ) WakeNetwork();
+}
+
+void Worker::WakeNetwork()
+{
+    std::lock_guard<std::mutex> lock( m_netWriteLock );
+    m_netWriteCv.notify_all();
+}
+
+void Worker::Exec()
+{
     for(;;)
     {
-        if( m_shutdown.load( std::memory_order_relaxed ) ) { m_netWriteCv.notify_one(); return; };
+        if( m_shutdown.load( std::memory_order_relaxed ) ) { WakeNetwork(); return; };
         if( m_sock.Connect( m_addr.c_str(), m_port ) ) break;
         std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
     }
 
-    std::chrono::time_point<std::chrono::high_resolution_clock> t0;
+    if( !Handshake() ) goto close;
+
+    {
+        std::lock_guard<std::mutex> lock( m_netWriteLock );
+        m_netStart = true;
+        m_netWriteCv.notify_one();
+    }
+
+    for(;;)
+    {
+        if( m_shutdown.load( std::memory_order_relaxed ) )
+        {
+            QueryTerminate();
+            goto close;
+        }
+
+        NetBuffer netbuf;
+        ReadNetBuffer( netbuf );
+        if( !ProcessNetBuffer( netbuf ) ) goto close;
+    }
+
+close:
+    CloseConnection();
+}
+
+bool Worker::Handshake()
+{
+    auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
 
     m_sock.Send( HandshakeShibboleth, HandshakeShibbolethSize );
     uint32_t protocolVersion = ProtocolVersion;
     m_sock.Send( &protocolVersion, sizeof( protocolVersion ) );
+    m_sock.Send( &m_wireCodecRequest, sizeof( m_wireCodecRequest ) );
     HandshakeStatus handshake;
     if( !m_sock.Read( &handshake, sizeof( handshake ), 10, ShouldExit ) )
     {
         m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
-        goto close;
+        return false;
     }
     m_handshake.store( handshake, std::memory_order_relaxed );
     switch( handshake )
@@ -2677,7 +3065,7 @@ void Worker::Exec()
     case HandshakeProtocolMismatch:
     case HandshakeNotAvailable:
     default:
-        goto close;
+        return false;
     }
 
     m_data.framesBase = m_data.frames.Retrieve( 0, [this] ( uint64_t name ) {
@@ -2696,7 +3084,7 @@ void Worker::Exec()
         if( !m_sock.Read( &welcome, sizeof( welcome ), 10, ShouldExit ) )
         {
             m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
-            goto close;
+            return false;
         }
         m_timerMul = welcome.timerMul;
         m_data.baseTime = welcome.initBegin;
@@ -2714,10 +3102,17 @@ void Worker::Exec()
         m_executableTime = welcome.exectime;
         m_ignoreMemFreeFaults = ( welcome.flags & WelcomeFlag::OnDemand ) || ( welcome.flags & WelcomeFlag::IsApple );
         m_ignoreFrameEndFaults = welcome.flags & WelcomeFlag::OnDemand;
+        m_ignoreZoneStackFaults = welcome.flags & WelcomeFlag::FlightRecorder;
         m_data.cpuArch = (CpuArchitecture)welcome.cpuArch;
         m_codeTransfer = welcome.flags & WelcomeFlag::CodeTransfer;
         m_combineSamples = welcome.flags & WelcomeFlag::CombineSamples;
         m_identifySamples = welcome.flags & WelcomeFlag::IdentifySamples;
+        m_wireCodec = welcome.wireCodec;
+        if( m_wireCodec >= NumWireCodecs )
+        {
+            m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+            return false;
+        }
         m_data.cpuId = welcome.cpuId;
         memcpy( m_data.cpuManufacturer, welcome.cpuManufacturer, 12 );
         m_data.cpuManufacturer[12] = '\0';
@@ -2732,16 +3127,68 @@ void Worker::Exec()
 
         m_hostInfo = welcome.hostInfo;
 
+        if( welcome.flags & WelcomeFlag::SharedMemory )
+        {
+            SharedMemoryOfferMessage offer;
+            if( !m_sock.Read( &offer, sizeof( offer ), 10, ShouldExit ) )
+            {
+                m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+                return false;
+            }
+            offer.name[SharedMemoryNameSize-1] = '\0';
+            SharedMemoryStatus status = SharedMemoryRejected;
+#ifdef TRACY_HAS_SHARED_MEMORY
+            // Only succeeds if the client runs on this host.
+            auto shm = new SharedMemoryRing;
+            if( shm->Open( offer.name, offer.nonce ) )
+            {
+                m_shm = shm;
+                status = SharedMemoryAccepted;
+            }
+            else
+            {
+                delete shm;
+            }
+#endif
+            m_sock.Send( &status, sizeof( status ) );
+        }
+
+        if( !m_shm && welcome.streams > 1 )
+        {
+            if( welcome.streams > MaxWireStreams )
+            {
+                m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+                return false;
+            }
+            for( int i=1; i<welcome.streams; i++ )
+            {
+                auto sock = std::make_unique<Socket>();
+                if( !sock->ConnectBlocking( m_addr.c_str(), m_port ) )
+                {
+                    m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+                    return false;
+                }
+                StreamMessage msg = { welcome.streamToken, uint8_t( i ) };
+                sock->Send( StreamShibboleth, StreamShibbolethSize );
+                sock->Send( &msg, sizeof( msg ) );
+                m_streamSock.emplace_back( std::move( sock ) );
+            }
+            m_streams = welcome.streams;
+        }
+
         if( m_onDemand )
         {
             OnDemandPayloadMessage onDemand;
             if( !m_sock.Read( &onDemand, sizeof( onDemand ), 10, ShouldExit ) )
             {
                 m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
-                goto close;
+                return false;
             }
             m_data.frameOffset = onDemand.frames;
             m_data.framesBase->frames.push_back( FrameEvent{ TscTime( onDemand.currentTime ), -1, -1 } );
+            m_refTimeSerial = onDemand.refTimeSerial;
+            m_refTimeCtx = onDemand.refTimeCtx;
+            m_refTimeGpu = onDemand.refTimeGpu;
         }
     }
 
@@ -2749,130 +3196,252 @@ void Worker::Exec()
     m_hasData.store( true, std::memory_order_release );
 
     LZ4_setStreamDecode( (LZ4_streamDecode_t*)m_stream, nullptr, 0 );
+    if( m_wireCodec == WireCodecZstd ) m_zstdStream = ZSTD_createDCtx();
+#ifdef TRACY_HAS_SHARED_MEMORY
+    m_netData = m_shm ? m_shm->Data() : m_buffer;
+#else
+    m_netData = m_buffer;
+#endif
     m_connected.store( true, std::memory_order_relaxed );
-    {
-        std::lock_guard<std::mutex> lock( m_netWriteLock );
-        m_netWriteCnt = 2;
-        m_netWriteCv.notify_one();
-    }
+    m_mbpsTime = std::chrono::high_resolution_clock::now();
+    return true;
+}
 
-    t0 = std::chrono::high_resolution_clock::now();
+// Returns false when the connection is to be closed.
+bool Worker::ProcessNetBuffer( const NetBuffer& netbuf )
+{
+    if( netbuf.bufferOffset < 0 ) return false;
 
-    for(;;)
-    {
-        if( m_shutdown.load( std::memory_order_relaxed ) )
-        {
-            QueryTerminate();
-            goto close;
-        }
+    const char* ptr = m_netData + netbuf.bufferOffset;
+    const char* end = ptr + netbuf.size;
 
-        NetBuffer netbuf;
+    {
+        std::lock_guard<DataLock> lock( m_data.lock );
+        while( ptr < end )
         {
-            std::unique_lock<std::mutex> lock( m_netReadLock );
-            m_netReadCv.wait( lock, [this] { return !m_netRead.empty(); } );
-            netbuf = m_netRead.front();
-            m_netRead.erase( m_netRead.begin() );
+            auto ev = (const QueueItem*)ptr;
+            if( !DispatchProcess( *ev, ptr ) )
+            {
+                FlushIngestLanes();
+                if( m_failure != Failure::None ) HandleFailure( ptr, end );
+                QueryTerminate();
+                return false;
+            }
         }
-        if( netbuf.bufferOffset < 0 ) goto close;
-
-        const char* ptr = m_buffer + netbuf.bufferOffset;
-        const char* end = ptr + netbuf.size;
+        FlushIngestLanes();
+        ReleaseNetBuffer();
 
+        if( m_serverQuerySpaceLeft > 0 && !m_serverQueryQueuePrio.empty() )
         {
-            std::lock_guard<std::mutex> lock( m_data.lock );
-            while( ptr < end )
+            const auto toSend = std::min( m_serverQuerySpaceLeft, m_serverQueryQueuePrio.size() );
+            m_sock.Send( m_serverQueryQueuePrio.data(), toSend * ServerQueryPacketSize );
+            m_serverQuerySpaceLeft -= toSend;
+            if( toSend == m_serverQueryQueuePrio.size() )
             {
-                auto ev = (const QueueItem*)ptr;
-                if( !DispatchProcess( *ev, ptr ) )
-                {
-                    if( m_failure != Failure::None ) HandleFailure( ptr, end );
-                    QueryTerminate();
-                    goto close;
-                }
+                m_serverQueryQueuePrio.clear();
             }
-
+            else
             {
-                std::lock_guard<std::mutex> lock( m_netWriteLock );
-                m_netWriteCnt++;
-                m_netWriteCv.notify_one();
+                m_serverQueryQueuePrio.erase( m_serverQueryQueuePrio.begin(), m_serverQueryQueuePrio.begin() + toSend );
             }
-
-            if( m_serverQuerySpaceLeft > 0 && !m_serverQueryQueuePrio.empty() )
+        }
+        if( m_serverQuerySpaceLeft > 0 && !m_serverQueryQueue.empty() )
+        {
+            const auto toSend = std::min( m_serverQuerySpaceLeft, m_serverQueryQueue.size() );
+            m_sock.Send( m_serverQueryQueue.data(), toSend * ServerQueryPacketSize );
+            m_serverQuerySpaceLeft -= toSend;
+            if( toSend == m_serverQueryQueue.size() )
             {
-                const auto toSend = std::min( m_serverQuerySpaceLeft, m_serverQueryQueuePrio.size() );
-                m_sock.Send( m_serverQueryQueuePrio.data(), toSend * ServerQueryPacketSize );
-                m_serverQuerySpaceLeft -= toSend;
-                if( toSend == m_serverQueryQueuePrio.size() )
-                {
-                    m_serverQueryQueuePrio.clear();
-                }
-                else
-                {
-                    m_serverQueryQueuePrio.erase( m_serverQueryQueuePrio.begin(), m_serverQueryQueuePrio.begin() + toSend );
-                }
+                m_serverQueryQueue.clear();
             }
-            if( m_serverQuerySpaceLeft > 0 && !m_serverQueryQueue.empty() )
+            else
             {
-                const auto toSend = std::min( m_serverQuerySpaceLeft, m_serverQueryQueue.size() );
-                m_sock.Send( m_serverQueryQueue.data(), toSend * ServerQueryPacketSize );
-                m_serverQuerySpaceLeft -= toSend;
-                if( toSend == m_serverQueryQueue.size() )
-                {
-                    m_serverQueryQueue.clear();
-                }
-                else
-                {
-                    m_serverQueryQueue.erase( m_serverQueryQueue.begin(), m_serverQueryQueue.begin() + toSend );
-                }
+                m_serverQueryQueue.erase( m_serverQueryQueue.begin(), m_serverQueryQueue.begin() + toSend );
             }
         }
+        // Give way to a waiting reader, otherwise back-to-back frames could starve the UI.
+        m_data.lock.Handover();
+    }
 
-        auto t1 = std::chrono::high_resolution_clock::now();
-        auto td = std::chrono::duration_cast<std::chrono::milliseconds>( t1 - t0 ).count();
-        enum { MbpsUpdateTime = 200 };
-        if( td > MbpsUpdateTime )
-        {
-            UpdateMbps( td );
-            t0 = t1;
-        }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto td = std::chrono::duration_cast<std::chrono::milliseconds>( t1 - m_mbpsTime ).count();
+    enum { MbpsUpdateTime = 200 };
+    if( td > MbpsUpdateTime )
+    {
+        UpdateMbps( td );
+        m_mbpsTime = t1;
+    }
 
-        if( m_terminate )
+    if( m_terminate )
+    {
+        if( m_pendingStrings != 0 || m_pendingThreads != 0 || m_pendingSourceLocation != 0 || m_pendingCallstackFrames != 0 ||
+            m_data.plots.IsPending() || m_pendingCallstackId != 0 || m_pendingExternalNames != 0 ||
+            m_pendingCallstackSubframes != 0 || m_pendingFrameImageData.image != nullptr || !m_pendingSymbols.empty() ||
+            m_pendingSymbolCode != 0 || !m_serverQueryQueue.empty() || !m_serverQueryQueuePrio.empty() ||
+            m_pendingSourceLocationPayload != 0 || m_pendingSingleString.ptr != nullptr || m_pendingSecondString.ptr != nullptr ||
+            !m_sourceCodeQuery.empty() || m_pendingFibers != 0 )
         {
-            if( m_pendingStrings != 0 || m_pendingThreads != 0 || m_pendingSourceLocation != 0 || m_pendingCallstackFrames != 0 ||
-                m_data.plots.IsPending() || m_pendingCallstackId != 0 || m_pendingExternalNames != 0 ||
-                m_pendingCallstackSubframes != 0 || m_pendingFrameImageData.image != nullptr || !m_pendingSymbols.empty() ||
-                m_pendingSymbolCode != 0 || !m_serverQueryQueue.empty() || !m_serverQueryQueuePrio.empty() ||
-                m_pendingSourceLocationPayload != 0 || m_pendingSingleString.ptr != nullptr || m_pendingSecondString.ptr != nullptr ||
-                !m_sourceCodeQuery.empty() || m_pendingFibers != 0 )
-            {
-                continue;
-            }
-            if( !m_crashed && !m_disconnect )
+            return true;
+        }
+        if( !m_crashed && !m_disconnect )
+        {
+            bool done = true;
+            for( auto& v : m_data.threads )
             {
-                bool done = true;
-                for( auto& v : m_data.threads )
+                if( !v->stack.empty() )
                 {
-                    if( !v->stack.empty() )
-                    {
-                        done = false;
-                        break;
-                    }
+                    done = false;
+                    break;
                 }
-                if( !done ) continue;
             }
-            QueryTerminate();
-            UpdateMbps( 0 );
-            break;
+            if( !done ) return true;
         }
+        QueryTerminate();
+        UpdateMbps( 0 );
+        return false;
     }
+    return true;
+}
 
-close:
+void Worker::CloseConnection()
+{
     Shutdown();
-    m_netWriteCv.notify_one();
+    WakeNetwork();
     m_sock.Close();
     m_connected.store( false, std::memory_order_relaxed );
 }
 
+Worker::PollStatus Worker::Poll()
+{
+    assert( m_pooled );
+    auto Close = [this] {
+        CloseConnection();
+        for( auto& sock : m_streamSock ) sock->Close();
+        m_pollStage = PollStage::Closed;
+        return PollStatus::Closed;
+    };
+
+    switch( m_pollStage )
+    {
+    case PollStage::Connect:
+        if( m_shutdown.load( std::memory_order_relaxed ) ) return Close();
+        if( !m_sock.Connect( m_addr.c_str(), m_port ) ) return PollStatus::Idle;
+        if( !Handshake() ) return Close();
+        m_pollLz4Buf.reset( new char[LZ4Size] );
+        if( m_streams > 1 )
+        {
+            for( int i=0; i<m_streams; i++ )
+            {
+                auto sock = i == 0 ? &m_sock : m_streamSock[i-1].get();
+                auto zstd = m_wireCodec == WireCodecZstd ? ZSTD_createDCtx() : nullptr;
+                m_pollStreams.emplace_back( PollStream { sock, LZ4_createStreamDecode(), zstd, std::unique_ptr<char[]>( new char[TargetFrameSize * 2] ), 0 } );
+            }
+        }
+        m_pollStage = PollStage::Receive;
+        return PollStatus::Busy;
+    case PollStage::Receive:
+    {
+        if( m_shutdown.load( std::memory_order_relaxed ) )
+        {
+            QueryTerminate();
+            return Close();
+        }
+        bool busy = false;
+        if( !m_pollNetClosed && !PollNetwork( busy ) )
+        {
+#ifdef TRACY_HAS_SHARED_MEMORY
+            // Don't let the client wait for ring space that will never be released.
+            if( m_shm ) m_shm->Detach();
+#endif
+            m_pollNetClosed = true;
+        }
+        const auto writePos = m_netWritePos.load( std::memory_order_relaxed );
+        while( m_netReadPos.load( std::memory_order_relaxed ) != writePos )
+        {
+            NetBuffer netbuf;
+            ReadNetBuffer( netbuf );
+            if( !ProcessNetBuffer( netbuf ) ) return Close();
+            busy = true;
+        }
+        if( m_pollNetClosed ) return Close();
+        return busy ? PollStatus::Busy : PollStatus::Idle;
+    }
+    default:
+        return PollStatus::Closed;
+    }
+}
+
+// Reads the frames which have already arrived, as long as there is space for
+// them. Returns false once the connection is closed.
+bool Worker::PollNetwork( bool& busy )
+{
+    auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
+
+    // Only a few frames are read at a time, so that the other connections of
+    // the pool get their turn.
+    enum { PollFrames = 16 };
+    for( int i=0; i<PollFrames; i++ )
+    {
+        const auto writePos = m_netWritePos.load( std::memory_order_relaxed );
+        if( writePos - m_netReadPos.load( std::memory_order_relaxed ) >= NetBufferSlots ) return true;
+
+#ifdef TRACY_HAS_SHARED_MEMORY
+        if( m_shm )
+        {
+            // The client writes no more data to the socket, so it becoming
+            // readable means the client has disconnected.
+            uint32_t sz;
+            uint64_t end;
+            auto ptr = m_shm->Read( sz, end );
+            if( !ptr )
+            {
+                if( m_shm->IsCorrupt() ) return false;
+                if( !m_sock.HasData() ) return true;
+                ptr = m_shm->Read( sz, end );
+                if( !ptr ) return false;
+            }
+            m_bytes.fetch_add( sizeof( sz ) + sz, std::memory_order_relaxed );
+            m_decBytes.fetch_add( sz, std::memory_order_relaxed );
+            m_netRead[writePos % NetBufferSlots] = NetBuffer { int( ptr - m_netData ), int( sz ), end };
+            m_netWritePos.store( writePos + 1 );
+            busy = true;
+            continue;
+        }
+#endif
+
+        lz4sz_t lz4sz;
+        if( m_streams > 1 )
+        {
+            const uint64_t slots = m_bufferSize / TargetFrameSize;
+            if( ( writePos + 1 ) * TargetFrameSize > m_netReleased.load() + slots * TargetFrameSize ) return true;
+            auto& stream = m_pollStreams[writePos % m_streams];
+            if( !stream.sock->HasData() ) return true;
+            auto dec = stream.dec.get() + stream.decIdx * TargetFrameSize;
+            stream.decIdx ^= 1;
+            const auto sz = ReadWireFrame( *stream.sock, m_wireCodec, dec, m_pollLz4Buf.get(), (LZ4_streamDecode_t*)stream.lz4, (ZSTD_DCtx*)stream.zstd, lz4sz, ShouldExit );
+            if( sz < 0 ) return false;
+            PublishStreamFrame( writePos, dec, sz, lz4sz );
+        }
+        else
+        {
+            const auto tail = m_bufferSize - m_pollPos % m_bufferSize;
+            if( tail < TargetFrameSize ) m_pollPos += tail;
+            if( m_pollPos + TargetFrameSize > m_netReleased.load() + m_bufferSize ) return true;
+            if( !m_sock.HasData() ) return true;
+            const auto bufferOffset = int( m_pollPos % m_bufferSize );
+            const auto sz = ReadWireFrame( m_sock, m_wireCodec, m_buffer + bufferOffset, m_pollLz4Buf.get(), (LZ4_streamDecode_t*)m_stream, (ZSTD_DCtx*)m_zstdStream, lz4sz, ShouldExit );
+            if( sz < 0 ) return false;
+            m_bytes.fetch_add( sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
+            m_decBytes.fetch_add( sz, std::memory_order_relaxed );
+            m_pollPos += sz;
+            m_netRead[writePos % NetBufferSlots] = NetBuffer { bufferOffset, sz, m_pollPos };
+            m_netWritePos.store( writePos + 1 );
+        }
+        busy = true;
+    }
+    return true;
+}
+
 void Worker::UpdateMbps( int64_t td )
 {
     const auto bytes = m_bytes.exchange( 0, std::memory_order_relaxed );
@@ -2933,11 +3502,7 @@ void Worker::HandleFailure( const char* ptr, const char* end )
         }
         if( HasAllFailureData() ) return;
 
-        {
-            std::lock_guard<std::mutex> lock( m_netWriteLock );
-            m_netWriteCnt++;
-            m_netWriteCv.notify_one();
-        }
+        ReleaseNetBuffer();
 
         if( m_serverQuerySpaceLeft > 0 && !m_serverQueryQueuePrio.empty() )
         {
@@ -2971,15 +3536,10 @@ void Worker::HandleFailure( const char* ptr, const char* end )
         if( m_shutdown.load( std::memory_order_relaxed ) ) return;
 
         NetBuffer netbuf;
-        {
-            std::unique_lock<std::mutex> lock( m_netReadLock );
-            m_netReadCv.wait( lock, [this] { return !m_netRead.empty(); } );
-            netbuf = m_netRead.front();
-            m_netRead.erase( m_netRead.begin() );
-        }
+        ReadNetBuffer( netbuf );
         if( netbuf.bufferOffset < 0 ) return;
 
-        ptr = m_buffer + netbuf.bufferOffset;
+        ptr = m_netData + netbuf.bufferOffset;
         end = ptr + netbuf.size;
     }
 }
@@ -3034,8 +3594,16 @@ void Worker::DispatchFailure( const QueueItem& ev, const char*& ptr )
     else
     {
         uint16_t sz;
+        uint64_t dt, idx;
         switch( ev.hdr.type )
         {
+        case QueueType::ZoneBeginCompact:
+            ptr = ReadVarInt( ptr + sizeof( QueueHeader ), dt );
+            ptr = ReadVarInt( ptr, idx );
+            break;
+        case QueueType::ZoneEndCompact:
+            ptr = ReadVarInt( ptr + sizeof( QueueHeader ), dt );
+            break;
         case QueueType::SingleStringData:
             ptr += sizeof( QueueHeader );
             memcpy( &sz, ptr, sizeof( sz ) );
@@ -3231,6 +3799,27 @@ bool Worker::DispatchProcess( const QueueItem& ev, const char*& ptr )
         uint16_t sz;
         switch( ev.hdr.type )
         {
+        case QueueType::ZoneBeginCompact:
+        {
+            uint64_t dt, idx;
+            ptr = ReadVarInt( ptr + sizeof( QueueHeader ), dt );
+            ptr = ReadVarInt( ptr, idx );
+            if( idx >= m_wireSrcLoc.size() ) return false;
+            QueueZoneBegin zoneBegin;
+            zoneBegin.time = ZigZagDecode( dt );
+            zoneBegin.srcloc = m_wireSrcLoc[idx];
+            ProcessZoneBegin( zoneBegin );
+            return true;
+        }
+        case QueueType::ZoneEndCompact:
+        {
+            uint64_t dt;
+            ptr = ReadVarInt( ptr + sizeof( QueueHeader ), dt );
+            QueueZoneEnd zoneEnd;
+            zoneEnd.time = ZigZagDecode( dt );
+            ProcessZoneEnd( zoneEnd );
+            return true;
+        }
         case QueueType::SingleStringData:
             ptr += sizeof( QueueHeader );
             memcpy( &sz, ptr, sizeof( sz ) );
@@ -3349,6 +3938,40 @@ void Worker::InsertMessageData( MessageData* msg )
     }
 }
 
+MessageData* Worker::AllocMessageData()
+{
+#ifdef TRACY_NO_STATISTICS
+    if( !m_messageDataPool.empty() ) return m_messageDataPool.back_and_pop();
+#endif
+    return m_slab.Alloc<MessageData>();
+}
+
+LockEvent* Worker::AllocLockEvent( LockType type )
+{
+    if( type == LockType::Lockable )
+    {
+#ifdef TRACY_NO_STATISTICS
+        if( !m_lockEventPool.empty() ) return m_lockEventPool.back_and_pop();
+#endif
+        return m_slab.Alloc<LockEvent>();
+    }
+    else
+    {
+#ifdef TRACY_NO_STATISTICS
+        if( !m_lockEventSharedPool.empty() ) return m_lockEventSharedPool.back_and_pop();
+#endif
+        return m_slab.Alloc<LockEventShared>();
+    }
+}
+
+GpuEvent* Worker::AllocGpuEvent()
+{
+#ifdef TRACY_NO_STATISTICS
+    if( !m_gpuEventPool.empty() ) return m_gpuEventPool.back_and_pop();
+#endif
+    return m_slab.Alloc<GpuEvent>();
+}
+
 ThreadData* Worker::NoticeThreadReal( uint64_t thread )
 {
     auto it = m_threadMap.find( thread );
@@ -3455,6 +4078,7 @@ ThreadData* Worker::NewThread( uint64_t thread, bool fiber )
     td->kernelSampleCnt = 0;
     td->pendingSample.time.Clear();
     td->isFiber = fiber;
+    td->ingestLane = m_ingestLanes.empty() ? 0 : uint8_t( m_data.threads.size() % m_ingestLanes.size() );
     td->fiber = nullptr;
     td->stackCount = (uint8_t*)m_slab.AllocBig( sizeof( uint8_t ) * 64*1024 );
     memset( td->stackCount, 0, sizeof( uint8_t ) * 64*1024 );
@@ -3462,6 +4086,8 @@ ThreadData* Worker::NewThread( uint64_t thread, bool fiber )
     m_threadMap.emplace( thread, td );
     m_data.threadDataLast.first = thread;
     m_data.threadDataLast.second = td;
+    // Callstack preceding the first event of a flight recording may have been discarded.
+    if( m_ignoreZoneStackFaults ) m_nextCallstack.emplace( thread, 0 );
     return td;
 }
 
@@ -3476,32 +4102,43 @@ void Worker::NewZone( ZoneEvent* zone )
     if( ssz == 0 )
     {
         td->stack.push_back( zone );
-        td->timeline.push_back( zone );
+        QueueZoneLaneItem( ZoneLaneItem { zone, td, -1, false } );
     }
     else
     {
+        // The first child is stored right away, so that the child list is never
+        // empty. Following children are appended in the ingestion lane.
         auto& back = td->stack.data()[ssz-1];
         if( !back->HasChildren() )
         {
-            back->SetChild( int32_t( m_data.zoneChildren.size() ) );
-            if( m_data.zoneVectorCache.empty() )
+#ifdef TRACY_NO_STATISTICS
+            if( !m_zoneChildrenFree.empty() )
             {
-                m_data.zoneChildren.push_back( Vector<short_ptr<ZoneEvent>>( zone ) );
+                const auto idx = m_zoneChildrenFree.back_and_pop();
+                back->SetChild( int32_t( idx ) );
+                m_data.zoneChildren[idx].push_back( zone );
             }
             else
+#endif
             {
-                Vector<short_ptr<ZoneEvent>> vze = std::move( m_data.zoneVectorCache.back_and_pop() );
-                assert( !vze.empty() );
-                vze.clear();
-                vze.push_back_non_empty( zone );
-                m_data.zoneChildren.push_back( std::move( vze ) );
+                back->SetChild( int32_t( m_data.zoneChildren.size() ) );
+                if( m_data.zoneVectorCache.empty() )
+                {
+                    m_data.zoneChildren.push_back( Vector<short_ptr<ZoneEvent>>( zone ) );
+                }
+                else
+                {
+                    Vector<short_ptr<ZoneEvent>> vze = std::move( m_data.zoneVectorCache.back_and_pop() );
+                    assert( !vze.empty() );
+                    vze.clear();
+                    vze.push_back_non_empty( zone );
+                    m_data.zoneChildren.push_back( std::move( vze ) );
+                }
             }
         }
         else
         {
-            const auto backChild = back->Child();
-            assert( !m_data.zoneChildren[backChild].empty() );
-            m_data.zoneChildren[backChild].push_back_non_empty( zone );
+            QueueZoneLaneItem( ZoneLaneItem { zone, td, back->Child(), false } );
         }
         td->stack.push_back_non_empty( zone );
     }
@@ -3514,6 +4151,27 @@ void Worker::NewZone( ZoneEvent* zone )
 #endif
 }
 
+// Traces which are not captured live have no ingestion lanes.
+void Worker::QueueZoneLaneItem( const ZoneLaneItem& item )
+{
+    if( m_ingestLanes.empty() )
+    {
+        assert( !item.end );
+        if( item.child < 0 )
+        {
+            item.thread->timeline.push_back( item.zone );
+        }
+        else
+        {
+            m_data.zoneChildren[item.child].push_back_non_empty( item.zone );
+        }
+    }
+    else
+    {
+        m_ingestLanes[item.thread->ingestLane]->zones.push_back( item );
+    }
+}
+
 void Worker::InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread, int64_t time )
 {
     if( m_data.lastTime < time ) m_data.lastTime = time;
@@ -4404,6 +5062,10 @@ bool Worker::Process( const QueueItem& ev )
     case QueueType::ZoneBegin:
         ProcessZoneBegin( ev.zoneBegin );
         break;
+    case QueueType::ZoneBeginIndexed:
+        m_wireSrcLoc.push_back( ev.zoneBegin.srcloc );
+        ProcessZoneBegin( ev.zoneBegin );
+        break;
     case QueueType::ZoneBeginCallstack:
         ProcessZoneBeginCallstack( ev.zoneBegin );
         break;
@@ -4450,6 +5112,9 @@ bool Worker::Process( const QueueItem& ev )
     case QueueType::ZoneValue:
         ProcessZoneValue( ev.zoneValue );
         break;
+    case QueueType::ZoneDropped:
+        ProcessZoneDropped( ev.zoneDropped );
+        break;
     case QueueType::LockAnnounce:
         ProcessLockAnnounce( ev.lockAnnounce );
         break;
@@ -4797,11 +5462,19 @@ void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
     auto td = GetCurrentThreadData();
     if( td->zoneIdStack.empty() )
     {
+        if( m_ignoreZoneStackFaults )
+        {
+            // Zone begin was in the part of a flight recording that was discarded.
+            RefTime( m_refTimeThread, ev.time );
+            return;
+        }
+        // Timelines are only complete once the ingestion lanes are flushed.
+        FlushIngestLanes();
         ZoneDoubleEndFailure( td->id, td->timeline.empty() ? nullptr : td->timeline.back() );
         return;
     }
     auto zoneId = td->zoneIdStack.back_and_pop();
-    if( zoneId != td->nextZoneId )
+    if( zoneId != td->nextZoneId && !( m_ignoreZoneStackFaults && zoneId == 0 ) )
     {
         ZoneStackFailure( td->id, td->stack.back() );
         return;
@@ -4819,6 +5492,51 @@ void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
 
     if( m_data.lastTime < timeEnd ) m_data.lastTime = timeEnd;
 
+    assert( !m_ingestLanes.empty() );
+    m_ingestLanes[td->ingestLane]->zones.push_back( ZoneLaneItem { zone, td, -1, true } );
+#ifndef TRACY_NO_STATISTICS
+    assert( !td->childTimeStack.empty() );
+    const auto timeSpan = timeEnd - zone->Start();
+    if( timeSpan > 0 )
+    {
+        const auto selfSpan = timeSpan - td->childTimeStack.back_and_pop();
+        if( !td->childTimeStack.empty() )
+        {
+            td->childTimeStack.back() += timeSpan;
+        }
+        // Statistics lanes are selected by source location, so that no two lanes
+        // update the same source location zones entry.
+        auto& lane = *m_ingestLanes[uint16_t( zone->SrcLoc() ) % m_ingestLanes.size()];
+        lane.statistics.push_back( ZoneEndItem { zone, selfSpan, CompressThread( td->id ), isReentry } );
+    }
+    else
+    {
+        td->childTimeStack.pop_back();
+    }
+#else
+    (void)isReentry;
+    CountZoneStatistics( zone );
+#endif
+}
+
+void Worker::ProcessZoneLaneItem( IngestLane& lane, const ZoneLaneItem& item )
+{
+    if( item.end )
+    {
+        FinishZone( lane, item.zone );
+    }
+    else if( item.child < 0 )
+    {
+        item.thread->timeline.push_back( item.zone );
+    }
+    else
+    {
+        m_data.zoneChildren[item.child].push_back_non_empty( item.zone );
+    }
+}
+
+void Worker::FinishZone( IngestLane& lane, ZoneEvent* zone )
+{
     if( zone->HasChildren() )
     {
         auto& childVec = m_data.zoneChildren[zone->Child()];
@@ -4827,75 +5545,110 @@ void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
         {
             Vector<short_ptr<ZoneEvent>> fitVec;
 #ifndef TRACY_NO_STATISTICS
-            fitVec.reserve_exact( sz, m_slab );
+            fitVec.reserve_exact( sz, lane.slab );
             memcpy( fitVec.data(), childVec.data(), sz * sizeof( short_ptr<ZoneEvent> ) );
 #else
             fitVec.set_magic();
             auto& fv = *((Vector<ZoneEvent>*)&fitVec);
-            fv.reserve_exact( sz, m_slab );
+            if( m_streaming )
+            {
+                // Streamed zones are released after each segment, keep them off the slab.
+                fv.reserve_and_use( sz );
+            }
+            else
+            {
+                fv.reserve_exact( sz, lane.slab );
+            }
             auto dst = fv.data();
             for( auto& ze : childVec )
             {
                 ZoneEvent* src = ze;
                 memcpy( dst++, src, sizeof( ZoneEvent ) );
-                m_zoneEventPool.push_back( src );
+                lane.zoneEventPool.push_back( src );
             }
 #endif
             fitVec.swap( childVec );
-            m_data.zoneVectorCache.push_back( std::move( fitVec ) );
+            lane.zoneVectorCache.push_back( std::move( fitVec ) );
         }
     }
+}
 
 #ifndef TRACY_NO_STATISTICS
-    assert( !td->childTimeStack.empty() );
-    const auto timeSpan = timeEnd - zone->Start();
-    if( timeSpan > 0 )
+void Worker::ProcessZoneStatistics( const ZoneEndItem& item )
+{
+    auto zone = item.zone;
+    const auto timeSpan = zone->End() - zone->Start();
+    ZoneThreadData ztd;
+    ztd.SetZone( zone );
+    ztd.SetThread( item.thread );
+
+    // Lookup cache is not used, as this runs in parallel with other source locations.
+    auto it = m_data.sourceLocationZones.find( zone->SrcLoc() );
+    assert( it != m_data.sourceLocationZones.end() );
+    auto slz = &it->second;
+    const auto selfSpan = item.selfSpan;
+    slz->Add( ztd, zone->Start(), zone->End(), selfSpan, item.reentry );
+    if( slz->min > timeSpan ) slz->min = timeSpan;
+    if( slz->max < timeSpan ) slz->max = timeSpan;
+    slz->total += timeSpan;
+    slz->sumSq += double( timeSpan ) * timeSpan;
+    if( slz->selfMin > selfSpan ) slz->selfMin = selfSpan;
+    if( slz->selfMax < selfSpan ) slz->selfMax = selfSpan;
+    slz->selfTotal += selfSpan;
+
+    if( !item.reentry )
     {
-        const auto ctid = CompressThread( td->id );
-        ZoneThreadData ztd;
-        ztd.SetZone( zone );
-        ztd.SetThread( ctid );
-
-        auto slz = GetSourceLocationZones( zone->SrcLoc() );
-        slz->zones.push_back( ztd );
-        if( slz->min > timeSpan ) slz->min = timeSpan;
-        if( slz->max < timeSpan ) slz->max = timeSpan;
-        slz->total += timeSpan;
-        slz->sumSq += double( timeSpan ) * timeSpan;
-        const auto selfSpan = timeSpan - td->childTimeStack.back_and_pop();
-        if( slz->selfMin > selfSpan ) slz->selfMin = selfSpan;
-        if( slz->selfMax < selfSpan ) slz->selfMax = selfSpan;
-        slz->selfTotal += selfSpan;
+        slz->nonReentrantCount++;
+        if( slz->nonReentrantMin > timeSpan ) slz->nonReentrantMin = timeSpan;
+        if( slz->nonReentrantMax < timeSpan ) slz->nonReentrantMax = timeSpan;
+        slz->nonReentrantTotal += timeSpan;
+    }
 
-        if( !isReentry )
-        {
-            slz->nonReentrantCount++;
-            if( slz->nonReentrantMin > timeSpan ) slz->nonReentrantMin = timeSpan;
-            if( slz->nonReentrantMax < timeSpan ) slz->nonReentrantMax = timeSpan;
-            slz->nonReentrantTotal += timeSpan;
-        }
-        if( !td->childTimeStack.empty() )
-        {
-            td->childTimeStack.back() += timeSpan;
-        }
+    auto tit = slz->threadCnt.find( item.thread );
+    if( tit == slz->threadCnt.end() )
+    {
+        slz->threadCnt.emplace( item.thread, 1 );
+    }
+    else
+    {
+        tit->second++;
+    }
+}
+#endif
 
-        auto it = slz->threadCnt.find( ctid );
-        if( it == slz->threadCnt.end() )
-        {
-            slz->threadCnt.emplace( ctid, 1 );
-        }
-        else
-        {
-            it->second++;
-        }
+void Worker::FlushIngestLanes()
+{
+    // Zone trees are built in the lane of their thread, while statistics are
+    // updated in the lane of their source location. Neither touches data the
+    // other lanes may use, so both are done in the same pass.
+    auto FlushLane = [this] ( size_t idx ) {
+        auto& lane = *m_ingestLanes[idx];
+        for( auto& item : lane.zones ) ProcessZoneLaneItem( lane, item );
+        lane.zones.clear();
+#ifndef TRACY_NO_STATISTICS
+        for( auto& item : lane.statistics ) ProcessZoneStatistics( item );
+        lane.statistics.clear();
+#endif
+    };
+    if( m_ingestDispatch )
+    {
+        m_ingestDispatch->Run( m_ingestLanes.size(), FlushLane );
     }
     else
     {
-        td->childTimeStack.pop_back();
+        assert( m_ingestLanes.size() == 1 );
+        FlushLane( 0 );
     }
-#else
-    CountZoneStatistics( zone );
+
+    for( auto& lane : m_ingestLanes )
+    {
+        for( auto& v : lane->zoneVectorCache ) m_data.zoneVectorCache.push_back( std::move( v ) );
+        lane->zoneVectorCache.clear();
+#ifdef TRACY_NO_STATISTICS
+        for( auto& v : lane->zoneEventPool ) m_zoneEventPool.push_back( v );
+        lane->zoneEventPool.clear();
 #endif
+    }
 }
 
 void Worker::ZoneStackFailure( uint64_t thread, const ZoneEvent* ev )
@@ -5170,10 +5923,20 @@ void Worker::ProcessZoneText()
     auto td = RetrieveThread( m_threadCtx );
     if( !td )
     {
+        if( m_ignoreZoneStackFaults )
+        {
+            GetSingleStringIdx();
+            return;
+        }
         ZoneTextFailure( m_threadCtx, m_pendingSingleString.ptr );
         return;
     }
     if( td->fiber ) td = td->fiber;
+    if( td->stack.empty() && m_ignoreZoneStackFaults )
+    {
+        GetSingleStringIdx();
+        return;
+    }
     if( td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneTextFailure( td->id, m_pendingSingleString.ptr );
@@ -5217,10 +5980,20 @@ void Worker::ProcessZoneName()
     auto td = RetrieveThread( m_threadCtx );
     if( !td )
     {
+        if( m_ignoreZoneStackFaults )
+        {
+            GetSingleStringIdx();
+            return;
+        }
         ZoneNameFailure( m_threadCtx );
         return;
     }
     if( td->fiber ) td = td->fiber;
+    if( td->stack.empty() && m_ignoreZoneStackFaults )
+    {
+        GetSingleStringIdx();
+        return;
+    }
     if( td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneNameFailure( td->id );
@@ -5239,10 +6012,12 @@ void Worker::ProcessZoneColor( const QueueZoneColor& ev )
     auto td = RetrieveThread( m_threadCtx );
     if( !td )
     {
+        if( m_ignoreZoneStackFaults ) return;
         ZoneColorFailure( m_threadCtx );
         return;
     }
     if( td->fiber ) td = td->fiber;
+    if( td->stack.empty() && m_ignoreZoneStackFaults ) return;
     if( td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneColorFailure( td->id );
@@ -5265,10 +6040,12 @@ void Worker::ProcessZoneValue( const QueueZoneValue& ev )
     auto td = RetrieveThread( m_threadCtx );
     if( !td )
     {
+        if( m_ignoreZoneStackFaults ) return;
         ZoneValueFailure( m_threadCtx, ev.value );
         return;
     }
     if( td->fiber ) td = td->fiber;
+    if( td->stack.empty() && m_ignoreZoneStackFaults ) return;
     if( td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneValueFailure( td->id, ev.value );
@@ -5302,6 +6079,14 @@ void Worker::ProcessZoneValue( const QueueZoneValue& ev )
     }
 }
 
+void Worker::ProcessZoneDropped( const QueueZoneDropped& ev )
+{
+    CheckSourceLocation( ev.srcloc );
+    auto& dropped = m_data.sourceLocationDropped[ShrinkSourceLocation( ev.srcloc )];
+    dropped.count += ev.count;
+    dropped.total += TscPeriod( ev.time );
+}
+
 void Worker::ProcessLockAnnounce( const QueueLockAnnounce& ev )
 {
     auto it = m_data.lockMap.find( ev.id );
@@ -5331,7 +6116,7 @@ void Worker::ProcessLockWait( const QueueLockWait& ev )
     assert( it != m_data.lockMap.end() );
     auto& lock = *it->second;
 
-    auto lev = lock.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5346,7 +6131,7 @@ void Worker::ProcessLockObtain( const QueueLockObtain& ev )
     assert( it != m_data.lockMap.end() );
     auto& lock = *it->second;
 
-    auto lev = lock.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5362,7 +6147,7 @@ void Worker::ProcessLockRelease( const QueueLockRelease& ev )
     assert( it != m_data.lockMap.end() );
     auto& lock = *it->second;
 
-    auto lev = lock.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5378,7 +6163,7 @@ void Worker::ProcessLockSharedWait( const QueueLockWait& ev )
     auto& lock = *it->second;
 
     assert( lock.type == LockType::SharedLockable );
-    auto lev = m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5394,7 +6179,7 @@ void Worker::ProcessLockSharedObtain( const QueueLockObtain& ev )
     auto& lock = *it->second;
 
     assert( lock.type == LockType::SharedLockable );
-    auto lev = m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5410,7 +6195,7 @@ void Worker::ProcessLockSharedRelease( const QueueLockReleaseShared& ev )
     auto& lock = *it->second;
 
     assert( lock.type == LockType::SharedLockable );
-    auto lev = m_slab.Alloc<LockEventShared>();
+    auto lev = AllocLockEvent( lock.type );
     const auto time = TscTime( RefTime( m_refTimeSerial, ev.time ) );
     lev->SetTime( time );
     lev->SetSrcLoc( 0 );
@@ -5428,8 +6213,10 @@ void Worker::ProcessLockMark( const QueueLockMark& ev )
     auto tid = lockmap.threadMap.find( ev.thread );
     assert( tid != lockmap.threadMap.end() );
     const auto thread = tid->second;
+    // Released lock events may only be followed by an obtain or a wait, which
+    // come before the mark.
     auto it = lockmap.timeline.end();
-    for(;;)
+    while( it != lockmap.timeline.begin() )
     {
         --it;
         if( it->ptr->thread == thread )
@@ -5513,7 +6300,7 @@ void Worker::ProcessPlotConfig( const QueuePlotConfig& ev )
 void Worker::ProcessMessage( const QueueMessage& ev )
 {
     auto td = GetCurrentThreadData();
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Idx, GetSingleStringIdx() );
@@ -5528,7 +6315,7 @@ void Worker::ProcessMessageLiteral( const QueueMessageLiteral& ev )
 {
     auto td = GetCurrentThreadData();
     CheckString( ev.text );
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Ptr, ev.text );
@@ -5542,7 +6329,7 @@ void Worker::ProcessMessageLiteral( const QueueMessageLiteral& ev )
 void Worker::ProcessMessageColor( const QueueMessageColor& ev )
 {
     auto td = GetCurrentThreadData();
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Idx, GetSingleStringIdx() );
@@ -5557,7 +6344,7 @@ void Worker::ProcessMessageLiteralColor( const QueueMessageColorLiteral& ev )
 {
     auto td = GetCurrentThreadData();
     CheckString( ev.text );
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Ptr, ev.text );
@@ -5718,8 +6505,17 @@ void Worker::ProcessGpuZoneBeginImplCommon( GpuEvent* zone, const QueueGpuZoneBe
         auto back = stack.back();
         if( back->Child() < 0 )
         {
-            back->SetChild( int32_t( m_data.gpuChildren.size() ) );
-            m_data.gpuChildren.push_back( Vector<short_ptr<GpuEvent>>() );
+#ifdef TRACY_NO_STATISTICS
+            if( !m_gpuChildrenFree.empty() )
+            {
+                back->SetChild( int32_t( m_gpuChildrenFree.back_and_pop() ) );
+            }
+            else
+#endif
+            {
+                back->SetChild( int32_t( m_data.gpuChildren.size() ) );
+                m_data.gpuChildren.push_back( Vector<short_ptr<GpuEvent>>() );
+            }
         }
         timeline = &m_data.gpuChildren[back->Child()];
     }
@@ -5733,13 +6529,13 @@ void Worker::ProcessGpuZoneBeginImplCommon( GpuEvent* zone, const QueueGpuZoneBe
 
 void Worker::ProcessGpuZoneBegin( const QueueGpuZoneBegin& ev, bool serial )
 {
-    auto zone = m_slab.Alloc<GpuEvent>();
+    auto zone = AllocGpuEvent();
     ProcessGpuZoneBeginImpl( zone, ev, serial );
 }
 
 void Worker::ProcessGpuZoneBeginCallstack( const QueueGpuZoneBegin& ev, bool serial )
 {
-    auto zone = m_slab.Alloc<GpuEvent>();
+    auto zone = AllocGpuEvent();
     ProcessGpuZoneBeginImpl( zone, ev, serial );
     if( serial )
     {
@@ -5759,13 +6555,13 @@ void Worker::ProcessGpuZoneBeginCallstack( const QueueGpuZoneBegin& ev, bool ser
 
 void Worker::ProcessGpuZoneBeginAllocSrcLoc( const QueueGpuZoneBeginLean& ev, bool serial )
 {
-    auto zone = m_slab.Alloc<GpuEvent>();
+    auto zone = AllocGpuEvent();
     ProcessGpuZoneBeginAllocSrcLocImpl( zone, ev, serial );
 }
 
 void Worker::ProcessGpuZoneBeginAllocSrcLocCallstack( const QueueGpuZoneBeginLean& ev, bool serial )
 {
-    auto zone = m_slab.Alloc<GpuEvent>();
+    auto zone = AllocGpuEvent();
     ProcessGpuZoneBeginAllocSrcLocImpl( zone, ev, serial );
     if( serial )
     {
@@ -5789,6 +6585,11 @@ void Worker::ProcessGpuZoneEnd( const QueueGpuZoneEnd& ev, bool serial )
     assert( ctx );
 
     auto td = ctx->threadData.find( ev.thread );
+    if( m_ignoreZoneStackFaults && ( td == ctx->threadData.end() || td->second.stack.empty() ) )
+    {
+        RefTime( serial ? m_refTimeSerial : m_refTimeThread, ev.cpuTime );
+        return;
+    }
     assert( td != ctx->threadData.end() );
 
     assert( !td->second.stack.empty() );
@@ -5856,6 +6657,7 @@ void Worker::ProcessGpuTime( const QueueGpuTime& ev )
     }
 
     auto zone = ctx->query[ev.queryId];
+    if( !zone && m_ignoreZoneStackFaults ) return;
     assert( zone );
     ctx->query[ev.queryId] = nullptr;
 
@@ -6966,7 +7768,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
 
     PlotData* plot;
     {
-        std::lock_guard<std::mutex> lock( m_data.lock );
+        std::lock_guard<DataLock> lock( m_data.lock );
         plot = m_slab.AllocInit<PlotData>();
         plot->data.reserve_exact( psz, m_slab );
     }
@@ -7059,7 +7861,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
     plot->max = max;
     plot->sum = sum;
 
-    std::lock_guard<std::mutex> lock( m_data.lock );
+    std::lock_guard<DataLock> lock( m_data.lock );
     m_data.plots.Data().insert( m_data.plots.Data().begin(), plot );
     mem.plot = plot;
 }
@@ -7156,7 +7958,7 @@ void Worker::ReconstructContextSwitchUsage()
         }
     }
 
-    std::lock_guard<std::mutex> lock( m_data.lock );
+    std::lock_guard<DataLock> lock( m_data.lock );
     m_data.ctxUsageReady = true;
 }
 
@@ -7382,54 +8184,1251 @@ void Worker::UpdateSampleStatisticsImpl( const CallstackFrameData** frames, uint
 }
 #endif
 
-int64_t Worker::ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx )
-{
-    uint32_t sz;
-    f.Read( sz );
-    return ReadTimelineHaveSize( f, zone, refTime, childIdx, sz );
-}
-
-int64_t Worker::ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz )
-{
-    if( sz == 0 )
-    {
-        zone->SetChild( -1 );
-        return refTime;
-    }
-    else
-    {
-        const auto idx = childIdx;
-        childIdx++;
-        zone->SetChild( idx );
-        return ReadTimeline( f, m_data.zoneChildren[idx], sz, refTime, childIdx );
-    }
-}
-
-void Worker::ReadTimeline( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx )
+void Worker::ReadFrames( FileRead& f, SectionLoad& sl )
 {
+    auto& slab = *sl.slab;
     uint64_t sz;
     f.Read( sz );
-    ReadTimelineHaveSize( f, zone, refTime, refGpuTime, childIdx, sz );
-}
-
-void Worker::ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx, uint64_t sz )
-{
-    if( sz == 0 )
-    {
-        zone->SetChild( -1 );
-    }
-    else
+    m_data.frames.Data().reserve_exact( sz, slab );
+    for( uint64_t i=0; i<sz; i++ )
     {
-        const auto idx = childIdx;
-        childIdx++;
-        zone->SetChild( idx );
-        ReadTimeline( f, m_data.gpuChildren[idx], sz, refTime, refGpuTime, childIdx );
-    }
-}
-
-#ifndef TRACY_NO_STATISTICS
-void Worker::ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint16_t thread )
-{
+        auto ptr = slab.AllocInit<FrameData>();
+        uint64_t fsz;
+        f.Read3( ptr->name, ptr->continuous, fsz );
+        ptr->frames.reserve_exact( fsz, slab );
+        int64_t refTime = 0;
+        if( ptr->continuous )
+        {
+            for( uint64_t j=0; j<fsz; j++ )
+            {
+                ptr->frames[j].start = ReadTimeOffset( f, refTime );
+                ptr->frames[j].end = -1;
+                f.Read( &ptr->frames[j].frameImage, sizeof( int32_t ) );
+            }
+        }
+        else
+        {
+            for( uint64_t j=0; j<fsz; j++ )
+            {
+                ptr->frames[j].start = ReadTimeOffset( f, refTime );
+                ptr->frames[j].end = ReadTimeOffset( f, refTime );
+                f.Read( &ptr->frames[j].frameImage, sizeof( int32_t ) );
+            }
+        }
+        for( uint64_t j=0; j<fsz; j++ )
+        {
+            const auto timeSpan = GetFrameTime( *ptr, j );
+            if( timeSpan > 0 )
+            {
+                ptr->min = std::min( ptr->min, timeSpan );
+                ptr->max = std::max( ptr->max, timeSpan );
+                ptr->total += timeSpan;
+                ptr->sumSq += double( timeSpan ) * timeSpan;
+            }
+        }
+        m_data.frames.Data()[i] = ptr;
+    }
+    m_data.framesBase = m_data.frames.Data()[0];
+    assert( m_data.framesBase->name == 0 );
+}
+
+void Worker::ReadThreadTimeline( FileRead& f, ThreadData* td, SectionLoad& sl )
+{
+    uint32_t tsz;
+    f.Read( tsz );
+    if( tsz != 0 )
+    {
+        ReadTimeline( f, td->timeline, tsz, 0, sl );
+    }
+}
+
+bool Worker::IsTimelinePending( const ThreadData* td ) const
+{
+    auto it = m_lazyTimelines.find( td );
+    return it != m_lazyTimelines.end() && !it->second.loaded;
+}
+
+void Worker::LoadTimeline( const ThreadData* td )
+{
+    auto it = m_lazyTimelines.find( td );
+    if( it == m_lazyTimelines.end() ) return;
+    auto& lt = it->second;
+    lt.lastUse = m_lazyGeneration;
+    if( lt.loaded ) return;
+
+    std::unique_ptr<FileRead> f( m_lazyFile->OpenSection( FileSection::ThreadTimeline, lt.section, std::thread::hardware_concurrency() ) );
+    assert( f );
+    auto thread = (ThreadData*)td;
+    lt.slab = std::make_unique<LoadSlab>();
+    SectionLoad sl { lt.slab.get(), 0 };
+    f->Read( sl.childIdx );
+    lt.childBase = sl.childIdx;
+    ReadThreadTimeline( *f, thread, sl );
+    lt.childCount = sl.childIdx - lt.childBase;
+    lt.loaded = true;
+    m_lazyUsage += lt.slab->Usage();
+
+#ifndef TRACY_NO_STATISTICS
+    // Timelines loaded before the background statistics are done get their
+    // zone pointers when the lists are ready.
+    if( m_data.sourceLocationZonesReady ) AttachTimelineZones( td );
+#else
+    if( !lt.counted )
+    {
+        for( auto& v : sl.zonesCnt ) m_data.sourceLocationZonesCnt[v.first] += v.second;
+    }
+    lt.counted = true;
+#endif
+}
+
+#ifndef TRACY_NO_STATISTICS
+// Puts the zone pointers of a loaded timeline back into the per source location
+// lists. Zones of a thread are matched to the list entries by their times, as
+// the order of zones starting at the same time is not kept by sorting.
+void Worker::AttachTimelineZones( const ThreadData* td )
+{
+    const auto tid = m_data.localThreadCompress.DecompressMustRaw( td->id );
+    unordered_flat_map<int16_t, std::vector<ZoneRangeRecord>> records;
+    auto countMap = std::make_unique<uint8_t[]>( 64*1024 );
+    if( !td->timeline.empty() ) GatherZoneRecords( countMap.get(), ((ThreadData*)td)->timeline, tid, records );
+
+    std::vector<uint32_t> listed;
+    for( auto& v : records )
+    {
+        auto& slz = m_data.sourceLocationZones.find( v.first )->second;
+        auto& rec = v.second;
+        pdqsort_branchless( rec.begin(), rec.end(), [] ( const auto& lhs, const auto& rhs ) {
+            return std::tie( lhs.start, lhs.end, lhs.self, lhs.reentrant ) < std::tie( rhs.start, rhs.end, rhs.self, rhs.reentrant );
+        } );
+        listed.clear();
+        listed.reserve( rec.size() );
+        const auto sz = slz.zones.size();
+        for( size_t i=0; i<sz; i++ )
+        {
+            if( slz.thread[i] == tid ) listed.emplace_back( uint32_t( i ) );
+        }
+        assert( listed.size() == rec.size() );
+        pdqsort_branchless( listed.begin(), listed.end(), [&slz] ( uint32_t lhs, uint32_t rhs ) {
+            const bool lr = slz.reentrant[lhs] != 0;
+            const bool rr = slz.reentrant[rhs] != 0;
+            return std::tie( slz.start[lhs], slz.end[lhs], slz.self[lhs], lr ) < std::tie( slz.start[rhs], slz.end[rhs], slz.self[rhs], rr );
+        } );
+        for( size_t i=0; i<rec.size(); i++ ) slz.zones[listed[i]].SetZone( rec[i].zone );
+    }
+}
+
+void Worker::DetachTimelineZones( const ThreadData* td )
+{
+    const auto tid = m_data.localThreadCompress.DecompressMustRaw( td->id );
+    for( auto& v : m_data.sourceLocationZones )
+    {
+        auto& slz = v.second;
+        if( slz.threadCnt.find( tid ) == slz.threadCnt.end() ) continue;
+        const auto sz = slz.zones.size();
+        for( size_t i=0; i<sz; i++ )
+        {
+            if( slz.thread[i] == tid ) slz.zones[i].SetZone( nullptr );
+        }
+    }
+}
+
+const ZoneEvent* Worker::LoadSourceLocationZone( const SourceLocationZones& slz, size_t idx )
+{
+    // The timeline is marked as used even if loaded, so that it is not evicted
+    // while the zone is shown.
+    if( !m_lazyTimelines.empty() ) LoadTimeline( GetThreadData( DecompressThread( slz.thread[idx] ) ) );
+    return slz.zones[idx].Zone();
+}
+#endif
+
+void Worker::EvictTimeline( const ThreadData* td )
+{
+    auto it = m_lazyTimelines.find( td );
+    assert( it != m_lazyTimelines.end() );
+    auto& lt = it->second;
+    if( !lt.loaded ) return;
+
+#ifndef TRACY_NO_STATISTICS
+    if( m_data.sourceLocationZonesReady ) DetachTimelineZones( td );
+#endif
+
+    auto thread = (ThreadData*)td;
+    memset( (char*)&thread->timeline, 0, sizeof( thread->timeline ) );
+    if( lt.childCount != 0 ) memset( (char*)( m_data.zoneChildren.data() + lt.childBase ), 0, sizeof( Vector<short_ptr<ZoneEvent>> ) * lt.childCount );
+    m_lazyUsage -= lt.slab->Usage();
+    lt.slab.reset();
+    lt.loaded = false;
+}
+
+void Worker::TrimTimelines( const std::function<void(const ThreadData*)>& evict )
+{
+    if( m_lazyTimelines.empty() ) return;
+    m_lazyGeneration++;
+    if( m_lazyUsage <= m_lazyBudget ) return;
+
+    // Timelines used since the previous trim are kept, even if over budget.
+    std::vector<std::pair<uint32_t, const ThreadData*>> cold;
+    for( auto& v : m_lazyTimelines )
+    {
+        if( v.second.loaded && m_lazyGeneration - v.second.lastUse > 1 ) cold.emplace_back( v.second.lastUse, v.first );
+    }
+    std::sort( cold.begin(), cold.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.first < rhs.first; } );
+    for( auto& v : cold )
+    {
+        if( m_lazyUsage <= m_lazyBudget ) break;
+        evict( v.second );
+        EvictTimeline( v.second );
+    }
+}
+
+#ifdef TRACY_NO_STATISTICS
+template<typename T>
+static tracy_force_inline const T& SegmentZone( const Vector<short_ptr<T>>& vec, size_t idx )
+{
+    return vec.is_magic() ? ((const Vector<T>&)vec)[idx] : *vec[idx];
+}
+
+template<typename T>
+static tracy_force_inline T& SegmentZone( Vector<short_ptr<T>>& vec, size_t idx )
+{
+    return vec.is_magic() ? ((Vector<T>&)vec)[idx] : *vec[idx];
+}
+
+// Lock state is rebuilt from the start of the timeline when a trace is loaded,
+// so the timeline may only be cut where the lock is not held. Threads that are
+// still waiting at the cut keep their wait events, listed in keep.
+static size_t LockReleasableEnd( const LockMap& lockmap, std::vector<uint32_t>& keep )
+{
+    keep.clear();
+    const auto& timeline = lockmap.timeline;
+    auto end = timeline.size();
+    uint64_t waiting = 0;
+    while( end != 0 )
+    {
+        const auto& tl = timeline[end-1];
+        if( tl.lockCount == 0 )
+        {
+            if( lockmap.type == LockType::Lockable )
+            {
+                waiting = tl.waitList;
+                break;
+            }
+            const auto tlp = (const LockEventShared*)(const LockEvent*)tl.ptr;
+            if( tlp->sharedList == 0 )
+            {
+                waiting = tl.waitList | tlp->waitShared;
+                break;
+            }
+        }
+        end--;
+    }
+    auto i = end;
+    while( waiting != 0 && i != 0 )
+    {
+        const auto& ev = *timeline[--i].ptr;
+        const auto tbit = uint64_t( 1 ) << ev.thread;
+        if( ( waiting & tbit ) != 0 && ( ev.type == LockEvent::Type::Wait || ev.type == LockEvent::Type::WaitShared ) )
+        {
+            keep.push_back( uint32_t( i ) );
+            waiting &= ~tbit;
+        }
+    }
+    assert( waiting == 0 );
+    std::reverse( keep.begin(), keep.end() );
+    return end;
+}
+
+uint64_t Worker::ReleaseZone( ZoneEvent& zone )
+{
+    uint64_t cnt = 1;
+    if( zone.extra != 0 )
+    {
+        m_zoneExtraFree.push_back( zone.extra );
+        zone.extra = 0;
+    }
+    if( zone.HasChildren() )
+    {
+        const auto idx = zone.Child();
+        auto& children = m_data.zoneChildren[idx];
+        if( children.is_magic() )
+        {
+            auto& vec = *(Vector<ZoneEvent>*)&children;
+            for( auto& child : vec ) cnt += ReleaseZone( child );
+            vec = Vector<ZoneEvent>();
+        }
+        else
+        {
+            for( auto& child : children )
+            {
+                cnt += ReleaseZone( *child );
+                m_zoneEventPool.push_back( child );
+            }
+            children = Vector<short_ptr<ZoneEvent>>();
+        }
+        m_zoneChildrenFree.push_back( uint32_t( idx ) );
+        zone.SetChild( -1 );
+    }
+    return cnt;
+}
+
+uint64_t Worker::ReleaseGpuZone( GpuEvent& zone )
+{
+    uint64_t cnt = 1;
+    if( zone.Child() >= 0 )
+    {
+        const auto idx = zone.Child();
+        auto& children = m_data.gpuChildren[idx];
+        assert( !children.is_magic() );
+        for( auto& child : children )
+        {
+            cnt += ReleaseGpuZone( *child );
+            m_gpuEventPool.push_back( child );
+        }
+        children = Vector<short_ptr<GpuEvent>>();
+        m_gpuChildrenFree.push_back( uint32_t( idx ) );
+        zone.SetChild( -1 );
+    }
+    return cnt;
+}
+
+// GPU zones are referenced by the pending queries until both of their GPU
+// times arrive, which may happen long after they were ended.
+bool Worker::IsGpuZoneResolved( const GpuEvent& zone ) const
+{
+    if( zone.CpuEnd() < 0 || zone.GpuEnd() < 0 ) return false;
+    if( zone.Child() < 0 ) return true;
+    const auto& children = m_data.gpuChildren[zone.Child()];
+    for( size_t i=0; i<children.size(); i++ )
+    {
+        if( !IsGpuZoneResolved( SegmentZone( children, i ) ) ) return false;
+    }
+    return true;
+}
+
+void Worker::ReleaseSegmentData()
+{
+    assert( m_streaming );
+
+    // Everything that ended is released, including the children of zones
+    // that are still open.
+    for( auto& td : m_data.threads )
+    {
+        td->count -= ReleaseZonesBefore( td->timeline, std::numeric_limits<int64_t>::max() );
+        m_data.samplesCnt -= td->samples.size();
+        td->kernelSampleCnt = 0;
+        td->samples.clear();
+    }
+
+    std::vector<uint32_t> keep;
+    for( auto& v : m_data.lockMap )
+    {
+        auto& lockmap = *v.second;
+        const auto num = LockReleasableEnd( lockmap, keep );
+        if( num == 0 ) continue;
+        auto& pool = lockmap.type == LockType::Lockable ? m_lockEventPool : m_lockEventSharedPool;
+        auto& timeline = lockmap.timeline;
+        size_t kept = 0;
+        for( size_t i=0; i<num; i++ )
+        {
+            if( kept < keep.size() && keep[kept] == i ) timeline[kept++] = timeline[i];
+            else pool.push_back( timeline[i].ptr );
+        }
+        timeline.erase( timeline.begin() + kept, timeline.begin() + num );
+        if( kept != 0 ) UpdateLockCount( lockmap, 0 );
+    }
+
+    for( auto& ctx : m_data.gpuData )
+    {
+        for( auto& td : ctx->threadData )
+        {
+            auto& timeline = td.second.timeline;
+            size_t num = 0;
+            while( num < timeline.size() && IsGpuZoneResolved( *timeline[num] ) )
+            {
+                const auto cnt = ReleaseGpuZone( *timeline[num] );
+                ctx->count -= cnt;
+                m_data.gpuCnt -= cnt;
+                m_gpuEventPool.push_back( timeline[num] );
+                num++;
+            }
+            if( num != 0 ) timeline.erase( timeline.begin(), timeline.begin() + num );
+        }
+    }
+
+    for( auto& msg : m_data.messages ) m_messageDataPool.push_back( msg );
+    m_data.messages = Vector<short_ptr<MessageData>>();
+    m_data.sourceLocationDropped.clear();
+    for( auto& td : m_data.threads ) td->messages = Vector<short_ptr<MessageData>>();
+
+    // The last value of each plot is kept, so that the next segment starts from it.
+    for( auto& plot : m_data.plots.Data() )
+    {
+        if( plot->data.size() < 2 ) continue;
+        decltype( plot->data ) last( plot->data.back() );
+        plot->data = std::move( last );
+    }
+
+    for( auto& v : m_data.memNameMap )
+    {
+        auto& mem = *v.second;
+        if( mem.frees.empty() ) continue;
+        Vector<MemEvent> active;
+        active.reserve( mem.active.size() );
+        for( auto& ev : mem.data )
+        {
+            if( ev.TimeFree() >= 0 ) continue;
+            mem.active[ev.Ptr()] = active.size();
+            active.push_back_no_space_check( ev );
+        }
+        mem.data = std::move( active );
+        mem.frees = Vector<uint32_t>();
+    }
+}
+
+// Zones are ordered and don't overlap, so only the first zone that is kept
+// may have children that ended before the given time.
+uint64_t Worker::ReleaseZonesBefore( Vector<short_ptr<ZoneEvent>>& vec, int64_t time )
+{
+    uint64_t cnt = 0;
+    size_t num = 0;
+    ZoneEvent* first = nullptr;
+    if( vec.is_magic() )
+    {
+        auto& v = *(Vector<ZoneEvent>*)&vec;
+        while( num < v.size() && v[num].IsEndValid() && v[num].End() < time )
+        {
+            cnt += ReleaseZone( v[num] );
+            num++;
+        }
+        if( num != 0 ) v.erase( v.begin(), v.begin() + num );
+        if( !v.empty() ) first = &v.front();
+    }
+    else
+    {
+        while( num < vec.size() && vec[num]->IsEndValid() && vec[num]->End() < time )
+        {
+            cnt += ReleaseZone( *vec[num] );
+            m_zoneEventPool.push_back( vec[num] );
+            num++;
+        }
+        if( num != 0 ) vec.erase( vec.begin(), vec.begin() + num );
+        if( !vec.empty() ) first = vec.front();
+    }
+    if( first && first->Start() < time && first->HasChildren() )
+    {
+        const auto idx = first->Child();
+        auto& children = m_data.zoneChildren[idx];
+        cnt += ReleaseZonesBefore( children, time );
+        if( children.empty() )
+        {
+            if( children.is_magic() )
+            {
+                *(Vector<ZoneEvent>*)&children = Vector<ZoneEvent>();
+            }
+            else
+            {
+                children = Vector<short_ptr<ZoneEvent>>();
+            }
+            m_zoneChildrenFree.push_back( uint32_t( idx ) );
+            first->SetChild( -1 );
+        }
+    }
+    return cnt;
+}
+
+void Worker::ReleaseDataBefore( int64_t time )
+{
+    assert( m_streaming );
+
+    for( auto& td : m_data.threads )
+    {
+        td->count -= ReleaseZonesBefore( td->timeline, time );
+
+        auto& msgs = td->messages;
+        size_t num = 0;
+        while( num < msgs.size() && msgs[num]->time < time ) num++;
+        if( num != 0 ) msgs.erase( msgs.begin(), msgs.begin() + num );
+    }
+
+    {
+        auto& msgs = m_data.messages;
+        size_t num = 0;
+        while( num < msgs.size() && msgs[num]->time < time ) m_messageDataPool.push_back( msgs[num++] );
+        if( num != 0 ) msgs.erase( msgs.begin(), msgs.begin() + num );
+    }
+
+    // The last plot value before the window is kept, so that the plot starts from it.
+    for( auto& plot : m_data.plots.Data() )
+    {
+        auto& data = plot->data;
+        data.ensure_sorted();
+        auto it = std::lower_bound( data.begin(), data.end(), time, [] ( const auto& l, const auto& r ) { return l.time.Val() < r; } );
+        if( it - data.begin() > 1 ) data.erase( data.begin(), it - 1 );
+    }
+
+    // New context switch data is appended to the last entry, which is always kept.
+    for( auto& v : m_data.ctxSwitch )
+    {
+        auto& data = v.second->v;
+        size_t num = 0;
+        while( num + 1 < data.size() && data[num].IsEndValid() && data[num].End() < time ) num++;
+        if( num != 0 ) data.erase( data.begin(), data.begin() + num );
+    }
+    for( int i=0; i<m_data.cpuDataCount; i++ )
+    {
+        auto& cs = m_data.cpuData[i].cs;
+        size_t num = 0;
+        while( num + 1 < cs.size() && cs[num].IsEndValid() && cs[num].End() < time ) num++;
+        if( num != 0 ) cs.erase( cs.begin(), cs.begin() + num );
+    }
+
+    for( auto& v : m_data.memNameMap )
+    {
+        auto& mem = *v.second;
+        if( mem.frees.empty() || mem.data[mem.frees.front()].TimeFree() >= time ) continue;
+        std::vector<uint32_t> remap( mem.data.size() );
+        Vector<MemEvent> data;
+        data.reserve( mem.data.size() );
+        for( size_t i=0; i<mem.data.size(); i++ )
+        {
+            auto& ev = mem.data[i];
+            const auto tf = ev.TimeFree();
+            if( tf >= 0 && tf < time ) continue;
+            remap[i] = uint32_t( data.size() );
+            if( tf < 0 ) mem.active[ev.Ptr()] = data.size();
+            data.push_back_no_space_check( ev );
+        }
+        Vector<uint32_t> frees;
+        for( auto& idx : mem.frees )
+        {
+            if( mem.data[idx].TimeFree() >= time ) frees.push_back( remap[idx] );
+        }
+        mem.data = std::move( data );
+        mem.frees = std::move( frees );
+    }
+}
+
+uint64_t Worker::CopySegmentZone( const Worker& prev, const ZoneEvent& src, ZoneEvent& dst, int32_t& childIdx, uint32_t& extraIdx )
+{
+    uint64_t cnt = 1;
+    memcpy( &dst, &src, sizeof( ZoneEvent ) );
+    m_data.sourceLocationZonesCnt[src.SrcLoc()]++;
+    if( src.extra != 0 )
+    {
+        dst.extra = extraIdx++;
+        m_data.zoneExtra[dst.extra] = prev.m_data.zoneExtra[src.extra];
+    }
+    if( src.HasChildren() )
+    {
+        const auto& children = prev.m_data.zoneChildren[src.Child()];
+        const auto idx = childIdx++;
+        dst.SetChild( idx );
+        auto& vec = *(Vector<ZoneEvent>*)&m_data.zoneChildren[idx];
+        vec.set_magic();
+        vec.reserve_exact( children.size(), m_slab );
+        for( size_t i=0; i<children.size(); i++ )
+        {
+            cnt += CopySegmentZone( prev, SegmentZone( children, i ), vec[i], childIdx, extraIdx );
+        }
+    }
+    return cnt;
+}
+
+// Children of a zone that was still open when the previous segment was written
+// are only present in this segment if they hadn't ended by then.
+uint64_t Worker::PrependSegmentChildren( const Worker& prev, const ZoneEvent& src, ZoneEvent& dst, int32_t& childIdx, uint32_t& extraIdx )
+{
+    if( !src.HasChildren() ) return 0;
+    const auto& pc = prev.m_data.zoneChildren[src.Child()];
+    const auto dsz = dst.HasChildren() ? m_data.zoneChildren[dst.Child()].size() : 0;
+    const auto dfirst = dsz != 0 ? SegmentZone( m_data.zoneChildren[dst.Child()], 0 ).Start() : std::numeric_limits<int64_t>::max();
+    size_t num = 0;
+    while( num < pc.size() && SegmentZone( pc, num ).End() >= 0 && SegmentZone( pc, num ).Start() < dfirst ) num++;
+
+    uint64_t cnt = 0;
+    if( num != 0 )
+    {
+        Vector<short_ptr<ZoneEvent>> merged;
+        auto& vec = *(Vector<ZoneEvent>*)&merged;
+        vec.set_magic();
+        vec.reserve_exact( uint32_t( num + dsz ), m_slab );
+        for( size_t i=0; i<num; i++ )
+        {
+            cnt += CopySegmentZone( prev, SegmentZone( pc, i ), vec[i], childIdx, extraIdx );
+        }
+        if( dsz != 0 )
+        {
+            auto& children = m_data.zoneChildren[dst.Child()];
+            for( size_t i=0; i<dsz; i++ ) memcpy( &vec[num+i], &SegmentZone( children, i ), sizeof( ZoneEvent ) );
+            children.swap( merged );
+        }
+        else
+        {
+            const auto idx = childIdx++;
+            dst.SetChild( idx );
+            m_data.zoneChildren[idx].swap( merged );
+        }
+    }
+    if( num < pc.size() && dsz != 0 )
+    {
+        auto& open = SegmentZone( pc, num );
+        auto& zone = SegmentZone( m_data.zoneChildren[dst.Child()], num );
+        if( open.End() < 0 && open.Start() == zone.Start() ) cnt += PrependSegmentChildren( prev, open, zone, childIdx, extraIdx );
+    }
+    return cnt;
+}
+
+uint64_t Worker::CopySegmentGpuZone( const Worker& prev, const GpuEvent& src, GpuEvent& dst, int32_t& childIdx )
+{
+    uint64_t cnt = 1;
+    memcpy( &dst, &src, sizeof( GpuEvent ) );
+    if( src.Child() >= 0 )
+    {
+        const auto& children = prev.m_data.gpuChildren[src.Child()];
+        const auto idx = childIdx++;
+        dst.SetChild( idx );
+        auto& vec = *(Vector<GpuEvent>*)&m_data.gpuChildren[idx];
+        vec.set_magic();
+        vec.reserve_exact( children.size(), m_slab );
+        for( size_t i=0; i<children.size(); i++ )
+        {
+            cnt += CopySegmentGpuZone( prev, SegmentZone( children, i ), vec[i], childIdx );
+        }
+    }
+    return cnt;
+}
+
+void Worker::PrependSegment( const Worker& prev )
+{
+    assert( !HasLazyTimelines() && !prev.HasLazyTimelines() );
+
+    // Segments are written from the same live worker, so string, source location,
+    // callstack and thread indices are compatible. Zones, GPU zones and lock
+    // events that were still in use at the end of the previous segment, and
+    // everything not released between segments, are already present in this one.
+    const auto childBase = m_data.zoneChildren.size();
+    const auto childNew = prev.m_data.zoneChildren.size();
+    if( childNew != 0 )
+    {
+        Vector<Vector<short_ptr<ZoneEvent>>> children;
+        children.reserve_exact( uint32_t( childBase + childNew ), m_slab );
+        memcpy( (char*)children.data(), m_data.zoneChildren.data(), childBase * sizeof( Vector<short_ptr<ZoneEvent>> ) );
+        memset( (char*)( children.data() + childBase ), 0, childNew * sizeof( Vector<short_ptr<ZoneEvent>> ) );
+        m_data.zoneChildren.swap( children );
+    }
+    const auto extraBase = m_data.zoneExtra.size();
+    {
+        Vector<ZoneExtra> extra;
+        extra.reserve_exact( uint32_t( extraBase + prev.m_data.zoneExtra.size() ), m_slab );
+        memcpy( extra.data(), m_data.zoneExtra.data(), extraBase * sizeof( ZoneExtra ) );
+        m_data.zoneExtra.swap( extra );
+    }
+
+    const auto gpuChildBase = m_data.gpuChildren.size();
+    const auto gpuChildNew = prev.m_data.gpuChildren.size();
+    if( gpuChildNew != 0 )
+    {
+        Vector<Vector<short_ptr<GpuEvent>>> children;
+        children.reserve_exact( uint32_t( gpuChildBase + gpuChildNew ), m_slab );
+        memcpy( (char*)children.data(), m_data.gpuChildren.data(), gpuChildBase * sizeof( Vector<short_ptr<GpuEvent>> ) );
+        memset( (char*)( children.data() + gpuChildBase ), 0, gpuChildNew * sizeof( Vector<short_ptr<GpuEvent>> ) );
+        m_data.gpuChildren.swap( children );
+    }
+
+    auto childIdx = int32_t( childBase );
+    auto extraIdx = uint32_t( extraBase );
+    for( auto& ptd : prev.m_data.threads )
+    {
+        auto it = m_threadMap.find( ptd->id );
+        if( it == m_threadMap.end() ) continue;
+        auto td = it->second;
+        const auto& ptl = ptd->timeline;
+        auto& timeline = td->timeline;
+        size_t cnt = 0;
+        while( cnt < ptl.size() )
+        {
+            auto& zone = SegmentZone( ptl, cnt );
+            if( zone.End() < 0 || ( !timeline.empty() && zone.Start() >= SegmentZone( timeline, 0 ).Start() ) ) break;
+            cnt++;
+        }
+        if( cnt != 0 )
+        {
+            Vector<short_ptr<ZoneEvent>> merged;
+            auto& vec = *(Vector<ZoneEvent>*)&merged;
+            vec.set_magic();
+            vec.reserve_exact( uint32_t( cnt + timeline.size() ), m_slab );
+            for( size_t i=0; i<cnt; i++ )
+            {
+                const auto zones = CopySegmentZone( prev, SegmentZone( ptl, i ), vec[i], childIdx, extraIdx );
+                td->count += zones;
+                m_data.zonesCnt += zones;
+            }
+            for( size_t i=0; i<timeline.size(); i++ ) memcpy( &vec[cnt+i], &SegmentZone( timeline, i ), sizeof( ZoneEvent ) );
+            timeline.swap( merged );
+        }
+        if( cnt < ptl.size() && cnt < timeline.size() )
+        {
+            auto& open = SegmentZone( ptl, cnt );
+            auto& zone = SegmentZone( timeline, cnt );
+            if( open.End() < 0 && open.Start() == zone.Start() )
+            {
+                const auto zones = PrependSegmentChildren( prev, open, zone, childIdx, extraIdx );
+                td->count += zones;
+                m_data.zonesCnt += zones;
+            }
+        }
+    }
+
+    auto gpuChildIdx = int32_t( gpuChildBase );
+    const auto gsz = std::min( prev.m_data.gpuData.size(), m_data.gpuData.size() );
+    for( size_t i=0; i<gsz; i++ )
+    {
+        auto ctx = m_data.gpuData[i];
+        for( auto& ptd : prev.m_data.gpuData[i]->threadData )
+        {
+            const auto& ptl = ptd.second.timeline;
+            auto& timeline = ctx->threadData[ptd.first].timeline;
+            size_t cnt = 0;
+            while( cnt < ptl.size() )
+            {
+                auto& zone = SegmentZone( ptl, cnt );
+                if( !prev.IsGpuZoneResolved( zone ) || ( !timeline.empty() && zone.CpuStart() >= SegmentZone( timeline, 0 ).CpuStart() ) ) break;
+                cnt++;
+            }
+            if( cnt == 0 ) continue;
+
+            Vector<short_ptr<GpuEvent>> merged;
+            auto& vec = *(Vector<GpuEvent>*)&merged;
+            vec.set_magic();
+            vec.reserve_exact( uint32_t( cnt + timeline.size() ), m_slab );
+            for( size_t j=0; j<cnt; j++ )
+            {
+                const auto zones = CopySegmentGpuZone( prev, SegmentZone( ptl, j ), vec[j], gpuChildIdx );
+                ctx->count += zones;
+                m_data.gpuCnt += zones;
+            }
+            for( size_t j=0; j<timeline.size(); j++ ) memcpy( &vec[cnt+j], &SegmentZone( timeline, j ), sizeof( GpuEvent ) );
+            timeline.swap( merged );
+        }
+    }
+
+    std::vector<uint32_t> keep;
+    for( auto& pl : prev.m_data.lockMap )
+    {
+        auto it = m_data.lockMap.find( pl.first );
+        if( it == m_data.lockMap.end() ) continue;
+        auto& lockmap = *it->second;
+        const auto& ptl = pl.second->timeline;
+        const auto end = LockReleasableEnd( *pl.second, keep );
+        const auto cnt = end - keep.size();
+        if( cnt == 0 ) continue;
+
+        // Wait events kept at the cut are already in this segment, ahead of
+        // the rest of its timeline, but may be older than the released events.
+        const auto lsz = lockmap.type == LockType::Lockable ? sizeof( LockEvent ) : sizeof( LockEventShared );
+        Vector<LockEventPtr> merged;
+        merged.reserve_exact( uint32_t( cnt + lockmap.timeline.size() ), m_slab );
+        size_t kept = 0;
+        for( size_t i=0; i<end; i++ )
+        {
+            if( kept < keep.size() && keep[kept] == i )
+            {
+                kept++;
+                continue;
+            }
+            auto lev = lockmap.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
+            memcpy( lev, (const LockEvent*)ptl[i].ptr, lsz );
+            merged[i-kept] = { lev };
+            UpdateLockRange( lockmap, *lev, lev->Time() );
+        }
+        memcpy( merged.data() + cnt, lockmap.timeline.data(), lockmap.timeline.size() * sizeof( LockEventPtr ) );
+        if( !keep.empty() )
+        {
+            std::inplace_merge( merged.begin(), merged.begin() + cnt, merged.begin() + cnt + keep.size(), [] ( const auto& lhs, const auto& rhs ) { return lhs.ptr->Time() < rhs.ptr->Time(); } );
+        }
+        lockmap.timeline.swap( merged );
+        UpdateLockCount( lockmap, 0 );
+    }
+
+    // Samples may arrive after the segment they belong to was written.
+    for( auto& ptd : prev.m_data.threads )
+    {
+        const auto psz = ptd->samples.size();
+        if( psz == 0 ) continue;
+        auto it = m_threadMap.find( ptd->id );
+        if( it == m_threadMap.end() ) continue;
+        auto td = it->second;
+        auto& samples = td->samples;
+        Vector<SampleData> merged;
+        merged.reserve_exact( uint32_t( psz + samples.size() ), m_slab );
+        memcpy( merged.data(), ptd->samples.data(), psz * sizeof( SampleData ) );
+        memcpy( merged.data() + psz, samples.data(), samples.size() * sizeof( SampleData ) );
+        if( !samples.empty() && samples.front().time.Val() < ptd->samples.back().time.Val() )
+        {
+            pdqsort_branchless( merged.begin(), merged.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
+        }
+        samples.swap( merged );
+        td->kernelSampleCnt += ptd->kernelSampleCnt;
+        m_data.samplesCnt += psz;
+    }
+
+    const auto msz = prev.m_data.messages.size();
+    if( msz != 0 )
+    {
+        unordered_flat_map<const MessageData*, MessageData*> msgMap;
+        msgMap.reserve( msz );
+        Vector<short_ptr<MessageData>> messages;
+        messages.reserve_exact( uint32_t( msz + m_data.messages.size() ), m_slab );
+        for( size_t i=0; i<msz; i++ )
+        {
+            const MessageData* src = prev.m_data.messages[i];
+            auto msg = m_slab.Alloc<MessageData>();
+            memcpy( msg, src, sizeof( MessageData ) );
+            messages[i] = msg;
+            msgMap.emplace( src, msg );
+        }
+        memcpy( messages.data() + msz, m_data.messages.data(), m_data.messages.size() * sizeof( short_ptr<MessageData> ) );
+        m_data.messages.swap( messages );
+
+        for( auto& ptd : prev.m_data.threads )
+        {
+            const auto psz = ptd->messages.size();
+            if( psz == 0 ) continue;
+            auto it = m_threadMap.find( ptd->id );
+            if( it == m_threadMap.end() ) continue;
+            auto& tmsg = it->second->messages;
+            Vector<short_ptr<MessageData>> merged;
+            merged.reserve_exact( uint32_t( psz + tmsg.size() ), m_slab );
+            for( size_t i=0; i<psz; i++ ) merged[i] = msgMap[ptd->messages[i]];
+            memcpy( merged.data() + psz, tmsg.data(), tmsg.size() * sizeof( short_ptr<MessageData> ) );
+            tmsg.swap( merged );
+        }
+    }
+
+    for( auto& pp : prev.m_data.plots.Data() )
+    {
+        if( pp->type == PlotType::Memory || pp->data.empty() ) continue;
+        PlotData* plot = nullptr;
+        for( auto& v : m_data.plots.Data() )
+        {
+            if( v->name == pp->name && v->type == pp->type )
+            {
+                plot = v;
+                break;
+            }
+        }
+        if( !plot ) continue;
+        size_t cnt = pp->data.size();
+        if( !plot->data.empty() )
+        {
+            const auto t0 = plot->data.front().time.Val();
+            cnt = std::lower_bound( pp->data.begin(), pp->data.end(), t0, [] ( const auto& l, const auto& r ) { return l.time.Val() < r; } ) - pp->data.begin();
+        }
+        if( cnt == 0 ) continue;
+        const auto psz = plot->data.size();
+        decltype( plot->data ) merged;
+        merged.reserve_exact( uint32_t( cnt + psz ), m_slab );
+        memcpy( merged.data(), pp->data.data(), cnt * sizeof( PlotItem ) );
+        memcpy( merged.data() + cnt, plot->data.data(), psz * sizeof( PlotItem ) );
+        if( psz == 0 )
+        {
+            plot->min = plot->max = pp->data[0].val;
+            plot->sum = 0;
+        }
+        for( size_t i=0; i<cnt; i++ )
+        {
+            const auto val = pp->data[i].val;
+            if( plot->min > val ) plot->min = val;
+            else if( plot->max < val ) plot->max = val;
+            plot->sum += val;
+        }
+        plot->data.swap( merged );
+    }
+
+    // Allocations still active at the end of the previous segment were carried
+    // over, only the freed ones need to be merged in.
+    for( auto& pm : prev.m_data.memNameMap )
+    {
+        auto it = m_data.memNameMap.find( pm.first );
+        if( it == m_data.memNameMap.end() ) continue;
+        auto& mem = *it->second;
+        const auto& pmem = *pm.second;
+        if( pmem.frees.empty() ) continue;
+
+        const auto dsz = mem.data.size() + pmem.frees.size();
+        Vector<MemEvent> data;
+        data.reserve_exact( uint32_t( dsz ), m_slab );
+        auto dst = data.data();
+        auto bit = mem.data.begin();
+        const auto bend = mem.data.end();
+        for( auto& ev : pmem.data )
+        {
+            if( ev.TimeFree() < 0 ) continue;
+            while( bit != bend && bit->TimeAlloc() < ev.TimeAlloc() ) *dst++ = *bit++;
+            *dst++ = ev;
+        }
+        while( bit != bend ) *dst++ = *bit++;
+        assert( dst == data.end() );
+        mem.data.swap( data );
+
+        size_t fsz = 0;
+        for( auto& ev : mem.data ) if( ev.TimeFree() >= 0 ) fsz++;
+        Vector<uint32_t> frees;
+        frees.reserve_exact( uint32_t( fsz ), m_slab );
+        mem.active.clear();
+        size_t fidx = 0;
+        for( size_t i=0; i<dsz; i++ )
+        {
+            auto& ev = mem.data[i];
+            if( ev.TimeFree() >= 0 )
+            {
+                frees[fidx++] = uint32_t( i );
+            }
+            else
+            {
+                mem.active.emplace( ev.Ptr(), i );
+            }
+        }
+        mem.frees.swap( frees );
+        if( mem.low > pmem.low ) mem.low = pmem.low;
+        if( mem.high < pmem.high ) mem.high = pmem.high;
+        mem.reconstruct = true;
+    }
+
+    for( auto& v : prev.m_data.sourceLocationDropped )
+    {
+        auto& dropped = m_data.sourceLocationDropped[v.first];
+        dropped.count += v.second.count;
+        dropped.total += v.second.total;
+    }
+}
+#endif
+
+void Worker::ReadThread( FileRead& f, ThreadData* td, uint16_t ctid, const unordered_flat_map<uint64_t, MessageData*>& msgMap, EventType::Type eventMask, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    uint64_t msz;
+    f.Read( msz );
+    if( eventMask & EventType::Messages )
+    {
+        td->messages.reserve_exact( msz, slab );
+        for( uint64_t j=0; j<msz; j++ )
+        {
+            uint64_t ptr;
+            f.Read( ptr );
+            auto it = msgMap.find( ptr );
+            assert( it != msgMap.end() );
+            auto md = it->second;
+            td->messages[j] = md;
+            md->thread = ctid;
+        }
+    }
+    else
+    {
+        f.Skip( msz * sizeof( uint64_t ) );
+    }
+    uint64_t ssz;
+    f.Read( ssz );
+    if( ssz != 0 )
+    {
+        if( eventMask & EventType::Samples )
+        {
+            int64_t refTime = 0;
+            td->ctxSwitchSamples.reserve_exact( ssz, slab );
+            auto ptr = td->ctxSwitchSamples.data();
+            for( uint64_t j=0; j<ssz; j++ )
+            {
+                ptr->time.SetVal( ReadTimeOffset( f, refTime ) );
+                f.Read( &ptr->callstack, sizeof( ptr->callstack ) );
+                ptr++;
+            }
+        }
+        else
+        {
+            f.Skip( ssz * ( 8 + 3 ) );
+        }
+    }
+    f.Read( ssz );
+    if( ssz != 0 )
+    {
+        if( eventMask & EventType::Samples )
+        {
+            int64_t refTime = 0;
+            td->samples.reserve_exact( ssz, slab );
+            auto ptr = td->samples.data();
+            for( uint64_t j=0; j<ssz; j++ )
+            {
+                ptr->time.SetVal( ReadTimeOffset( f, refTime ) );
+                f.Read( &ptr->callstack, sizeof( ptr->callstack ) );
+                ptr++;
+            }
+        }
+        else
+        {
+            f.Skip( ssz * ( 8 + 3 ) );
+        }
+    }
+}
+
+void Worker::ReadGpuContext( FileRead& f, GpuCtxData* ctx, SectionLoad& sl )
+{
+    uint64_t tdsz;
+    f.Read( tdsz );
+    for( uint64_t j=0; j<tdsz; j++ )
+    {
+        uint64_t tid, tsz;
+        f.Read2( tid, tsz );
+        if( tsz != 0 )
+        {
+            int64_t refTime = 0;
+            int64_t refGpuTime = 0;
+            auto td = ctx->threadData.emplace( tid, GpuCtxThreadData {} ).first;
+            ReadTimeline( f, td->second.timeline, tsz, refTime, refGpuTime, sl );
+        }
+    }
+}
+
+void Worker::ReadMemory( FileRead& f, MemData& memdata, uint64_t sz, uint64_t memload, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    memdata.data.reserve_exact( sz, slab );
+    uint64_t activeSz, freesSz;
+    f.Read2( activeSz, freesSz );
+    memdata.active.reserve( activeSz );
+    memdata.frees.reserve_exact( freesSz, slab );
+    auto mem = memdata.data.data();
+    s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
+    size_t fidx = 0;
+    int64_t refTime = 0;
+    auto& frees = memdata.frees;
+    auto& active = memdata.active;
+
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        s_loadProgress.subProgress.store( memload+i, std::memory_order_relaxed );
+        uint64_t ptr, size;
+        Int24 csAlloc;
+        int64_t timeAlloc, timeFree;
+        uint16_t threadAlloc, threadFree;
+        f.Read8( ptr, size, csAlloc, mem->csFree, timeAlloc, timeFree, threadAlloc, threadFree );
+        mem->SetPtr( ptr );
+        mem->SetSize( size );
+        mem->SetCsAlloc( csAlloc.Val() );
+        refTime += timeAlloc;
+        mem->SetTimeThreadAlloc( refTime, threadAlloc );
+        if( timeFree >= 0 )
+        {
+            mem->SetTimeThreadFree( timeFree + refTime, threadFree );
+            frees[fidx++] = i;
+        }
+        else
+        {
+            mem->SetTimeThreadFree( timeFree, threadFree );
+            active.emplace( ptr, i );
+        }
+        mem++;
+    }
+    f.Read4( memdata.high, memdata.low, memdata.usage, memdata.name );
+
+    if( sz != 0 )
+    {
+        memdata.reconstruct = true;
+    }
+}
+
+void Worker::ReadCallstacks( FileRead& f, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    uint64_t sz;
+    f.Read( sz );
+    m_data.callstackPayload.reserve_exact( sz+1, slab );
+    m_data.callstackPayload[0] = nullptr;
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        uint16_t csz;
+        f.Read( csz );
+
+        const auto memsize = sizeof( VarArray<CallstackFrameId> ) + csz * sizeof( CallstackFrameId );
+        auto mem = (char*)slab.AllocRaw( memsize );
+
+        auto data = (CallstackFrameId*)mem;
+        f.Read( data, csz * sizeof( CallstackFrameId ) );
+
+        auto arr = (VarArray<CallstackFrameId>*)( mem + csz * sizeof( CallstackFrameId ) );
+        new(arr) VarArray<CallstackFrameId>( csz, data );
+
+        m_data.callstackPayload[i+1] = arr;
+    }
+
+    f.Read( sz );
+    m_data.callstackFrameMap.reserve( sz );
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        CallstackFrameId id;
+        auto frameData = slab.Alloc<CallstackFrameData>();
+        f.Read3( id, frameData->size, frameData->imageName );
+
+        frameData->data = slab.Alloc<CallstackFrame>( frameData->size );
+        f.Read( frameData->data, sizeof( CallstackFrame ) * frameData->size );
+
+        m_data.callstackFrameMap.emplace( id, frameData );
+    }
+}
+
+void Worker::ReadContextSwitches( FileRead& f, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    uint64_t sz;
+    f.Read( sz );
+    s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
+    m_data.ctxSwitch.reserve( sz );
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        s_loadProgress.subProgress.store( i, std::memory_order_relaxed );
+        uint64_t thread, csz;
+        f.Read2( thread, csz );
+        auto data = slab.AllocInit<ContextSwitch>();
+        data->v.reserve_exact( csz, slab );
+        int64_t runningTime = 0;
+        int64_t refTime = 0;
+        auto ptr = data->v.data();
+        for( uint64_t j=0; j<csz; j++ )
+        {
+            int64_t deltaWakeup, deltaStart, diff, thread;
+            uint8_t cpu;
+            int8_t reason, state;
+            f.Read7( deltaWakeup, deltaStart, diff, cpu, reason, state, thread );
+            refTime += deltaWakeup;
+            ptr->SetWakeup( refTime );
+            refTime += deltaStart;
+            ptr->SetStartCpu( refTime, cpu );
+            if( diff > 0 ) runningTime += diff;
+            refTime += diff;
+            ptr->SetEndReasonState( refTime, reason, state );
+            // All saved threads are already known. Don't touch thread compression cache in a thread.
+            ptr->SetThread( m_data.localThreadCompress.DecompressMustRaw( thread ) );
+            ptr++;
+        }
+        data->runningTime = runningTime;
+        m_data.ctxSwitch.emplace( thread, data );
+    }
+}
+
+void Worker::ReadContextSwitchesPerCpu( FileRead& f, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    uint64_t sz;
+    f.Read( sz );
+    s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
+    uint64_t cnt = 0;
+    for( int i=0; i<256; i++ )
+    {
+        int64_t refTime = 0;
+        f.Read( sz );
+        if( sz != 0 )
+        {
+            m_data.cpuDataCount = i+1;
+            m_data.cpuData[i].cs.reserve_exact( sz, slab );
+            auto ptr = m_data.cpuData[i].cs.data();
+            for( uint64_t j=0; j<sz; j++ )
+            {
+                int64_t deltaStart, deltaEnd;
+                uint16_t thread;
+                f.Read3( deltaStart, deltaEnd, thread );
+                refTime += deltaStart;
+                ptr->SetStartThread( refTime, thread );
+                refTime += deltaEnd;
+                ptr->SetEnd( refTime );
+                ptr++;
+            }
+            cnt += sz;
+        }
+        s_loadProgress.subProgress.store( cnt, std::memory_order_relaxed );
+    }
+}
+
+void Worker::ReadSymbolCode( FileRead& f, SectionLoad& sl )
+{
+    auto& slab = *sl.slab;
+    uint64_t sz;
+    f.Read( sz );
+    uint64_t ssz = 0;
+    m_data.symbolCode.reserve( sz );
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        uint64_t symAddr;
+        uint32_t len;
+        f.Read2( symAddr, len );
+        ssz += len;
+        auto ptr = (char*)slab.AllocBig( len );
+        f.Read( ptr, len );
+        m_data.symbolCode.emplace( symAddr, MemoryBlock { ptr, len } );
+    }
+    m_data.symbolCodeSize = ssz;
+}
+
+void Worker::ReadZoneDropped( FileRead& f )
+{
+    uint64_t sz;
+    f.Read( sz );
+    m_data.sourceLocationDropped.reserve( sz );
+    for( uint64_t i=0; i<sz; i++ )
+    {
+        int16_t srcloc;
+        SourceLocationDropped dropped;
+        f.Read3( srcloc, dropped.count, dropped.total );
+        m_data.sourceLocationDropped.emplace( srcloc, dropped );
+    }
+}
+
+int64_t Worker::ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, SectionLoad& sl )
+{
+    uint32_t sz;
+    f.Read( sz );
+    return ReadTimelineHaveSize( f, zone, refTime, sl, sz );
+}
+
+int64_t Worker::ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, SectionLoad& sl, uint32_t sz )
+{
+    if( sz == 0 )
+    {
+        zone->SetChild( -1 );
+        return refTime;
+    }
+    else
+    {
+        const auto idx = sl.childIdx;
+        sl.childIdx++;
+        zone->SetChild( idx );
+        return ReadTimeline( f, m_data.zoneChildren[idx], sz, refTime, sl );
+    }
+}
+
+void Worker::ReadTimeline( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl )
+{
+    uint64_t sz;
+    f.Read( sz );
+    ReadTimelineHaveSize( f, zone, refTime, refGpuTime, sl, sz );
+}
+
+void Worker::ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl, uint64_t sz )
+{
+    if( sz == 0 )
+    {
+        zone->SetChild( -1 );
+    }
+    else
+    {
+        const auto idx = sl.childIdx;
+        sl.childIdx++;
+        zone->SetChild( idx );
+        ReadTimeline( f, m_data.gpuChildren[idx], sz, refTime, refGpuTime, sl );
+    }
+}
+
+#ifndef TRACY_NO_STATISTICS
+void Worker::ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint16_t thread )
+{
     assert( zone.IsEndValid() );
     auto timeSpan = zone.End() - zone.Start();
     if( timeSpan > 0 )
@@ -7437,12 +9436,7 @@ void Worker::ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint
         auto it = m_data.sourceLocationZones.find( zone.SrcLoc() );
         assert( it != m_data.sourceLocationZones.end() );
 
-        ZoneThreadData ztd;
-        ztd.SetZone( &zone );
-        ztd.SetThread( thread );
-
         auto& slz = it->second;
-        slz.zones.push_back( ztd );
         if( slz.min > timeSpan ) slz.min = timeSpan;
         if( slz.max < timeSpan ) slz.max = timeSpan;
         slz.total += timeSpan;
@@ -7456,17 +9450,12 @@ void Worker::ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint
             slz.nonReentrantTotal += timeSpan;
         }
 
-        if( zone.HasChildren() )
-        {
-            auto& children = GetZoneChildren( zone.Child() );
-            assert( children.is_magic() );
-            auto& c = *(Vector<ZoneEvent>*)( &children );
-            for( auto& v : c )
-            {
-                const auto childSpan = std::max( int64_t( 0 ), v.End() - v.Start() );
-                timeSpan -= childSpan;
-            }
-        }
+        timeSpan -= GetZoneChildTime( zone );
+
+        ZoneThreadData ztd;
+        ztd.SetZone( &zone );
+        ztd.SetThread( thread );
+        slz.Add( ztd, zone.Start(), zone.End(), timeSpan, countMap[uint16_t(zone.SrcLoc())] != 0 );
 
         if( slz.selfMin > timeSpan ) slz.selfMin = timeSpan;
         if( slz.selfMax < timeSpan ) slz.selfMax = timeSpan;
@@ -7484,6 +9473,94 @@ void Worker::ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint
     }
 }
 
+// Collects zones of a thread timeline, without touching the shared statistics.
+// Returns the time spanned by the zones in the vector.
+int64_t Worker::GatherZoneRecords( uint8_t* countMap, Vector<short_ptr<ZoneEvent>>& _vec, uint16_t thread, unordered_flat_map<int16_t, std::vector<ZoneRangeRecord>>& records )
+{
+    if( m_shutdown.load( std::memory_order_relaxed ) ) return 0;
+    assert( _vec.is_magic() );
+    auto& vec = *(Vector<ZoneEvent>*)( &_vec );
+    int64_t time = 0;
+    for( auto& zone : vec )
+    {
+        const auto timeSpan = zone.End() - zone.Start();
+        const auto record = zone.IsEndValid() && timeSpan > 0;
+        size_t idx = 0;
+        if( record )
+        {
+            auto& rec = records[zone.SrcLoc()];
+            idx = rec.size();
+            rec.emplace_back( ZoneRangeRecord { zone.Start(), zone.End(), timeSpan, thread, countMap[uint16_t(zone.SrcLoc())] != 0, &zone } );
+        }
+        if( zone.HasChildren() )
+        {
+            countMap[uint16_t(zone.SrcLoc())]++;
+            const auto childTime = GatherZoneRecords( countMap, GetZoneChildrenMutable( zone.Child() ), thread, records );
+            countMap[uint16_t(zone.SrcLoc())]--;
+            // Parent record is looked up again, as the map may have grown.
+            if( record ) records[zone.SrcLoc()][idx].self -= childTime;
+        }
+        time += std::max( int64_t( 0 ), timeSpan );
+    }
+    return time;
+}
+
+void Worker::ReconstructZoneStatistics( SourceLocationZones& slz, const std::vector<ZoneRangeRecord>& records )
+{
+    slz.Reserve( slz.zones.size() + records.size() );
+    for( auto& r : records )
+    {
+        const auto timeSpan = r.end - r.start;
+        if( slz.min > timeSpan ) slz.min = timeSpan;
+        if( slz.max < timeSpan ) slz.max = timeSpan;
+        slz.total += timeSpan;
+        slz.sumSq += double( timeSpan ) * timeSpan;
+
+        if( !r.reentrant )
+        {
+            slz.nonReentrantCount++;
+            if( slz.nonReentrantMin > timeSpan ) slz.nonReentrantMin = timeSpan;
+            if( slz.nonReentrantMax < timeSpan ) slz.nonReentrantMax = timeSpan;
+            slz.nonReentrantTotal += timeSpan;
+        }
+
+        ZoneThreadData ztd;
+        ztd.SetZone( r.zone );
+        ztd.SetThread( r.thread );
+        slz.Add( ztd, r.start, r.end, r.self, r.reentrant );
+
+        if( slz.selfMin > r.self ) slz.selfMin = r.self;
+        if( slz.selfMax < r.self ) slz.selfMax = r.self;
+        slz.selfTotal += r.self;
+
+        auto tit = slz.threadCnt.find( r.thread );
+        if( tit == slz.threadCnt.end() )
+        {
+            slz.threadCnt.emplace( r.thread, 1 );
+        }
+        else
+        {
+            tit->second++;
+        }
+    }
+}
+
+// Finds the zone in the sorted part of its source location zone list.
+const Worker::SourceLocationZones* Worker::FindSourceLocationZone( const ZoneEvent& zone, size_t& idx ) const
+{
+    if( !m_data.sourceLocationZonesReady ) return nullptr;
+    auto it = m_data.sourceLocationZones.find( zone.SrcLoc() );
+    if( it == m_data.sourceLocationZones.end() ) return nullptr;
+    auto& slz = it->second;
+    const auto se = slz.start.begin() + ( slz.zones.is_sorted() ? slz.zones.size() : slz.zones.sorted_end() );
+    for( auto sit = std::lower_bound( slz.start.begin(), se, zone.Start() ); sit != se && *sit == zone.Start(); ++sit )
+    {
+        idx = size_t( sit - slz.start.begin() );
+        if( slz.zones[idx].Zone() == &zone ) return &slz;
+    }
+    return nullptr;
+}
+
 void Worker::ReconstructZoneStatistics( GpuEvent& zone, uint16_t thread )
 {
     assert( zone.GpuEnd() >= 0 );
@@ -7506,6 +9583,125 @@ void Worker::ReconstructZoneStatistics( GpuEvent& zone, uint16_t thread )
         slz.sumSq += double( timeSpan ) * timeSpan;
     }
 }
+
+void Worker::SourceLocationZones::Reserve( size_t cnt )
+{
+    zones.reserve( cnt );
+    start.reserve( cnt );
+    end.reserve( cnt );
+    self.reserve( cnt );
+    thread.reserve( cnt );
+    reentrant.reserve( cnt );
+}
+
+template<typename T>
+static void ApplyPermutation( T* data, const std::vector<uint32_t>& perm, size_t base )
+{
+    std::vector<T> tmp( data + base, data + base + perm.size() );
+    for( size_t i=0; i<perm.size(); i++ ) data[base+i] = tmp[perm[i] - base];
+}
+
+// Same as SortedVector::sort(), but the zone order is applied to the columns
+// as well. Start times are taken from the start column.
+void Worker::SourceLocationZones::EnsureSorted()
+{
+    if( zones.is_sorted() ) return;
+
+    const auto sz = zones.size();
+    const auto se = zones.sorted_end();
+    const auto cmp = [this] ( uint32_t lhs, uint32_t rhs ) { return start[lhs] < start[rhs]; };
+
+    std::vector<uint32_t> tail( sz - se );
+    std::iota( tail.begin(), tail.end(), uint32_t( se ) );
+    pdqsort_branchless( tail.begin(), tail.end(), cmp );
+
+    const auto ss = size_t( std::lower_bound( start.begin(), start.begin() + se, start[tail.front()] ) - start.begin() );
+    std::vector<uint32_t> perm( sz - ss );
+    std::iota( perm.begin(), perm.begin() + ( se - ss ), uint32_t( ss ) );
+    std::copy( tail.begin(), tail.end(), perm.begin() + ( se - ss ) );
+    std::inplace_merge( perm.begin(), perm.begin() + ( se - ss ), perm.end(), cmp );
+
+    ApplyPermutation( zones.data(), perm, ss );
+    ApplyPermutation( start.data(), perm, ss );
+    ApplyPermutation( end.data(), perm, ss );
+    ApplyPermutation( self.data(), perm, ss );
+    ApplyPermutation( thread.data(), perm, ss );
+    ApplyPermutation( reentrant.data(), perm, ss );
+    zones.mark_sorted();
+}
+
+void Worker::BuildZoneRangeIndex( const std::vector<int16_t>& srclocs )
+{
+    // Zone lists are sorted and no longer change once the trace is loaded.
+    unordered_flat_map<int16_t, ZoneRangeIndex> index;
+    index.reserve( srclocs.size() );
+    for( auto srcloc : srclocs )
+    {
+        if( m_shutdown.load( std::memory_order_relaxed ) ) return;
+        const auto& slz = GetZonesForSourceLocation( srcloc );
+        assert( slz.zones.is_sorted() );
+
+        const auto sz = slz.zones.size();
+        auto& idx = index.emplace( srcloc, ZoneRangeIndex() ).first->second;
+        idx.total.resize( sz + 1 );
+        idx.selfTotal.resize( sz + 1 );
+        idx.nonReentrantTotal.resize( sz + 1 );
+        idx.nonReentrantCount.resize( sz + 1 );
+
+        const auto multiThread = slz.threadCnt.size() > 1;
+        unordered_flat_map<uint16_t, uint32_t> threadMap;
+
+        int64_t total = 0;
+        int64_t selfTotal = 0;
+        int64_t nonReentrantTotal = 0;
+        uint32_t nonReentrantCount = 0;
+        for( size_t i=0; i<sz; i++ )
+        {
+            const auto timeSpan = slz.end[i] - slz.start[i];
+            const auto reentrant = slz.reentrant[i] != 0;
+            total += timeSpan;
+            selfTotal += slz.self[i];
+            if( !reentrant )
+            {
+                nonReentrantTotal += timeSpan;
+                nonReentrantCount++;
+            }
+            idx.total[i+1] = total;
+            idx.selfTotal[i+1] = selfTotal;
+            idx.nonReentrantTotal[i+1] = nonReentrantTotal;
+            idx.nonReentrantCount[i+1] = nonReentrantCount;
+            if( multiThread )
+            {
+                const auto thread = slz.thread[i];
+                auto tit = threadMap.find( thread );
+                if( tit == threadMap.end() )
+                {
+                    tit = threadMap.emplace( thread, uint32_t( idx.threads.size() ) ).first;
+                    idx.threads.emplace_back( ZoneRangeIndex::ThreadZones { thread } );
+                }
+                auto& tz = idx.threads[tit->second];
+                tz.zones.push_back( uint32_t( i ) );
+                if( !reentrant ) tz.nonReentrant.push_back( uint32_t( i ) );
+            }
+        }
+
+        const auto blocks = ( sz + ZoneRangeIndex::BlockSize - 1 ) / ZoneRangeIndex::BlockSize;
+        idx.blockEnd.resize( blocks * 2, std::numeric_limits<int64_t>::min() );
+        for( size_t i=0; i<sz; i++ )
+        {
+            auto& be = idx.blockEnd[blocks + i / ZoneRangeIndex::BlockSize];
+            if( be < slz.end[i] ) be = slz.end[i];
+        }
+        for( size_t i=blocks-1; i>0; i-- )
+        {
+            idx.blockEnd[i] = std::max( idx.blockEnd[i*2], idx.blockEnd[i*2+1] );
+        }
+    }
+
+    std::lock_guard<DataLock> lock( m_data.lock );
+    m_data.zoneRangeIndex = std::move( index );
+    m_data.zoneRangeIndexReady = true;
+}
 #else
 void Worker::CountZoneStatistics( ZoneEvent* zone )
 {
@@ -7520,14 +9716,13 @@ void Worker::CountZoneStatistics( GpuEvent* zone )
 }
 #endif
 
-int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, uint32_t size, int64_t refTime, int32_t& childIdx )
+int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, uint32_t size, int64_t refTime, SectionLoad& sl )
 {
     assert( size != 0 );
-    const auto lp = s_loadProgress.subProgress.load( std::memory_order_relaxed );
-    s_loadProgress.subProgress.store( lp + size, std::memory_order_relaxed );
+    s_loadProgress.subProgress.fetch_add( size, std::memory_order_relaxed );
     auto& vec = *(Vector<ZoneEvent>*)( &_vec );
     vec.set_magic();
-    vec.reserve_exact( size, m_slab );
+    vec.reserve_exact( size, *sl.slab );
     auto zone = vec.begin();
     auto end = vec.end() - 1;
 
@@ -7541,12 +9736,12 @@ int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, u
         refTime += tstart;
         zone->SetStartSrcLoc( refTime, srcloc );
         zone->extra = extra;
-        refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz );
+        refTime = ReadTimelineHaveSize( f, zone, refTime, sl, childSz );
         f.Read5( tend, srcloc, tstart, extra, childSz );
         refTime += tend;
         zone->SetEnd( refTime );
 #ifdef TRACY_NO_STATISTICS
-        CountZoneStatistics( zone );
+        sl.zonesCnt[zone->SrcLoc()]++;
 #endif
         zone++;
     }
@@ -7554,25 +9749,24 @@ int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, u
     refTime += tstart;
     zone->SetStartSrcLoc( refTime, srcloc );
     zone->extra = extra;
-    refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz );
+    refTime = ReadTimelineHaveSize( f, zone, refTime, sl, childSz );
     f.Read( tend );
     refTime += tend;
     zone->SetEnd( refTime );
 #ifdef TRACY_NO_STATISTICS
-    CountZoneStatistics( zone );
+    sl.zonesCnt[zone->SrcLoc()]++;
 #endif
 
     return refTime;
 }
 
-void Worker::ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& _vec, uint64_t size, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx )
+void Worker::ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& _vec, uint64_t size, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl )
 {
     assert( size != 0 );
-    const auto lp = s_loadProgress.subProgress.load( std::memory_order_relaxed );
-    s_loadProgress.subProgress.store( lp + size, std::memory_order_relaxed );
+    s_loadProgress.subProgress.fetch_add( size, std::memory_order_relaxed );
     auto& vec = *(Vector<GpuEvent>*)( &_vec );
     vec.set_magic();
-    vec.reserve_exact( size, m_slab );
+    vec.reserve_exact( size, *sl.slab );
     auto zone = vec.begin();
     auto end = vec.end();
     do
@@ -7589,7 +9783,7 @@ void Worker::ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& _vec, uint6
         zone->SetCpuStart( refTime );
         zone->SetGpuStart( refGpuTime );
 
-        ReadTimelineHaveSize( f, zone, refTime, refGpuTime, childIdx, childSz );
+        ReadTimelineHaveSize( f, zone, refTime, refGpuTime, sl, childSz );
 
         f.Read2( tcpu, tgpu );
         refTime += tcpu;
@@ -7678,34 +9872,6 @@ void Worker::Write( FileWrite& f, bool fiDict )
 
     f.Write( &m_data.crashEvent, sizeof( m_data.crashEvent ) );
 
-    sz = m_data.frames.Data().size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& fd : m_data.frames.Data() )
-    {
-        int64_t refTime = 0;
-        f.Write( &fd->name, sizeof( fd->name ) );
-        f.Write( &fd->continuous, sizeof( fd->continuous ) );
-        sz = fd->frames.size();
-        f.Write( &sz, sizeof( sz ) );
-        if( fd->continuous )
-        {
-            for( auto& fe : fd->frames )
-            {
-                WriteTimeOffset( f, refTime, fe.start );
-                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
-            }
-        }
-        else
-        {
-            for( auto& fe : fd->frames )
-            {
-                WriteTimeOffset( f, refTime, fe.start );
-                WriteTimeOffset( f, refTime, fe.end );
-                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
-            }
-        }
-    }
-
     sz = m_data.stringData.size();
     f.Write( &sz, sizeof( sz ) );
     for( auto& v : m_data.stringData )
@@ -7871,43 +10037,10 @@ void Worker::Write( FileWrite& f, bool fiDict )
     f.Write( &sz, sizeof( sz ) );
     for( auto& thread : m_data.threads )
     {
-        int64_t refTime = 0;
         f.Write( &thread->id, sizeof( thread->id ) );
         f.Write( &thread->count, sizeof( thread->count ) );
         f.Write( &thread->kernelSampleCnt, sizeof( thread->kernelSampleCnt ) );
         f.Write( &thread->isFiber, sizeof( thread->isFiber ) );
-        WriteTimeline( f, thread->timeline, refTime );
-        sz = thread->messages.size();
-        f.Write( &sz, sizeof( sz ) );
-        for( auto& v : thread->messages )
-        {
-            auto ptr = uint64_t( (MessageData*)v );
-            f.Write( &ptr, sizeof( ptr ) );
-        }
-        sz = thread->ctxSwitchSamples.size();
-        f.Write( &sz, sizeof( sz ) );
-        refTime = 0;
-        for( auto& v : thread->ctxSwitchSamples )
-        {
-            WriteTimeOffset( f, refTime, v.time.Val() );
-            f.Write( &v.callstack, sizeof( v.callstack ) );
-        }
-        if( m_inconsistentSamples )
-        {
-#ifdef NO_PARALLEL_SORT
-            pdqsort_branchless( thread->samples.begin(), thread->samples.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
-#else
-            std::sort( std::execution::par_unseq, thread->samples.begin(), thread->samples.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
-#endif
-        }
-        sz = thread->samples.size();
-        f.Write( &sz, sizeof( sz ) );
-        refTime = 0;
-        for( auto& v : thread->samples )
-        {
-            WriteTimeOffset( f, refTime, v.time.Val() );
-            f.Write( &v.callstack, sizeof( v.callstack ) );
-        }
     }
 
     sz = 0;
@@ -7927,16 +10060,6 @@ void Worker::Write( FileWrite& f, bool fiDict )
         f.Write( &ctx->type, sizeof( ctx->type ) );
         f.Write( &ctx->name, sizeof( ctx->name ) );
         f.Write( &ctx->overflow, sizeof( ctx->overflow ) );
-        sz = ctx->threadData.size();
-        f.Write( &sz, sizeof( sz ) );
-        for( auto& td : ctx->threadData )
-        {
-            int64_t refTime = 0;
-            int64_t refGpuTime = 0;
-            uint64_t tid = td.first;
-            f.Write( &tid, sizeof( tid ) );
-            WriteTimeline( f, td.second.timeline, refTime, refGpuTime );
-        }
     }
 
     sz = m_data.plots.Data().size();
@@ -7961,74 +10084,24 @@ void Worker::Write( FileWrite& f, bool fiDict )
         {
             WriteTimeOffset( f, refTime, v.time.Val() );
             f.Write( &v.val, sizeof( v.val ) );
-        }
-    }
-
-    sz = m_data.memNameMap.size();
-    f.Write( &sz, sizeof( sz ) );
-    sz = 0;
-    for( auto& memory : m_data.memNameMap )
-    {
-        sz += memory.second->data.size();
-    }
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& memory : m_data.memNameMap )
-    {
-        uint64_t name = memory.first;
-        f.Write( &name, sizeof( name ) );
-
-        auto& memdata = *memory.second;
-        int64_t refTime = 0;
-        sz = memdata.data.size();
-        f.Write( &sz, sizeof( sz ) );
-        sz = memdata.active.size();
-        f.Write( &sz, sizeof( sz ) );
-        sz = memdata.frees.size();
-        f.Write( &sz, sizeof( sz ) );
-        for( auto& mem : memdata.data )
-        {
-            const auto ptr = mem.Ptr();
-            const auto size = mem.Size();
-            const Int24 csAlloc = mem.CsAlloc();
-            f.Write( &ptr, sizeof( ptr ) );
-            f.Write( &size, sizeof( size ) );
-            f.Write( &csAlloc, sizeof( csAlloc ) );
-            f.Write( &mem.csFree, sizeof( mem.csFree ) );
-
-            int64_t timeAlloc = mem.TimeAlloc();
-            uint16_t threadAlloc = mem.ThreadAlloc();
-            int64_t timeFree = mem.TimeFree();
-            uint16_t threadFree = mem.ThreadFree();
-            WriteTimeOffset( f, refTime, timeAlloc );
-            int64_t freeOffset = timeFree < 0 ? timeFree : timeFree - timeAlloc;
-            f.Write( &freeOffset, sizeof( freeOffset ) );
-            f.Write( &threadAlloc, sizeof( threadAlloc ) );
-            f.Write( &threadFree, sizeof( threadFree ) );
-        }
-        f.Write( &memdata.high, sizeof( memdata.high ) );
-        f.Write( &memdata.low, sizeof( memdata.low ) );
-        f.Write( &memdata.usage, sizeof( memdata.usage ) );
-        f.Write( &memdata.name, sizeof( memdata.name ) );
-    }
-
-    sz = m_data.callstackPayload.size() - 1;
-    f.Write( &sz, sizeof( sz ) );
-    for( size_t i=1; i<=sz; i++ )
-    {
-        auto& cs = m_data.callstackPayload[i];
-        uint16_t csz = cs->size();
-        f.Write( &csz, sizeof( csz ) );
-        f.Write( cs->data(), sizeof( CallstackFrameId ) * csz );
+        }
     }
 
-    sz = m_data.callstackFrameMap.size();
+    sz = m_data.memNameMap.size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& frame : m_data.callstackFrameMap )
+    sz = 0;
+    for( auto& memory : m_data.memNameMap )
     {
-        f.Write( &frame.first, sizeof( CallstackFrameId ) );
-        f.Write( &frame.second->size, sizeof( frame.second->size ) );
-        f.Write( &frame.second->imageName, sizeof( frame.second->imageName ) );
-        f.Write( frame.second->data, sizeof( CallstackFrame ) * frame.second->size );
+        sz += memory.second->data.size();
+    }
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& memory : m_data.memNameMap )
+    {
+        uint64_t name = memory.first;
+        f.Write( &name, sizeof( name ) );
+
+        sz = memory.second->data.size();
+        f.Write( &sz, sizeof( sz ) );
     }
 
     sz = m_data.appInfo.size();
@@ -8110,18 +10183,276 @@ void Worker::Write( FileWrite& f, bool fiDict )
         }
     }
 
+    sz = m_data.tidToPid.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.tidToPid )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+
+    sz = m_data.cpuThreadData.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.cpuThreadData )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+
+    sz = m_data.symbolLoc.size();
+    f.Write( &sz, sizeof( sz ) );
+    sz = m_data.symbolLocInline.size();
+    f.Write( &sz, sizeof( sz ) );
+    sz = m_data.symbolMap.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.symbolMap )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+
+    sz = m_data.codeSymbolMap.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.codeSymbolMap )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+
+    sz = m_data.hwSamples.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.hwSamples )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        WriteHwSampleVec( f, v.second.cycles );
+        WriteHwSampleVec( f, v.second.retired );
+        WriteHwSampleVec( f, v.second.cacheRef );
+        WriteHwSampleVec( f, v.second.cacheMiss );
+        WriteHwSampleVec( f, v.second.branchRetired );
+        WriteHwSampleVec( f, v.second.branchMiss );
+    }
+
+    sz = m_data.sourceFileCache.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.sourceFileCache )
+    {
+        uint32_t s32 = strlen( v.first );
+        f.Write( &s32, sizeof( s32 ) );
+        f.Write( v.first, s32 );
+        f.Write( &v.second.len, sizeof( v.second.len ) );
+        f.Write( v.second.data, v.second.len );
+    }
+
+    f.BeginSection( FileSection::Frames, 0 );
+    WriteFrames( f );
+
+    int32_t childIdx = 0;
+    for( size_t i=0; i<m_data.threads.size(); i++ )
+    {
+        auto td = m_data.threads[i];
+        const bool pending = IsTimelinePending( td );
+        if( pending ) LoadTimeline( td );
+        f.BeginSection( FileSection::ThreadTimeline, uint32_t( i ) );
+        WriteThreadTimeline( f, td, childIdx );
+        if( pending ) EvictTimeline( td );
+        f.BeginSection( FileSection::Thread, uint32_t( i ) );
+        WriteThread( f, td );
+    }
+
+    childIdx = 0;
+    for( size_t i=0; i<m_data.gpuData.size(); i++ )
+    {
+        f.BeginSection( FileSection::GpuContext, uint32_t( i ) );
+        WriteGpuContext( f, m_data.gpuData[i], childIdx );
+    }
+
+    uint32_t memIdx = 0;
+    for( auto& memory : m_data.memNameMap )
+    {
+        f.BeginSection( FileSection::Memory, memIdx++ );
+        WriteMemory( f, *memory.second );
+    }
+
+    f.BeginSection( FileSection::Callstacks, 0 );
+    WriteCallstacks( f );
+
+    f.BeginSection( FileSection::ContextSwitches, 0 );
+    WriteContextSwitches( f );
+
+    f.BeginSection( FileSection::ContextSwitchesPerCpu, 0 );
+    WriteContextSwitchesPerCpu( f );
+
+    f.BeginSection( FileSection::SymbolCode, 0 );
+    WriteSymbolCode( f );
+
+    f.BeginSection( FileSection::ZoneDropped, 0 );
+    WriteZoneDropped( f );
+}
+
+void Worker::WriteFrames( FileWrite& f )
+{
+    uint64_t sz = m_data.frames.Data().size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& fd : m_data.frames.Data() )
+    {
+        int64_t refTime = 0;
+        f.Write( &fd->name, sizeof( fd->name ) );
+        f.Write( &fd->continuous, sizeof( fd->continuous ) );
+        sz = fd->frames.size();
+        f.Write( &sz, sizeof( sz ) );
+        if( fd->continuous )
+        {
+            for( auto& fe : fd->frames )
+            {
+                WriteTimeOffset( f, refTime, fe.start );
+                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
+            }
+        }
+        else
+        {
+            for( auto& fe : fd->frames )
+            {
+                WriteTimeOffset( f, refTime, fe.start );
+                WriteTimeOffset( f, refTime, fe.end );
+                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
+            }
+        }
+    }
+}
+
+void Worker::WriteThreadTimeline( FileWrite& f, ThreadData* thread, int32_t& childIdx )
+{
+    f.Write( &childIdx, sizeof( childIdx ) );
+    int64_t refTime = 0;
+    WriteTimeline( f, thread->timeline, refTime, childIdx );
+}
+
+void Worker::WriteThread( FileWrite& f, ThreadData* thread )
+{
+    int64_t refTime;
+    uint64_t sz = thread->messages.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : thread->messages )
+    {
+        auto ptr = uint64_t( (MessageData*)v );
+        f.Write( &ptr, sizeof( ptr ) );
+    }
+    sz = thread->ctxSwitchSamples.size();
+    f.Write( &sz, sizeof( sz ) );
+    refTime = 0;
+    for( auto& v : thread->ctxSwitchSamples )
+    {
+        WriteTimeOffset( f, refTime, v.time.Val() );
+        f.Write( &v.callstack, sizeof( v.callstack ) );
+    }
+    if( m_inconsistentSamples )
+    {
+#ifdef NO_PARALLEL_SORT
+        pdqsort_branchless( thread->samples.begin(), thread->samples.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
+#else
+        std::sort( std::execution::par_unseq, thread->samples.begin(), thread->samples.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.time.Val() < rhs.time.Val(); } );
+#endif
+    }
+    sz = thread->samples.size();
+    f.Write( &sz, sizeof( sz ) );
+    refTime = 0;
+    for( auto& v : thread->samples )
+    {
+        WriteTimeOffset( f, refTime, v.time.Val() );
+        f.Write( &v.callstack, sizeof( v.callstack ) );
+    }
+}
+
+void Worker::WriteGpuContext( FileWrite& f, const GpuCtxData* ctx, int32_t& childIdx )
+{
+    f.Write( &childIdx, sizeof( childIdx ) );
+    uint64_t sz = ctx->threadData.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& td : ctx->threadData )
+    {
+        int64_t refTime = 0;
+        int64_t refGpuTime = 0;
+        uint64_t tid = td.first;
+        f.Write( &tid, sizeof( tid ) );
+        WriteTimeline( f, td.second.timeline, refTime, refGpuTime, childIdx );
+    }
+}
+
+void Worker::WriteMemory( FileWrite& f, const MemData& memdata )
+{
+    int64_t refTime = 0;
+    uint64_t sz = memdata.active.size();
+    f.Write( &sz, sizeof( sz ) );
+    sz = memdata.frees.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& mem : memdata.data )
+    {
+        const auto ptr = mem.Ptr();
+        const auto size = mem.Size();
+        const Int24 csAlloc = mem.CsAlloc();
+        f.Write( &ptr, sizeof( ptr ) );
+        f.Write( &size, sizeof( size ) );
+        f.Write( &csAlloc, sizeof( csAlloc ) );
+        f.Write( &mem.csFree, sizeof( mem.csFree ) );
+
+        int64_t timeAlloc = mem.TimeAlloc();
+        uint16_t threadAlloc = mem.ThreadAlloc();
+        int64_t timeFree = mem.TimeFree();
+        uint16_t threadFree = mem.ThreadFree();
+        WriteTimeOffset( f, refTime, timeAlloc );
+        int64_t freeOffset = timeFree < 0 ? timeFree : timeFree - timeAlloc;
+        f.Write( &freeOffset, sizeof( freeOffset ) );
+        f.Write( &threadAlloc, sizeof( threadAlloc ) );
+        f.Write( &threadFree, sizeof( threadFree ) );
+    }
+    f.Write( &memdata.high, sizeof( memdata.high ) );
+    f.Write( &memdata.low, sizeof( memdata.low ) );
+    f.Write( &memdata.usage, sizeof( memdata.usage ) );
+    f.Write( &memdata.name, sizeof( memdata.name ) );
+}
+
+void Worker::WriteCallstacks( FileWrite& f )
+{
+    uint64_t sz = m_data.callstackPayload.size() - 1;
+    f.Write( &sz, sizeof( sz ) );
+    for( size_t i=1; i<=sz; i++ )
+    {
+        auto& cs = m_data.callstackPayload[i];
+        uint16_t csz = cs->size();
+        f.Write( &csz, sizeof( csz ) );
+        f.Write( cs->data(), sizeof( CallstackFrameId ) * csz );
+    }
+
+    sz = m_data.callstackFrameMap.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& frame : m_data.callstackFrameMap )
+    {
+        f.Write( &frame.first, sizeof( CallstackFrameId ) );
+        f.Write( &frame.second->size, sizeof( frame.second->size ) );
+        f.Write( &frame.second->imageName, sizeof( frame.second->imageName ) );
+        f.Write( frame.second->data, sizeof( CallstackFrame ) * frame.second->size );
+    }
+}
+
+void Worker::WriteContextSwitches( FileWrite& f )
+{
     // Only save context switches relevant to active threads.
     std::vector<unordered_flat_map<uint64_t, ContextSwitch*>::const_iterator> ctxValid;
     ctxValid.reserve( m_data.ctxSwitch.size() );
     for( auto it = m_data.ctxSwitch.begin(); it != m_data.ctxSwitch.end(); ++it )
     {
         auto td = RetrieveThread( it->first );
+#ifdef TRACY_NO_STATISTICS
+        // Zones and samples of a streamed capture are released after each segment.
+        if( td && ( m_streaming || td->count > 0 || !td->samples.empty() ) )
+#else
         if( td && ( td->count > 0 || !td->samples.empty() ) )
+#endif
         {
             ctxValid.emplace_back( it );
         }
     }
-    sz = ctxValid.size();
+    uint64_t sz = ctxValid.size();
     f.Write( &sz, sizeof( sz ) );
     for( auto& ctx : ctxValid )
     {
@@ -8144,8 +10475,11 @@ void Worker::Write( FileWrite& f, bool fiDict )
             f.Write( &thread, sizeof( thread ) );
         }
     }
+}
 
-    sz = GetContextSwitchPerCpuCount();
+void Worker::WriteContextSwitchesPerCpu( FileWrite& f )
+{
+    uint64_t sz = GetContextSwitchPerCpuCount();
     f.Write( &sz, sizeof( sz ) );
     for( int i=0; i<256; i++ )
     {
@@ -8160,36 +10494,11 @@ void Worker::Write( FileWrite& f, bool fiDict )
             f.Write( &thread, sizeof( thread ) );
         }
     }
+}
 
-    sz = m_data.tidToPid.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.tidToPid )
-    {
-        f.Write( &v.first, sizeof( v.first ) );
-        f.Write( &v.second, sizeof( v.second ) );
-    }
-
-    sz = m_data.cpuThreadData.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.cpuThreadData )
-    {
-        f.Write( &v.first, sizeof( v.first ) );
-        f.Write( &v.second, sizeof( v.second ) );
-    }
-
-    sz = m_data.symbolLoc.size();
-    f.Write( &sz, sizeof( sz ) );
-    sz = m_data.symbolLocInline.size();
-    f.Write( &sz, sizeof( sz ) );
-    sz = m_data.symbolMap.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.symbolMap )
-    {
-        f.Write( &v.first, sizeof( v.first ) );
-        f.Write( &v.second, sizeof( v.second ) );
-    }
-
-    sz = m_data.symbolCode.size();
+void Worker::WriteSymbolCode( FileWrite& f )
+{
+    uint64_t sz = m_data.symbolCode.size();
     f.Write( &sz, sizeof( sz ) );
     for( auto& v : m_data.symbolCode )
     {
@@ -8197,56 +10506,36 @@ void Worker::Write( FileWrite& f, bool fiDict )
         f.Write( &v.second.len, sizeof( v.second.len ) );
         f.Write( v.second.data, v.second.len );
     }
+}
 
-    sz = m_data.codeSymbolMap.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.codeSymbolMap )
-    {
-        f.Write( &v.first, sizeof( v.first ) );
-        f.Write( &v.second, sizeof( v.second ) );
-    }
-
-    sz = m_data.hwSamples.size();
+void Worker::WriteZoneDropped( FileWrite& f )
+{
+    uint64_t sz = m_data.sourceLocationDropped.size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.hwSamples )
+    for( auto& v : m_data.sourceLocationDropped )
     {
         f.Write( &v.first, sizeof( v.first ) );
-        WriteHwSampleVec( f, v.second.cycles );
-        WriteHwSampleVec( f, v.second.retired );
-        WriteHwSampleVec( f, v.second.cacheRef );
-        WriteHwSampleVec( f, v.second.cacheMiss );
-        WriteHwSampleVec( f, v.second.branchRetired );
-        WriteHwSampleVec( f, v.second.branchMiss );
-    }
-
-    sz = m_data.sourceFileCache.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.sourceFileCache )
-    {
-        uint32_t s32 = strlen( v.first );
-        f.Write( &s32, sizeof( s32 ) );
-        f.Write( v.first, s32 );
-        f.Write( &v.second.len, sizeof( v.second.len ) );
-        f.Write( v.second.data, v.second.len );
+        f.Write( &v.second.count, sizeof( v.second.count ) );
+        f.Write( &v.second.total, sizeof( v.second.total ) );
     }
 }
 
-void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime )
+void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime, int32_t& childIdx )
 {
     uint32_t sz = uint32_t( vec.size() );
     f.Write( &sz, sizeof( sz ) );
     if( vec.is_magic() )
     {
-        WriteTimelineImpl<VectorAdapterDirect<ZoneEvent>>( f, *(Vector<ZoneEvent>*)( &vec ), refTime );
+        WriteTimelineImpl<VectorAdapterDirect<ZoneEvent>>( f, *(Vector<ZoneEvent>*)( &vec ), refTime, childIdx );
     }
     else
     {
-        WriteTimelineImpl<VectorAdapterPointer<ZoneEvent>>( f, vec, refTime );
+        WriteTimelineImpl<VectorAdapterPointer<ZoneEvent>>( f, vec, refTime, childIdx );
     }
 }
 
 template<typename Adapter, typename V>
-void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime )
+void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int32_t& childIdx )
 {
     Adapter a;
     for( auto& val : vec )
@@ -8264,28 +10553,30 @@ void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime )
         }
         else
         {
-            WriteTimeline( f, GetZoneChildren( v.Child() ), refTime );
+            auto& children = GetZoneChildren( v.Child() );
+            if( !children.empty() ) childIdx++;
+            WriteTimeline( f, children, refTime, childIdx );
         }
         WriteTimeOffset( f, refTime, v.End() );
     }
 }
 
-void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime )
+void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx )
 {
     uint64_t sz = vec.size();
     f.Write( &sz, sizeof( sz ) );
     if( vec.is_magic() )
     {
-        WriteTimelineImpl<VectorAdapterDirect<GpuEvent>>( f, *(Vector<GpuEvent>*)( &vec ), refTime, refGpuTime );
+        WriteTimelineImpl<VectorAdapterDirect<GpuEvent>>( f, *(Vector<GpuEvent>*)( &vec ), refTime, refGpuTime, childIdx );
     }
     else
     {
-        WriteTimelineImpl<VectorAdapterPointer<GpuEvent>>( f, vec, refTime, refGpuTime );
+        WriteTimelineImpl<VectorAdapterPointer<GpuEvent>>( f, vec, refTime, refGpuTime, childIdx );
     }
 }
 
 template<typename Adapter, typename V>
-void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime )
+void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx )
 {
     Adapter a;
     for( auto& val : vec )
@@ -8306,7 +10597,9 @@ void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, in
         }
         else
         {
-            WriteTimeline( f, GetGpuChildren( v.Child() ), refTime, refGpuTime );
+            auto& children = GetGpuChildren( v.Child() );
+            if( !children.empty() ) childIdx++;
+            WriteTimeline( f, children, refTime, refGpuTime, childIdx );
         }
 
         WriteTimeOffset( f, refTime, v.CpuEnd() );
@@ -8357,6 +10650,15 @@ const Worker::CpuThreadTopology* Worker::GetThreadTopology( uint32_t cpuThread )
 ZoneExtra& Worker::AllocZoneExtra( ZoneEvent& ev )
 {
     assert( ev.extra == 0 );
+#ifdef TRACY_NO_STATISTICS
+    if( !m_zoneExtraFree.empty() )
+    {
+        ev.extra = m_zoneExtraFree.back_and_pop();
+        auto& extra = m_data.zoneExtra[ev.extra];
+        memset( (char*)&extra, 0, sizeof( extra ) );
+        return extra;
+    }
+#endif
     ev.extra = uint32_t( m_data.zoneExtra.size() );
     auto& extra = m_data.zoneExtra.push_next();
     memset( (char*)&extra, 0, sizeof( extra ) );
@@ -2,8 +2,11 @@
 #define __TRACYWORKER_HPP__
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <stdexcept>
@@ -18,10 +21,12 @@
 #include "../public/common/TracyProtocol.hpp"
 #include "../public/common/TracySocket.hpp"
 #include "tracy_robin_hood.h"
+#include "TracyDataLock.hpp"
 #include "TracyEvent.hpp"
 #include "TracyShortPtr.hpp"
 #include "TracySlab.hpp"
 #include "TracyStringDiscovery.hpp"
+#include "TracyTaskDispatch.hpp"
 #include "TracyTextureCompression.hpp"
 #include "TracyThreadCompress.hpp"
 #include "TracyVarArray.hpp"
@@ -32,6 +37,7 @@ namespace tracy
 
 class FileRead;
 class FileWrite;
+class SharedMemoryRing;
 
 namespace EventType
 {
@@ -145,6 +151,18 @@ public:
     };
     enum { GpuZoneThreadDataSize = sizeof( GpuZoneThreadData ) };
 
+    // Statistics of the zones of a source location which lie within a time range.
+    struct ZoneRangeStatistics
+    {
+        size_t count;
+        int64_t total;
+        int64_t selfTotal;
+        size_t nonReentrantCount;
+        int64_t nonReentrantTotal;
+        uint16_t threadNum;
+        uint16_t nonReentrantThreadNum;
+    };
+
     struct CpuThreadTopology
     {
         uint32_t package;
@@ -199,7 +217,30 @@ private:
     {
         struct ZtdSort { bool operator()( const ZoneThreadData& lhs, const ZoneThreadData& rhs ) { return lhs.Zone()->Start() < rhs.Zone()->Start(); } };
 
+        tracy_force_inline void Add( const ZoneThreadData& ztd, int64_t zoneStart, int64_t zoneEnd, int64_t zoneSelf, bool zoneReentrant )
+        {
+            // Zones of evicted timelines have no pointer, so the order is
+            // checked on the start column.
+            zones.push_back( ztd, [this, zoneStart] ( const ZoneThreadData&, const ZoneThreadData& ) { return start.back() < zoneStart; } );
+            start.push_back( zoneStart );
+            end.push_back( zoneEnd );
+            self.push_back( zoneSelf );
+            thread.push_back( ztd.Thread() );
+            reentrant.push_back( zoneReentrant );
+        }
+
+        void Reserve( size_t cnt );
+        void EnsureSorted();
+
         SortedVector<ZoneThreadData, ZtdSort> zones;
+        // Zone times and threads, in the same order as zones. Scans over
+        // these don't have to load each zone from the timeline slab.
+        Vector<int64_t> start;
+        Vector<int64_t> end;
+        Vector<int64_t> self;
+        Vector<uint16_t> thread;
+        // Set if a zone of the same source location is on the stack.
+        Vector<uint8_t> reentrant;
         int64_t min = std::numeric_limits<int64_t>::max();
         int64_t max = std::numeric_limits<int64_t>::min();
         int64_t total = 0;
@@ -225,6 +266,49 @@ private:
         double sumSq = 0;
     };
 
+    // Zone of a source location, as seen by the background statistics pass.
+    struct ZoneRangeRecord
+    {
+        int64_t start;
+        int64_t end;
+        int64_t self;
+        uint16_t thread;
+        bool reentrant;
+        ZoneEvent* zone;
+    };
+
+    // Prefix sums of the zone times of a source location, in the order of its
+    // sorted zone list, so that the statistics of any time range can be found with
+    // binary searches on the start column. Zones which start in the range, but end
+    // after it, are found through a tree of the maximum end times of each block of
+    // zones.
+    struct ZoneRangeIndex
+    {
+        enum { BlockSize = 64 };
+
+        struct ThreadZones
+        {
+            uint16_t thread;
+            std::vector<uint32_t> zones;
+            std::vector<uint32_t> nonReentrant;
+        };
+
+        std::vector<int64_t> total;
+        std::vector<int64_t> selfTotal;
+        std::vector<int64_t> nonReentrantTotal;
+        std::vector<uint32_t> nonReentrantCount;
+        std::vector<int64_t> blockEnd;
+        // Only filled if the zones come from more than one thread.
+        std::vector<ThreadZones> threads;
+    };
+
+    // Instances of sampled zones which were not sent by the client.
+    struct SourceLocationDropped
+    {
+        uint64_t count = 0;
+        int64_t total = 0;
+    };
+
     struct CallstackFrameIdHash
     {
         size_t operator()( const CallstackFrameId& id ) const { return id.data; }
@@ -276,7 +360,7 @@ private:
 
     struct DataBlock
     {
-        std::mutex lock;
+        DataLock lock;
         StringDiscovery<FrameData*> frames;
         FrameData* framesBase;
         Vector<GpuCtxData*> gpuData;
@@ -310,12 +394,15 @@ private:
 #ifndef TRACY_NO_STATISTICS
         unordered_flat_map<int16_t, SourceLocationZones> sourceLocationZones;
         bool sourceLocationZonesReady = false;
+        unordered_flat_map<int16_t, ZoneRangeIndex> zoneRangeIndex;
+        bool zoneRangeIndexReady = false;
         unordered_flat_map<int16_t, GpuSourceLocationZones> gpuSourceLocationZones;
         bool gpuSourceLocationZonesReady = false;
 #else
         unordered_flat_map<int16_t, uint64_t> sourceLocationZonesCnt;
         unordered_flat_map<int16_t, uint64_t> gpuSourceLocationZonesCnt;
 #endif
+        unordered_flat_map<int16_t, SourceLocationDropped> sourceLocationDropped;
 
         unordered_flat_map<VarArray<CallstackFrameId>*, uint32_t, VarArrayHasher<CallstackFrameId>, VarArrayComparator<CallstackFrameId>> callstackMap;
         Vector<short_ptr<VarArray<CallstackFrameId>>> callstackPayload;
@@ -431,6 +518,51 @@ private:
         uint32_t csz;
     };
 
+    // Events are decoded in order, and the zone stacks of client threads are
+    // kept up to date while doing so. Building the zone trees (appending zones
+    // to their parent's child list or to the thread timeline, fitting the child
+    // lists of ended zones) is queued in the ingestion lane of the thread, and
+    // statistics of ended zones in a lane selected by source location. After
+    // each network frame all lanes are flushed in parallel, in a single pass.
+    struct ZoneLaneItem
+    {
+        ZoneEvent* zone;
+        ThreadData* thread;
+        int32_t child;          // parent child list index, or -1 for the thread timeline
+        bool end;
+    };
+
+#ifndef TRACY_NO_STATISTICS
+    struct ZoneEndItem
+    {
+        ZoneEvent* zone;
+        int64_t selfSpan;
+        uint16_t thread;
+        bool reentry;
+    };
+#endif
+
+    enum { MaxIngestLanes = 8 };
+
+    struct IngestLane
+    {
+        Vector<ZoneLaneItem> zones;
+        Vector<Vector<short_ptr<ZoneEvent>>> zoneVectorCache;
+#ifndef TRACY_NO_STATISTICS
+        Vector<ZoneEndItem> statistics;
+#else
+        Vector<ZoneEvent*> zoneEventPool;
+#endif
+        Slab<1024*1024> slab;
+    };
+
+    struct NetBuffer
+    {
+        int bufferOffset;
+        int size;
+        uint64_t end;
+    };
+
 public:
     enum class Failure
     {
@@ -452,9 +584,14 @@ public:
         NUM_FAILURES
     };
 
-    Worker( const char* addr, uint16_t port );
+    enum { DefaultNetBufferSize = 16 * 1024 * 1024 };
+    enum { MaxNetBufferSize = 1024 * 1024 * 1024 };     // buffer offsets are int
+
+    // A pooled worker starts no threads of its own. Instead, Poll() has to be
+    // called repeatedly, from one thread at a time, until it returns Closed.
+    Worker( const char* addr, uint16_t port, size_t netBufferSize = DefaultNetBufferSize, TaskDispatch* ingestDispatch = nullptr, uint8_t wireCodec = WireCodecAny, bool pooled = false );
     Worker( const char* name, const char* program, const std::vector<ImportEventTimeline>& timeline, const std::vector<ImportEventMessages>& messages, const std::vector<ImportEventPlots>& plots, const std::unordered_map<uint64_t, std::string>& threadNames );
-    Worker( FileRead& f, EventType::Type eventMask = EventType::All, bool bgTasks = true, bool allowStringModification = false);
+    Worker( FileRead& f, EventType::Type eventMask = EventType::All, bool bgTasks = true, bool allowStringModification = false, uint64_t timelineMemoryBudget = 0 );
     ~Worker();
 
     const std::string& GetAddr() const { return m_addr; }
@@ -471,7 +608,20 @@ public:
     uint32_t GetCpuId() const { return m_data.cpuId; }
     const char* GetCpuManufacturer() const { return m_data.cpuManufacturer; }
 
-    std::mutex& GetDataLock() { return m_data.lock; }
+    DataLock& GetDataLock() { return m_data.lock; }
+
+    // Thread timelines of traces loaded with a memory budget are decoded on
+    // first use and may be evicted again. These must be called with the data
+    // lock held. Evicting timelines invalidates all pointers to their zones,
+    // so the callback is given each timeline before it is evicted. Per source
+    // location zone lists keep the times of evicted zones, but not the zone
+    // pointers, which have to be retrieved with LoadSourceLocationZone().
+    bool HasLazyTimelines() const { return !m_lazyTimelines.empty(); }
+    bool IsTimelinePending( const ThreadData* td ) const;
+    void LoadTimeline( const ThreadData* td );
+    void TrimTimelines( const std::function<void(const ThreadData*)>& evict );
+    uint64_t GetTimelineMemoryUsage() const { return m_lazyUsage; }
+    uint64_t GetTimelineMemoryBudget() const { return m_lazyBudget; }
     size_t GetFrameCount( const FrameData& fd ) const { return fd.frames.size(); }
     size_t GetFullFrameCount( const FrameData& fd ) const;
     bool AreFramesUsed() const;
@@ -576,11 +726,15 @@ public:
     tracy_force_inline int64_t GetZoneEnd( const GpuEvent& ev ) { return ev.GpuEnd() >= 0 ? ev.GpuEnd() : GetZoneEndImpl( ev ); }
     static tracy_force_inline int64_t GetZoneEndDirect( const ZoneEvent& ev ) { return ev.IsEndValid() ? ev.End() : ev.Start(); }
     static tracy_force_inline int64_t GetZoneEndDirect( const GpuEvent& ev ) { return ev.GpuEnd() >= 0 ? ev.GpuEnd() : ev.GpuStart(); }
+    // Self time of a finished zone. The value stored with the source location statistics is used,
+    // if the zone can be found there. Otherwise it is calculated from the zone's children.
+    int64_t GetZoneSelfTime( const ZoneEvent& ev ) const;
 
     uint32_t FindStringIdx( const char* str ) const;
     const char* GetString( uint64_t ptr ) const;
     const char* GetString( const StringRef& ref ) const;
     const char* GetString( const StringIdx& idx ) const;
+    bool IsStringAvailable( const StringRef& ref ) const;
     const char* GetThreadName( uint64_t id ) const;
     bool IsThreadLocal( uint64_t id );
     bool IsThreadFiber( uint64_t id );
@@ -603,6 +757,7 @@ public:
     tracy_force_inline const ZoneExtra& GetZoneExtra( const ZoneEvent& ev ) const { return m_data.zoneExtra[ev.extra]; }
 
     std::vector<int16_t> GetMatchingSourceLocation( const char* query, bool ignoreCase ) const;
+    const unordered_flat_map<int16_t, SourceLocationDropped>& GetSourceLocationDropped() const { return m_data.sourceLocationDropped; }
 
     const unordered_flat_map<uint64_t, SymbolData>& GetSymbolMap() const { return m_data.symbolMap; }
 
@@ -612,6 +767,8 @@ public:
     const unordered_flat_map<int16_t, SourceLocationZones>& GetSourceLocationZones() const { return m_data.sourceLocationZones; }
     const unordered_flat_map<int16_t, GpuSourceLocationZones>& GetGpuSourceLocationZones() const { return m_data.gpuSourceLocationZones; }
     bool AreSourceLocationZonesReady() const { return m_data.sourceLocationZonesReady; }
+    const ZoneEvent* LoadSourceLocationZone( const SourceLocationZones& slz, size_t idx );
+    bool GetZoneRangeStatistics( int16_t srcloc, int64_t min, int64_t max, ZoneRangeStatistics& out ) const;
     bool AreGpuSourceLocationZonesReady() const { return m_data.gpuSourceLocationZonesReady; }
     bool IsCpuUsageReady() const { return m_data.ctxUsageReady; }
     const Vector<ContextSwitchUsage>& GetCpuUsage() const { return m_data.ctxUsage; }
@@ -637,14 +794,39 @@ public:
 
     bool HasData() const { return m_hasData.load( std::memory_order_acquire ); }
     bool IsConnected() const { return m_connected.load( std::memory_order_relaxed ); }
-    bool IsDataStatic() const { return !m_thread.joinable(); }
+    bool IsDataStatic() const { return !m_thread.joinable() && !m_pooled; }
     bool IsBackgroundDone() const { return m_backgroundDone.load( std::memory_order_relaxed ); }
     bool IsOnDemand() const { return m_onDemand; }
     void Shutdown() { m_shutdown.store( true, std::memory_order_relaxed ); }
     void Disconnect();
     bool WasDisconnectIssued() const { return m_disconnect; }
 
+    enum class PollStatus
+    {
+        Idle,
+        Busy,
+        Closed
+    };
+
+    // Connects, receives the frames which have already arrived and processes
+    // them. Doesn't wait for data, but the handshake is read in one go.
+    PollStatus Poll();
+
     void Write( FileWrite& f, bool fiDict );
+#ifdef TRACY_NO_STATISTICS
+    // Streaming capture writes the trace as a sequence of segments. After each
+    // segment is written, the closed zones, messages, plot history and freed
+    // memory events it contained are returned to the allocator. Both calls
+    // must be made with the data lock held.
+    void EnableStreaming() { m_streaming = true; }
+    void ReleaseSegmentData();
+    // Flight recorder capture keeps only a sliding time window. Data that
+    // ended before the given time is released, while the dictionaries it
+    // referenced are kept. Requires streaming and the data lock held.
+    void ReleaseDataBefore( int64_t time );
+    // Stitches the data of the preceding segment in front of this one.
+    void PrependSegment( const Worker& prev );
+#endif
     int GetTraceVersion() const { return m_traceVersion; }
     uint8_t GetHandshakeStatus() const { return m_handshake.load( std::memory_order_relaxed ); }
     int64_t GetSamplingPeriod() const { return m_samplingPeriod; }
@@ -679,7 +861,17 @@ public:
 
 private:
     void Network();
+    void NetworkStreams();
+    void NetworkStream( Socket& sock, uint64_t seq );
+    void ReadNetBuffer( NetBuffer& netbuf );
+    void ReleaseNetBuffer();
+    void WakeNetwork();
     void Exec();
+    bool Handshake();
+    bool ProcessNetBuffer( const NetBuffer& netbuf );
+    void CloseConnection();
+    void PublishStreamFrame( uint64_t seq, const char* dec, int sz, lz4sz_t lz4sz );
+    bool PollNetwork( bool& busy );
     void Query( ServerQuery type, uint64_t data, uint32_t extra = 0 );
     void QueryTerminate();
     void QuerySourceFile( const char* fn, const char* image );
@@ -703,6 +895,7 @@ private:
     tracy_force_inline void ProcessZoneName();
     tracy_force_inline void ProcessZoneColor( const QueueZoneColor& ev );
     tracy_force_inline void ProcessZoneValue( const QueueZoneValue& ev );
+    tracy_force_inline void ProcessZoneDropped( const QueueZoneDropped& ev );
     tracy_force_inline void ProcessLockAnnounce( const QueueLockAnnounce& ev );
     tracy_force_inline void ProcessLockTerminate( const QueueLockTerminate& ev );
     tracy_force_inline void ProcessLockWait( const QueueLockWait& ev );
@@ -814,6 +1007,9 @@ private:
     void ReconstructMemAllocPlot( MemData& memdata );
 
     void InsertMessageData( MessageData* msg );
+    tracy_force_inline MessageData* AllocMessageData();
+    tracy_force_inline LockEvent* AllocLockEvent( LockType type );
+    tracy_force_inline GpuEvent* AllocGpuEvent();
 
     ThreadData* NoticeThreadReal( uint64_t thread );
     ThreadData* NewThread( uint64_t thread, bool fiber );
@@ -862,6 +1058,13 @@ private:
 #endif
 
     tracy_force_inline void NewZone( ZoneEvent* zone );
+    tracy_force_inline void QueueZoneLaneItem( const ZoneLaneItem& item );
+    void ProcessZoneLaneItem( IngestLane& lane, const ZoneLaneItem& item );
+    void FinishZone( IngestLane& lane, ZoneEvent* zone );
+#ifndef TRACY_NO_STATISTICS
+    void ProcessZoneStatistics( const ZoneEndItem& item );
+#endif
+    void FlushIngestLanes();
 
     void InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread, int64_t time );
 
@@ -925,37 +1128,102 @@ private:
     tracy_force_inline int AddGhostZone( const VarArray<CallstackFrameId>& cs, Vector<GhostZone>* vec, uint64_t t );
 #endif
 
-    tracy_force_inline int64_t ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx );
-    tracy_force_inline int64_t ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz );
-    tracy_force_inline void ReadTimeline( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
-    tracy_force_inline void ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx, uint64_t sz );
+    typedef Slab<8*1024*1024> LoadSlab;
+
+    // State of a single trace file section load. Sections may be decoded in
+    // parallel, so everything that would be shared is kept here instead.
+    struct SectionLoad
+    {
+        LoadSlab* slab;
+        int32_t childIdx;
+#ifdef TRACY_NO_STATISTICS
+        unordered_flat_map<int16_t, uint64_t> zonesCnt;
+#endif
+    };
+
+    void ReadFrames( FileRead& f, SectionLoad& sl );
+    // Thread timeline, which is kept in its own section, so that it can be
+    // loaded lazily.
+    struct LazyTimeline
+    {
+        uint32_t section;
+        int32_t childBase;
+        int32_t childCount;
+        uint32_t lastUse;
+        bool loaded;
+        bool counted;
+        std::unique_ptr<LoadSlab> slab;
+    };
+
+    void ReadThreadTimeline( FileRead& f, ThreadData* td, SectionLoad& sl );
+    void AttachTimelineZones( const ThreadData* td );
+    void DetachTimelineZones( const ThreadData* td );
+    void EvictTimeline( const ThreadData* td );
+    void ReadThread( FileRead& f, ThreadData* td, uint16_t ctid, const unordered_flat_map<uint64_t, MessageData*>& msgMap, EventType::Type eventMask, SectionLoad& sl );
+    void ReadGpuContext( FileRead& f, GpuCtxData* ctx, SectionLoad& sl );
+    void ReadMemory( FileRead& f, MemData& memdata, uint64_t sz, uint64_t memload, SectionLoad& sl );
+    void ReadCallstacks( FileRead& f, SectionLoad& sl );
+    void ReadContextSwitches( FileRead& f, SectionLoad& sl );
+    void ReadContextSwitchesPerCpu( FileRead& f, SectionLoad& sl );
+    void ReadSymbolCode( FileRead& f, SectionLoad& sl );
+    void ReadZoneDropped( FileRead& f );
+
+    tracy_force_inline int64_t ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, SectionLoad& sl );
+    tracy_force_inline int64_t ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, SectionLoad& sl, uint32_t sz );
+    tracy_force_inline void ReadTimeline( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl );
+    tracy_force_inline void ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl, uint64_t sz );
 
 #ifndef TRACY_NO_STATISTICS
     tracy_force_inline void ReconstructZoneStatistics( uint8_t* countMap, ZoneEvent& zone, uint16_t thread );
     tracy_force_inline void ReconstructZoneStatistics( GpuEvent& zone, uint16_t thread );
+    int64_t GatherZoneRecords( uint8_t* countMap, Vector<short_ptr<ZoneEvent>>& vec, uint16_t thread, unordered_flat_map<int16_t, std::vector<ZoneRangeRecord>>& records );
+    void ReconstructZoneStatistics( SourceLocationZones& slz, const std::vector<ZoneRangeRecord>& records );
+    void BuildZoneRangeIndex( const std::vector<int16_t>& srclocs );
+    const SourceLocationZones* FindSourceLocationZone( const ZoneEvent& zone, size_t& idx ) const;
 #else
     tracy_force_inline void CountZoneStatistics( ZoneEvent* zone );
     tracy_force_inline void CountZoneStatistics( GpuEvent* zone );
 #endif
+    int64_t GetZoneChildTime( const ZoneEvent& zone ) const;
 
     tracy_force_inline ZoneExtra& GetZoneExtraMutable( const ZoneEvent& ev ) { return m_data.zoneExtra[ev.extra]; }
     tracy_force_inline ZoneExtra& AllocZoneExtra( ZoneEvent& ev );
     tracy_force_inline ZoneExtra& RequestZoneExtra( ZoneEvent& ev );
+#ifdef TRACY_NO_STATISTICS
+    uint64_t ReleaseZone( ZoneEvent& zone );
+    uint64_t ReleaseZonesBefore( Vector<short_ptr<ZoneEvent>>& vec, int64_t time );
+    uint64_t ReleaseGpuZone( GpuEvent& zone );
+    bool IsGpuZoneResolved( const GpuEvent& zone ) const;
+    uint64_t CopySegmentZone( const Worker& prev, const ZoneEvent& src, ZoneEvent& dst, int32_t& childIdx, uint32_t& extraIdx );
+    uint64_t PrependSegmentChildren( const Worker& prev, const ZoneEvent& src, ZoneEvent& dst, int32_t& childIdx, uint32_t& extraIdx );
+    uint64_t CopySegmentGpuZone( const Worker& prev, const GpuEvent& src, GpuEvent& dst, int32_t& childIdx );
+#endif
 
     int64_t GetZoneEndImpl( const ZoneEvent& ev );
     int64_t GetZoneEndImpl( const GpuEvent& ev );
 
     void UpdateMbps( int64_t td );
 
-    int64_t ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& vec, uint32_t size, int64_t refTime, int32_t& childIdx );
-    void ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& vec, uint64_t size, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
-
-    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime );
-    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime );
+    int64_t ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& vec, uint32_t size, int64_t refTime, SectionLoad& sl );
+    void ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& vec, uint64_t size, int64_t& refTime, int64_t& refGpuTime, SectionLoad& sl );
+
+    void WriteFrames( FileWrite& f );
+    void WriteThreadTimeline( FileWrite& f, ThreadData* thread, int32_t& childIdx );
+    void WriteThread( FileWrite& f, ThreadData* thread );
+    void WriteGpuContext( FileWrite& f, const GpuCtxData* ctx, int32_t& childIdx );
+    void WriteMemory( FileWrite& f, const MemData& memdata );
+    void WriteCallstacks( FileWrite& f );
+    void WriteContextSwitches( FileWrite& f );
+    void WriteContextSwitchesPerCpu( FileWrite& f );
+    void WriteSymbolCode( FileWrite& f );
+    void WriteZoneDropped( FileWrite& f );
+
+    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime, int32_t& childIdx );
+    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
     template<typename Adapter, typename V>
-    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime );
+    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int32_t& childIdx );
     template<typename Adapter, typename V>
-    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime );
+    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
 
     int64_t TscTime( int64_t tsc ) { return int64_t( ( tsc - m_data.baseTime ) * m_timerMul ); }
     int64_t TscTime( uint64_t tsc ) { return int64_t( ( tsc - m_data.baseTime ) * m_timerMul ); }
@@ -988,11 +1256,20 @@ private:
     bool m_crashed = false;
     bool m_disconnect = false;
     void* m_stream;     // LZ4_streamDecode_t*
+    uint8_t m_wireCodecRequest;
+    uint8_t m_wireCodec = WireCodecLz4;
+    void* m_zstdStream = nullptr;   // ZSTD_DCtx*
+    uint8_t m_streams = 1;
+    std::vector<uint64_t> m_wireSrcLoc;     // source locations referenced by compact zone events
+    std::vector<std::unique_ptr<Socket>> m_streamSock;
     char* m_buffer;
-    int m_bufferOffset;
+    size_t m_bufferSize;
+    const char* m_netData = nullptr;        // m_buffer, or the shared memory ring of a client on this host
+    SharedMemoryRing* m_shm = nullptr;
     bool m_onDemand;
     bool m_ignoreMemFreeFaults;
     bool m_ignoreFrameEndFaults;
+    bool m_ignoreZoneStackFaults = false;
     bool m_codeTransfer;
     bool m_combineSamples;
     bool m_identifySamples = false;
@@ -1031,6 +1308,13 @@ private:
     uint64_t m_memNamePayload = 0;
 
     Slab<64*1024*1024> m_slab;
+    std::vector<std::unique_ptr<LoadSlab>> m_loadSlabs;
+
+    unordered_flat_map<const ThreadData*, LazyTimeline> m_lazyTimelines;
+    std::unique_ptr<FileRead> m_lazyFile;
+    uint64_t m_lazyBudget = 0;
+    uint64_t m_lazyUsage = 0;
+    uint32_t m_lazyGeneration = 0;
 
     DataBlock m_data;
     MbpsBlock m_mbpsData;
@@ -1064,22 +1348,74 @@ private:
     std::atomic<uint64_t> m_bytes { 0 };
     std::atomic<uint64_t> m_decBytes { 0 };
 
-    struct NetBuffer
+    std::vector<std::unique_ptr<IngestLane>> m_ingestLanes;
+    TaskDispatch* m_ingestDispatch = nullptr;
+    std::unique_ptr<TaskDispatch> m_ingestDispatchOwned;
+
+    // Decoded frames are handed from the network thread to the worker thread
+    // through a single producer, single consumer ring of descriptors. Frame
+    // data is kept in m_buffer until the worker thread releases it. Positions
+    // in m_buffer grow monotonically, skipping the buffer tail on wrap around.
+    enum { NetBufferSlots = 1024 };
+    NetBuffer m_netRead[NetBufferSlots];
+    std::atomic<uint64_t> m_netReadPos { 0 };
+    std::atomic<uint64_t> m_netWritePos { 0 };
+    std::atomic<uint64_t> m_netReleased { 0 };
+    uint64_t m_netReadEnd = 0;
+
+    // Only used to sleep when the ring is empty or full.
+    std::atomic<bool> m_netReadSleep { false };
+    std::mutex m_netReadLock;
+    std::condition_variable m_netReadCv;
+
+    // With several streams, frame n comes from stream n % m_streams. Each frame
+    // has a fixed size slot in m_buffer. Frames are published in order, so a
+    // frame decoded ahead of time waits for the preceding ones.
+    bool m_netReady[NetBufferSlots] = {};
+    std::mutex m_netPublishLock;
+    std::atomic<uint64_t> m_netStreamEnd { std::numeric_limits<uint64_t>::max() };   // first frame that won't arrive
+
+    bool m_netStart = false;
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_mbpsTime;
+
+    // A pooled connection is serviced by Poll(). It reads the frames of all
+    // streams in order, with a separate decoder for each stream.
+    enum class PollStage : uint8_t
     {
-        int bufferOffset;
-        int size;
+        Connect,
+        Receive,
+        Closed
     };
 
-    std::vector<NetBuffer> m_netRead;
-    std::mutex m_netReadLock;
-    std::condition_variable m_netReadCv;
+    struct PollStream
+    {
+        Socket* sock;
+        void* lz4;          // LZ4_streamDecode_t*
+        void* zstd;         // ZSTD_DCtx*
+        std::unique_ptr<char[]> dec;
+        int decIdx;
+    };
 
-    int m_netWriteCnt = 0;
+    bool m_pooled = false;
+    PollStage m_pollStage = PollStage::Connect;
+    bool m_pollNetClosed = false;
+    uint64_t m_pollPos = 0;
+    std::unique_ptr<char[]> m_pollLz4Buf;
+    std::vector<PollStream> m_pollStreams;
+    std::atomic<int> m_netWriteSleep { 0 };
     std::mutex m_netWriteLock;
     std::condition_variable m_netWriteCv;
 
 #ifdef TRACY_NO_STATISTICS
     Vector<ZoneEvent*> m_zoneEventPool;
+    Vector<MessageData*> m_messageDataPool;
+    Vector<LockEvent*> m_lockEventPool;
+    Vector<LockEvent*> m_lockEventSharedPool;
+    Vector<GpuEvent*> m_gpuEventPool;
+    Vector<uint32_t> m_zoneChildrenFree;
+    Vector<uint32_t> m_gpuChildrenFree;
+    Vector<uint32_t> m_zoneExtraFree;
+    bool m_streaming = false;
 #endif
 
     Vector<Parameter> m_params;
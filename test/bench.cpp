@@ -0,0 +1,321 @@
+// Client overhead benchmark.
+//
+// Measures the cost of the instrumentation hot paths, while an in-process
+// stand-in for the capture utility receives and discards the data stream.
+// Results are printed to stdout as CSV, one line for each benchmark and
+// producer thread count. Times are given per operation, which is a single
+// iteration of the benchmark loop, as described in the benchmark list below.
+//
+// Usage: tracy-bench [-n operations per thread] [-t max threads] [-b benchmark]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "tracy/Tracy.hpp"
+#include "common/TracyProtocol.hpp"
+#include "common/TracySocket.hpp"
+
+struct Benchmark
+{
+    const char* name;
+    void(*run)( uint64_t ops, uint32_t thread );
+};
+
+static void BenchZone( uint64_t ops, uint32_t )
+{
+    // Zone begin and end.
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        ZoneScopedN( "Bench zone" );
+    }
+}
+
+static void BenchZoneBatch( uint64_t ops, uint32_t )
+{
+    // Zone begin and end, published to the profiler thread in batches.
+    TracyQueueBatch;
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        ZoneScopedN( "Bench zone batch" );
+    }
+}
+
+static void BenchZoneText( uint64_t ops, uint32_t )
+{
+    // Zone text, attached to a single zone.
+    ZoneScopedN( "Bench zone text" );
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        ZoneText( "Bench text", 10 );
+    }
+}
+
+static void BenchZoneValue( uint64_t ops, uint32_t )
+{
+    // Zone value, attached to a single zone.
+    ZoneScopedN( "Bench zone value" );
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        ZoneValue( i );
+    }
+}
+
+static void BenchPlot( uint64_t ops, uint32_t )
+{
+    // Plot data point.
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        TracyPlot( "Bench plot", int64_t( i ) );
+    }
+}
+
+static void BenchMessage( uint64_t ops, uint32_t )
+{
+    // Message, copied.
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        TracyMessage( "Bench message", 13 );
+    }
+}
+
+static void BenchMessageLiteral( uint64_t ops, uint32_t )
+{
+    // Message, string literal.
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        TracyMessageL( "Bench message" );
+    }
+}
+
+static void BenchAlloc( uint64_t ops, uint32_t thread )
+{
+    // Memory allocation and free.
+    const auto base = ( uint64_t( thread ) + 1 ) << 40;
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        const auto ptr = (void*)( base + i * 16 );
+        TracyAlloc( ptr, 16 );
+        TracyFree( ptr );
+    }
+}
+
+static void BenchAllocCallstack( uint64_t ops, uint32_t thread )
+{
+    // Memory allocation and free, both with an 8 frame call stack.
+    const auto base = ( uint64_t( thread ) + 1 ) << 40;
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        const auto ptr = (void*)( base + i * 16 );
+        TracyAllocS( ptr, 16, 8 );
+        TracyFreeS( ptr, 8 );
+    }
+}
+
+static void BenchLock( uint64_t ops, uint32_t )
+{
+    // Uncontended lock and unlock of a lock owned by the thread.
+    TracyLockableN( std::mutex, lock, "Bench lock" );
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        lock.lock();
+        lock.unlock();
+    }
+}
+
+static void BenchFrameMark( uint64_t ops, uint32_t )
+{
+    // Continuous frame mark.
+    for( uint64_t i=0; i<ops; i++ )
+    {
+        FrameMark;
+    }
+}
+
+static const Benchmark Benchmarks[] = {
+    { "zone", BenchZone },
+    { "zone_batch", BenchZoneBatch },
+    { "zone_text", BenchZoneText },
+    { "zone_value", BenchZoneValue },
+    { "plot", BenchPlot },
+    { "message", BenchMessage },
+    { "message_literal", BenchMessageLiteral },
+    { "alloc_free", BenchAlloc },
+    { "alloc_free_callstack", BenchAllocCallstack },
+    { "lock", BenchLock },
+    { "frame_mark", BenchFrameMark },
+};
+
+
+// Connects to the profiled application, like the capture utility would, and
+// discards everything it receives.
+class CaptureStandIn
+{
+public:
+    CaptureStandIn()
+        : m_exit( false )
+        , m_received( 0 )
+        , m_thread( [this] { Worker(); } )
+    {
+    }
+
+    ~CaptureStandIn()
+    {
+        m_exit.store( true, std::memory_order_relaxed );
+        m_thread.join();
+    }
+
+    uint64_t Received() const { return m_received.load( std::memory_order_relaxed ); }
+
+private:
+    void Worker()
+    {
+        const char* portEnv = getenv( "TRACY_PORT" );
+        const uint16_t port = portEnv ? uint16_t( atoi( portEnv ) ) : 8086;
+
+        tracy::Socket sock;
+        while( !sock.Connect( "127.0.0.1", port ) )
+        {
+            if( m_exit.load( std::memory_order_relaxed ) ) return;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+
+        sock.Send( tracy::HandshakeShibboleth, tracy::HandshakeShibbolethSize );
+        uint32_t protocolVersion = tracy::ProtocolVersion;
+        sock.Send( &protocolVersion, sizeof( protocolVersion ) );
+        const uint8_t wireCodec = tracy::WireCodecAny;
+        sock.Send( &wireCodec, sizeof( wireCodec ) );
+        tracy::HandshakeStatus handshake;
+        tracy::WelcomeMessage welcome;
+        if( !sock.Read( &handshake, sizeof( handshake ), 5000 ) || handshake != tracy::HandshakeWelcome ||
+            !sock.Read( &welcome, sizeof( welcome ), 5000 ) )
+        {
+            fprintf( stderr, "Handshake with the profiled application failed.\n" );
+            exit( 1 );
+        }
+        // The data has to go through the network, as it would for a remote server.
+        if( welcome.flags & tracy::WelcomeFlag::SharedMemory )
+        {
+            tracy::SharedMemoryOfferMessage offer;
+            sock.Read( &offer, sizeof( offer ), 5000 );
+            const auto status = tracy::SharedMemoryRejected;
+            sock.Send( &status, sizeof( status ) );
+        }
+        if( welcome.streams > 1 )
+        {
+            fprintf( stderr, "Multiple streams (TRACY_STREAMS) are not supported by the benchmark.\n" );
+            exit( 1 );
+        }
+
+        std::vector<char> buf( 1024 * 1024 );
+        while( !m_exit.load( std::memory_order_relaxed ) )
+        {
+            if( sock.HasData() )
+            {
+                const auto sz = sock.ReadUpTo( buf.data(), int( buf.size() ) );
+                if( sz <= 0 ) break;
+                m_received.fetch_add( sz, std::memory_order_relaxed );
+            }
+            else
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+        }
+    }
+
+    std::atomic<bool> m_exit;
+    std::atomic<uint64_t> m_received;
+    std::thread m_thread;
+};
+
+
+struct Result
+{
+    int64_t ticks;
+    int64_t ns;
+};
+
+static Result RunBenchmark( const Benchmark& bench, uint32_t threads, uint64_t ops )
+{
+    std::atomic<uint32_t> ready( 0 );
+    std::atomic<bool> go( false );
+    std::vector<Result> results( threads );
+    std::vector<std::thread> workers;
+    for( uint32_t t=0; t<threads; t++ )
+    {
+        workers.emplace_back( [&bench, &ready, &go, &results, ops, t] {
+            // Warm up the per-thread profiler state outside of the measured region.
+            bench.run( std::max<uint64_t>( ops / 100, 1 ), t );
+            ready.fetch_add( 1, std::memory_order_acq_rel );
+            while( !go.load( std::memory_order_acquire ) ) std::this_thread::yield();
+
+            const auto t0 = std::chrono::steady_clock::now();
+            const auto c0 = tracy::Profiler::GetTime();
+            bench.run( ops, t );
+            const auto c1 = tracy::Profiler::GetTime();
+            const auto t1 = std::chrono::steady_clock::now();
+            results[t] = Result { c1 - c0, std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() };
+        } );
+    }
+    while( ready.load( std::memory_order_acquire ) != threads ) std::this_thread::yield();
+    go.store( true, std::memory_order_release );
+    for( auto& w : workers ) w.join();
+
+    Result sum = {};
+    for( auto& r : results )
+    {
+        sum.ticks += r.ticks;
+        sum.ns += r.ns;
+    }
+    return sum;
+}
+
+int main( int argc, char** argv )
+{
+    uint64_t ops = 1000000;
+    uint32_t maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    const char* filter = nullptr;
+
+    for( int i=1; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-n" ) == 0 && i+1 < argc ) ops = strtoull( argv[++i], nullptr, 10 );
+        else if( strcmp( argv[i], "-t" ) == 0 && i+1 < argc ) maxThreads = std::max( 1, atoi( argv[++i] ) );
+        else if( strcmp( argv[i], "-b" ) == 0 && i+1 < argc ) filter = argv[++i];
+        else
+        {
+            fprintf( stderr, "Usage: %s [-n operations per thread] [-t max threads] [-b benchmark]\n", argv[0] );
+            return 1;
+        }
+    }
+    if( ops == 0 ) ops = 1;
+
+    std::vector<uint32_t> threadCounts;
+    for( uint32_t t=1; t<maxThreads; t*=2 ) threadCounts.push_back( t );
+    threadCounts.push_back( maxThreads );
+
+    auto standIn = new CaptureStandIn;
+    while( !TracyIsConnected ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+    printf( "benchmark,threads,ops_per_thread,ticks_per_op,ns_per_op\n" );
+    for( auto& bench : Benchmarks )
+    {
+        if( filter && strcmp( filter, bench.name ) != 0 ) continue;
+        for( auto threads : threadCounts )
+        {
+            const auto res = RunBenchmark( bench, threads, ops );
+            const auto total = double( ops ) * threads;
+            printf( "%s,%u,%llu,%.2f,%.2f\n", bench.name, threads, (unsigned long long)ops, res.ticks / total, res.ns / total );
+            fflush( stdout );
+        }
+    }
+
+    fprintf( stderr, "Stand-in capture received %llu bytes.\n", (unsigned long long)standIn->Received() );
+    delete standIn;
+    return 0;
+}
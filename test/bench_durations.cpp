@@ -0,0 +1,156 @@
+// Zone duration aggregation benchmark.
+//
+// Compares the aggregation functions from server/TracyDurationStats.cpp with
+// plain loops doing the same work, as the profiler views did before. Both
+// versions are checked to give the same results. Results are printed to
+// stdout as CSV, with times given per zone. Configure a release build
+// (CMAKE_BUILD_TYPE=Release) to get meaningful numbers.
+//
+// Usage: tracy-bench-durations [-n zones] [-r repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../server/TracyDurationStats.hpp"
+
+using tracy::DurationStats;
+
+struct Data
+{
+    std::vector<int64_t> start;
+    std::vector<int64_t> end;
+    std::vector<int64_t> self;
+    int64_t rangeMin;
+    int64_t rangeMax;
+};
+
+static void ReferenceTime( const Data& d, DurationStats& stats )
+{
+    const auto sz = d.self.size();
+    for( size_t i=0; i<sz; i++ )
+    {
+        const auto t = d.self[i];
+        stats.count++;
+        stats.total += t;
+        if( stats.min > t ) stats.min = t;
+        if( stats.max < t ) stats.max = t;
+        stats.sumSq += double( t ) * t;
+    }
+}
+
+static void ReferenceRange( const Data& d, DurationStats& stats )
+{
+    const auto sz = d.start.size();
+    for( size_t i=0; i<sz; i++ )
+    {
+        const auto start = d.start[i];
+        const auto end = d.end[i];
+        if( start >= d.rangeMin && end <= d.rangeMax )
+        {
+            const auto t = end - start;
+            stats.count++;
+            stats.total += t;
+            if( stats.min > t ) stats.min = t;
+            if( stats.max < t ) stats.max = t;
+            stats.sumSq += double( t ) * t;
+        }
+    }
+}
+
+static void SimdTime( const Data& d, DurationStats& stats )
+{
+    tracy::AggregateDurations( d.self.data(), d.self.size(), stats );
+}
+
+static void SimdRange( const Data& d, DurationStats& stats )
+{
+    tracy::AggregateDurations( d.start.data(), d.end.data(), nullptr, d.start.size(), d.rangeMin, d.rangeMax, stats );
+}
+
+struct Benchmark
+{
+    const char* name;
+    void(*reference)( const Data&, DurationStats& );
+    void(*simd)( const Data&, DurationStats& );
+};
+
+static const Benchmark Benchmarks[] = {
+    { "durations", ReferenceTime, SimdTime },
+    { "durations_in_range", ReferenceRange, SimdRange },
+};
+
+static double Measure( void(*f)( const Data&, DurationStats& ), const Data& d, int reps, DurationStats& stats )
+{
+    double best = 1e300;
+    for( int r=0; r<reps; r++ )
+    {
+        stats = DurationStats();
+        const auto t0 = std::chrono::steady_clock::now();
+        f( d, stats );
+        const auto t1 = std::chrono::steady_clock::now();
+        best = std::min( best, std::chrono::duration<double, std::nano>( t1 - t0 ).count() );
+    }
+    return best;
+}
+
+static bool Same( const DurationStats& a, const DurationStats& b )
+{
+    if( a.count != b.count || a.total != b.total || a.min != b.min || a.max != b.max ) return false;
+    return fabs( a.sumSq - b.sumSq ) <= 1e-9 * std::max( 1.0, fabs( a.sumSq ) );
+}
+
+int main( int argc, char** argv )
+{
+    size_t zones = 1000000;
+    int reps = 10;
+
+    for( int i=1; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-n" ) == 0 && i+1 < argc ) zones = strtoull( argv[++i], nullptr, 10 );
+        else if( strcmp( argv[i], "-r" ) == 0 && i+1 < argc ) reps = std::max( 1, atoi( argv[++i] ) );
+        else
+        {
+            fprintf( stderr, "Usage: %s [-n zones] [-r repetitions]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    // Zone durations span several orders of magnitude, like in a real trace.
+    Data d;
+    d.start.resize( zones );
+    d.end.resize( zones );
+    d.self.resize( zones );
+    std::mt19937_64 rng( 1 );
+    std::uniform_real_distribution<double> exp( 1, 9 );
+    int64_t time = 0;
+    for( size_t i=0; i<zones; i++ )
+    {
+        time += rng() % 1000;
+        const auto duration = int64_t( pow( 10, exp( rng ) ) );
+        d.start[i] = time;
+        d.end[i] = time + duration;
+        d.self[i] = duration - int64_t( rng() % uint64_t( duration ) );
+    }
+    d.rangeMin = time / 4;
+    d.rangeMax = time - time / 4;
+
+    printf( "benchmark,zones,reference_ns,simd_ns,speedup\n" );
+    for( auto& bench : Benchmarks )
+    {
+        DurationStats ref, simd;
+        const auto tref = Measure( bench.reference, d, reps, ref );
+        const auto tsimd = Measure( bench.simd, d, reps, simd );
+        if( !Same( ref, simd ) )
+        {
+            fprintf( stderr, "%s: results differ\n", bench.name );
+            return 1;
+        }
+        printf( "%s,%zu,%.3f,%.3f,%.2f\n", bench.name, zones, tref / zones, tsimd / zones, tref / tsimd );
+    }
+}
@@ -0,0 +1,228 @@
+// Trace file section round trip test.
+//
+// Sections of sizes around the block (64 KB) and chunk (2 MB) boundaries are
+// written with one and with several compression jobs, and then read back,
+// both by section and through the whole file reader, decompressing on one
+// and on several threads. Data is written in small pieces, as the worker
+// does, so that a section may end with a completely filled buffer. Files
+// without sections are checked as well, as there the whole file reader
+// would run into the section index, if it missed the end of the stream.
+// Finally, reading a section with damaged data has to fail with an error.
+//
+// Usage: tracy-test-filesections [temporary file]
+
+// Assertions in the file reader and writer are a part of the test.
+#undef NDEBUG
+
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../server/TracyFileRead.hpp"
+#include "../server/TracyFileWrite.hpp"
+
+using namespace tracy;
+
+static const size_t Block = 64 * 1024;
+static const size_t Sizes[] = { 1, Block, 31 * Block, 32 * Block, 33 * Block, 64 * Block, 100 };
+// Data written before the first section, which is read by the whole file reader.
+static const uint32_t Header = uint32_t( sizeof( Sizes ) / sizeof( *Sizes ) );
+static const size_t HeaderSize = 2 * Block;
+
+static uint64_t Value( uint32_t section, uint64_t i )
+{
+    // Partially compressible, so that some blocks grow when compressed.
+    auto v = ( i * 0x9E3779B97F4A7C15ull ) ^ ( uint64_t( section ) << 56 );
+    return ( i & 4 ) ? v : i;
+}
+
+static size_t Size( uint32_t s )
+{
+    return s == Header ? HeaderSize : Sizes[s];
+}
+
+static void WriteData( FileWrite& f, uint32_t s )
+{
+    const auto cnt = Size( s ) / sizeof( uint64_t );
+    for( uint64_t i=0; i<cnt; i++ )
+    {
+        const auto v = Value( s, i );
+        f.Write( &v, sizeof( v ) );
+    }
+    for( size_t i=cnt*sizeof( uint64_t ); i<Size( s ); i++ )
+    {
+        const uint8_t v = uint8_t( i );
+        f.Write( &v, 1 );
+    }
+}
+
+static bool Write( const char* fn, FileWrite::Compression comp, int jobs, bool sections )
+{
+    std::unique_ptr<FileWrite> f( FileWrite::Open( fn, comp, 1, jobs ) );
+    if( !f ) return false;
+    WriteData( *f, Header );
+    if( !sections ) return true;
+    for( uint32_t s=0; s<Header; s++ )
+    {
+        f->BeginSection( FileSection::ThreadTimeline, s );
+        WriteData( *f, s );
+    }
+    return true;
+}
+
+static bool Check( FileRead& f, uint32_t s )
+{
+    const auto cnt = Size( s ) / sizeof( uint64_t );
+    for( uint64_t i=0; i<cnt; i++ )
+    {
+        uint64_t v;
+        f.Read( v );
+        if( v != Value( s, i ) ) return false;
+    }
+    for( size_t i=cnt*sizeof( uint64_t ); i<Size( s ); i++ )
+    {
+        uint8_t v;
+        f.Read( v );
+        if( v != uint8_t( i ) ) return false;
+    }
+    return true;
+}
+
+static int Read( const char* fn, const char* name, bool sections )
+{
+    int failed = 0;
+    for( int jobs : { 1, 4 } )
+    {
+        std::unique_ptr<FileRead> f( FileRead::Open( fn, jobs ) );
+        if( !f || !f->HasSectionIndex() || !Check( *f, Header ) )
+        {
+            fprintf( stderr, "%s: file start mismatch with %i jobs\n", name, jobs );
+            failed++;
+        }
+    }
+
+    if( !sections ) return failed;
+
+    std::unique_ptr<FileRead> f( FileRead::Open( fn ) );
+    if( !f ) return failed + 1;
+    for( uint32_t s=0; s<Header; s++ )
+    {
+        if( f->GetSectionSize( FileSection::ThreadTimeline, s ) != Sizes[s] )
+        {
+            fprintf( stderr, "%s: section %u has wrong size\n", name, s );
+            failed++;
+        }
+        for( int jobs : { 1, 4 } )
+        {
+            std::unique_ptr<FileRead> sf( f->OpenSection( FileSection::ThreadTimeline, s, jobs ) );
+            if( !sf || !Check( *sf, s ) )
+            {
+                fprintf( stderr, "%s: section %u (%zu bytes) mismatch with %i jobs\n", name, s, Sizes[s], jobs );
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+// Damages a block in the largest section, which takes the last part of the
+// file. Blocks are found by following the size prefixes, which go through all
+// streams up to the section index. LZ4 has no checksums, so there only the
+// block size can be damaged in a detectable way.
+static bool Corrupt( const char* fn, bool content )
+{
+    FILE* f = fopen( fn, "r+b" );
+    if( !f ) return false;
+    fseek( f, 0, SEEK_END );
+    const auto size = ftell( f );
+    std::vector<long> blocks;
+    long offset = 4;
+    uint32_t sz;
+    while( offset < size / 4 * 3 )
+    {
+        fseek( f, offset, SEEK_SET );
+        if( fread( &sz, 1, sizeof( sz ), f ) != sizeof( sz ) ) break;
+        blocks.push_back( offset );
+        offset += sizeof( sz ) + sz;
+    }
+    fseek( f, blocks.back(), SEEK_SET );
+    if( content )
+    {
+        if( fread( &sz, 1, sizeof( sz ), f ) != sizeof( sz ) ) return false;
+        fseek( f, blocks.back() + sizeof( sz ) + sz / 2, SEEK_SET );
+        for( int i=0; i<64; i++ ) fputc( 0xFF, f );
+    }
+    else
+    {
+        sz = 0xFFFFFFF0;
+        fwrite( &sz, 1, sizeof( sz ), f );
+    }
+    fclose( f );
+    return true;
+}
+
+static int ReadCorrupted( const char* fn, const char* name, FileWrite::Compression comp )
+{
+    if( !Corrupt( fn, comp == FileWrite::Compression::Zstd ) ) return 1;
+
+    int failed = 0;
+    std::unique_ptr<FileRead> fr( FileRead::Open( fn ) );
+    const auto s = Header - 2;
+    for( int jobs : { 1, 4 } )
+    {
+        bool error = false;
+        try
+        {
+            std::unique_ptr<FileRead> sf( fr->OpenSection( FileSection::ThreadTimeline, s, jobs ) );
+            // Errors may be found only at the end of a chunk, past the damaged values.
+            sf->Skip( Sizes[s] );
+        }
+        catch( const FileReadError& )
+        {
+            error = true;
+        }
+        if( !error )
+        {
+            fprintf( stderr, "%s: corrupted section read without an error with %i jobs\n", name, jobs );
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int main( int argc, char** argv )
+{
+    const char* fn = argc > 1 ? argv[1] : "tracy-test-filesections.tmp";
+
+    static const struct { FileWrite::Compression comp; const char* name; } Modes[] = {
+        { FileWrite::Compression::Fast, "lz4" },
+        { FileWrite::Compression::Slow, "lz4hc" },
+        { FileWrite::Compression::Zstd, "zstd" },
+    };
+
+    int failed = 0;
+    for( auto& mode : Modes )
+    {
+        for( int jobs : { 1, 4 } )
+        {
+            for( bool sections : { true, false } )
+            {
+                char name[64];
+                snprintf( name, sizeof( name ), "%s, %i write jobs%s", mode.name, jobs, sections ? "" : ", no sections" );
+                if( !Write( fn, mode.comp, jobs, sections ) )
+                {
+                    fprintf( stderr, "%s: cannot write file\n", name );
+                    return 1;
+                }
+                auto res = Read( fn, name, sections );
+                if( sections && jobs == 1 ) res += ReadCorrupted( fn, name, mode.comp );
+                printf( "%s: %s\n", name, res == 0 ? "ok" : "FAILED" );
+                failed += res;
+            }
+        }
+    }
+    remove( fn );
+    return failed == 0 ? 0 : 1;
+}
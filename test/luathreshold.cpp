@@ -0,0 +1,92 @@
+// Lua zones nested in threshold zones.
+//
+// A threshold zone is only sent once a nested zone begins, and must be sent
+// before it, so every Lua zone begin has to flush the pending threshold zones.
+// The Lua zone functions are called directly, through the few Lua API entry
+// points they use, so the test doesn't depend on a Lua installation.
+//
+// Usage: tracy-test-luathreshold
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../public/tracy/Tracy.hpp"
+
+#ifndef TRACY_DEFERRED_ZONES
+#  error "The test requires TRACY_DEFERRED_ZONES"
+#endif
+
+struct lua_State {};
+typedef int (*lua_CFunction)( lua_State* );
+typedef long long lua_Integer;
+
+struct lua_Debug
+{
+    const char* name;
+    const char* source;
+    char short_src[60];
+    int currentline;
+};
+
+static int lua_getstack( lua_State*, int level, lua_Debug* )
+{
+    return level == 1;
+}
+
+static int lua_getinfo( lua_State*, const char*, lua_Debug* ar )
+{
+    ar->name = "nested";
+    ar->source = "@luathreshold.lua";
+    strcpy( ar->short_src, "luathreshold.lua" );
+    ar->currentline = 1;
+    return 1;
+}
+
+static const char* lua_tolstring( lua_State*, int, size_t* len )
+{
+    if( len ) *len = 4;
+    return "name";
+}
+
+static lua_Integer lua_tointeger( lua_State*, int ) { return 4; }
+static void lua_newtable( lua_State* ) {}
+static void lua_pushcfunction( lua_State*, lua_CFunction ) {}
+static void lua_setfield( lua_State*, int, const char* ) {}
+static void lua_setglobal( lua_State*, const char* ) {}
+#define lua_tostring( L, i ) lua_tolstring( L, i, nullptr )
+
+#include "../public/tracy/TracyLua.hpp"
+
+static int Check( const char* name, int (*begin)( lua_State* ) )
+{
+    lua_State L;
+    ZoneScopedThreshold( 1000 * 1000 * 1000 );
+    auto& stack = tracy::GetDeferredZones();
+    if( stack.emitted == stack.depth )
+    {
+        printf( "%s: threshold zone was sent before any nested zone\n", name );
+        return 1;
+    }
+    begin( &L );
+    const auto flushed = stack.emitted == stack.depth;
+    tracy::detail::LuaZoneEnd( &L );
+    if( !flushed )
+    {
+        printf( "%s: enclosing threshold zone was not sent\n", name );
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+    ret += Check( "ZoneBegin", tracy::detail::LuaZoneBegin );
+    ret += Check( "ZoneBeginN", tracy::detail::LuaZoneBeginN );
+#ifdef TRACY_HAS_CALLSTACK
+    ret += Check( "ZoneBeginS", tracy::detail::LuaZoneBeginS );
+    ret += Check( "ZoneBeginNS", tracy::detail::LuaZoneBeginNS );
+#endif
+    if( ret == 0 ) printf( "Lua zones flush the enclosing threshold zones\n" );
+    return ret;
+}
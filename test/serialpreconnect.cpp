@@ -0,0 +1,50 @@
+// Per-thread serial queue test, before a server connects.
+//
+// The profiler thread doesn't drain the serial rings until a server connects,
+// so memory events issued at startup have to be accepted without waiting for
+// free space. Several threads issue far more events than a ring holds. The
+// test hangs, and is stopped by the ctest timeout, if any of them blocks.
+//
+// Usage: tracy-test-serialpreconnect
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "../public/tracy/Tracy.hpp"
+
+#ifndef TRACY_PER_THREAD_SERIAL
+#  error "The test requires TRACY_PER_THREAD_SERIAL"
+#endif
+
+static const int Events = 100 * 1000;
+static const int Threads = 4;
+
+static void Run( int thread )
+{
+    for( int i=0; i<Events; i++ )
+    {
+        // Only the addresses are recorded, so no memory is actually allocated.
+        const auto ptr = (const void*)uintptr_t( ( ( thread + 1 ) << 24 ) + i * 16 );
+        if( i & 1 )
+        {
+            TracyAllocN( ptr, 16, "preconnect" );
+            TracyFreeN( ptr, "preconnect" );
+        }
+        else
+        {
+            TracyAlloc( ptr, 16 );
+            TracyFree( ptr );
+        }
+    }
+}
+
+int main()
+{
+    std::vector<std::thread> threads;
+    for( int i=1; i<Threads; i++ ) threads.emplace_back( [i] { Run( i ); } );
+    Run( 0 );
+    for( auto& v : threads ) v.join();
+    printf( "%i memory events issued on %i threads\n", Events * 2 * Threads, Threads );
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Shared memory ring test.
+//
+// Frames written by the client side of the ring are read back by the server
+// side, also across the jump to the ring start. The ring lives in memory
+// shared with the client process, so the server has to reject frame sizes
+// that would run past the ring end, past the written data, or over the frame
+// size limit, instead of handing out memory it shouldn't touch.
+//
+// Usage: tracy-test-shmring
+
+// Assertions in the ring are a part of the test.
+#undef NDEBUG
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../public/common/TracySharedMemory.hpp"
+
+#ifndef TRACY_HAS_SHARED_MEMORY
+int main()
+{
+    printf( "Shared memory is not available, nothing to test\n" );
+    return 0;
+}
+#else
+
+using namespace tracy;
+
+enum { RingSize = TargetFrameSize * 2 };
+
+static char s_frame[TargetFrameSize];
+
+struct Ring
+{
+    Ring()
+    {
+        static int cnt = 0;
+        sprintf( name, "/tracy-test-shmring-%i-%i", int( getpid() ), cnt++ );
+        ok = client.Create( name, 1234, RingSize ) && server.Open( name, 1234 );
+        SharedMemoryRing::Unlink( name );
+    }
+
+    // Size field of the frame at the given ring offset, as the client could overwrite it.
+    void SetSize( uint64_t offset, uint32_t sz )
+    {
+        memcpy( (char*)server.Data() + offset, &sz, sizeof( sz ) );
+    }
+
+    char name[64];
+    bool ok;
+    SharedMemoryRing client;
+    SharedMemoryRing server;
+};
+
+static bool Pass( Ring& ring, uint32_t len )
+{
+    if( !ring.client.Write( s_frame, len ) ) return false;
+    uint32_t sz;
+    uint64_t end;
+    auto ptr = ring.server.Read( sz, end );
+    if( !ptr || sz != len || memcmp( ptr, s_frame, len ) != 0 ) return false;
+    ring.server.Release( end );
+    return true;
+}
+
+static int Check( const char* name, Ring& ring )
+{
+    uint32_t sz;
+    uint64_t end;
+    if( ring.server.Read( sz, end ) || !ring.server.IsCorrupt() )
+    {
+        printf( "%s: damaged frame was accepted\n", name );
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    for( size_t i=0; i<sizeof( s_frame ); i++ ) s_frame[i] = char( i * 7 );
+
+    int ret = 0;
+    {
+        Ring ring;
+        if( !ring.ok )
+        {
+            printf( "Shared memory object can't be created, nothing to test\n" );
+            return 0;
+        }
+        for( int i=0; i<16; i++ )
+        {
+            if( !Pass( ring, TargetFrameSize - 1000 * i - 1 ) )
+            {
+                printf( "Frame %i was not read back\n", i );
+                return 1;
+            }
+        }
+        if( ring.server.IsCorrupt() )
+        {
+            printf( "Valid frames marked the ring as damaged\n" );
+            return 1;
+        }
+    }
+    {
+        Ring ring;
+        ring.client.Write( s_frame, 16 );
+        ring.SetSize( 0, TargetFrameSize + 1 );
+        ret += Check( "Frame over the size limit", ring );
+    }
+    {
+        Ring ring;
+        ring.client.Write( s_frame, 16 );
+        ring.SetSize( 0, 32 );
+        ret += Check( "Frame past the written data", ring );
+    }
+    {
+        // Leave 8 bytes before the ring end, then wrap.
+        Ring ring;
+        Pass( ring, TargetFrameSize - sizeof( uint32_t ) );
+        Pass( ring, TargetFrameSize - sizeof( uint32_t ) - 8 );
+        ring.client.Write( s_frame, 100 );
+        ring.SetSize( RingSize - 8, 5 );
+        ret += Check( "Frame past the ring end", ring );
+    }
+    if( ret == 0 ) printf( "Damaged shared memory frames are rejected\n" );
+    return ret;
+}
+
+#endif
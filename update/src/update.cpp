@@ -25,10 +25,13 @@
 
 void Usage()
 {
-    printf( "Usage: update [options] input.tracy output.tracy\n\n" );
+    printf( "Usage: update [options] input.tracy [input.tracy ...] output.tracy\n\n" );
+    printf( "  Multiple inputs are the consecutive segments of a streamed capture,\n" );
+    printf( "  which are stitched into a single output trace.\n\n" );
     printf( "  -h: enable LZ4HC compression\n" );
     printf( "  -e: enable extreme LZ4HC compression (very slow)\n" );
     printf( "  -z level: use Zstd compression with given compression level\n" );
+    printf( "  -j jobs: number of threads used for compression\n" );
     printf( "  -d: build dictionary for frame images\n" );
     printf( "  -s flags: strip selected data from capture:\n" );
     printf( "      l: locks, m: messages, p: plots, M: memory, i: frame images\n" );
@@ -53,13 +56,14 @@ int main( int argc, char** argv )
     tracy::FileWrite::Compression clev = tracy::FileWrite::Compression::Fast;
     uint32_t events = tracy::EventType::All;
     int zstdLevel = 1;
+    int jobs = 1;
     bool buildDict = false;
     bool cacheSource = false;
     bool resolveSymbols = false;
     std::vector<std::string> pathSubstitutions;
 
     int c;
-    while( ( c = getopt( argc, argv, "hez:ds:crp:" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "hez:j:ds:crp:" ) ) != -1 )
     {
         switch( c )
         {
@@ -78,6 +82,14 @@ int main( int argc, char** argv )
                 exit( 1 );
             }
             break;
+        case 'j':
+            jobs = atoi( optarg );
+            if( jobs < 1 )
+            {
+                printf( "Number of jobs must be at least 1\n" );
+                exit( 1 );
+            }
+            break;
         case 'd':
             buildDict = true;
             break;
@@ -138,10 +150,13 @@ int main( int argc, char** argv )
         }
     }
 
-    if (argc != optind + 2) Usage();
+    if (argc < optind + 2) Usage();
 
-    const char* input = argv[optind];
-    const char* output = argv[optind+1];
+    // With multiple inputs, the last segment is loaded first and the earlier
+    // ones are stitched in front of it.
+    const int segments = argc - optind - 1;
+    const char* input = argv[argc-2];
+    const char* output = argv[argc-1];
 
     printf( "Loading...\r" );
     fflush( stdout );
@@ -163,6 +178,22 @@ int main( int argc, char** argv )
             const bool allowStringModification = resolveSymbols;
             tracy::Worker worker( *f, (tracy::EventType::Type)events, allowBgThreads, allowStringModification);
 
+            for( int i=segments-2; i>=0; i-- )
+            {
+                auto sf = std::unique_ptr<tracy::FileRead>( tracy::FileRead::Open( argv[optind+i] ) );
+                if( !sf )
+                {
+                    fprintf( stderr, "Cannot open input file %s!\n", argv[optind+i] );
+                    exit( 1 );
+                }
+                printf( "Stitching %s...\r", argv[optind+i] );
+                fflush( stdout );
+#ifdef TRACY_NO_STATISTICS
+                tracy::Worker segment( *sf, (tracy::EventType::Type)events, allowBgThreads, false );
+                worker.PrependSegment( segment );
+#endif
+            }
+
 #ifndef TRACY_NO_STATISTICS
             while( !worker.AreSourceLocationZonesReady() ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
 #endif
@@ -171,7 +202,7 @@ int main( int argc, char** argv )
 
             if ( resolveSymbols ) PatchSymbols( worker, pathSubstitutions );
 
-            auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, clev, zstdLevel ) );
+            auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, clev, zstdLevel, jobs ) );
             if( !w )
             {
                 fprintf( stderr, "Cannot open output file!\n" );
@@ -188,10 +219,14 @@ int main( int argc, char** argv )
             t = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
         }
 
-        FILE* in = fopen( input, "rb" );
-        fseek( in, 0, SEEK_END );
-        const auto inSize = ftello64( in );
-        fclose( in );
+        int64_t inSize = 0;
+        for( int i=0; i<segments; i++ )
+        {
+            FILE* in = fopen( argv[optind+i], "rb" );
+            fseek( in, 0, SEEK_END );
+            inSize += ftello64( in );
+            fclose( in );
+        }
 
         FILE* out = fopen( output, "rb" );
         fseek( out, 0, SEEK_END );